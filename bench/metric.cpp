@@ -0,0 +1,225 @@
+/**
+ * Convergence of edge metrics: how long Network::path() keeps an edge after
+ * it degrades and how long it takes to use it again after it recovers, for
+ * the old cumulative counters (good, errors and retries summed forever, delay
+ * averaged with the previous value) and the current moving averages.
+ *
+ * Every period a frame is sent from the first node to every other node,
+ * hop by hop along the path from the source (so edges to neighbours are
+ * measured whichever path the last node is reached by). Outcome of every hop
+ * is sampled from the environment timeline as the emulator samples unicast
+ * (Medium): retries, failure if errors > 0 or the destination has no power
+ * (then every retransmission was used) and delay of every attempt. Every hop
+ * the frame reached is sampled into its edge, as StatusFrame and Ack do.
+ * Network::decay() runs every 3 s, as in Router.
+ *
+ * Time is simulated, so a day of history takes a moment. For every point
+ * of the timeline frames lost until the next point, the time of the first
+ * change of path to the last node after it and the new path are printed.
+ *
+ * Usage: bench_metric [topology.yml environment.yml] [period ms]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "../src/router/network.h"
+#include "../src/emulator/environment.h"
+
+using namespace PUT::CS::XbeeRouting;
+
+//! Retransmissions of radio after reset (FR), all of them are used when frame is not delivered
+static const uint8_t RETRANSMISSIONS = 10;
+
+//! Parameters before moving averages
+struct Counters {
+  uint32_t good = 0;
+  uint32_t errors = 0;
+  uint32_t retries = 0;
+  uint16_t delay = 10;
+
+  //! Parameters::metric() of the old antireliability
+  Metric metric() const {
+    uint64_t metric = uint64_t(retries) * (uint64_t(errors) + 1) * Parameters::METRIC_SCALE / (uint64_t(good) + 1);
+
+    return metric > Parameters::MAX_METRIC ? Parameters::MAX_METRIC : Metric(metric);
+  }
+};
+
+//! Points of the timeline [s], as Environment reads them
+static std::vector<std::pair<std::string, double>> points(const Emulator::Yaml &root) {
+  std::vector<std::pair<std::string, double>> points;
+  double current = 0;
+
+  for (auto &entry : root.entries) {
+    const Emulator::Yaml* point = entry.second.find("point");
+    const Emulator::Yaml* delay = entry.second.find("delay");
+
+    if (point != nullptr)
+      current = atof(point->value.c_str());
+    else if (delay != nullptr)
+      current += atof(delay->value.c_str());
+
+    points.push_back(std::make_pair(entry.first, current));
+  }
+
+  return points;
+}
+
+//! Frames lost and the first path change, for every point of the timeline
+struct Result {
+  std::vector<int> lost;
+  std::vector<double> changed;
+  std::vector<int> changes;
+  std::vector<std::string> paths;
+};
+
+/**
+ * Send frames through the environment.
+ *
+ * @param sample Samples hop into Parameters of the edge (retries, error, delay, now [ms])
+ */
+static Result run(const Emulator::Environment &environment, const std::vector<std::pair<std::string, double>> &timeline, int period,
+                  std::function<void(Address, Address, Parameters*, uint8_t, bool, uint16_t, uint64_t)> sample) {
+  const std::vector<std::string> &names = environment.nodes();
+  Address destination = names.size();
+  double end = timeline.back().second + (timeline.size() > 1 ? timeline.back().second - timeline[timeline.size() - 2].second : 60);
+  std::mt19937 random(868);
+  Network network(1);
+  Result result;
+  Path last;
+
+  for (size_t i = 0; i < names.size(); i++) {
+    network.mac(i + 1, 0x0013a20000000000 + i + 1);
+
+    for (const std::string &neighbour : environment.adjacent(names[i])) {
+      size_t j = std::find(names.begin(), names.end(), neighbour) - names.begin();
+
+      if (i < j)
+        network.add_edge(i + 1, j + 1);
+    }
+  }
+
+  result.lost.assign(timeline.size(), 0);
+  result.changed.assign(timeline.size(), -1);
+  result.paths.assign(timeline.size(), "");
+  result.changes.assign(timeline.size(), 0);
+
+  for (uint64_t now = 1; now < end * 1000; now += period) {
+    double time = now / 1000.0;
+    size_t point = 0;
+
+    while (point + 1 < timeline.size() && timeline[point + 1].second <= time)
+      point++;
+
+    if (now % 3000 < uint64_t(period))
+      network.decay(now);
+
+    for (Address to = 2; to <= destination; to++) {
+      Path path = network.path(1, to, Visited());
+      Address a = 1;
+      bool lost = path.empty();
+
+      if (to == destination && path != last) {
+        result.changes[point] += now > 1;
+
+        if (result.changed[point] < 0 && now > 1) {
+          result.changed[point] = time - timeline[point].second;
+
+          for (Address b : path)
+            result.paths[point] += (result.paths[point].empty() ? "" : "-") + names[b - 1];
+        }
+
+        last = path;
+      }
+
+      for (Address b : path) {
+        const std::string &from = names[a - 1], &next = names[b - 1];
+        int retries = std::max((int) environment.edge(time, from, next, "retries", 0, random), 0);
+        bool failure = environment.node(time, next, "power", 1, random) < 1 || environment.edge(time, from, next, "errors", 0, random) > 0;
+
+        if (failure)
+          retries = RETRANSMISSIONS;
+
+        double delay = environment.edge(time, from, next, "delay", 0, random) * (retries + 1);
+        Parameters* parameters = network.edge(a, b);
+        Metric cost = parameters->metric();
+
+        sample(a, b, parameters, retries, failure, uint16_t(std::min(delay, 65535.0)), now);
+
+        if (parameters->metric() != cost)
+          network.invalidate();
+
+        if (failure) {
+          lost = true;
+          break;
+        }
+
+        a = b;
+      }
+
+      result.lost[point] += lost;
+    }
+  }
+
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  const char* topology = argc > 2 ? argv[1] : "test/fixtures/00_basic.network.yml";
+  const char* definition = argc > 2 ? argv[2] : "test/fixtures/link_degradation.environment.yml";
+  int period = argc == 2 ? atoi(argv[1]) : (argc > 3 ? atoi(argv[3]) : 250);
+  Emulator::Yaml network, root;
+  Emulator::Environment environment;
+
+  if (period <= 0 || !Emulator::Yaml::load(topology, network) || !environment.topology(network) ||
+      !Emulator::Yaml::load(definition, root) || !environment.environment(root) || environment.nodes().size() < 2 || environment.nodes().size() > 254) {
+    fprintf(stderr, "Usage: %s [topology.yml environment.yml] [period ms]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::pair<std::string, double>> timeline = points(root);
+  std::vector<Counters> counters(256 * 256);
+
+  Result before = run(environment, timeline, period, [&counters](Address a, Address b, Parameters* parameters, uint8_t retries, bool error, uint16_t delay, uint64_t) {
+    Counters &c = counters[std::min(a, b) * 256 + std::max(a, b)];
+
+    c.retries = std::min(uint64_t(c.retries) + retries, uint64_t(UINT32_MAX));
+    c.errors = std::min(uint64_t(c.errors) + error, uint64_t(UINT32_MAX));
+    c.good = std::min(uint64_t(c.good) + !error, uint64_t(UINT32_MAX));
+    c.delay = (uint16_t) round((double(c.delay) + double(delay)) / 2);
+
+    parameters->retries = c.metric();
+    parameters->losses = 0;
+  });
+
+  Result after = run(environment, timeline, period, [](Address, Address, Parameters* parameters, uint8_t retries, bool error, uint16_t delay, uint64_t now) {
+    parameters->sample(retries, error, delay, now);
+  });
+
+  printf("frame to every node every %d ms, path from %s to %s\n", period, environment.nodes().front().c_str(), environment.nodes().back().c_str());
+  printf("%-12s %8s | %-40s | %-40s\n", "", "", "cumulative counters", "moving averages");
+  printf("%-12s %8s | %6s %8s %7s %-16s | %6s %8s %7s %-16s\n", "point", "time s", "lost", "change s", "changes", "new path", "lost", "change s", "changes", "new path");
+
+  for (size_t i = 0; i < timeline.size(); i++) {
+    char b[16] = "-", a[16] = "-";
+
+    if (before.changed[i] >= 0)
+      snprintf(b, sizeof(b), "%.2f", before.changed[i]);
+
+    if (after.changed[i] >= 0)
+      snprintf(a, sizeof(a), "%.2f", after.changed[i]);
+
+    printf("%-12s %8.0f | %6d %8s %7d %-16s | %6d %8s %7d %-16s\n", timeline[i].first.c_str(), timeline[i].second,
+           before.lost[i], b, before.changes[i], before.paths[i].c_str(), after.lost[i], a, after.changes[i], after.paths[i].c_str());
+  }
+
+  return 0;
+}
@@ -0,0 +1,285 @@
+/**
+ * Cost of finding single path with Network::path() on every topology
+ * fixture, for the old kernel (float antireliability, std::priority_queue
+ * with lazy deletion, visited nodes and unknown MAC penalized with
+ * INFINITE_DISTANCE, no early exit) and the current one (fixed-point
+ * metric, indexed heap, excluded nodes, search stops at destination).
+ *
+ * Edges get random Parameters. Every node asks for path to every other
+ * node, with itself visited (as when a packet is relayed). Paths from self
+ * are served from the shortest path tree - they are measured as well.
+ *
+ * Then all pairs mode is enabled: the same paths are served from Routes
+ * and the time of computing Routes after a change (on the background
+ * thread, until they are ready) is measured.
+ *
+ * Usage: bench_path [iterations] [topology.yml ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <glob.h>
+
+#include <chrono>
+#include <thread>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "../src/router/network.h"
+#include "../src/emulator/environment.h"
+
+using namespace PUT::CS::XbeeRouting;
+
+//! Adjacency as the old kernel traversed it
+struct LegacyGraph {
+  std::vector<std::vector<std::pair<Address, float>>> neighbours;
+  std::vector<uint64_t> macs;
+};
+
+//! Network::path() before integer metrics
+static Path legacy_path(const LegacyGraph &graph, Address from, Address to, const Visited &visited) {
+  const float INFINITE_DISTANCE = 9999999;
+  std::array<float, 256> distance;
+  std::array<Address, 256> previous;
+  std::bitset<256> avoided;
+  std::priority_queue< Destination, std::vector<Destination, BufferAllocator<Destination>>, std::greater<Destination> > queue;
+  Address next_node, current_node;
+  float next_distance, current_distance;
+  Path path;
+
+  for (Address a : visited)
+    avoided.set(a);
+
+  distance.fill(INFINITE_DISTANCE);
+  previous.fill(0);
+
+  distance[from] = 0;
+  queue.push(Destination(0.0f, from));
+
+  while (!queue.empty()) {
+    current_node = queue.top().second;
+    current_distance = queue.top().first;
+    queue.pop();
+
+    if (current_distance <= distance[current_node]) {
+      for (auto &nb : graph.neighbours[current_node]) {
+        next_node = nb.first;
+        next_distance = 0;
+
+        next_distance += (current_node == from && graph.macs[next_node] == 0) ? INFINITE_DISTANCE : 0;
+        next_distance += avoided.test(next_node) ? INFINITE_DISTANCE : 0;
+
+        if (distance[next_node] > (next_distance += (distance[current_node] + nb.second))) {
+          distance[next_node] = next_distance;
+          previous[next_node] = current_node;
+          queue.push(Destination(next_distance, next_node));
+        }
+      }
+    }
+  }
+
+  current_node = to;
+
+  while (previous[current_node] != 0) {
+    path.push_front(current_node);
+    current_node = previous[current_node];
+  }
+
+  return path;
+}
+
+//! Topology file, node addresses are positions (from 1)
+static bool topology(const char* file, std::vector<std::pair<Address, Address>> &edges, Address &nodes) {
+  Emulator::Yaml root;
+  Emulator::Environment environment;
+
+  if (!Emulator::Yaml::load(file, root) || !environment.topology(root) || environment.nodes().empty() || environment.nodes().size() > 254)
+    return false;
+
+  const std::vector<std::string> &names = environment.nodes();
+
+  for (size_t i = 0; i < names.size(); i++)
+    for (const std::string &neighbour : environment.adjacent(names[i])) {
+      size_t j = std::find(names.begin(), names.end(), neighbour) - names.begin();
+
+      if (i < j)
+        edges.push_back(std::make_pair(Address(i + 1), Address(j + 1)));
+    }
+
+  nodes = names.size();
+
+  return true;
+}
+
+//! Results of measured calls are written here, so they are not optimized out
+static volatile size_t sink;
+
+/**
+ * Measure round of calls, repeated at least given number of times and
+ * at least so many times, that there are 100000 calls.
+ *
+ * @return Average time of single call [ns], F finds paths and returns sum of their lengths
+ */
+template <class F>
+static double measure(int iterations, int calls, F round) {
+  size_t hops = round();
+  auto start = std::chrono::steady_clock::now();
+
+  iterations = std::max(iterations, 100000 / std::max(calls, 1));
+
+  for (int i = 0; i < iterations; i++)
+    hops += round();
+
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  sink = hops;
+
+  return double(time) / (double(iterations) * std::max(calls, 1));
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 200;
+  std::vector<std::string> files;
+
+  for (int i = 2; i < argc; i++)
+    files.push_back(argv[i]);
+
+  if (files.empty()) {
+    glob_t g;
+
+    if (glob("test/fixtures/*.yml", 0, nullptr, &g) == 0)
+      files.assign(g.gl_pathv, g.gl_pathv + g.gl_pathc);
+
+    globfree(&g);
+  }
+
+  if (iterations <= 0 || files.empty()) {
+    fprintf(stderr, "Usage: %s [iterations] [topology.yml ...]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-32s %5s %5s %12s %12s %8s %12s %12s %10s %9s\n", "topology", "nodes", "edges", "before ns", "after ns", "speedup", "tree ns", "table ns", "rebuild ms", "mismatch");
+
+  for (const std::string &file : files) {
+    std::vector<std::pair<Address, Address>> edges;
+    Address count = 0;
+
+    if (!topology(file.c_str(), edges, count) || edges.empty())
+      continue;
+
+    Network network(1);
+    LegacyGraph legacy;
+    std::mt19937 random(868);
+
+    legacy.neighbours.resize(256);
+    legacy.macs.assign(256, 0);
+
+    for (auto &edge : edges) {
+      Parameters* parameters = network.edge(edge.first, edge.second);
+
+      parameters->retries = random() % (3 * Parameters::METRIC_SCALE);
+      parameters->losses = random() % (Parameters::METRIC_SCALE / 4);
+
+      legacy.neighbours[edge.first].push_back(std::make_pair(edge.second, parameters->antireliability()));
+      legacy.neighbours[edge.second].push_back(std::make_pair(edge.first, parameters->antireliability()));
+    }
+
+    for (Address a = 1; a <= count; a++) {
+      network.mac(a, 0x0013a20000000000 + a);
+      legacy.macs[a] = 0x0013a20000000000 + a;
+    }
+
+    network.invalidate();
+
+    int calls = 0, mismatch = 0;
+
+    for (Address from = 2; from <= count; from++)
+      for (Address to = 1; to <= count; to++)
+        if (from != to) {
+          Visited visited = { from };
+
+          calls++;
+          mismatch += legacy_path(legacy, from, to, visited).empty() != network.path(from, to, visited).empty();
+        }
+
+    double before = measure(iterations, calls, [&]() {
+      size_t hops = 0;
+
+      for (Address from = 2; from <= count; from++)
+        for (Address to = 1; to <= count; to++)
+          if (from != to) {
+            Visited visited = { from };
+            hops += legacy_path(legacy, from, to, visited).size();
+          }
+
+      return hops;
+    });
+
+    double after = measure(iterations, calls, [&]() {
+      size_t hops = 0;
+
+      for (Address from = 2; from <= count; from++)
+        for (Address to = 1; to <= count; to++)
+          if (from != to) {
+            Visited visited = { from };
+            hops += network.path(from, to, visited).size();
+          }
+
+      return hops;
+    });
+
+    double tree = measure(iterations, count - 1, [&]() {
+      size_t hops = 0;
+
+      for (Address to = 2; to <= count; to++)
+        hops += network.path(1, to, Visited()).size();
+
+      return hops;
+    });
+
+    network.all_pairs(true);
+
+    auto start = std::chrono::steady_clock::now();
+    int rebuilds = 20;
+
+    for (int i = 0; i < rebuilds; i++) {
+      network.invalidate();
+
+      while (!network.all_pairs_ready())
+        std::this_thread::yield();
+    }
+
+    double rebuild = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0 / rebuilds;
+
+    double table = measure(iterations, calls, [&]() {
+      size_t hops = 0;
+
+      for (Address from = 2; from <= count; from++)
+        for (Address to = 1; to <= count; to++)
+          if (from != to) {
+            Visited visited = { from };
+            hops += network.path(from, to, visited).size();
+          }
+
+      return hops;
+    });
+
+    for (Address from = 2; from <= count; from++)
+      for (Address to = 1; to <= count; to++)
+        if (from != to)
+          mismatch += legacy_path(legacy, from, to, Visited({ from })).empty() != (network.next_hop(from, to) == 0);
+
+    network.all_pairs(false);
+
+    const char* name = strrchr(file.c_str(), '/');
+
+    printf("%-32s %5d %5zu %12.0f %12.0f %7.2fx %12.0f %12.0f %10.2f %9d\n", name != nullptr ? name + 1 : file.c_str(), count, edges.size(), before, after, before / after, tree, table, rebuild, mismatch);
+  }
+
+  return 0;
+}
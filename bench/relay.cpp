@@ -0,0 +1,346 @@
+/**
+ * Cost of relaying single Data packet hop by hop along the network: on every
+ * hop the received packet is copied (it is stored in History), the hop is
+ * appended to visited nodes, the next hop is found with Network::path()
+ * and the packet is serialized for the next hop.
+ *
+ * Counts heap allocations and time per hop, for the old bookkeeping
+ * (visited nodes in a deque passed by value, std::find over visited
+ * for every relaxed edge, adjacency hashed and copied while searching) and
+ * the current one (inline Packet::visited, 256-bit set of avoided nodes,
+ * flat Graph store).
+ *
+ * Packet travels from the first to the last node of the topology file.
+ * Instead of a file, length of a synthetic chain may be given.
+ *
+ * Usage: bench_relay [topology.yml | chain length] [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <map>
+#include <queue>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "../src/router/network.h"
+#include "../src/router/packet.h"
+#include "../src/router/router.h"
+#include "../src/emulator/environment.h"
+
+using namespace PUT::CS::XbeeRouting;
+
+static std::atomic<uint64_t> allocations {0};
+
+extern "C" {
+  void* __real_malloc(size_t size);
+  void* __real_realloc(void* p, size_t size);
+
+  void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+  }
+
+  void* __wrap_realloc(void* p, size_t size) {
+    allocations++;
+    return __real_realloc(p, size);
+  }
+}
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+
+  if (p == nullptr)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+//! Network graph as the old path search used it (map of maps, edge parameters on the heap)
+struct LegacyGraph {
+  std::unordered_map<Address, std::unordered_map<Address, Parameters*>> neighbours;
+  std::map<Address, uint64_t> macs;
+  Address max_address = 0;
+};
+
+//! Packet::visited before it was stored inline
+struct LegacyPacket {
+  Address source, destination;
+  uint8_t packet_id, port, length;
+  Path visited;
+  uint8_t content[Packet::MAX_PAYLOAD];
+};
+
+//! Network::path() before inline visited nodes (visited by value, std::find, adjacency copy)
+static Path legacy_path(LegacyGraph &graph, Address from, Address to, Path visited) {
+  const float INFINITE_DISTANCE = 9999999;
+  std::vector<float> distance(graph.max_address + 1, INFINITE_DISTANCE);
+  std::vector<Address> previous(graph.max_address + 1, 0);
+  std::priority_queue< Destination, std::vector<Destination>, std::greater<Destination> > queue;
+  Address next_node, current_node;
+  float next_distance, current_distance;
+  Path path;
+
+  distance[from] = 0;
+  queue.push(Destination(0.0f, from));
+
+  while (!queue.empty()) {
+    current_node = queue.top().second;
+    current_distance = queue.top().first;
+    queue.pop();
+
+    if (current_distance <= distance[current_node]) {
+      auto adjacent = graph.neighbours[current_node];
+
+      for (auto &nb : adjacent) {
+        next_node = nb.first;
+        next_distance = 0;
+
+        next_distance += (current_node == from && graph.macs[next_node] == 0) ? INFINITE_DISTANCE : 0;
+        next_distance += (std::find(visited.begin(), visited.end(), next_node) != visited.end()) ? INFINITE_DISTANCE : 0;
+
+        if (distance[next_node] > (next_distance += (distance[current_node] + nb.second->antireliability()))) {
+          distance[next_node] = next_distance;
+          previous[next_node] = current_node;
+          queue.push(Destination(next_distance, next_node));
+        }
+      }
+    }
+  }
+
+  current_node = to;
+
+  while (previous[current_node] != 0) {
+    path.push_front(current_node);
+    current_node = previous[current_node];
+  }
+
+  return path;
+}
+
+//! Receive frame carrying serialized packet, as next hop gets it
+static int receive_frame(const unsigned char* header, uint8_t header_length, const uint8_t* payload, uint16_t payload_length, unsigned char* bytes) {
+  unsigned char data[Frame::MAX_SIZE];
+  Frame receive(Frame::Type::Receive);
+
+  memcpy(data, header, header_length);
+  memcpy(data + header_length, payload, payload_length);
+
+  receive.data.receive.mac = 0x0013a20000000001;
+  receive.data.receive.network = 0xFFFE;
+  receive.data.receive.options = 0;
+  receive.data.receive.data = data;
+  receive.length = header_length + payload_length;
+
+  int length = receive.serialize(bytes);
+
+  // data is on the stack
+  receive.length = 0;
+
+  return length;
+}
+
+//! Serialize old packet (the same wire format as Packet::serialize())
+static uint8_t legacy_serialize(const LegacyPacket &packet, unsigned char* header) {
+  uint8_t l = 0;
+
+  header[l++] = (unsigned char)Packet::Type::Data;
+  header[l++] = packet.destination;
+  header[l++] = packet.source;
+  header[l++] = packet.packet_id;
+  header[l++] = packet.port;
+  header[l++] = packet.visited.size();
+
+  for (uint8_t n : packet.visited)
+    header[l++] = n;
+
+  return l;
+}
+
+struct Result {
+  double allocations;
+  double nanoseconds;
+  int hops;
+};
+
+//! Relay packet from source to destination, F relays single hop and returns next one
+template <class F>
+static Result measure(int iterations, const unsigned char* first, int first_length, Address source, Address destination, F hop) {
+  unsigned char bytes[2][Frame::MAX_SIZE];
+  int hops = 0;
+
+  auto relay = [&]() {
+    Address self = source;
+    int length = first_length;
+    int current = 0;
+
+    memcpy(bytes[current], first, length);
+    hops = 0;
+
+    while (self != destination && self != 0 && hops < 256) {
+      self = hop(self, bytes[current], bytes[1 - current], length);
+      current = 1 - current;
+      hops++;
+    }
+  };
+
+  relay();
+
+  uint64_t a = allocations.load();
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < iterations; i++)
+    relay();
+
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  double relayed = double(iterations) * std::max(hops, 1);
+
+  return Result { double(allocations.load() - a) / relayed, double(time) / relayed, hops };
+}
+
+//! Topology from file or synthetic chain, node addresses are positions (from 1)
+static bool topology(const char* argument, std::vector<std::pair<Address, Address>> &edges, Address &nodes) {
+  char* end;
+  long chain = strtol(argument, &end, 10);
+
+  if (*end == '\0') {
+    if (chain < 2 || chain > 254)
+      return false;
+
+    for (long i = 1; i < chain; i++)
+      edges.push_back(std::make_pair(Address(i), Address(i + 1)));
+
+    nodes = chain;
+
+    return true;
+  }
+
+  Emulator::Yaml root;
+  Emulator::Environment environment;
+
+  if (!Emulator::Yaml::load(argument, root) || !environment.topology(root) || environment.nodes().size() > 254)
+    return false;
+
+  const std::vector<std::string> &names = environment.nodes();
+
+  for (size_t i = 0; i < names.size(); i++)
+    for (const std::string &neighbour : environment.adjacent(names[i])) {
+      size_t j = std::find(names.begin(), names.end(), neighbour) - names.begin();
+
+      if (i < j)
+        edges.push_back(std::make_pair(Address(i + 1), Address(j + 1)));
+    }
+
+  nodes = names.size();
+
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  const char* source = argc > 1 ? argv[1] : "test/fixtures/02_chain.network.yml";
+  int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+  std::vector<std::pair<Address, Address>> edges;
+  Address count;
+
+  if (!topology(source, edges, count)) {
+    fprintf(stderr, "Usage: %s [topology.yml | chain length] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  Router::configure_pools();
+
+  Network network(1);
+  LegacyGraph legacy;
+
+  for (auto &edge : edges) {
+    network.add_edge(edge.first, edge.second);
+
+    Parameters* parameters = new Parameters();
+    legacy.neighbours[edge.first][edge.second] = parameters;
+    legacy.neighbours[edge.second][edge.first] = parameters;
+  }
+
+  for (Address a = 1; a <= count; a++) {
+    network.mac(a, 0x0013a20000000000 + a);
+    legacy.macs[a] = 0x0013a20000000000 + a;
+    legacy.max_address = std::max(legacy.max_address, a);
+  }
+
+  // data packet as it leaves the source
+  Packet packet(std::string(64, 'x'));
+  packet.source = 1;
+  packet.destination = count;
+  packet.packet_id = 7;
+
+  unsigned char header[Frame::MAX_SIZE], first[Frame::MAX_SIZE];
+  const uint8_t* payload;
+  uint16_t payload_length;
+  uint8_t header_length = packet.serialize(header, payload, payload_length);
+  int first_length = receive_frame(header, header_length, payload, payload_length, first);
+
+  Result before = measure(iterations, first, first_length, 1, count, [&](Address self, unsigned char* in, unsigned char* out, int &length) {
+    FrameView frame;
+    frame.unserialize(in);
+
+    PacketView view;
+    view.from_frame(frame.data.receive, frame.length);
+
+    LegacyPacket owned;
+    owned.source = view.source;
+    owned.destination = view.destination;
+    owned.packet_id = view.packet_id;
+    owned.port = view.port;
+    owned.length = view.length;
+    owned.visited.assign(view.visited, view.visited + view.visited_count);
+    memcpy(owned.content, view.data.content, view.length);
+
+    owned.visited.push_back(self);
+
+    Path path = legacy_path(legacy, self, owned.destination, owned.visited);
+    Address next = path.empty() ? 0 : path.front();
+
+    unsigned char h[Frame::MAX_SIZE];
+    length = receive_frame(h, legacy_serialize(owned, h), owned.content, owned.length, out);
+
+    return next;
+  });
+
+  Result after = measure(iterations, first, first_length, 1, count, [&](Address self, unsigned char* in, unsigned char* out, int &length) {
+    FrameView frame;
+    frame.unserialize(in);
+
+    PacketView view;
+    view.from_frame(frame.data.receive, frame.length);
+
+    Packet owned(view);
+    owned.visited.push_back(self);
+
+    Path path = network.path(self, owned.destination, owned.visited);
+    Address next = path.empty() ? 0 : path.front();
+
+    unsigned char h[Frame::MAX_SIZE];
+    const uint8_t* content;
+    uint16_t content_length;
+    uint8_t l = owned.serialize(h, content, content_length);
+    length = receive_frame(h, l, content, content_length, out);
+
+    return next;
+  });
+
+  printf("Relayed Data packet over %d nodes, %d hops, %d iterations\n", count, after.hops, iterations);
+  printf("%-8s %12s %10s\n", "path", "allocations", "ns/hop");
+  printf("%-8s %12.2f %10.0f\n", "before", before.allocations, before.nanoseconds);
+  printf("%-8s %12.2f %10.0f\n", "after", after.allocations, after.nanoseconds);
+
+  return 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * Path computation as the network grows, up to the whole address space
+ * (1022 nodes if built with XBEE_WIDE_ADDRESS, 254 otherwise).
+ *
+ * Nodes are scattered over a square and every node is connected to nodes
+ * closer than the radio range, which is chosen so a node has about 6
+ * neighbours (like the tram network); far apart parts are joined along
+ * the way, so the graph is connected. Edges get random Parameters.
+ *
+ * For every size:
+ *  - build: every edge added and MAC of every node set, graph published,
+ *  - path: Network::path() from random source to random destination with
+ *    the source visited (Dijkstra, as when a packet is relayed),
+ *  - tree: Network::path() from self (served from the shortest path tree),
+ *  - paths: Network::paths() with 3 edge-disjoint paths from self,
+ *  - update: Network::update() of random edge (tree is repaired and the
+ *    graph is published),
+ *  - routes: computing Routes of all pairs after a change (background
+ *    thread, until they are ready).
+ *
+ * Network prints every added edge and update to stdout, so the table is
+ * printed to stderr.
+ *
+ * Usage: bench_scale [iterations] [nodes ...] > /dev/null
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "../src/router/network.h"
+
+using namespace PUT::CS::XbeeRouting;
+
+static volatile size_t sink;
+
+//! @return Average time of single call of f [ns]
+template <class F>
+static double measure(int calls, F f) {
+  size_t hops = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < calls; i++)
+    hops += f(i);
+
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  sink = hops;
+
+  return double(time) / calls;
+}
+
+//! Random geometric graph of nodes 1 till count, about 6 neighbours each
+static std::vector<std::pair<Address, Address>> topology(int count, std::mt19937 &random) {
+  std::uniform_real_distribution<double> coordinate(0, 1);
+  std::vector<std::pair<double, double>> position(count + 1);
+  std::vector<std::pair<Address, Address>> edges;
+  double range = std::sqrt(6.0 / (M_PI * count));
+
+  for (int a = 1; a <= count; a++)
+    position[a] = std::make_pair(coordinate(random), coordinate(random));
+
+  for (int a = 1; a <= count; a++) {
+    int nearest = 0;
+    double best = 2;
+
+    for (int b = 1; b <= count; b++) {
+      double d = std::hypot(position[a].first - position[b].first, position[a].second - position[b].second);
+
+      if (a < b && d < range)
+        edges.push_back(std::make_pair(a, b));
+
+      // nearest node with lower address joins disconnected parts
+      if (b < a && d < best) {
+        best = d;
+        nearest = b;
+      }
+    }
+
+    if (nearest != 0 && best >= range)
+      edges.push_back(std::make_pair(nearest, a));
+  }
+
+  return edges;
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+  std::vector<int> sizes;
+
+  for (int i = 2; i < argc; i++)
+    sizes.push_back(atoi(argv[i]));
+
+  if (sizes.empty())
+    sizes = { 50, 100, 250, 500, 1000, MAX_ADDRESS - 1 };
+
+  if (iterations <= 0) {
+    fprintf(stderr, "Usage: %s [iterations] [nodes ...]\n", argv[0]);
+    return 1;
+  }
+
+  fprintf(stderr, "%d-bit addresses, %d nodes at most\n", int(8 * sizeof(Address)), MAX_ADDRESS - 1);
+  fprintf(stderr, "%5s %5s %10s %10s %10s %10s %10s %10s\n", "nodes", "edges", "build ms", "path ns", "tree ns", "paths ns", "update ns", "routes ms");
+
+  for (int count : sizes) {
+    if (count < 2 || count >= MAX_ADDRESS)
+      continue;
+
+    std::mt19937 random(count);
+    std::vector<std::pair<Address, Address>> edges = topology(count, random);
+    std::uniform_int_distribution<int> node(1, count), metric(0, 4 * Parameters::METRIC_SCALE), edge(0, edges.size() - 1);
+    Network network(1);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int a = 1; a <= count; a++)
+      network.mac(a, 0x0013a20000000000 + a);
+
+    for (auto &e : edges)
+      network.edge(e.first, e.second)->retries = metric(random);
+
+    network.invalidate();
+
+    double build = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0;
+
+    std::vector<Address> sources(iterations), destinations(iterations);
+
+    for (int i = 0; i < iterations; i++) {
+      sources[i] = node(random);
+      destinations[i] = node(random);
+    }
+
+    double path = measure(iterations, [&](int i) {
+      Visited visited;
+      visited.push_back(sources[i]);
+
+      return network.path(sources[i], destinations[i], visited).size();
+    });
+
+    double tree = measure(iterations, [&](int i) {
+      return network.path(1, destinations[i], Visited()).size();
+    });
+
+    double paths = measure(iterations / 10, [&](int i) {
+      Path found[3];
+
+      return network.paths(1, destinations[i], Visited(), found, nullptr, 3);
+    });
+
+    double update = measure(iterations / 10, [&](int i) {
+      auto &e = edges[edge(random)];
+
+      network.update(e.first, e.second, i % 4, i % 7 == 0, 20);
+
+      return 1;
+    });
+
+    network.all_pairs(true);
+
+    int rebuilds = 5;
+    start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < rebuilds; i++) {
+      network.invalidate();
+
+      while (!network.all_pairs_ready())
+        std::this_thread::yield();
+    }
+
+    double routes = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0 / rebuilds;
+
+    network.all_pairs(false);
+
+    fprintf(stderr, "%5d %5zu %10.2f %10.0f %10.0f %10.0f %10.0f %10.2f\n", count, edges.size(), build, path, tree, paths, update, routes);
+  }
+
+  return 0;
+}
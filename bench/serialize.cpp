@@ -0,0 +1,201 @@
+/**
+ * Cost of forwarding single Data frame through the router: frame received
+ * from the radio is decoded, Packet is copied (it is stored in History),
+ * visited list is updated and the frame is sent to the next hop.
+ *
+ * Counts heap allocations and bytes copied by memcpy per forwarded frame,
+ * for the old path (Frame copies on both sides) and the current one
+ * (FrameView/PacketView on receive, scatter-gather Xbee::send on transmit).
+ *
+ * Usage: bench_serialize [payload length] [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#include "../src/router/xbee.h"
+#include "../src/router/packet.h"
+
+using namespace PUT::CS::XbeeRouting;
+
+static std::atomic<uint64_t> allocations {0};
+static std::atomic<uint64_t> copied {0};
+
+extern "C" {
+  void* __real_malloc(size_t size);
+  void* __real_realloc(void* p, size_t size);
+  void* __real_memcpy(void* d, const void* s, size_t n);
+
+  void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+  }
+
+  void* __wrap_realloc(void* p, size_t size) {
+    allocations++;
+    return __real_realloc(p, size);
+  }
+
+  void* __wrap_memcpy(void* d, const void* s, size_t n) {
+    copied += n;
+    return __real_memcpy(d, s, n);
+  }
+}
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+
+  if (p == nullptr)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+//! Transmit path of the router before scatter-gather send (Packet::to_frame + Frame::serialize)
+static void legacy_send(int fd, Packet* packet, uint8_t id, uint64_t mac, uint16_t network) {
+  Frame* frame = new Frame(Frame::Type::Transmit);
+  unsigned char d[256];
+  uint8_t l = 0;
+
+  d[l++] = (unsigned char)packet->type;
+  d[l++] = packet->destination;
+  d[l++] = packet->source;
+  d[l++] = packet->packet_id;
+  d[l++] = packet->port;
+  d[l++] = packet->visited.size();
+
+  for (uint8_t n : packet->visited)
+    d[l++] = n;
+
+  memcpy(d + l, packet->data.content, packet->length);
+  l += packet->length;
+
+  frame->length = l;
+  frame->data.transmit.data = (unsigned char*)malloc(frame->length);
+  memcpy(frame->data.transmit.data, d, frame->length);
+  frame->data.transmit.id = id;
+  frame->data.transmit.mac = mac;
+  frame->data.transmit.network = network;
+  frame->data.transmit.radius = 0;
+  frame->data.transmit.options = 0;
+
+  int length;
+  unsigned char* bytes = frame->serialize(length);
+
+  if (write(fd, bytes, length) != length)
+    exit(1);
+
+  free(bytes);
+  delete frame;
+}
+
+//! Receive frame as it comes from the radio
+static unsigned char* received_frame(uint8_t payload_length) {
+  Packet packet(Packet::Type::Data);
+  packet.destination = 9;
+  packet.source = 1;
+  packet.packet_id = 17;
+  packet.port = 15;
+  packet.visited = { 1, 3, 5 };
+  packet.length = payload_length;
+  memset(packet.data.content, 'x', payload_length);
+
+  Frame* transmit = packet.to_frame();
+  Frame receive(Frame::Type::Receive);
+  receive.data.receive.mac = 0x0013a20000000001;
+  receive.data.receive.network = 0xFFFE;
+  receive.data.receive.options = 0;
+  receive.length = transmit->length;
+  receive.data.receive.data = transmit->data.transmit.data;
+
+  int length;
+  unsigned char* bytes = receive.serialize(length);
+
+  receive.length = 0;
+  delete transmit;
+
+  return bytes;
+}
+
+struct Result {
+  double allocations;
+  double copied;
+  double nanoseconds;
+};
+
+template <class F>
+static Result measure(int iterations, F forward) {
+  forward();
+
+  uint64_t a = allocations.load(), c = copied.load();
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < iterations; i++)
+    forward();
+
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  return Result { double(allocations.load() - a) / iterations, double(copied.load() - c) / iterations, double(time) / iterations };
+}
+
+int main(int argc, char* argv[]) {
+  uint8_t payload_length = argc > 1 ? atoi(argv[1]) : 200;
+  int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+
+  setenv("IN_SIMULATOR", "1", 1);
+
+  Xbee xbee("/dev/null");
+  int fd = open("/dev/null", O_WRONLY);
+  unsigned char* bytes = received_frame(payload_length);
+  const Address self = 5;
+  const uint64_t next_hop = 0x0013a20000000009;
+
+  Result before = measure(iterations, [&]() {
+    Frame* frame = new Frame((Frame::Type)0x00);
+    frame->unserialize(bytes);
+
+    Packet* packet = new Packet();
+    packet->from_frame(frame);
+    delete frame;
+
+    packet->visited.push_back(self);
+    legacy_send(fd, packet, 1, next_hop, 0xFFFE);
+
+    delete packet;
+  });
+
+  Result after = measure(iterations, [&]() {
+    FrameView frame;
+    frame.unserialize(bytes);
+
+    PacketView view;
+    view.from_frame(frame.data.receive, frame.length);
+
+    Packet* packet = new Packet(view);
+    packet->visited.push_back(self);
+    xbee.send(*packet, 1, next_hop, 0xFFFE);
+
+    delete packet;
+  });
+
+  printf("Forwarded Data frame, %d bytes of payload, %d iterations\n", payload_length, iterations);
+  printf("%-8s %12s %14s %10s\n", "path", "allocations", "bytes copied", "ns");
+  printf("%-8s %12.2f %14.2f %10.0f\n", "before", before.allocations, before.copied, before.nanoseconds);
+  printf("%-8s %12.2f %14.2f %10.0f\n", "after", after.allocations, after.copied, after.nanoseconds);
+
+  free(bytes);
+  close(fd);
+
+  return 0;
+}
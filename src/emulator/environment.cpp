@@ -0,0 +1,376 @@
+#include "environment.h"
+
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      namespace Emulator {
+        //! Significant line of YAML document
+        struct Line {
+          size_t indent;
+          std::string text;
+        };
+
+        static std::string trim(const std::string &text) {
+          size_t begin = text.find_first_not_of(" \t\r");
+          size_t end = text.find_last_not_of(" \t\r");
+
+          return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+        }
+
+        //! Position of key separator (colon followed by space or end of line), outside brackets
+        static size_t key_end(const std::string &text) {
+          int depth = 0;
+
+          for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] == '[')
+              depth++;
+            else if (text[i] == ']')
+              depth--;
+            else if (text[i] == ':' && depth == 0 && (i + 1 == text.size() || text[i + 1] == ' '))
+              return i;
+          }
+
+          return std::string::npos;
+        }
+
+        static bool parse_block(const std::vector<Line> &lines, size_t &i, size_t indent, Yaml &node) {
+          while (i < lines.size()) {
+            const Line &line = lines[i];
+
+            if (line.indent < indent)
+              return true;
+
+            if (line.indent > indent)
+              return false;
+
+            if (line.text[0] == '-') {
+              node.items.push_back(trim(line.text.substr(1)));
+              i++;
+              continue;
+            }
+
+            size_t colon = key_end(line.text);
+
+            if (colon == std::string::npos)
+              return false;
+
+            Yaml child;
+            std::string key = trim(line.text.substr(0, colon));
+            std::string rest = trim(line.text.substr(colon + 1));
+
+            i++;
+
+            if (!rest.empty()) {
+              child.value = rest;
+              child.items = Yaml::flow(rest);
+            } else if (i < lines.size() && lines[i].indent > indent) {
+              if (!parse_block(lines, i, lines[i].indent, child))
+                return false;
+            }
+
+            node.entries.emplace_back(key, child);
+          }
+
+          return true;
+        }
+
+        bool Yaml::load(const std::string &path, Yaml &root) {
+          std::ifstream file(path);
+          std::stringstream text;
+
+          if (!file)
+            return false;
+
+          text << file.rdbuf();
+
+          return parse(text.str(), root);
+        }
+
+        bool Yaml::parse(const std::string &text, Yaml &root) {
+          std::vector<Line> lines;
+          std::istringstream input(text);
+          std::string raw;
+
+          while (std::getline(input, raw)) {
+            // comment starts a line or follows whitespace
+            for (size_t i = 0; i < raw.size(); i++) {
+              if (raw[i] == '#' && (i == 0 || raw[i - 1] == ' ' || raw[i - 1] == '\t')) {
+                raw.resize(i);
+                break;
+              }
+            }
+
+            std::string content = trim(raw);
+
+            if (content.empty())
+              continue;
+
+            lines.push_back(Line { raw.find_first_not_of(' '), content });
+          }
+
+          size_t i = 0;
+          root = Yaml();
+
+          return lines.empty() || (parse_block(lines, i, lines[0].indent, root) && i == lines.size());
+        }
+
+        std::vector<std::string> Yaml::flow(const std::string &text) {
+          std::vector<std::string> items;
+
+          if (text.size() < 2 || text.front() != '[' || text.back() != ']')
+            return items;
+
+          std::istringstream input(text.substr(1, text.size() - 2));
+          std::string item;
+
+          while (std::getline(input, item, ',')) {
+            item = trim(item);
+
+            if (!item.empty())
+              items.push_back(item);
+          }
+
+          return items;
+        }
+
+        const Yaml* Yaml::find(const std::string &key) const {
+          for (auto &entry : entries)
+            if (entry.first == key)
+              return &entry.second;
+
+          return nullptr;
+        }
+
+        //! Read number from scalar
+        static bool number(const Yaml* node, double &value) {
+          char* end;
+
+          if (node == nullptr || node->value.empty())
+            return false;
+
+          value = strtod(node->value.c_str(), &end);
+
+          return *end == '\0';
+        }
+
+        bool Distribution::parse(const Yaml &definition, Distribution &distribution) {
+          distribution = Distribution();
+
+          if (!definition.value.empty())
+            return number(&definition, distribution.a);
+
+          const Yaml* type = definition.find("distribution");
+
+          if (type == nullptr)
+            return false;
+
+          number(definition.find("scale"), distribution.scale);
+          number(definition.find("bias"), distribution.bias);
+
+          if (type->value == "constant" || type->value == "degenerate") {
+            distribution.type = Type::Constant;
+
+            return number(definition.find("value"), distribution.a) || number(definition.find("constant"), distribution.a);
+          }
+
+          if (type->value == "uniform") {
+            distribution.type = Type::Uniform;
+
+            return number(definition.find("included"), distribution.a) && number(definition.find("excluded"), distribution.b);
+          }
+
+          if (type->value == "normal") {
+            distribution.type = Type::Normal;
+            distribution.b = 1;
+            number(definition.find("std"), distribution.b);
+
+            return number(definition.find("mean"), distribution.a);
+          }
+
+          if (type->value == "exponential") {
+            distribution.type = Type::Exponential;
+
+            return number(definition.find("lambda"), distribution.a) && distribution.a > 0;
+          }
+
+          return false;
+        }
+
+        double Distribution::sample(std::mt19937 &random) const {
+          double value;
+
+          switch (type) {
+            case Type::Uniform:
+              value = std::uniform_real_distribution<double>(a, b)(random);
+              break;
+
+            case Type::Normal:
+              value = std::normal_distribution<double>(a, b)(random);
+              break;
+
+            case Type::Exponential:
+              value = std::exponential_distribution<double>(a)(random);
+              break;
+
+            default:
+              value = a;
+          }
+
+          return scale * value + bias;
+        }
+
+        bool Environment::merge(const Yaml &definition, Parameters &parameters) {
+          for (auto &entry : definition.entries) {
+            if (!Distribution::parse(entry.second, parameters[entry.first]))
+              return false;
+          }
+
+          return true;
+        }
+
+        const Conditions* Environment::at(double time) const {
+          const Conditions* current = timeline.empty() ? nullptr : &timeline.front().second;
+
+          for (auto &point : timeline) {
+            if (point.first > time)
+              break;
+
+            current = &point.second;
+          }
+
+          return current;
+        }
+
+        bool Environment::topology(const Yaml &topology) {
+          node_names.clear();
+          adjacency.clear();
+
+          for (auto &entry : topology.entries)
+            node_names.push_back(entry.first);
+
+          for (auto &entry : topology.entries) {
+            for (auto &neighbour : entry.second.items) {
+              if (std::find(node_names.begin(), node_names.end(), neighbour) == node_names.end())
+                return false;
+
+              std::vector<std::string> &a = adjacency[entry.first], &b = adjacency[neighbour];
+
+              if (std::find(a.begin(), a.end(), neighbour) == a.end())
+                a.push_back(neighbour);
+
+              if (std::find(b.begin(), b.end(), entry.first) == b.end())
+                b.push_back(entry.first);
+            }
+          }
+
+          return !node_names.empty();
+        }
+
+        bool Environment::environment(const Yaml &environment, double speed) {
+          double current = 0;
+
+          timeline.clear();
+
+          for (auto &entry : environment.entries) {
+            const Yaml &definition = entry.second;
+            const Yaml* edges = definition.find("edges");
+            const Yaml* nodes = definition.find("nodes");
+            Conditions conditions = timeline.empty() ? Conditions() : timeline.back().second;
+            double time = 0;
+
+            if (number(definition.find("point"), time))
+              current = time;
+            else if (number(definition.find("delay"), time))
+              current += time;
+
+            for (size_t i = 0; edges != nullptr && i < edges->entries.size(); i++) {
+              const std::string &key = edges->entries[i].first;
+              const Yaml &parameters = edges->entries[i].second;
+
+              if (key == "all") {
+                for (auto &a : node_names)
+                  for (auto &b : adjacent(a))
+                    if (!merge(parameters, conditions.edges[std::make_pair(a, b)]))
+                      return false;
+              } else {
+                std::vector<std::string> edge = Yaml::flow(key);
+
+                if (edge.size() != 2 || !merge(parameters, conditions.edges[std::make_pair(edge[0], edge[1])]))
+                  return false;
+              }
+            }
+
+            for (size_t i = 0; nodes != nullptr && i < nodes->entries.size(); i++) {
+              const std::string &key = nodes->entries[i].first;
+              const Yaml &parameters = nodes->entries[i].second;
+
+              if (key == "all") {
+                for (auto &node : node_names)
+                  if (!merge(parameters, conditions.nodes[node]))
+                    return false;
+              } else if (!merge(parameters, conditions.nodes[key])) {
+                return false;
+              }
+            }
+
+            timeline.emplace_back(current / speed, conditions);
+          }
+
+          std::stable_sort(timeline.begin(), timeline.end(), [](const std::pair<double, Conditions> &a, const std::pair<double, Conditions> &b) {
+            return a.first < b.first;
+          });
+
+          return true;
+        }
+
+        const std::vector<std::string> &Environment::nodes() const {
+          return node_names;
+        }
+
+        const std::vector<std::string> &Environment::adjacent(const std::string &node) const {
+          static const std::vector<std::string> none;
+          auto a = adjacency.find(node);
+
+          return a == adjacency.end() ? none : a->second;
+        }
+
+        double Environment::edge(double time, const std::string &a, const std::string &b, const std::string &name, double fallback, std::mt19937 &random) const {
+          const Conditions* conditions = at(time);
+
+          if (conditions == nullptr)
+            return fallback;
+
+          auto edge = conditions->edges.find(std::make_pair(a, b));
+
+          if (edge == conditions->edges.end())
+            return fallback;
+
+          auto parameter = edge->second.find(name);
+
+          return parameter == edge->second.end() ? fallback : parameter->second.sample(random);
+        }
+
+        double Environment::node(double time, const std::string &node, const std::string &name, double fallback, std::mt19937 &random) const {
+          const Conditions* conditions = at(time);
+
+          if (conditions == nullptr)
+            return fallback;
+
+          auto n = conditions->nodes.find(node);
+
+          if (n == conditions->nodes.end())
+            return fallback;
+
+          auto parameter = n->second.find(name);
+
+          return parameter == n->second.end() ? fallback : parameter->second.sample(random);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,198 @@
+#ifndef PUT_EMULATOR_ENVIRONMENT_H
+#define PUT_EMULATOR_ENVIRONMENT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <utility>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      namespace Emulator {
+        /**
+         * Document in subset of YAML used by test fixtures - nested mappings
+         * (by indentation), block sequences ("- item"), flow sequences ("[1, 2]")
+         * and scalars. Comments are skipped.
+         */
+        class Yaml {
+         public:
+          //! Scalar value (flow sequence is kept here in raw form too)
+          std::string value;
+
+          //! Mapping entries, in order of appearance
+          std::vector<std::pair<std::string, Yaml>> entries;
+
+          //! Sequence items (block or flow)
+          std::vector<std::string> items;
+
+          /**
+           * Parse YAML file.
+           *
+           * @param path File path
+           * @param root Parsed document
+           * @return False if file could not be read or is malformed
+           */
+          static bool load(const std::string &path, Yaml &root);
+
+          /**
+           * Parse YAML document.
+           *
+           * @param text Document
+           * @param root Parsed document
+           * @return False if document is malformed
+           */
+          static bool parse(const std::string &text, Yaml &root);
+
+          /**
+           * Split flow sequence ("[1, 2]") into items.
+           *
+           * @param text Flow sequence
+           * @return Items, empty if text is not a flow sequence
+           */
+          static std::vector<std::string> flow(const std::string &text);
+
+          /**
+           * Find mapping entry.
+           *
+           * @param key Entry key
+           * @return Entry or nullptr
+           */
+          const Yaml* find(const std::string &key) const;
+        };
+
+        /**
+         * Random distribution of a link or node parameter, as in environment
+         * files: constant (value), uniform (included, excluded), normal (mean, std)
+         * or exponential (lambda). Sample is scaled and biased.
+         */
+        class Distribution {
+         public:
+          enum class Type {
+            Constant,
+            Uniform,
+            Normal,
+            Exponential
+          };
+
+          Type type = Type::Constant;
+
+          //! First parameter (value, included bound, mean or lambda)
+          double a = 0;
+
+          //! Second parameter (excluded bound or standard deviation)
+          double b = 0;
+
+          double scale = 1;
+          double bias = 0;
+
+          /**
+           * Create distribution from environment definition. Plain number
+           * is a constant.
+           *
+           * @param definition Distribution definition
+           * @param distribution Parsed distribution
+           * @return False if definition is malformed
+           */
+          static bool parse(const Yaml &definition, Distribution &distribution);
+
+          /**
+           * @param random Random generator
+           * @return Random value
+           */
+          double sample(std::mt19937 &random) const;
+        };
+
+        //! Parameter distributions by name (delay [ms], retries, errors, power)
+        typedef std::map<std::string, Distribution> Parameters;
+
+        /**
+         * Environment at given point of time - parameters of every directed
+         * edge and every node, by node names.
+         */
+        struct Conditions {
+          std::map<std::pair<std::string, std::string>, Parameters> edges;
+          std::map<std::string, Parameters> nodes;
+        };
+
+        /**
+         * Network environment changing in time (environment.yml) over
+         * network topology (network.yml).
+         *
+         * Every top level entry of environment file is a point in time, either
+         * absolute ("point" in seconds) or relative to previous one ("delay").
+         * Point inherits every parameter from previous one, parameters are given for
+         * "all" or single edges ("[a, b]", directed) and for "all" or single nodes.
+         */
+        class Environment {
+         private:
+          //! Points of time [s] with conditions, sorted
+          std::vector<std::pair<double, Conditions>> timeline;
+
+          //! Node names, in order of topology file
+          std::vector<std::string> node_names;
+
+          //! Adjacent nodes, by name
+          std::map<std::string, std::vector<std::string>> adjacency;
+
+          //! Merge parameters definition into conditions
+          static bool merge(const Yaml &definition, Parameters &parameters);
+
+          //! Conditions active at given time
+          const Conditions* at(double time) const;
+
+         public:
+          /**
+           * Read topology, adjacency is made symmetric.
+           *
+           * @param topology Topology (node name to list of neighbours)
+           * @return False if topology is malformed
+           */
+          bool topology(const Yaml &topology);
+
+          /**
+           * Read environment timeline. Topology must be read first.
+           *
+           * @param environment Environment definition
+           * @param speed Timeline speed up
+           * @return False if environment is malformed
+           */
+          bool environment(const Yaml &environment, double speed = 1);
+
+          //! @return Node names, in order of topology file
+          const std::vector<std::string> &nodes() const;
+
+          //! @return Neighbours of the node
+          const std::vector<std::string> &adjacent(const std::string &node) const;
+
+          /**
+           * Sample edge parameter.
+           *
+           * @param time Time since start [s]
+           * @param a Source node
+           * @param b Destination node
+           * @param name Parameter name
+           * @param fallback Value if parameter is not defined
+           * @param random Random generator
+           * @return Value
+           */
+          double edge(double time, const std::string &a, const std::string &b, const std::string &name, double fallback, std::mt19937 &random) const;
+
+          /**
+           * Sample node parameter.
+           *
+           * @param time Time since start [s]
+           * @param node Node
+           * @param name Parameter name
+           * @param fallback Value if parameter is not defined
+           * @param random Random generator
+           * @return Value
+           */
+          double node(double time, const std::string &node, const std::string &name, double fallback, std::mt19937 &random) const;
+        };
+      }
+    }
+  }
+}
+#endif
@@ -0,0 +1,85 @@
+#include "medium.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace PUT::CS::XbeeRouting;
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s -e ENVIRONMENT -t TOPOLOGY [-s SPEED] [-r SEED]\n", name);
+  fprintf(stderr, "  -e PATH   Environment definition file (test/fixtures/*.environment.yml)\n");
+  fprintf(stderr, "  -t PATH   Topology definition file (test/fixtures/*.yml)\n");
+  fprintf(stderr, "  -s SPEED  Environment timeline speed up\n");
+  fprintf(stderr, "  -r SEED   Random seed\n");
+}
+
+/**
+ * Xbee 868 emulator - creates one pty per node of the topology. For every
+ * node "NAME TTY" is printed, router may be started on the TTY. Runs until
+ * SIGINT or SIGTERM.
+ */
+int main(int argc, char* argv[]) {
+  const char* environment = NULL;
+  const char* topology = NULL;
+  double speed = 1;
+  unsigned int seed = 5489u;
+  int option;
+
+  google::InitGoogleLogging(argv[0]);
+
+  while ((option = getopt(argc, argv, "e:t:s:r:h")) != -1) {
+    switch (option) {
+      case 'e': environment = optarg; break;
+      case 't': topology = optarg; break;
+      case 's': speed = atof(optarg); break;
+      case 'r': seed = atoi(optarg); break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (environment == NULL || topology == NULL || speed <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  sigset_t signals;
+  int signal;
+
+  // signals are handled only by sigwait, threads inherit the mask
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  Emulator::Medium medium(seed);
+
+  if (!medium.load(environment, topology, speed) || !medium.start())
+    return 1;
+
+  for (Emulator::Device* device : medium.devices())
+    printf("%s %s\n", device->name.c_str(), device->path().c_str());
+
+  printf("EMULATOR RUN\n");
+  fflush(stdout);
+
+  sigwait(&signals, &signal);
+
+  medium.stop();
+
+  printf("transmitted %llu, delivered %llu, lost %llu\n",
+         (unsigned long long)medium.transmitted(), (unsigned long long)medium.delivered(), (unsigned long long)medium.lost());
+
+  for (int type = 0; type < 256; type++)
+    if (medium.frames(type) > 0)
+      printf("airtime 0x%02x: %llu frames, %.1f ms\n", type, (unsigned long long)medium.frames(type), medium.airtime(type));
+
+  printf("collisions %llu\n", (unsigned long long)medium.collisions());
+
+  return 0;
+}
@@ -0,0 +1,482 @@
+#include "medium.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "../common.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      namespace Emulator {
+        //! Network ID reported by every radio
+        static const uint16_t network_id = 0xFFFE;
+
+        Device::Device(Medium &m, std::string n, uint64_t a) : medium(m), name(n), mac(a) {
+        }
+
+        Device::~Device() {
+          stop();
+
+          if (slave != -1)
+            close(slave);
+
+          if (master != -1)
+            close(master);
+        }
+
+        bool Device::open() {
+          struct termios options;
+
+          master = posix_openpt(O_RDWR | O_NOCTTY);
+
+          if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0)
+            return false;
+
+          tty = ptsname(master);
+          slave = ::open(tty.c_str(), O_RDWR | O_NOCTTY);
+
+          if (slave == -1)
+            return false;
+
+          tcgetattr(slave, &options);
+          cfmakeraw(&options);
+          tcsetattr(slave, TCSANOW, &options);
+
+          return true;
+        }
+
+        void Device::start() {
+          running = true;
+
+          thread = std::thread([this]() {
+            THREAD_NAME("EmulatorRadio");
+            struct pollfd input = { master, POLLIN, 0 };
+            FrameView frame;
+
+            while (running) {
+              while (reader.next(frame))
+                handle(frame);
+
+              if (poll(&input, 1, 100) <= 0)
+                continue;
+
+              if (reader.fill(master) <= 0)
+                break;
+            }
+          });
+        }
+
+        void Device::stop() {
+          running = false;
+
+          if (thread.joinable())
+            thread.join();
+        }
+
+        const std::string &Device::path() const {
+          return tty;
+        }
+
+        bool Device::active() const {
+          return attached;
+        }
+
+        uint8_t Device::max_retransmissions() const {
+          return retransmissions;
+        }
+
+        void Device::write(Frame &frame) {
+          unsigned char bytes[Frame::MAX_SIZE];
+          int length = frame.serialize(bytes);
+          int offset = 0;
+          ssize_t status;
+
+          std::lock_guard<std::mutex> lock(write_mutex);
+
+          while (offset < length) {
+            status = ::write(master, bytes + offset, length - offset);
+
+            if (status == -1 && errno == EINTR)
+              continue;
+
+            if (status == -1) {
+              LOG(WARNING) << name << ": could not write frame (" << strerror(errno) << ")";
+              return;
+            }
+
+            offset += status;
+          }
+        }
+
+        void Device::receive(const Device &source, const std::vector<unsigned char> &data) {
+          Frame frame(Frame::Type::Receive);
+
+          frame.data.receive.mac = source.mac;
+          frame.data.receive.network = network_id;
+          frame.data.receive.options = 0;
+          frame.data.receive.data = (unsigned char*)data.data();
+          frame.length = data.size();
+
+          write(frame);
+
+          // data is not owned by the frame
+          frame.length = 0;
+        }
+
+        void Device::status(uint8_t id, uint8_t retries, uint8_t status) {
+          Frame frame(Frame::Type::Status);
+
+          frame.data.status.id = id;
+          frame.data.status.network = network_id;
+          frame.data.status.retries = retries;
+          frame.data.status.status = status;
+          frame.data.status.discovery = 0;
+
+          write(frame);
+        }
+
+        void Device::handle(const FrameView &frame) {
+          attached = true;
+
+          switch (frame.type) {
+            case Frame::Type::Command:
+            case Frame::Type::CommandQueue:
+              command(frame);
+              break;
+
+            case Frame::Type::Transmit:
+              medium.transmit(*this, frame);
+              break;
+
+            case Frame::Type::RemoteCommand: {
+              // remote radios are not emulated
+              Frame response(Frame::Type::RemoteCommandResponse);
+
+              response.data.remote_command_response.id = frame.data.remote_command.id;
+              response.data.remote_command_response.mac = frame.data.remote_command.mac;
+              response.data.remote_command_response.network = frame.data.remote_command.network;
+              memcpy(response.data.remote_command_response.command, frame.data.remote_command.command, 2);
+              response.data.remote_command_response.status = 0x04;
+
+              if (response.data.remote_command_response.id != 0)
+                write(response);
+
+              break;
+            }
+
+            default:
+              LOG(WARNING) << name << ": unsupported frame type " << (int)frame.type;
+          }
+        }
+
+        void Device::command(const FrameView &frame) {
+          const CommandFrame &request = frame.data.command;
+          Frame response(Frame::Type::CommandResponse);
+          unsigned char value[32];
+          uint32_t half;
+
+          response.data.command_response.id = request.id;
+          memcpy(response.data.command_response.command, request.command, 2);
+          response.data.command_response.status = 0;
+          response.data.command_response.data = value;
+
+          if (memcmp(request.command, "FR", 2) == 0) {
+            retransmissions = 10;
+          } else if (memcmp(request.command, "NI", 2) == 0) {
+            response.length = std::min(name.size(), sizeof(value));
+            memcpy(value, name.c_str(), response.length);
+          } else if (memcmp(request.command, "ID", 2) == 0) {
+            response.length = 2;
+            memcpy(value, &network_id, 2);
+          } else if (memcmp(request.command, "SL", 2) == 0) {
+            half = mac >> 32;
+            response.length = 4;
+            memcpy(value, &half, 4);
+          } else if (memcmp(request.command, "SH", 2) == 0) {
+            half = mac;
+            response.length = 4;
+            memcpy(value, &half, 4);
+          } else if (memcmp(request.command, "MT", 2) == 0 || memcmp(request.command, "RR", 2) == 0) {
+            if (frame.length > 0)
+              retransmissions = request.data[0];
+          } else if (memcmp(request.command, "DB", 2) == 0) {
+            response.length = 1;
+            value[0] = 0x60;
+          } else if (memcmp(request.command, "PL", 2) != 0) {
+            LOG(WARNING) << name << ": unimplemented command " << request.command[0] << request.command[1];
+            response.data.command_response.status = 0x02;
+          }
+
+          if (request.id != 0)
+            write(response);
+
+          // value is not owned by the frame
+          response.length = 0;
+
+          if (memcmp(request.command, "FR", 2) == 0) {
+            Frame reset(Frame::Type::ModemStatus);
+            reset.data.modem_status.status = 0x00;
+
+            write(reset);
+          }
+        }
+
+        Medium::Medium(unsigned int seed) : random(seed) {
+        }
+
+        Medium::~Medium() {
+          stop();
+        }
+
+        bool Medium::load(const std::string &environment_path, const std::string &topology_path, double speed) {
+          Yaml topology, definition;
+
+          if (!Yaml::load(topology_path, topology) || !environment.topology(topology)) {
+            LOG(ERROR) << "Malformed topology file " << topology_path;
+            return false;
+          }
+
+          if (!Yaml::load(environment_path, definition) || !environment.environment(definition, speed)) {
+            LOG(ERROR) << "Malformed environment file " << environment_path;
+            return false;
+          }
+
+          return true;
+        }
+
+        bool Medium::start() {
+          const std::vector<std::string> &names = environment.nodes();
+
+          for (size_t i = 0; i < names.size(); i++)
+            radios.push_back(new Device(*this, names[i], 0x0013a20000000000 + i + 1));
+
+          for (Device* radio : radios) {
+            if (!radio->open()) {
+              LOG(ERROR) << "Could not create pty for " << radio->name;
+              return false;
+            }
+
+            for (auto &neighbour : environment.adjacent(radio->name))
+              for (Device* other : radios)
+                if (other->name == neighbour)
+                  radio->adjacent.push_back(other);
+          }
+
+          start_time = std::chrono::steady_clock::now();
+          scheduler_run = true;
+
+          scheduler = std::thread([this]() {
+            THREAD_NAME("EmulatorMedium");
+
+            run();
+          });
+
+          for (Device* radio : radios)
+            radio->start();
+
+          return true;
+        }
+
+        void Medium::stop() {
+          for (Device* radio : radios)
+            radio->stop();
+
+          events_mutex.lock();
+          scheduler_run = false;
+          events = std::priority_queue<Event>();
+          events_mutex.unlock();
+          events_ready.notify_one();
+
+          if (scheduler.joinable())
+            scheduler.join();
+
+          for (Device* radio : radios)
+            delete radio;
+
+          radios.clear();
+        }
+
+        const std::vector<Device*> &Medium::devices() const {
+          return radios;
+        }
+
+        double Medium::now() const {
+          return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        }
+
+        double Medium::edge(const Device &a, const Device &b, const char* name, double fallback) {
+          std::lock_guard<std::mutex> lock(random_mutex);
+
+          return environment.edge(now(), a.name, b.name, name, fallback, random);
+        }
+
+        double Medium::node(const Device &a, const char* name, double fallback) {
+          std::lock_guard<std::mutex> lock(random_mutex);
+
+          return environment.node(now(), a.name, name, fallback, random);
+        }
+
+        void Medium::schedule(double delay, std::function<void()> action) {
+          auto at = std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(std::max(delay, 0.0) * 1000));
+
+          events_mutex.lock();
+          events.push(Event { at, events_order++, action });
+          events_mutex.unlock();
+
+          events_ready.notify_one();
+        }
+
+        void Medium::run() {
+          std::unique_lock<std::mutex> lock(events_mutex);
+
+          while (scheduler_run) {
+            if (events.empty()) {
+              events_ready.wait(lock);
+              continue;
+            }
+
+            // copied, the queue may reallocate while waiting
+            auto at = events.top().at;
+
+            if (at > std::chrono::steady_clock::now()) {
+              events_ready.wait_until(lock, at);
+              continue;
+            }
+
+            std::function<void()> action = events.top().action;
+            events.pop();
+
+            lock.unlock();
+            action();
+            lock.lock();
+          }
+        }
+
+        void Medium::transmit(Device &source, const FrameView &frame) {
+          const TransmitFrame &request = frame.data.transmit;
+          auto data = std::make_shared<std::vector<unsigned char>>(request.data, request.data + frame.length);
+
+          if (request.mac == Frame::BROADCAST) {
+            std::vector<Device*> receivers;
+
+            for (Device* destination : source.adjacent)
+              if (destination->active())
+                receivers.push_back(destination);
+
+            occupy(source, receivers, *data, 1);
+
+            for (Device* destination : receivers)
+              transmit(source, *destination, 0, data, false);
+
+            return;
+          }
+
+          for (Device* destination : source.adjacent) {
+            if (destination->mac == request.mac && destination->active()) {
+              occupy(source, { destination }, *data, transmit(source, *destination, request.id, data, request.id != 0));
+              return;
+            }
+          }
+
+          // destination is not adjacent - route not found, radio tries anyway
+          occupy(source, {}, *data, source.max_retransmissions() + 1);
+          lost_frames++;
+
+          if (request.id != 0)
+            source.status(request.id, source.max_retransmissions(), 0x25);
+        }
+
+        int Medium::transmit(Device &source, Device &destination, uint8_t id, std::shared_ptr<std::vector<unsigned char>> data, bool ack) {
+          int retries = std::max((int)edge(source, destination, "retries", 0), 0);
+          bool failure = node(destination, "power", 1) < 1 || edge(source, destination, "errors", 0) > 0;
+
+          if (failure)
+            retries = destination.max_retransmissions();
+
+          // every attempt takes the edge delay
+          double delay = edge(source, destination, "delay", 0) * (retries + 1);
+
+          transmitted_frames++;
+
+          schedule(delay, [this, &source, &destination, id, data, ack, retries, failure]() {
+            if (failure) {
+              lost_frames++;
+
+              if (ack)
+                source.status(id, retries, 0x01);
+
+              return;
+            }
+
+            destination.receive(source, *data);
+            delivered_frames++;
+
+            if (ack) {
+              schedule(edge(destination, source, "delay", 0) / 2, [&source, id, retries]() {
+                source.status(id, retries, 0x00);
+              });
+            }
+          });
+
+          return retries + 1;
+        }
+
+        void Medium::occupy(Device &source, const std::vector<Device*> &receivers, const std::vector<unsigned char> &data, int attempts) {
+          uint8_t type = data.empty() ? 0 : data[0];
+          uint64_t duration = uint64_t(data.size() + RF_OVERHEAD) * 8 * 1000000 / RF_RATE * attempts;
+
+          type_airtime[type] += duration;
+          type_frames[type] += attempts;
+
+          std::lock_guard<std::mutex> lock(channel_mutex);
+
+          // radio waits for its previous transmission
+          int64_t begin = std::max((int64_t)(now() * 1000000), source.busy);
+
+          for (Device* receiver : receivers) {
+            bool collided = receiver->busy > begin;
+
+            for (Device* other : receiver->adjacent)
+              collided |= other != &source && other->busy > begin;
+
+            collided_frames += collided;
+          }
+
+          source.busy = begin + duration;
+        }
+
+        uint64_t Medium::transmitted() const {
+          return transmitted_frames;
+        }
+
+        uint64_t Medium::delivered() const {
+          return delivered_frames;
+        }
+
+        uint64_t Medium::lost() const {
+          return lost_frames;
+        }
+
+        double Medium::airtime(uint8_t type) const {
+          return type_airtime[type] / 1000.0;
+        }
+
+        uint64_t Medium::frames(uint8_t type) const {
+          return type_frames[type];
+        }
+
+        uint64_t Medium::collisions() const {
+          return collided_frames;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,320 @@
+#ifndef PUT_EMULATOR_MEDIUM_H
+#define PUT_EMULATOR_MEDIUM_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+#include "environment.h"
+#include "../radio.h"
+#include "../router/reader.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      namespace Emulator {
+        class Medium;
+
+        /**
+         * Virtual Xbee 868 radio in API mode, available as pseudo terminal.
+         *
+         * Router opens the slave side of the pty as it would open real serial port.
+         * Radio answers AT commands (FR, NI, ID, SL, SH, PL, MT, RR, DB) and passes
+         * Transmit frames to the Medium, which delivers them as Receive frames
+         * and reports transmission result with Status frame.
+         *
+         * Radio takes part in the network only after it received first frame
+         * (router is attached).
+         */
+        class Device {
+         private:
+          Medium &medium;
+
+          //! Master side of pty
+          int master = -1;
+
+          //! Slave side of pty, held open so master never reads end of file
+          int slave = -1;
+
+          //! Serial port path for the router
+          std::string tty;
+
+          //! Frame decoder (used only by reader thread)
+          FrameReader reader;
+
+          //! Master side write lock
+          std::mutex write_mutex;
+
+          //! Reader thread
+          std::thread thread;
+
+          //! Reader thread status
+          std::atomic<bool> running {false};
+
+          //! True if router is attached
+          std::atomic<bool> attached {false};
+
+          //! Unicast retransmissions (MT/RR command)
+          std::atomic<uint8_t> retransmissions {10};
+
+          //! Handle frame received from the router
+          void handle(const FrameView &frame);
+
+          //! Answer local AT command
+          void command(const FrameView &frame);
+
+         public:
+          //! Node name (from topology)
+          const std::string name;
+
+          //! MAC address, in byte order of the frames (as Node::mac)
+          const uint64_t mac;
+
+          //! Neighbours in topology
+          std::vector<Device*> adjacent;
+
+          //! End of the last transmission of the radio [us since start], guarded by Medium
+          int64_t busy = 0;
+
+          Device(Medium &m, std::string n, uint64_t a);
+
+          ~Device();
+
+          /**
+           * Create pseudo terminal in raw mode.
+           *
+           * @return False if pty could not be created
+           */
+          bool open();
+
+          //! Start reading frames from the router
+          void start();
+
+          //! Stop reader thread
+          void stop();
+
+          //! @return Serial port path for the router
+          const std::string &path() const;
+
+          //! @return True if router is attached
+          bool active() const;
+
+          //! @return Unicast retransmissions limit
+          uint8_t max_retransmissions() const;
+
+          /**
+           * Write frame to the router.
+           *
+           * @param frame Frame
+           */
+          void write(Frame &frame);
+
+          /**
+           * Write Receive frame to the router.
+           *
+           * @param source Transmitting radio
+           * @param data Payload
+           */
+          void receive(const Device &source, const std::vector<unsigned char> &data);
+
+          /**
+           * Write Status frame to the router.
+           *
+           * @param id Frame ID of transmission
+           * @param retries Number of retries
+           * @param status Delivery status (0 - success)
+           */
+          void status(uint8_t id, uint8_t retries, uint8_t status);
+        };
+
+        /**
+         * Radio medium between virtual radios.
+         *
+         * Every unicast transmission has delay, retries and errors sampled from
+         * current Environment conditions of the edge, and power of the receiving
+         * node. Delay is multiplied by number of attempts. Transmission is lost
+         * if edge has errors or node has no power (power < 1) - sender gets Status
+         * with maximal retries and error. Otherwise Receive frame is delivered and
+         * Status follows after half of the reverse edge delay. Broadcasts are
+         * delivered the same way, but without Status.
+         *
+         * Channel time of every transmission is accounted by packet type (the first
+         * byte of frame data), broadcast occupies the channel once, unicast once
+         * per attempt. Radio transmits its frames one after another. If another radio
+         * in range of the receiver transmits at the same time, the frame is counted
+         * as collided (it is still delivered).
+         */
+        class Medium {
+         private:
+          /**
+           * Scheduled delivery.
+           */
+          struct Event {
+            std::chrono::steady_clock::time_point at;
+            uint64_t order;
+            std::function<void()> action;
+
+            bool operator<(const Event &other) const {
+              return at != other.at ? at > other.at : order > other.order;
+            }
+          };
+
+          Environment environment;
+
+          std::vector<Device*> radios;
+
+          //! Emulation start
+          std::chrono::steady_clock::time_point start_time;
+
+          //! Random generator, guarded by random_mutex
+          std::mt19937 random;
+          std::mutex random_mutex;
+
+          //! Scheduled events (earliest first)
+          std::priority_queue<Event> events;
+          uint64_t events_order = 0;
+          std::mutex events_mutex;
+          std::condition_variable events_ready;
+
+          //! Scheduler thread
+          std::thread scheduler;
+          bool scheduler_run = false;
+
+          std::atomic<uint64_t> transmitted_frames {0};
+          std::atomic<uint64_t> delivered_frames {0};
+          std::atomic<uint64_t> lost_frames {0};
+
+          //! Occupied channel time by packet type [us]
+          std::array<std::atomic<uint64_t>, 256> type_airtime {};
+
+          //! Transmissions by packet type
+          std::array<std::atomic<uint64_t>, 256> type_frames {};
+
+          //! Frames which overlapped with another transmission at the receiver
+          std::atomic<uint64_t> collided_frames {0};
+
+          //! Guards Device::busy
+          std::mutex channel_mutex;
+
+          /**
+           * Account channel time of transmission and collisions at receivers.
+           *
+           * @param source Transmitting radio
+           * @param receivers Radios which receive the transmission
+           * @param data Frame data
+           * @param attempts Number of attempts
+           */
+          void occupy(Device &source, const std::vector<Device*> &receivers, const std::vector<unsigned char> &data, int attempts);
+
+          //! @return Seconds since start
+          double now() const;
+
+          //! Sample edge parameter
+          double edge(const Device &a, const Device &b, const char* name, double fallback);
+
+          //! Sample node parameter
+          double node(const Device &a, const char* name, double fallback);
+
+          /**
+           * Run action after delay.
+           *
+           * @param delay Delay [ms]
+           * @param action Action
+           */
+          void schedule(double delay, std::function<void()> action);
+
+          //! Scheduler thread body
+          void run();
+
+          /**
+           * Transmit frame over single edge.
+           *
+           * @return Number of attempts
+           */
+          int transmit(Device &source, Device &destination, uint8_t id, std::shared_ptr<std::vector<unsigned char>> data, bool ack);
+
+         public:
+          //! RF data rate of Xbee 868 [b/s]
+          static const int RF_RATE = 24000;
+
+          //! Approximate framing overhead of single RF transmission (preamble, headers, CRC) [bytes]
+          static const int RF_OVERHEAD = 20;
+
+          /**
+           * Create medium, random generator is seeded with given seed.
+           *
+           * @param seed Random seed
+           */
+          Medium(unsigned int seed = 5489u);
+
+          ~Medium();
+
+          /**
+           * Read topology and environment files.
+           *
+           * @param environment_path Environment definition (*.environment.yml)
+           * @param topology_path Topology definition (*.yml)
+           * @param speed Timeline speed up
+           * @return False if any file is malformed
+           */
+          bool load(const std::string &environment_path, const std::string &topology_path, double speed = 1);
+
+          /**
+           * Create radios (one pty per node) and start emulation.
+           *
+           * @return False if pty could not be created
+           */
+          bool start();
+
+          //! Stop emulation, ptys are closed
+          void stop();
+
+          //! @return Radios, in order of topology file
+          const std::vector<Device*> &devices() const;
+
+          /**
+           * Handle Transmit frame from the router.
+           *
+           * @param source Transmitting radio
+           * @param frame Transmit frame
+           */
+          void transmit(Device &source, const FrameView &frame);
+
+          //! @return Number of transmissions (broadcast counts once per neighbour)
+          uint64_t transmitted() const;
+
+          //! @return Number of delivered Receive frames
+          uint64_t delivered() const;
+
+          //! @return Number of lost transmissions
+          uint64_t lost() const;
+
+          /**
+           * @param type Packet type (the first byte of frame data)
+           * @return Channel time occupied by packets of the type [ms]
+           */
+          double airtime(uint8_t type) const;
+
+          /**
+           * @param type Packet type (the first byte of frame data)
+           * @return Number of transmissions of packets of the type (broadcast counts once)
+           */
+          uint64_t frames(uint8_t type) const;
+
+          //! @return Number of received frames which overlapped with another transmission
+          uint64_t collisions() const;
+        };
+      }
+    }
+  }
+}
+#endif
@@ -0,0 +1,190 @@
+#ifndef PUT_INLINE_VECTOR_H
+#define PUT_INLINE_VECTOR_H
+
+#include <stddef.h>
+
+#include <initializer_list>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * Vector of fixed capacity, elements are stored inline (no allocation).
+       *
+       * Interface follows std::vector where it is needed - elements are
+       * appended with push_back(), which refuses to grow vector over its
+       * capacity. Meant for small trivially copyable types (e.g. Address).
+       */
+      template <typename T, size_t N>
+      class InlineVector {
+       private:
+        //! Elements, only first InlineVector::count are valid
+        T items[N];
+
+        //! Number of elements
+        size_t count = 0;
+
+       public:
+        typedef T value_type;
+        typedef T &reference;
+        typedef const T &const_reference;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+        typedef size_t size_type;
+
+        InlineVector() { }
+
+        InlineVector(std::initializer_list<T> list) {
+          assign(list.begin(), list.end());
+        }
+
+        InlineVector(const InlineVector &v) {
+          assign(v.begin(), v.end());
+        }
+
+        //! Moved from vector is left empty
+        InlineVector(InlineVector &&v) {
+          assign(v.begin(), v.end());
+          v.clear();
+        }
+
+        InlineVector &operator=(const InlineVector &v) {
+          if (this != &v)
+            assign(v.begin(), v.end());
+
+          return *this;
+        }
+
+        InlineVector &operator=(InlineVector &&v) {
+          if (this != &v) {
+            assign(v.begin(), v.end());
+            v.clear();
+          }
+
+          return *this;
+        }
+
+        InlineVector &operator=(std::initializer_list<T> list) {
+          assign(list.begin(), list.end());
+
+          return *this;
+        }
+
+        /**
+         * Replace content with range, elements over capacity are dropped.
+         *
+         * @param first Range begin
+         * @param last Range end
+         */
+        template <typename I>
+        void assign(I first, I last) {
+          for (count = 0; first != last && count < N; ++first)
+            items[count++] = *first;
+        }
+
+        /**
+         * Append element.
+         *
+         * @param value Element
+         * @return False if vector is full (element is not appended)
+         */
+        bool push_back(const T &value) {
+          if (count == N)
+            return false;
+
+          items[count++] = value;
+
+          return true;
+        }
+
+        inline void pop_back() {
+          count--;
+        }
+
+        inline void clear() {
+          count = 0;
+        }
+
+        inline size_t size() const {
+          return count;
+        }
+
+        inline bool empty() const {
+          return count == 0;
+        }
+
+        inline bool full() const {
+          return count == N;
+        }
+
+        static constexpr size_t capacity() {
+          return N;
+        }
+
+        inline T &operator[](size_t i) {
+          return items[i];
+        }
+
+        inline const T &operator[](size_t i) const {
+          return items[i];
+        }
+
+        inline T &front() {
+          return items[0];
+        }
+
+        inline const T &front() const {
+          return items[0];
+        }
+
+        inline T &back() {
+          return items[count - 1];
+        }
+
+        inline const T &back() const {
+          return items[count - 1];
+        }
+
+        inline iterator begin() {
+          return items;
+        }
+
+        inline iterator end() {
+          return items + count;
+        }
+
+        inline const_iterator begin() const {
+          return items;
+        }
+
+        inline const_iterator end() const {
+          return items + count;
+        }
+
+        inline const_iterator cbegin() const {
+          return items;
+        }
+
+        inline const_iterator cend() const {
+          return items + count;
+        }
+
+        bool operator==(const InlineVector &v) const {
+          if (count != v.count)
+            return false;
+
+          for (size_t i = 0; i < count; i++)
+            if (!(items[i] == v.items[i]))
+              return false;
+
+          return true;
+        }
+
+        bool operator!=(const InlineVector &v) const {
+          return !(*this == v);
+        }
+      };
+    }
+  }
+}
+#endif
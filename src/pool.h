@@ -0,0 +1,311 @@
+#ifndef PUT_POOL_H
+#define PUT_POOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <cstddef>
+#include <new>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * Fixed-capacity slab of equally sized blocks.
+       *
+       * Memory for every block is allocated once by configure(), then blocks
+       * are taken from and returned to a free list. Slab which is not configured
+       * (or is exhausted) gives nothing - caller falls back to the heap, so
+       * owns() must be checked before a block is released.
+       */
+      class Slab {
+       private:
+        //! Size of single block
+        const size_t block;
+
+        //! Blocks memory (nullptr until configured)
+        unsigned char* memory = nullptr;
+
+        //! Number of blocks
+        size_t capacity = 0;
+
+        //! Free blocks (stack, recently released block is reused first)
+        std::vector<void*> free_blocks;
+
+        //! Free list lock
+        std::mutex mutex;
+
+        //! Maximal number of blocks used at once
+        size_t peak = 0;
+
+        //! Number of allocations which fell back to the heap
+        std::atomic<uint64_t> fallbacks {0};
+
+       public:
+        /**
+         * Create empty slab.
+         *
+         * @param size Size of single block
+         */
+        Slab(size_t size) : block((size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1)) { }
+
+        //! Blocks are freed, none of them may be used anymore
+        ~Slab() {
+          free(memory);
+        }
+
+        Slab(const Slab &) = delete;
+        Slab &operator=(const Slab &) = delete;
+
+        /**
+         * Allocate blocks. Slab is configured only once, it must be done
+         * before any thread allocates from it.
+         *
+         * @param count Number of blocks (0 keeps slab empty)
+         * @return False if slab was already configured
+         */
+        bool configure(size_t count) {
+          std::lock_guard<std::mutex> lock(mutex);
+
+          if (memory != nullptr || count == 0)
+            return false;
+
+          memory = (unsigned char*)malloc(block * count);
+
+          if (memory == nullptr)
+            return false;
+
+          capacity = count;
+          free_blocks.reserve(count);
+
+          for (size_t i = count; i > 0; i--)
+            free_blocks.push_back(memory + (i - 1) * block);
+
+          return true;
+        }
+
+        /**
+         * Take free block.
+         *
+         * @return Block or nullptr if slab is empty (fallback is counted)
+         */
+        void* allocate() {
+          std::lock_guard<std::mutex> lock(mutex);
+
+          if (free_blocks.empty()) {
+            fallbacks.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+          }
+
+          void* p = free_blocks.back();
+          free_blocks.pop_back();
+
+          peak = std::max(peak, capacity - free_blocks.size());
+
+          return p;
+        }
+
+        /**
+         * Return block to the slab.
+         *
+         * @param p Block
+         * @return False if block is not owned by the slab (it was not released)
+         */
+        bool release(void* p) {
+          if (!owns(p))
+            return false;
+
+          std::lock_guard<std::mutex> lock(mutex);
+          free_blocks.push_back(p);
+
+          return true;
+        }
+
+        //! @return True if pointer is a block of this slab
+        inline bool owns(const void* p) const {
+          return (uintptr_t)p - (uintptr_t)memory < block * capacity;
+        }
+
+        //! @return Size of single block
+        inline size_t block_size() const {
+          return block;
+        }
+
+        //! @return Number of blocks
+        inline size_t size() const {
+          return capacity;
+        }
+
+        //! @return Number of used blocks
+        size_t used() {
+          std::lock_guard<std::mutex> lock(mutex);
+
+          return capacity - free_blocks.size();
+        }
+
+        //! @return Maximal number of blocks used at once
+        size_t max_used() {
+          std::lock_guard<std::mutex> lock(mutex);
+
+          return peak;
+        }
+
+        //! @return Number of allocations which fell back to the heap
+        uint64_t heap_allocations() const {
+          return fallbacks.load(std::memory_order_relaxed);
+        }
+      };
+
+      /**
+       * Pool of objects of single type, used by class specific
+       * operator new and delete:
+       *
+       *     static void* operator new(size_t size) { return Pool<T>::allocate(size); }
+       *     static void operator delete(void* p) { Pool<T>::release(p); }
+       *
+       * Derived classes (of other size) are allocated from the heap.
+       */
+      template <typename T>
+      struct Pool {
+        //! @return Slab of the type (never destroyed, objects may outlive static destructors)
+        static Slab &slab() {
+          static Slab &s = *new Slab(sizeof(T));
+          return s;
+        }
+
+        static void* allocate(size_t size) {
+          void* p = size == sizeof(T) ? slab().allocate() : nullptr;
+
+          return p != nullptr ? p : ::operator new(size);
+        }
+
+        static void release(void* p) {
+          if (!slab().release(p))
+            ::operator delete(p);
+        }
+      };
+
+      /**
+       * Pools of variable sized buffers (frame and packet payloads, paths,
+       * history entries).
+       *
+       * Buffers are taken from the smallest slab they fit in, larger buffers
+       * (and buffers requested when slabs are empty) come from malloc. Every
+       * buffer must be released with Buffers::release(), pointers from malloc
+       * are accepted as well.
+       */
+      struct Buffers {
+        //! Small buffers (container nodes, short payloads)
+        static Slab &small() {
+          static Slab &s = *new Slab(64);
+          return s;
+        }
+
+        //! Large buffers (any payload of a frame, deque chunks)
+        static Slab &large() {
+          static Slab &s = *new Slab(512);
+          return s;
+        }
+
+        //! Number of buffers allocated with malloc
+        static std::atomic<uint64_t> &heap() {
+          static std::atomic<uint64_t> allocations(0);
+          return allocations;
+        }
+
+        /**
+         * Allocate buffer.
+         *
+         * @param size Size of buffer
+         * @return Buffer (never nullptr for size > 0)
+         */
+        static void* allocate(size_t size) {
+          void* p = nullptr;
+
+          if (size <= small().block_size())
+            p = small().allocate();
+
+          if (p == nullptr && size <= large().block_size())
+            p = large().allocate();
+
+          if (p != nullptr)
+            return p;
+
+          heap().fetch_add(1, std::memory_order_relaxed);
+
+          return malloc(size);
+        }
+
+        /**
+         * Release buffer.
+         *
+         * @param p Buffer (from Buffers::allocate() or malloc, may be nullptr)
+         */
+        static void release(void* p) {
+          if (!small().release(p) && !large().release(p))
+            free(p);
+        }
+
+        /**
+         * Resize buffer, content is kept (as realloc).
+         *
+         * @param p Buffer (may be nullptr)
+         * @param length Current length of content
+         * @param size New size of buffer
+         * @return Resized buffer
+         */
+        static void* resize(void* p, size_t length, size_t size) {
+          if ((small().owns(p) && size <= small().block_size()) || (large().owns(p) && size <= large().block_size()))
+            return p;
+
+          void* resized = allocate(size);
+
+          if (p != nullptr)
+            memcpy(resized, p, std::min(length, size));
+
+          release(p);
+
+          return resized;
+        }
+      };
+
+      /**
+       * Standard allocator using Buffers - for containers which live on the
+       * packet path (visited nodes, history).
+       */
+      template <typename T>
+      struct BufferAllocator {
+        typedef T value_type;
+
+        BufferAllocator() { }
+
+        template <typename U>
+        BufferAllocator(const BufferAllocator<U> &) { }
+
+        T* allocate(size_t n) {
+          return (T*)Buffers::allocate(n * sizeof(T));
+        }
+
+        void deallocate(T* p, size_t) {
+          Buffers::release(p);
+        }
+
+        template <typename U>
+        bool operator==(const BufferAllocator<U> &) const {
+          return true;
+        }
+
+        template <typename U>
+        bool operator!=(const BufferAllocator<U> &) const {
+          return false;
+        }
+      };
+    }
+  }
+}
+#endif
@@ -2,6 +2,8 @@
 #define PUT_RADIO_H
 
 #include "common.h"
+#include "pool.h"
+#include "inline_vector.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -12,14 +14,39 @@
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
-      //! Packet ID
-      typedef uint32_t PacketId;
+#ifdef XBEE_WIDE_ADDRESS
+      /**
+       * Node address, 16-bit mode (XBEE_WIDE_ADDRESS is defined).
+       *
+       * Addresses take two bytes on air, so routers built in different
+       * modes do not understand each other.
+       */
+      typedef uint16_t Address;
 
+      //! Size of address space (tables indexed by address are this long)
+      static const uint16_t ADDRESSES = 1024;
+
+      //! Packet ID (destination, source and 8-bit id)
+      typedef uint64_t PacketId;
+#else
       //! Node address
       typedef uint8_t Address;
 
-      //! Path definition
-      typedef std::deque<Address> Path;
+      //! Size of address space (tables indexed by address are this long)
+      static const uint16_t ADDRESSES = 256;
+
+      //! Packet ID (destination, source and 8-bit id)
+      typedef uint32_t PacketId;
+#endif
+
+      //! The last address is reserved (so as 0), valid addresses are 1 till MAX_ADDRESS - 1
+      static const Address MAX_ADDRESS = ADDRESSES - 1;
+
+      //! Path definition (buffers come from Buffers pools)
+      typedef std::deque<Address, BufferAllocator<Address>> Path;
+
+      //! Visited nodes of a packet (Data header with visited nodes must fit 255 bytes)
+      typedef InlineVector<Address, (255 - 4 - 2 * sizeof(Address)) / sizeof(Address)> Visited;
 
       //! Edge definition
       typedef Address Edge[2];
@@ -255,6 +282,8 @@ namespace PUT {
       } ExplicitReceiveFrame;
 
 
+      struct FrameView;
+
       /**
        * General Xbee frame definition.
        */
@@ -299,7 +328,7 @@ namespace PUT {
         /**
          * Union translating frame contents to frame structs
          */
-        union {
+        union Contents {
           //! Modem Status Frame - ModemStatusFrame
           ModemStatusFrame modem_status;
           //! AT Command Frame or Queue Parameter Value Frame - CommandFrame
@@ -339,48 +368,73 @@ namespace PUT {
          */
         Frame(Type t) : length(0), type(t) { };
 
+        /**
+         * Create owning copy of the frame view - variable data is copied.
+         *
+         * @param view Frame view
+         */
+        Frame(const FrameView &view);
+
         /**
          * Destroys frame, frees memory used by data (if any).
+         *
+         * Variable data must be allocated with Buffers::allocate() (or malloc).
          */
         ~Frame() {
           if (length == 0)
             return;
 
-          switch (type) {
+          unsigned char** p = payload(type, data);
+
+          if (p != nullptr)
+            Buffers::release(*p);
+        }
+
+        //! Frames are allocated from Pool
+        static void* operator new(size_t size) {
+          return Pool<Frame>::allocate(size);
+        }
+
+        static void operator delete(void* p) {
+          Pool<Frame>::release(p);
+        }
+
+        /**
+         * Find variable data field of given frame type.
+         *
+         * @param t Frame type
+         * @param contents Frame contents
+         * @return Address of variable data pointer or nullptr if frame type has no variable data
+         */
+        static unsigned char** payload(Type t, Contents &contents) {
+          switch (t) {
             case Type::Command:
             case Type::CommandQueue:
-              free(data.command.data);
-              break;
+              return &contents.command.data;
 
             case Type::CommandResponse:
-              free(data.command_response.data);
-              break;
+              return &contents.command_response.data;
 
             case Type::RemoteCommand:
-              free(data.remote_command.data);
-              break;
+              return &contents.remote_command.data;
 
             case Type::RemoteCommandResponse:
-              free(data.remote_command_response.data);
-              break;
+              return &contents.remote_command_response.data;
 
             case Type::Transmit:
-              free(data.transmit.data);
-              break;
+              return &contents.transmit.data;
 
             case Type::ExplicitTransmit:
-              free(data.explicit_transmit.data);
-              break;
+              return &contents.explicit_transmit.data;
 
             case Type::Receive:
-              free(data.receive.data);
-              break;
+              return &contents.receive.data;
 
             case Type::ExplicitReceive:
-              free(data.explicit_receive.data);
+              return &contents.explicit_receive.data;
 
             default:
-              break;
+              return nullptr;
           }
         }
 
@@ -392,10 +446,24 @@ namespace PUT {
          * Xbee modem.
          *
          * @param packet_length Length of generated packet
-         * @return Byte array ready to send to Xbee
+         * @return Byte array ready to send to Xbee (must be freed)
          */
         unsigned char* serialize(int &packet_length) {
-          unsigned char* frame = (unsigned char*)malloc(300);
+          unsigned char* frame = (unsigned char*)malloc(MAX_SIZE);
+
+          packet_length = serialize(frame);
+
+          return frame;
+        }
+
+        /**
+         * Serialize current frame into caller provided byte array.
+         *
+         * @param frame Byte array of at least Frame::MAX_SIZE bytes
+         * @return Length of generated packet
+         */
+        int serialize(unsigned char* frame) {
+          int packet_length;
           uint16_t offset = length;
           length = 0;
 
@@ -468,15 +536,65 @@ namespace PUT {
 
           length = offset;
 
-          return frame;
+          return packet_length;
         }
 
+        /**
+         * Unserializes byte array received from Xbee radio into
+         * current frame. Variable data is copied.
+         *
+         * @param frame Byte array representing frame received from Xbee
+         */
+        void unserialize(unsigned char* frame);
+
+        /**
+         * Copy frame view into current frame. Variable data is copied,
+         * current frame must not own any data.
+         *
+         * @param view Frame view
+         */
+        void assign(const FrameView &view);
+
+        //! Broadcast address
+        static const unsigned long long int BROADCAST = 0xFFFF000000000000;
+
+        //! Maximal size of serialized frame (with delimiter, length and checksum)
+        static const int MAX_SIZE = 300;
+      } Frame;
+
 #define READ_STRUCT(_f,_l) memcpy(&data._f, &frame[4], _l); offset += _l;
-#define READ_DATA(_f) data._f.data = (unsigned char*)malloc(length-offset+1); memcpy(data._f.data, &frame[4+offset], length - offset-1);
+#define READ_DATA(_f) data._f.data = &frame[4+offset];
+
+      /**
+       * Non-owning view of Xbee frame.
+       *
+       * Fields are the same as in Frame, however variable data points directly
+       * into the byte array the view was unserialized from (usually FrameReader
+       * buffer), so no memory is allocated. View is valid as long as the byte
+       * array is not modified.
+       *
+       * @see Frame
+       * @see FrameReader
+       */
+      typedef struct FrameView {
+        //! Length of the data field (as in Frame::length)
+        uint16_t length = 0;
+
+        //! Frame type
+        Frame::Type type = (Frame::Type)0x00;
+
+        //! Frame contents, variable data is not owned
+        Frame::Contents data;
+
+        //! Checksum of the frame
+        uint8_t checksum = 0;
+
+        //! True size of unserialized frame
+        int size = 0;
 
         /**
          * Unserializes byte array received from Xbee radio into
-         * current frame.
+         * current view. Byte array must outlive the view.
          *
          * @param frame Byte array representing frame received from Xbee
          */
@@ -484,55 +602,55 @@ namespace PUT {
           uint16_t offset = 0;
 
           length = frame[2] | (((uint16_t)frame[1]) << 8);
-          type = (Type)frame[3];
+          type = (Frame::Type)frame[3];
           checksum = frame[3 + length];
 
           switch (type) {
-            case Type::ModemStatus:
+            case Frame::Type::ModemStatus:
               READ_STRUCT(modem_status, 1);
               break;
 
-            case Type::Command:
-            case Type::CommandQueue:
+            case Frame::Type::Command:
+            case Frame::Type::CommandQueue:
               READ_STRUCT(command, 3);
               READ_DATA(command);
               break;
 
-            case Type::CommandResponse:
+            case Frame::Type::CommandResponse:
               READ_STRUCT(command_response, 4);
               READ_DATA(command_response);
               break;
 
-            case Type::RemoteCommand:
+            case Frame::Type::RemoteCommand:
               READ_STRUCT(remote_command, 14);
               READ_DATA(remote_command);
               break;
 
-            case Type::RemoteCommandResponse:
+            case Frame::Type::RemoteCommandResponse:
               READ_STRUCT(remote_command_response, 14);
               READ_DATA(remote_command_response);
               break;
 
-            case Type::Transmit:
+            case Frame::Type::Transmit:
               READ_STRUCT(transmit, 13);
               READ_DATA(transmit);
               break;
 
-            case Type::ExplicitTransmit:
+            case Frame::Type::ExplicitTransmit:
               READ_STRUCT(explicit_transmit, 19);
               READ_DATA(explicit_transmit);
               break;
 
-            case Type::Status:
+            case Frame::Type::Status:
               READ_STRUCT(status, 6);
               break;
 
-            case Type::Receive:
+            case Frame::Type::Receive:
               READ_STRUCT(receive, 11);
               READ_DATA(receive);
               break;
 
-            case Type::ExplicitReceive:
+            case Frame::Type::ExplicitReceive:
               READ_STRUCT(explicit_receive, 17);
               READ_DATA(explicit_receive);
               break;
@@ -542,9 +660,54 @@ namespace PUT {
           length -= offset + 1;
         }
 
-        //! Broadcast address
-        static const unsigned long long int BROADCAST = 0xFFFF000000000000;
-      } Frame;
+        /**
+         * Point current view at frame, variable data stays owned by the frame.
+         *
+         * @param frame Frame which must outlive the view
+         */
+        void assign(const Frame &frame) {
+          length = frame.length;
+          type = frame.type;
+          data = frame.data;
+          checksum = frame.checksum;
+          size = frame.size;
+        }
+      } FrameView;
+
+      inline Frame::Frame(const FrameView &view) : length(0), type(view.type) {
+        assign(view);
+      }
+
+      inline void Frame::assign(const FrameView &view) {
+        length = view.length;
+        type = view.type;
+        data = view.data;
+        checksum = view.checksum;
+        size = view.size;
+
+        unsigned char** p = payload(type, data);
+
+        if (p == nullptr)
+          return;
+
+        // data still points into the view's byte array
+        unsigned char* source = *p;
+
+        if (length == 0) {
+          *p = nullptr;
+          return;
+        }
+
+        *p = (unsigned char*)Buffers::allocate(length);
+        memcpy(*p, source, length);
+      }
+
+      inline void Frame::unserialize(unsigned char* frame) {
+        FrameView view;
+        view.unserialize(frame);
+
+        assign(view);
+      }
 
 // End of magic
 #pragma pack(pop)
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <glog/logging.h>
+
+#include "../common.h"
+#include "../radio.h"
+#include "../router/reader.h"
+#include "../router/capture.h"
+
+using namespace PUT::CS::XbeeRouting;
+
+/**
+ * Captured frame.
+ */
+struct Record {
+  //! Time since capture start [us]
+  uint64_t time;
+  Capture::Direction direction;
+  //! Raw API frame
+  std::vector<unsigned char> bytes;
+
+  Frame::Type type() const {
+    return (Frame::Type)(bytes.size() > 3 ? bytes[3] : 0);
+  }
+};
+
+/**
+ * Radio replaying the capture on master side of pty.
+ *
+ * Local AT commands of the router are answered with captured responses
+ * (so router gets identity of the captured radio), any other frame
+ * of the router is only counted.
+ */
+struct Replay {
+  int master = -1;
+  int slave = -1;
+  std::string tty;
+
+  //! Captured responses to local AT commands, by command
+  std::map<std::string, std::vector<unsigned char>> answers;
+
+  std::mutex write_mutex;
+  std::thread thread;
+  std::atomic<bool> running {false};
+
+  //! True after router sent its first Transmit frame (router runs)
+  std::atomic<bool> started {false};
+
+  //! Number of frames written by the router
+  std::atomic<uint64_t> received {0};
+
+  //! Last frame written by the router [ns of steady clock]
+  std::atomic<int64_t> activity {0};
+
+  bool open() {
+    struct termios options;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0)
+      return false;
+
+    tty = ptsname(master);
+    slave = ::open(tty.c_str(), O_RDWR | O_NOCTTY);
+
+    if (slave == -1)
+      return false;
+
+    tcgetattr(slave, &options);
+    cfmakeraw(&options);
+    tcsetattr(slave, TCSANOW, &options);
+
+    return true;
+  }
+
+  void write(const unsigned char* bytes, size_t length) {
+    size_t offset = 0;
+    ssize_t status;
+
+    std::lock_guard<std::mutex> lock(write_mutex);
+
+    while (offset < length) {
+      status = ::write(master, bytes + offset, length - offset);
+
+      if (status == -1 && errno == EINTR)
+        continue;
+
+      if (status == -1) {
+        LOG(WARNING) << "Could not write frame (" << strerror(errno) << ")";
+        return;
+      }
+
+      offset += status;
+    }
+  }
+
+  void write(Frame &frame) {
+    unsigned char bytes[Frame::MAX_SIZE];
+
+    write(bytes, frame.serialize(bytes));
+  }
+
+  void command(const FrameView &frame) {
+    const CommandFrame &request = frame.data.command;
+    auto answer = answers.find(std::string((const char*)request.command, 2));
+
+    if (request.id != 0 && answer != answers.end()) {
+      // captured response with frame ID of the request
+      std::vector<unsigned char> bytes = answer->second;
+      unsigned char checksum = 0;
+
+      bytes[4] = request.id;
+
+      for (size_t i = 3; i < bytes.size() - 1; i++)
+        checksum += bytes[i];
+
+      bytes.back() = 0xFF - checksum;
+      write(bytes.data(), bytes.size());
+    } else if (request.id != 0) {
+      Frame response(Frame::Type::CommandResponse);
+
+      response.data.command_response.id = request.id;
+      memcpy(response.data.command_response.command, request.command, 2);
+      response.data.command_response.status = 0;
+      response.data.command_response.data = nullptr;
+
+      write(response);
+    }
+
+    if (memcmp(request.command, "FR", 2) == 0) {
+      Frame reset(Frame::Type::ModemStatus);
+      reset.data.modem_status.status = 0x00;
+
+      write(reset);
+    }
+  }
+
+  void start() {
+    running = true;
+
+    thread = std::thread([this]() {
+      THREAD_NAME("ReplayRadio");
+      struct pollfd input = { master, POLLIN, 0 };
+      FrameReader reader;
+      FrameView frame;
+
+      while (running) {
+        while (reader.next(frame)) {
+          received++;
+          activity = std::chrono::steady_clock::now().time_since_epoch().count();
+
+          if (frame.type == Frame::Type::Command || frame.type == Frame::Type::CommandQueue)
+            command(frame);
+          else if (frame.type == Frame::Type::Transmit)
+            started = true;
+        }
+
+        if (poll(&input, 1, 100) <= 0)
+          continue;
+
+        if (reader.fill(master) <= 0)
+          break;
+      }
+    });
+  }
+
+  void stop() {
+    running = false;
+
+    if (thread.joinable())
+      thread.join();
+  }
+};
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-s SPEED] [-w QUIET] [-d] CAPTURE [COMMAND ARGS...]\n", name);
+  fprintf(stderr, "  -s SPEED  Replay speed up (0 - as fast as possible)\n");
+  fprintf(stderr, "  -w QUIET  Router is done when it is quiet for QUIET ms (default 500)\n");
+  fprintf(stderr, "  -d        Print the capture and exit\n");
+  fprintf(stderr, "  COMMAND   Router to start, {} is replaced with TTY\n");
+}
+
+static bool load(const char* path, std::vector<Record> &records, uint64_t &started) {
+  FILE* file = fopen(path, "rb");
+  Capture::Record header;
+  Record record;
+
+  if (file == NULL)
+    return false;
+
+  if (!Capture::read_header(file, started)) {
+    fclose(file);
+    return false;
+  }
+
+  while (Capture::read(file, header, record.bytes)) {
+    record.time = header.time;
+    record.direction = header.direction;
+    records.push_back(record);
+  }
+
+  fclose(file);
+
+  return true;
+}
+
+static void dump(const std::vector<Record> &records) {
+  for (const Record &record : records) {
+    bool received = record.direction == Capture::Direction::Received;
+
+    printf("%10.6f %s \033[0;%dm", record.time / 1e6, received ? "<" : ">", received ? 33 : 32);
+
+    for (unsigned char byte : record.bytes)
+      printf("%.2X ", byte);
+
+    printf("\033[0m\n");
+  }
+}
+
+//! CPU time of process (all threads) [s], negative if process is gone
+static double cpu_time(pid_t pid) {
+  char path[64];
+  unsigned long user, system;
+
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  FILE* file = fopen(path, "r");
+
+  if (file == NULL)
+    return -1;
+
+  // process name may contain spaces, fields are counted after closing parenthesis
+  int read = fscanf(file, "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system);
+  fclose(file);
+
+  return read == 2 ? (double)(user + system) / sysconf(_SC_CLK_TCK) : -1;
+}
+
+static pid_t spawn(char* argv[], int argc, const std::string &tty) {
+  std::vector<char*> arguments;
+
+  for (int i = 0; i < argc; i++)
+    arguments.push_back(strcmp(argv[i], "{}") == 0 ? (char*)tty.c_str() : argv[i]);
+
+  arguments.push_back(NULL);
+
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    execvp(arguments[0], arguments.data());
+    fprintf(stderr, "Could not start %s (%s)\n", arguments[0], strerror(errno));
+    _exit(127);
+  }
+
+  return pid;
+}
+
+static bool alive(pid_t pid) {
+  return pid == -1 || waitpid(pid, NULL, WNOHANG) == 0;
+}
+
+/**
+ * Capture replay - serves frames received in the capture (Capture) on a pty,
+ * keeping their original timing divided by the speed up. Router command may be
+ * given, then router is started on the pty and its CPU time per replayed
+ * frame is reported. Otherwise "REPLAY TTY" is printed and replay starts
+ * when router is attached.
+ *
+ * Replay starts after router sent its first Transmit frame (startup is
+ * finished), command responses and modem status of the capture are not
+ * replayed - router gets its own. CPU time is counted in clock ticks,
+ * so per frame cost is meaningful only for captures of many frames.
+ */
+int main(int argc, char* argv[]) {
+  double speed = 1;
+  int quiet = 500;
+  bool print = false;
+  int option;
+
+  google::InitGoogleLogging(argv[0]);
+
+  // options end at capture path, rest is the router command
+  while ((option = getopt(argc, argv, "+s:w:dh")) != -1) {
+    switch (option) {
+      case 's': speed = atof(optarg); break;
+      case 'w': quiet = atoi(optarg); break;
+      case 'd': print = true; break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc || speed < 0 || quiet <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<Record> records;
+  uint64_t captured;
+
+  if (!load(argv[optind], records, captured)) {
+    fprintf(stderr, "%s is not a capture\n", argv[optind]);
+    return 1;
+  }
+
+  if (print) {
+    dump(records);
+    return 0;
+  }
+
+  Replay replay;
+  std::vector<const Record*> frames;
+
+  for (const Record &record : records) {
+    if (record.direction != Capture::Direction::Received || record.bytes.size() < 5)
+      continue;
+
+    if (record.type() == Frame::Type::CommandResponse) {
+      std::string command((const char*)record.bytes.data() + 5, 2);
+
+      if (replay.answers.count(command) == 0)
+        replay.answers[command] = record.bytes;
+    } else if (record.type() != Frame::Type::ModemStatus) {
+      frames.push_back(&record);
+    }
+  }
+
+  if (frames.empty()) {
+    fprintf(stderr, "Nothing to replay\n");
+    return 1;
+  }
+
+  if (!replay.open()) {
+    fprintf(stderr, "Could not create pty\n");
+    return 1;
+  }
+
+  replay.start();
+
+  pid_t router = -1;
+
+  if (optind + 1 < argc) {
+    router = spawn(argv + optind + 1, argc - optind - 1, replay.tty);
+  } else {
+    printf("REPLAY TTY %s\n", replay.tty.c_str());
+    fflush(stdout);
+  }
+
+  auto attached = std::chrono::steady_clock::now();
+
+  // router without heartbeat is still replayed, after a while
+  while (!replay.started && alive(router) && (router == -1 || std::chrono::steady_clock::now() - attached < std::chrono::seconds(10)))
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  if (!alive(router)) {
+    fprintf(stderr, "Router exited before replay\n");
+    return 1;
+  }
+
+  double cpu_start = router != -1 ? cpu_time(router) : -1;
+  uint64_t received_start = replay.received;
+  int64_t lag = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (const Record* frame : frames) {
+    if (speed > 0) {
+      auto at = start + std::chrono::microseconds((int64_t)((frame->time - frames.front()->time) / speed));
+
+      std::this_thread::sleep_until(at);
+      lag = std::max(lag, (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - at).count());
+    }
+
+    replay.write(frame->bytes.data(), frame->bytes.size());
+  }
+
+  auto fed = std::chrono::steady_clock::now();
+
+  // router is done when it stops writing
+  while (alive(router)) {
+    auto last = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(replay.activity.load()));
+
+    if (std::chrono::steady_clock::now() - std::max(last, fed) >= std::chrono::milliseconds(quiet))
+      break;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  double cpu_end = router != -1 ? cpu_time(router) : -1;
+  double duration = std::chrono::duration<double>(fed - start).count();
+
+  if (router != -1) {
+    kill(router, SIGTERM);
+    waitpid(router, NULL, 0);
+  }
+
+  replay.stop();
+  close(replay.slave);
+  close(replay.master);
+
+  printf("replayed %zu frames in %.3f s (%.0f frames/s), max lag %.3f ms\n",
+         frames.size(), duration, duration > 0 ? frames.size() / duration : 0.0, lag / 1e3);
+  printf("router wrote %llu frames\n", (unsigned long long)(replay.received - received_start));
+
+  if (cpu_start >= 0 && cpu_end >= 0)
+    printf("router cpu %.3f s, %.1f us per frame\n", cpu_end - cpu_start, (cpu_end - cpu_start) * 1e6 / frames.size());
+
+  return 0;
+}
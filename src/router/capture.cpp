@@ -0,0 +1,105 @@
+#include "capture.h"
+
+#include <string.h>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      const char Capture::magic[8] = { 'X', 'B', 'E', 'E', 'C', 'A', 'P', 1 };
+
+      const std::chrono::milliseconds Capture::flush_interval(500);
+
+      bool Capture::open(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        file = fopen(path.c_str(), "wb");
+
+        if (file == NULL)
+          return false;
+
+        // records are small, system call is made once per buffer
+        setvbuf(file, NULL, _IOFBF, 1 << 16);
+
+        uint64_t started = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        start = std::chrono::steady_clock::now();
+        flushed = start;
+
+        fwrite(magic, sizeof(magic), 1, file);
+        fwrite(&started, sizeof(started), 1, file);
+
+        return true;
+      }
+
+      void Capture::close() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (file != NULL)
+          fclose(file);
+
+        file = NULL;
+      }
+
+      Capture::~Capture() {
+        close();
+      }
+
+      void Capture::record(Direction direction, const unsigned char* frame, size_t length) {
+        Record header;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (file == NULL)
+          return;
+
+        // time is taken under the lock, so records are in order
+        auto now = std::chrono::steady_clock::now();
+
+        header.time = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+        header.direction = direction;
+        header.length = length;
+
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(frame, length, 1, file);
+        records++;
+
+        if (now - flushed >= flush_interval) {
+          fflush(file);
+          flushed = now;
+        }
+      }
+
+      void Capture::flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (file != NULL)
+          fflush(file);
+
+        flushed = std::chrono::steady_clock::now();
+      }
+
+      uint64_t Capture::recorded() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return records;
+      }
+
+      bool Capture::read_header(FILE* file, uint64_t &started) {
+        char header[sizeof(magic)];
+
+        if (fread(header, sizeof(header), 1, file) != 1 || memcmp(header, magic, sizeof(magic)) != 0)
+          return false;
+
+        return fread(&started, sizeof(started), 1, file) == 1;
+      }
+
+      bool Capture::read(FILE* file, Record &record, std::vector<unsigned char> &frame) {
+        if (fread(&record, sizeof(record), 1, file) != 1)
+          return false;
+
+        frame.resize(record.length);
+
+        return record.length == 0 || fread(frame.data(), record.length, 1, file) == 1;
+      }
+    }
+  }
+}
@@ -0,0 +1,131 @@
+#ifndef PUT_RADIO_CAPTURE_H
+#define PUT_RADIO_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * Binary capture of serial traffic between router and Xbee radio.
+       *
+       * File starts with 8-byte magic ("XBEECAP" and version byte) followed by
+       * capture start time (microseconds since epoch, uint64). Then records follow,
+       * every record is Capture::Record header and raw API frame (from start
+       * delimiter to checksum). Integers are in host byte order, so capture
+       * is replayed on machine of the same endianness.
+       *
+       * Recording is cheap - record is appended to buffered file under a short lock,
+       * so both receiving and writer threads may record. Buffer is written
+       * when record comes flush_interval after previous write, or by flush()
+       * (owner should call it when traffic stops). Capture of killed router
+       * loses only its last records.
+       */
+      class Capture {
+       public:
+        //! Direction of the frame
+        enum class Direction : uint8_t {
+          //! Frame received from the radio
+          Received = 0,
+          //! Frame written to the radio
+          Sent = 1
+        };
+
+#pragma pack(push)
+#pragma pack(1)
+        /**
+         * Record header.
+         */
+        struct Record {
+          //! Time since capture start [us]
+          uint64_t time;
+          //! Direction
+          Direction direction;
+          //! Length of the frame
+          uint16_t length;
+        };
+#pragma pack(pop)
+
+        //! File magic, last byte is format version
+        static const char magic[8];
+
+        //! Longest time records stay in the buffer while traffic continues
+        static const std::chrono::milliseconds flush_interval;
+
+       private:
+        //! Capture file
+        FILE* file = NULL;
+
+        //! File lock
+        std::mutex mutex;
+
+        //! Capture start
+        std::chrono::steady_clock::time_point start;
+
+        //! Last write of the buffer
+        std::chrono::steady_clock::time_point flushed;
+
+        //! Number of recorded frames
+        uint64_t records = 0;
+
+       public:
+        /**
+         * Create capture file, existing file is truncated.
+         *
+         * @param path File path
+         * @return False if file could not be created
+         */
+        bool open(const std::string &path);
+
+        /**
+         * Write buffered records and close the file.
+         */
+        void close();
+
+        ~Capture();
+
+        /**
+         * Append frame to the capture.
+         *
+         * @param direction Direction
+         * @param frame Raw API frame
+         * @param length Frame length
+         */
+        void record(Direction direction, const unsigned char* frame, size_t length);
+
+        //! Write buffered records to the file
+        void flush();
+
+        //! @return Number of recorded frames
+        uint64_t recorded();
+
+        /**
+         * Read capture file header.
+         *
+         * @param file Capture file
+         * @param started Capture start time (microseconds since epoch)
+         * @return False if file is not a capture
+         */
+        static bool read_header(FILE* file, uint64_t &started);
+
+        /**
+         * Read next record.
+         *
+         * @param file Capture file
+         * @param record Record header
+         * @param frame Raw API frame
+         * @return False on end of file (or truncated record)
+         */
+        static bool read(FILE* file, Record &record, std::vector<unsigned char> &frame);
+      };
+    }
+  }
+}
+#endif
@@ -0,0 +1,276 @@
+#include "checkpoint.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <algorithm>
+
+#include "network.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      const char Checkpoint::magic[8] = { 'X', 'B', 'E', 'E', 'T', 'O', 'P', sizeof(Address) };
+
+      //! Slots are resized in pages
+      static const size_t PAGE = 4096;
+
+      //! FNV-1a hash of bytes, continued from hash
+      static uint32_t fnv(const unsigned char* data, size_t length, uint32_t hash = 2166136261u) {
+        for (size_t i = 0; i < length; i++)
+          hash = (hash ^ data[i]) * 16777619u;
+
+        return hash;
+      }
+
+      //! Checksum of slot, as if Header::checksum was 0
+      static uint32_t checksum(const Checkpoint::Header* header) {
+        Checkpoint::Header copy = *header;
+        size_t length = header->nodes * sizeof(Checkpoint::NodeRecord) + header->edges * sizeof(Checkpoint::EdgeRecord);
+
+        copy.checksum = 0;
+
+        return fnv(reinterpret_cast<const unsigned char*>(header + 1), length, fnv(reinterpret_cast<const unsigned char*>(&copy), sizeof(copy)));
+      }
+
+      //! @return Wall clock time [ms since epoch]
+      static uint64_t wall() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+      }
+
+      bool Checkpoint::open(const std::string &path) {
+        struct stat status;
+
+        close();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        descriptor = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+        if (descriptor < 0)
+          return false;
+
+        if (fstat(descriptor, &status) != 0 || !resize(size_t(status.st_size) / 2)) {
+          ::close(descriptor);
+          descriptor = -1;
+          return false;
+        }
+
+        const Header* header = latest();
+        generation = header != nullptr ? header->generation : 0;
+
+        return true;
+      }
+
+      void Checkpoint::close() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (map != nullptr)
+          munmap(map, 2 * capacity);
+
+        if (descriptor >= 0)
+          ::close(descriptor);
+
+        map = nullptr;
+        capacity = 0;
+        descriptor = -1;
+      }
+
+      Checkpoint::~Checkpoint() {
+        close();
+      }
+
+      bool Checkpoint::opened() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return map != nullptr;
+      }
+
+      bool Checkpoint::resize(size_t size) {
+        // slots are rounded up to pages, empty file gets single page slots
+        size_t rounded = std::max(PAGE, (size + PAGE - 1) / PAGE * PAGE);
+
+        if (map != nullptr && rounded == capacity)
+          return true;
+
+        if (map != nullptr)
+          munmap(map, 2 * capacity);
+
+        map = nullptr;
+        capacity = 0;
+
+        if (ftruncate(descriptor, 2 * rounded) != 0)
+          return false;
+
+        void* mapped = mmap(NULL, 2 * rounded, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+
+        if (mapped == MAP_FAILED)
+          return false;
+
+        map = static_cast<unsigned char*>(mapped);
+        capacity = rounded;
+
+        return true;
+      }
+
+      const Checkpoint::Header* Checkpoint::slot(int i) const {
+        const Header* header = reinterpret_cast<const Header*>(map + i * capacity);
+
+        if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->generation % 2 != uint64_t(i))
+          return nullptr;
+
+        if (sizeof(Header) + header->nodes * sizeof(NodeRecord) + uint64_t(header->edges) * sizeof(EdgeRecord) > capacity)
+          return nullptr;
+
+        return checksum(header) == header->checksum ? header : nullptr;
+      }
+
+      const Checkpoint::Header* Checkpoint::latest() const {
+        const Header* a = slot(0);
+        const Header* b = slot(1);
+
+        if (a == nullptr || (b != nullptr && b->generation > a->generation))
+          return b;
+
+        return a;
+      }
+
+      void Checkpoint::write(uint64_t generation, const std::vector<NodeRecord> &nodes, const std::vector<EdgeRecord> &edges) {
+        Header* header = reinterpret_cast<Header*>(map + (generation % 2) * capacity);
+        unsigned char* records = reinterpret_cast<unsigned char*>(header + 1);
+
+        // slot is invalid while records are written, header comes last
+        memset(header, 0, sizeof(Header));
+
+        memcpy(records, nodes.data(), nodes.size() * sizeof(NodeRecord));
+        memcpy(records + nodes.size() * sizeof(NodeRecord), edges.data(), edges.size() * sizeof(EdgeRecord));
+
+        Header written;
+        memcpy(written.magic, magic, sizeof(magic));
+        written.generation = generation;
+        written.written = wall();
+        written.nodes = nodes.size();
+        written.edges = edges.size();
+        written.checksum = 0;
+
+        memcpy(header, &written, sizeof(Header));
+        header->checksum = checksum(header);
+      }
+
+      bool Checkpoint::save(const Network &network) {
+        std::shared_ptr<const Snapshot> s = network.current();
+        std::vector<NodeRecord> nodes;
+        std::vector<EdgeRecord> edges;
+
+        // single snapshot, so nodes and edges match
+        for (int a = 1; a < MAX_ADDRESS; a++) {
+          if (s->nodes[a] == nullptr)
+            continue;
+
+          NodeRecord node;
+          node.address = a;
+          node.mac = s->directory.mac(a);
+          nodes.push_back(node);
+
+          for (const Snapshot::Link* link = s->begin(a); link != s->end(a); link++) {
+            if (link->node < a)
+              continue;
+
+            EdgeRecord edge;
+            edge.a = a;
+            edge.b = link->node;
+            edge.retries = link->parameters.retries;
+            edge.losses = link->parameters.losses;
+            edge.delay = link->parameters.delay;
+            edge.measured = link->parameters.updated != 0;
+            edges.push_back(edge);
+          }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (map == nullptr)
+          return false;
+
+        size_t size = sizeof(Header) + nodes.size() * sizeof(NodeRecord) + edges.size() * sizeof(EdgeRecord);
+
+        if (size > capacity) {
+          // slots move when the file grows, so both are written
+          if (!resize(size + size / 2))
+            return false;
+
+          write(++generation, nodes, edges);
+        }
+
+        write(++generation, nodes, edges);
+
+        // written back by the kernel, router does not wait for the disk
+        msync(map, 2 * capacity, MS_ASYNC);
+
+        return true;
+      }
+
+      bool Checkpoint::restore(Network &network, size_t &nodes, size_t &edges) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        nodes = 0;
+        edges = 0;
+
+        const Header* header = map != nullptr ? latest() : nullptr;
+
+        if (header == nullptr)
+          return false;
+
+        const NodeRecord* node = reinterpret_cast<const NodeRecord*>(header + 1);
+        const EdgeRecord* edge = reinterpret_cast<const EdgeRecord*>(node + header->nodes);
+        uint64_t now = wall();
+        uint64_t halvings = now > header->written ? (now - header->written) / Parameters::HALF_LIFE : 0;
+        uint64_t measured = Network::clock();
+
+        std::lock_guard<std::mutex> graph(network.graphLock);
+        Address self = network.self_node->address;
+
+        for (int i = 0; i < header->nodes; i++, node++) {
+          Address a = node->address;
+
+          if (a == self || !network.insert(a))
+            continue;
+
+          network.nodes[a].mac = node->mac;
+          network.directory.set(a, node->mac);
+          nodes++;
+        }
+
+        for (uint32_t i = 0; i < header->edges; i++, edge++) {
+          if (!network.connect(edge->a, edge->b))
+            continue;
+
+          Parameters* parameters = network.topology.edge(edge->a, edge->b);
+
+          // measures age as if no sample came since the checkpoint
+          if (edge->measured) {
+            parameters->retries = halvings < 32 ? edge->retries >> halvings : 0;
+            parameters->losses = halvings < 32 ? edge->losses >> halvings : 0;
+            parameters->updated = measured;
+          } else {
+            parameters->retries = edge->retries;
+            parameters->losses = edge->losses;
+          }
+
+          parameters->delay = edge->delay;
+          edges++;
+        }
+
+        // the whole topology is published at once
+        network.graph_version++;
+        network.publish();
+
+        return true;
+      }
+    }
+  }
+}
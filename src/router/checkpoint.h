@@ -0,0 +1,145 @@
+#ifndef PUT_RADIO_CHECKPOINT_H
+#define PUT_RADIO_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "../radio.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      class Network;
+
+      /**
+       * Topology of the network kept on disk for warm restart - nodes with
+       * MAC addresses and edges with their Parameters.
+       *
+       * File is memory mapped and holds two slots of the same size, which
+       * are written alternately. Slot starts with Checkpoint::Header, then
+       * Checkpoint::NodeRecord and Checkpoint::EdgeRecord arrays follow.
+       * Header is written last and its checksum covers the whole slot, so
+       * slot torn by crash is invalid and the other one (previous
+       * generation) is restored. Integers are in host byte order - the
+       * checkpoint is restored by the router which wrote it.
+       *
+       * Restored topology is provisional: measured edges are aged as if no
+       * sample came since the checkpoint was written (Parameters::decay()),
+       * neighbours of self are dropped unless their heartbeat comes and
+       * advertisements of other nodes replace their edges.
+       */
+      class Checkpoint {
+       public:
+#pragma pack(push)
+#pragma pack(1)
+        //! Slot header
+        struct Header {
+          //! Checkpoint::magic
+          char magic[8];
+          //! Increased with every write
+          uint64_t generation;
+          //! Time of write [ms since epoch]
+          uint64_t written;
+          //! Number of node records
+          uint16_t nodes;
+          //! Number of edge records
+          uint32_t edges;
+          //! FNV-1a of the slot, computed with this field equal to 0
+          uint32_t checksum;
+        };
+
+        //! Node in the network
+        struct NodeRecord {
+          Address address;
+          //! MAC address (0 if unknown)
+          uint64_t mac;
+        };
+
+        //! Edge and its Parameters
+        struct EdgeRecord {
+          Address a;
+          Address b;
+          uint32_t retries;
+          uint32_t losses;
+          uint32_t delay;
+          //! 1 if edge was measured by self (Parameters::updated was set)
+          uint8_t measured;
+        };
+#pragma pack(pop)
+
+        //! File magic, last byte is format version (size of Address, so the other address mode is not read)
+        static const char magic[8];
+
+       private:
+        //! File descriptor (-1 if closed)
+        int descriptor = -1;
+
+        //! Mapped file, both slots
+        unsigned char* map = nullptr;
+
+        //! Size of single slot
+        size_t capacity = 0;
+
+        //! Generation of the latest valid slot
+        uint64_t generation = 0;
+
+        std::mutex mutex;
+
+        //! @return Valid header of slot or nullptr, mutex must be held
+        const Header* slot(int i) const;
+
+        //! @return Valid header of the latest generation or nullptr, mutex must be held
+        const Header* latest() const;
+
+        //! Write records into slot of generation, mutex must be held
+        void write(uint64_t generation, const std::vector<NodeRecord> &nodes, const std::vector<EdgeRecord> &edges);
+
+        //! Resize file and map it again, mutex must be held
+        bool resize(size_t size);
+
+       public:
+        /**
+         * Open checkpoint file, it is created if missing.
+         *
+         * @param path File path
+         * @return False if file could not be opened or mapped
+         */
+        bool open(const std::string &path);
+
+        //! Unmap and close the file
+        void close();
+
+        //! @return True if checkpoint file is open
+        bool opened();
+
+        ~Checkpoint();
+
+        /**
+         * Write topology of the network into the older slot.
+         *
+         * @param network Network
+         * @return False if checkpoint is not open or could not be resized
+         */
+        bool save(const Network &network);
+
+        /**
+         * Add topology from the latest valid slot to the network.
+         *
+         * Edges already in the network are kept with their Parameters, self
+         * keeps its MAC address.
+         *
+         * @param network Network
+         * @param nodes Number of restored nodes
+         * @param edges Number of restored edges
+         * @return False if there is no valid slot
+         */
+        bool restore(Network &network, size_t &nodes, size_t &edges);
+      };
+    }
+  }
+}
+#endif
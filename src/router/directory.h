@@ -0,0 +1,136 @@
+#ifndef PUT_RADIO_DIRECTORY_H
+#define PUT_RADIO_DIRECTORY_H
+
+#include <stdint.h>
+#include <array>
+
+#include "../radio.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * MAC addresses of nodes, by logical address, with open-addressing
+       * index from MAC address back to logical address.
+       *
+       * Index slots hold only addresses (0 is empty slot) and are probed
+       * linearly, MAC of address in the slot is compared. There are twice as
+       * many slots as addresses, so probe sequences stay short. Removed entry
+       * is filled by shifting its probe sequence back (no tombstones).
+       * If several nodes share MAC address, the lowest address is indexed.
+       *
+       * Everything lives inline - Directory is copied into every Snapshot.
+       */
+      class Directory {
+       private:
+        //! Number of index slots (power of 2)
+        static const uint16_t SLOTS = 2 * ADDRESSES;
+
+        //! log2 of Directory::SLOTS (ADDRESSES is 256 or 1024)
+        static const int SLOT_BITS = sizeof(Address) == 1 ? 9 : 11;
+
+        //! MAC address by logical address (0 if unknown)
+        std::array<uint64_t, ADDRESSES> macs;
+
+        //! Index slots, addresses (0 for empty slot)
+        std::array<Address, SLOTS> slots;
+
+        //! @return Home slot of MAC address
+        static inline uint16_t home(uint64_t mac) {
+          return uint16_t((mac * 0x9E3779B97F4A7C15ULL) >> (64 - SLOT_BITS));
+        }
+
+        //! @return Slot of MAC address or of the empty slot ending its probe sequence
+        inline uint16_t probe(uint64_t mac) const {
+          uint16_t i = home(mac);
+
+          while (slots[i] != 0 && macs[slots[i]] != mac)
+            i = (i + 1) & (SLOTS - 1);
+
+          return i;
+        }
+
+        //! Remove indexed entry of slot
+        void erase(uint16_t i) {
+          uint16_t j = i;
+
+          slots[i] = 0;
+
+          // entries behind which may not be reached any more are shifted back
+          while (true) {
+            j = (j + 1) & (SLOTS - 1);
+
+            if (slots[j] == 0)
+              return;
+
+            uint16_t h = home(macs[slots[j]]);
+
+            // entry may stay if its home is cyclically in (i, j]
+            if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+              continue;
+
+            slots[i] = slots[j];
+            slots[j] = 0;
+            i = j;
+          }
+        }
+
+       public:
+        Directory() {
+          macs.fill(0);
+          slots.fill(0);
+        }
+
+        /**
+         * Set MAC address of node.
+         *
+         * @param a Address
+         * @param mac MAC address (0 if unknown)
+         */
+        void set(Address a, uint64_t mac) {
+          uint64_t old = macs[a];
+
+          if (old == mac)
+            return;
+
+          if (old != 0) {
+            uint16_t i = probe(old);
+
+            if (slots[i] == a) {
+              erase(i);
+              macs[a] = 0;
+
+              // other node with the same MAC takes the entry
+              for (int b = 1; b < MAX_ADDRESS; b++)
+                if (macs[b] == old) {
+                  slots[probe(old)] = b;
+                  break;
+                }
+            }
+          }
+
+          macs[a] = mac;
+
+          if (mac == 0)
+            return;
+
+          uint16_t i = probe(mac);
+
+          if (slots[i] == 0 || a < slots[i])
+            slots[i] = a;
+        }
+
+        //! @return MAC address of node (0 if unknown)
+        inline uint64_t mac(Address a) const {
+          return macs[a];
+        }
+
+        //! @return Address of node with MAC address (0 if none)
+        inline Address find(uint64_t mac) const {
+          return mac == 0 ? 0 : slots[probe(mac)];
+        }
+      };
+    }
+  }
+}
+#endif
@@ -22,39 +22,171 @@ namespace PUT {
       }
 
       Dispatcher::~Dispatcher() {
-        tick_thread.detach();
+        tick_threadRun.store(false);
+
+        if (tick_thread.joinable())
+          tick_thread.join();
       }
 
-      bool Dispatcher::deliver(Packet* packet) {
-        Path path = network.path(self->address, packet->destination, packet->visited);
+      bool Dispatcher::deliver(Packet &&packet) {
+        Paths alternatives;
+
+        history.lock();
+
+        Path path = route(packet, alternatives);
 
         if (path.empty()) {
+          history.unlock();
+
           LOG(WARNING) << "Packet could NOT be delivered, no route exists";
 
-          if (packet->source == self->address)
-            driver.deliver_back(packet->destination, packet->port, packet->data.content, packet->length);
+          if (packet.source == self->address)
+            driver.deliver_back(packet.destination, packet.port, packet.data.content, packet.length);
+
+          return false;
+        }
+
+        Metadata* meta = history.watch(std::move(packet), path);
+
+        meta->alternatives = std::move(alternatives);
+        in_flight[path.front()]++;
+
+        Xbee::Sent sent = xbee.send(meta->packet, meta->frame_id, network.mac(path.front()), self->network);
+
+        if (sent != Xbee::Sent::Queued && !dropped(meta, sent)) {
+          history.erase(meta->packet);
+          history.unlock();
+
+          return false;
+        }
+
+        history.unlock();
+
+        return true;
+      }
+
+      Path Dispatcher::route(const Packet &packet, Paths &alternatives, bool cached) {
+        Metric costs[paths_max];
+        uint64_t weights[paths_max];
+        uint8_t order[paths_max];
+        uint8_t count = 0;
+        uint64_t version = network.topology_version();
+        size_t hash = 0;
+
+        for (Address a : packet.visited)
+          hash = hash * 31 + a;
+
+        // with the same visited nodes, destinations get consecutive slots
+        Candidates &c = candidates[(hash * 31 + packet.destination) & (candidates_size - 1)];
+
+        alternatives.clear();
+
+        if (cached && c.version == version && c.destination == packet.destination && c.visited == packet.visited)
+          while (count < c.count && network.cost(self->address, c.paths[count], costs[count]))
+            count++;
+
+        // some path is not usable any more, all are found again
+        if (count == 0 || count < c.count) {
+          count = network.paths(self->address, packet.destination, packet.visited, c.paths, costs, paths_max);
+          c.version = version;
+          c.destination = packet.destination;
+          c.visited = packet.visited;
+          c.count = count;
+        }
+
+        if (count == 0)
+          return Path();
+
+        for (uint8_t i = 0; i < count; i++) {
+          weights[i] = (uint64_t(costs[i]) + Parameters::METRIC_SCALE) * (uint64_t(in_flight[c.paths[i].front()]) + 1);
+          order[i] = i;
+        }
+
+        // insertion sort keeps ties ordered by cost (std::stable_sort takes heap buffer)
+        for (uint8_t i = 1; i < count; i++)
+          for (uint8_t j = i; j > 0 && weights[order[j]] < weights[order[j - 1]]; j--)
+            std::swap(order[j], order[j - 1]);
+
+        for (uint8_t i = 1; i < count; i++)
+          alternatives.push_back(c.paths[order[i]]);
+
+        return c.paths[order[0]];
+      }
+
+      uint16_t Dispatcher::load(Address a) {
+        history.lock();
+
+        uint16_t load = in_flight[a];
+
+        history.unlock();
+
+        return load;
+      }
+
+      Path Dispatcher::failover(Metadata* meta) {
+        Packet &p = meta->packet;
+
+        while (!meta->alternatives.empty()) {
+          Path path = std::move(meta->alternatives.front());
+          Address a = self->address;
+          bool usable = network.mac(path.front()) != Frame::BROADCAST;
+
+          meta->alternatives.erase(meta->alternatives.begin());
+
+          for (Address b : path) {
+            usable &= network.adjacent(a, b) && std::find(p.visited.begin(), p.visited.end(), b) == p.visited.end();
+            a = b;
+          }
+
+          if (usable)
+            return path;
+        }
+
+        return Path();
+      }
+
+      bool Dispatcher::dropped(Metadata* meta, Xbee::Sent sent) {
+        Address hop = meta->path_history.back().front();
+        Packet &p = meta->packet;
+
+        if (in_flight[hop] > 0)
+          in_flight[hop]--;
+
+        // frame ID 0 is never reserved, so released ID is not erased again
+        history.erase_frame(meta->frame_id);
+        history.release_id(meta->frame_id);
+        meta->frame_id = 0;
+
+        // every retransmission would be dropped the same way
+        if (sent == Xbee::Sent::Oversized) {
+          LOG(WARNING) << "Packet could NOT be delivered, it does not fit into frame";
+
+          if (p.source == self->address)
+            driver.deliver_back(p.destination, p.port, p.data.content, p.length);
 
           return false;
         }
 
-        uint8_t id = history.watch(packet, path);
+        LOG(WARNING) << "Frame was dropped, packet waits for retransmission";
 
-        Frame* frame = packet->to_frame(id, network.mac(path.front()), self->network);
-        xbee.send(frame);
-        delete frame;
+        meta->timeout = timeout(p, meta->path_history.back());
+        meta->check_timeout = true;
 
         return true;
       }
 
       bool Dispatcher::retransmit(Metadata* meta) {
-        Packet* p = meta->packet;
-        Path path = network.path(self->address, p->destination, p->visited);
+        Packet &p = meta->packet;
+        Path path = failover(meta);
+
+        if (path.empty())
+          path = route(p, meta->alternatives, false);
 
         if (path.empty()) {
           LOG(WARNING) << "Packet could NOT be delivered, no route exists (retransmission)";
 
-          if (p->source == self->address)
-            driver.deliver_back(p->destination, p->port, p->data.content, p->length);
+          if (p.source == self->address)
+            driver.deliver_back(p.destination, p.port, p.data.content, p.length);
 
           return false;
         }
@@ -70,14 +202,18 @@ namespace PUT {
         meta->frame_id = history.reserve_id();
         meta->send_time = std::chrono::steady_clock::now();
         meta->check_timeout = false;
-
-        Frame* frame = meta->packet->to_frame(meta->frame_id, network.mac(path.front()), self->network);
-        xbee.send(frame);
+        in_flight[path.front()]++;
         history.frames()[meta->frame_id] = meta;
 
-        history.unlock();
+        Xbee::Sent sent = xbee.send(meta->packet, meta->frame_id, network.mac(path.front()), self->network);
+
+        // packet is erased by tick()
+        if (sent != Xbee::Sent::Queued && !dropped(meta, sent)) {
+          history.unlock();
+          return false;
+        }
 
-        delete frame;
+        history.unlock();
 
         return true;
       }
@@ -91,38 +227,33 @@ namespace PUT {
         LOG(WARNING) << "try_retransmit2";
 
         //WARNING that max retries is reached and do something if source is self
-        Packet* p = meta->packet;
+        Packet &p = meta->packet;
         LOG(WARNING) << "-----max retransmitions reached----";
-        if (p->source == self->address)
-          driver.deliver_back(p->destination, p->port, p->data.content, p->length);
+        if (p.source == self->address)
+          driver.deliver_back(p.destination, p.port, p.data.content, p.length);
 
         return false;
       }
 
-      bool Dispatcher::send(Packet* packet) {
-        Frame* frame = packet->to_frame(0, network.mac(packet->destination), self->network);
-
-        if (network.mac(packet->destination) == Frame::BROADCAST) {
+      bool Dispatcher::send(const Packet &packet) {
+        if (network.mac(packet.destination) == Frame::BROADCAST) {
           LOG(WARNING) << "Packet could NOT be delivered, because packet dest is not adjacent";
 
-          if (packet->source == self->address)
-            driver.deliver_back(packet->destination, packet->port, packet->data.content, packet->length);
+          if (packet.source == self->address)
+            driver.deliver_back(packet.destination, packet.port, (uint8_t*)packet.data.content, packet.length);
 
           return false;
         }
 
-        xbee.send(frame);
-        delete frame;
+        xbee.send(packet, 0, network.mac(packet.destination), self->network);
 
         return true;
       }
 
-      void Dispatcher::broadcast(Packet* packet) {
-        packet->destination = 0;
-        Frame* frame = packet->to_frame(0, Frame::BROADCAST, self->network);
+      void Dispatcher::broadcast(Packet &packet) {
+        packet.destination = 0;
 
-        xbee.send(frame);
-        delete frame;
+        xbee.send(packet, 0, Frame::BROADCAST, self->network);
       }
 
       int Dispatcher::tick() {
@@ -130,17 +261,20 @@ namespace PUT {
 
         history.lock();
 
-        for (auto meta : history.packets()) {
-          if (!meta.second->check_timeout || meta.second->timeout >= std::chrono::steady_clock::now())
+        // iterator is advanced first, packet may be erased
+        for (auto it = history.packets().begin(); it != history.packets().end();) {
+          Metadata* meta = (it++)->second;
+
+          if (!meta->check_timeout || meta->timeout >= std::chrono::steady_clock::now())
             continue;
 
           outdated++;
           LOG(WARNING) << "outdated " << outdated;
-          if (meta.second->packet->source != self->address || !try_retransmit(meta.second)) {
+          if (meta->packet.source != self->address || !try_retransmit(meta)) {
             //free memory from meta and packet
             LOG(WARNING) <<  "----------------tick::erase-------------------";
-            history.erase_frame(meta.second->frame_id);
-            history.erase(meta.second->packet);
+            history.erase_frame(meta->frame_id);
+            history.erase(meta->packet);
             LOG(WARNING) <<  "----------------tick::after_erase-------------------";
           }
 
@@ -150,14 +284,21 @@ namespace PUT {
         return outdated;
       }
 
-      inline void Dispatcher::handle_data(Packet* packet) {
-        if (packet->destination == self->address) {
+      inline void Dispatcher::handle_data(const Packet &packet) {
+        if (packet.destination == self->address) {
           send_ack(packet, 0);
-          LOG(WARNING) << "Data packet delivered, sending ACK for packet" << (int) packet->packet_id;
+          LOG(WARNING) << "Data packet delivered, sending ACK for packet" << (int) packet.packet_id;
         }
       }
 
-      inline void Dispatcher::handle_ack(Packet* packet) {
+      inline void Dispatcher::handle_data(const PacketView &packet) {
+        if (packet.destination == self->address) {
+          send_ack(packet, 0);
+          LOG(WARNING) << "Data packet delivered, sending ACK for packet" << (int) packet.packet_id;
+        }
+      }
+
+      inline void Dispatcher::handle_ack(Packet &packet) {
         Metadata* meta;
         Address previous;
         bool retry;
@@ -165,28 +306,29 @@ namespace PUT {
         history.lock();
         meta = history.meta(packet);
 
-        previous = network.from_mac(packet->mac);
+        previous = network.from_mac(packet.mac);
 
-        for (int i = packet->length - 1; i >= 0; i--) {
-          network.update(previous, packet->data.parameters[i].hop, packet->data.parameters[i].retries, packet->data.parameters[i].errors, packet->data.parameters[i].delay);
-          LOG(INFO) << "Updating edge [ " << (int) previous << " -> " << (int) packet->data.parameters[i].hop << " ]";
-          previous = packet->data.parameters[i].hop;
+        for (int i = packet.length - 1; i >= 0; i--) {
+          network.update(previous, packet.data.parameters[i].hop, packet.data.parameters[i].retries, packet.data.parameters[i].errors, packet.data.parameters[i].delay);
+          LOG(INFO) << "Updating edge [ " << (int) previous << " -> " << (int) packet.data.parameters[i].hop << " ]";
+          previous = packet.data.parameters[i].hop;
         }
 
-        packet->length++;
-        packet->data.parameters = (RemoteParameters*)realloc((void*)packet->data.parameters, packet->length * sizeof(RemoteParameters));
-        packet->data.parameters[packet->length - 1] = meta->frame_status;
+        if (packet.length < Packet::MAX_PARAMETERS)
+          packet.data.parameters[packet.length++] = meta->frame_status;
+        else
+          LOG(WARNING) << "Ack is full, parameters of hop " << (int) meta->frame_status.hop << " are not passed";
 
         retry = false;
 
-        if (packet->origin != self->address) {
-          packet->destination = meta->packet->visited.size() == 1
-                                ? packet->origin
-                                : *(history.meta(packet)->packet->visited.cend() - 2);
+        if (packet.origin != self->address) {
+          packet.destination = meta->packet.visited.size() == 1
+                               ? packet.origin
+                               : *(meta->packet.visited.cend() - 2);
 
-          LOG(INFO) << "Passing ACK to " << (int) packet->destination;
+          LOG(INFO) << "Passing ACK to " << (int) packet.destination;
           send(packet);
-        } else if (packet->status != 0) {
+        } else if (packet.status != 0) {
           retry = try_retransmit(meta);
         }
 
@@ -200,11 +342,11 @@ namespace PUT {
         history.unlock();
       }
 
-      inline void Dispatcher::handle_internal(Packet* packet) {
+      inline void Dispatcher::handle_internal(Packet &packet) {
         Frame* frame;
         Metadata* meta;
 
-        frame = packet->data.frame;
+        frame = packet.data.frame;
 
         if (frame->type == Frame::Type::Status) {
           history.lock();
@@ -217,6 +359,9 @@ namespace PUT {
             history.unlock();
             return;
           }
+          if (in_flight[meta->path_history.back().front()] > 0)
+            in_flight[meta->path_history.back().front()]--;
+
           auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - meta->send_time).count();
           LOG(WARNING) << "millis: " << millis;
 
@@ -225,7 +370,7 @@ namespace PUT {
           meta->frame_status.errors += (frame->data.status.status > 0);
           meta->frame_status.retries += frame->data.status.retries;
 
-          LOG(INFO) << "Status for " << (int) frame->data.status.id << ":'" << (char*) meta->packet->data.content << "'"
+          LOG(INFO) << "Status for " << (int) frame->data.status.id << ":'" << (char*) meta->packet.data.content << "'"
                      << " - retries " << (int) frame->data.status.retries << ", errors " << (int) frame->data.status.status << ", time " << (int) millis << " ms";
 
           network.update(self->address, meta->path_history.back().front(), frame->data.status.retries, frame->data.status.status, millis);
@@ -233,12 +378,12 @@ namespace PUT {
           if (frame->data.status.status > 0) { // retransmit if error
             if (!try_retransmit(meta)) { //too many retransmisions
 
-              if (packet->source != self->address) { // send ack with status == self->address
+              if (packet.source != self->address) { // send ack with status == self->address
                 send_ack(packet, self->address);
-                LOG(INFO) << "Data packet not delivered, sending ACK with status: " << self->address << " for packet" << (int) packet->packet_id;
+                LOG(INFO) << "Data packet not delivered, sending ACK with status: " << self->address << " for packet" << (int) packet.packet_id;
               }
 
-              if (network.edge(self->address, meta->path_history.back().front())->antireliability() > Dispatcher::antireliability_trheshold)
+              if (network.parameters(self->address, meta->path_history.back().front()).antireliability() > Dispatcher::antireliability_trheshold)
                 broadcast_edge_drop(self->address, meta->path_history.back().front());
 
               LOG(WARNING) << "handle internal: Removing packet from history";
@@ -259,8 +404,8 @@ namespace PUT {
         }
       }
 
-      void Dispatcher::scan(Packet* packet) {
-        switch (packet->type) {
+      void Dispatcher::scan(Packet &packet) {
+        switch (packet.type) {
           case Packet::Type::Data:
             handle_data(packet);
             break;
@@ -278,8 +423,25 @@ namespace PUT {
         }
       }
 
+      void Dispatcher::scan(const PacketView &packet) {
+        switch (packet.type) {
+          case Packet::Type::Data:
+            handle_data(packet);
+            break;
+
+          case Packet::Type::Ack: {
+            Packet ack(packet);
+            handle_ack(ack);
+            break;
+          }
 
-      std::chrono::steady_clock::time_point Dispatcher::timeout(Packet* packet, Path &path) {
+          default:
+            break;
+        }
+      }
+
+
+      std::chrono::steady_clock::time_point Dispatcher::timeout(const Packet &packet, Path &path) {
         Timeout t = 0;
 
         //see [Inz] Timeouts math google doc
@@ -288,14 +450,14 @@ namespace PUT {
         Address a = self->address;
 
         for (auto b : path) {
-          Parameters* p = network.edge(a, b);
-          edges_sum += p->delay * (1 + (p->retries / (p->good - p->retries > 0 ? p->good - p->retries : 1)));
+          Parameters p = network.parameters(a, b);
+          edges_sum += uint64_t(p.delay) * (Parameters::METRIC_SCALE + p.retries) / (Parameters::METRIC_SCALE * Parameters::METRIC_SCALE);
           a = b;
         }
 
         t = (edges_sum + Dispatcher::tv * path.size()) * Dispatcher::c * Metadata::retransmission_max;
 
-        if (packet->source != self->address)  // increasing timeout on non-source nodes (needed when ack of packet doesn't come back through current node)
+        if (packet.source != self->address)  // increasing timeout on non-source nodes (needed when ack of packet doesn't come back through current node)
           t *= Dispatcher::timeout_multiplier;
 
         LOG(WARNING) << "timeout calculated: " << (int) t;
@@ -303,22 +465,24 @@ namespace PUT {
       }
 
 
-      void Dispatcher::send_ack(Packet* packet, Address status) {
-        Packet* response = new Packet(packet, self->address, status);
+      void Dispatcher::send_ack(const Packet &packet, Address status) {
+        Packet response(packet, self->address, status);
+
         send(response);
+      }
 
-        delete response;
+      void Dispatcher::send_ack(const PacketView &packet, Address status) {
+        Packet response(packet, self->address, status);
+
+        send(response);
       }
 
       void Dispatcher::broadcast_edge_drop(Address a, Address b) {
         LOG(WARNING) << "Broadcasting EdgeDrop from " << self->address << " for edge " << a << "->" << b;
 
-        Packet* p = new Packet(Packet::Type::EdgeDrop);
-        p->data.edge[0] = a;
-        p->data.edge[1] = b;
+        Packet p(a, b);
 
         broadcast(p);
-        delete p;
       }
     }
   }
@@ -16,6 +16,8 @@
 #include <thread>
 #include <atomic>
 #include <deque>
+#include <array>
+#include <algorithm>
 
 namespace PUT {
   namespace CS {
@@ -95,6 +97,75 @@ namespace PUT {
          */
         const float antireliability_trheshold = 10;  // TODO: set proper value!!!
 
+        /**
+         * Number of edge-disjoint paths considered for every packet
+         *
+         * @see Dispatcher::route()
+         */
+        static const uint8_t paths_max = 3;
+
+        /**
+         * Edge-disjoint paths found for destination, when packet visited
+         * given nodes.
+         *
+         * @see Dispatcher::route()
+         */
+        struct Candidates {
+          //! Network::topology_version() the paths were found for
+          uint64_t version = 0;
+          //! Destination
+          Address destination = 0;
+          //! Visited nodes of packet
+          Visited visited;
+          //! Number of found paths
+          uint8_t count = 0;
+          //! Paths ordered by cost
+          Path paths[paths_max];
+        };
+
+        //! Number of Dispatcher::candidates (power of 2)
+        static const uint8_t candidates_size = 16;
+
+        /**
+         * Recently found paths, by hash of destination and visited nodes.
+         *
+         * Must be accessed with history locked.
+         */
+        std::array<Candidates, candidates_size> candidates;
+
+        /**
+         * Frames sent to adjacent node, waiting for StatusFrame (by address).
+         *
+         * Must be accessed with history locked.
+         */
+        std::array<uint16_t, ADDRESSES> in_flight {};
+
+        /**
+         * Take the first usable precomputed path of packet.
+         *
+         * Path is usable if its edges are still in the network, first hop MAC
+         * is known and no visited node is on the path.
+         *
+         * @param meta Metadata of packet
+         * @return Path or empty path if no alternative is usable
+         */
+        Path failover(Metadata* meta);
+
+        /**
+         * Frame of packet was dropped by Xbee, so no StatusFrame comes.
+         * The frame is forgotten. If transmit queue was full, packet waits
+         * for its timeout, as if it was sent - then it is retransmitted by
+         * tick(). Packet which does not fit into frame fails at once (it is
+         * delivered back if source is self) and must be erased by caller.
+         *
+         * Must be called with history locked.
+         *
+         * @param meta Metadata of packet
+         * @param sent Why the frame was dropped
+         * @return True if packet waits for retransmission
+         */
+        bool dropped(Metadata* meta, Xbee::Sent sent);
+
        public:
         /**
          * Create new Dispatcher instance. Does nothing.
@@ -116,26 +187,28 @@ namespace PUT {
          * Reliably send Packet to its destination.
          *
          * Packet is given next free ID and it is stored in Dispatcher::history.
-         * Packet is send to next adjacent node according to Network::path().
+         * Packet is send to next adjacent node according to Dispatcher::route().
          * If packet is delivered successful ACK is awaited, otherwise Packet delivery
-         * is repeated with new path.
+         * is repeated with the next precomputed path (or new path, if none is left).
          *
          *
-         * @param p Complete Packet (must contain source, destination and type).
-         * @return True if any path to destination exists
+         * @param p Complete Packet (must contain source, destination and type), moved into history
+         * @return True if any path to destination exists and packet fits into frame
          * @see Dispatcher::watch()
          * @see Dispatcher::scan()
          */
-        bool deliver(Packet* p);
+        bool deliver(Packet &&p);
 
         /**
          * Retransmit packet to its destination
          *
          * Similar to deliver, but instead of invoking watch(), that create metadata for packet and
          * adds new entry to history, this method just change metadata in existing entry in history.
+         * Packet is sent over the first usable of Metadata::alternatives, new paths are found
+         * only if there is none.
          *
          * @param meta Pointer to metadata in history
-         * @return True if any path to destination exists
+         * @return True if any path to destination exists and packet fits into frame
          * @see Dispatcher::deliver()
          * @see Dispatcher::scan()
          */
@@ -164,7 +237,7 @@ namespace PUT {
          * @param p Complete Packet
          * @return True if any mac address is known
          */
-        bool send(Packet* p);
+        bool send(const Packet &p);
 
         /**
          * Broadcast packet to adjacent nodes.
@@ -174,7 +247,7 @@ namespace PUT {
          *
          * @param p Packet (destination is changed to 0, to mark broadcast packet)
          */
-        void broadcast(Packet* p);
+        void broadcast(Packet &p);
 
         /**
          * Tick maintains delivery of packets with timeouted ACK.
@@ -216,23 +289,65 @@ namespace PUT {
          * @see Dispatcher::watch()
          * @see Dispatcher::deliver()
          */
-        void scan(Packet* p);
+        void scan(Packet &p);
+
+        /**
+         * Scan incoming packet view for delivery messages.
+         *
+         * The same as Dispatcher::scan(Packet&), however Packet is copied
+         * only if it is needed (Packet::Type::Ack is modified and passed on).
+         *
+         * @param p Incoming packet view
+         * @see Dispatcher::scan(Packet&)
+         */
+        void scan(const PacketView &p);
 
-        inline void handle_data(Packet* packet);
-        inline void handle_ack(Packet* packet);
-        inline void handle_internal(Packet* packet);
+        inline void handle_data(const Packet &packet);
+        inline void handle_data(const PacketView &packet);
+        inline void handle_ack(Packet &packet);
+        inline void handle_internal(Packet &packet);
 
        public:
+        /**
+         * Choose path of packet among edge-disjoint paths to its destination.
+         *
+         * Every path is weighted with its cost and number of frames in flight
+         * over its first hop, the lightest path is chosen. With no frames in
+         * flight it is the most reliable path, under load traffic is spread
+         * over parallel paths in proportion to their reliability.
+         *
+         * Paths are precomputed - they are found once for destination and
+         * visited nodes and reused while no edge is added or dropped
+         * (Network::topology_version()) and every path is usable (their
+         * current costs are used).
+         *
+         * @param packet Packet to route
+         * @param alternatives Other paths are written here, the lightest first
+         * @param cached If false, paths are found again (on failover)
+         * @return Chosen path (empty if destination is not reachable)
+         * @see Network::paths()
+         * @see Network::cost()
+         */
+        Path route(const Packet &packet, Paths &alternatives, bool cached = true);
+
+        //! @return Number of frames sent to adjacent node, waiting for StatusFrame
+        uint16_t load(Address a);
+
         /**
          * calculates timeout value for packet
          */
-        std::chrono::steady_clock::time_point timeout(Packet* packet, Path &path);
+        std::chrono::steady_clock::time_point timeout(const Packet &packet, Path &path);
 
 
         /**
          * Sends ack with given status
          */
-        void send_ack(Packet* packet, Address status);
+        void send_ack(const Packet &packet, Address status);
+
+        /**
+         * Sends ack with given status for packet view
+         */
+        void send_ack(const PacketView &packet, Address status);
 
 
         /**
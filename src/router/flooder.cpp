@@ -0,0 +1,247 @@
+#include "flooder.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      Flooder::Flooder(Network &n, Broadcast b, std::chrono::milliseconds w) : network(n), broadcast(b), window(w), heard(ADDRESSES),
+        random(n.self()->address ^ std::chrono::steady_clock::now().time_since_epoch().count()) {
+        sequences.fill(0);
+        ages.fill(0);
+
+        if (window.count() == 0)
+          return;
+
+        worker = std::thread([this]() {
+          THREAD_NAME("Flooder");
+          std::unique_lock<std::mutex> guard(lock);
+
+          while (running) {
+            if (!armed) {
+              changed.wait(guard);
+              continue;
+            }
+
+            if (deadline > std::chrono::steady_clock::now()) {
+              changed.wait_until(guard, deadline);
+              continue;
+            }
+
+            guard.unlock();
+            send();
+            guard.lock();
+          }
+        });
+      }
+
+      Flooder::~Flooder() {
+        lock.lock();
+        running = false;
+        lock.unlock();
+
+        changed.notify_one();
+
+        if (worker.joinable())
+          worker.join();
+      }
+
+      void Flooder::arm() {
+        if (armed)
+          return;
+
+        armed = true;
+        deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(random() % (window.count() + 1));
+
+        changed.notify_one();
+      }
+
+      void Flooder::advertise() {
+        lock.lock();
+
+        if (own)
+          merged_floods++;
+
+        own = true;
+        arm();
+
+        lock.unlock();
+
+        if (window.count() == 0)
+          send();
+      }
+
+      void Flooder::link_state(Address origin, uint16_t sequence, uint8_t age, Address transmitter) {
+        std::bitset<ADDRESSES> audience = network.audience(transmitter);
+        bool covered = network.covered(audience);
+
+        lock.lock();
+
+        if (advertisements.test(origin)) {
+          merged_floods++;
+
+          // neighbours heard the newer one, the older is not needed
+          if (covered) {
+            advertisements.reset(origin);
+            cancelled_floods++;
+          }
+        }
+
+        if (!covered) {
+          advertisements.set(origin);
+          sequences[origin] = sequence;
+          ages[origin] = age;
+          heard[origin] = audience;
+          arm();
+        }
+
+        lock.unlock();
+
+        if (window.count() == 0)
+          send();
+      }
+
+      //! @return True if drop is of edge (a, b) in any direction
+      static bool same(const Edge &edge, Address a, Address b) {
+        return (edge[0] == a && edge[1] == b) || (edge[0] == b && edge[1] == a);
+      }
+
+      void Flooder::edge_drop(Address a, Address b, Address transmitter) {
+        std::bitset<ADDRESSES> audience = network.audience(transmitter);
+        bool pending = false;
+
+        lock.lock();
+
+        for (Drop &drop : drops) {
+          if (same(drop.edge, a, b)) {
+            drop.heard |= audience;
+            merged_floods++;
+            pending = true;
+          }
+        }
+
+        if (!pending && !network.covered(audience)) {
+          drops.push_back(Drop());
+          drops.back().edge[0] = a;
+          drops.back().edge[1] = b;
+          drops.back().heard = audience;
+          arm();
+        }
+
+        lock.unlock();
+
+        if (window.count() == 0)
+          send();
+      }
+
+      void Flooder::overheard_link_state(Address origin, uint16_t sequence, Address transmitter) {
+        std::bitset<ADDRESSES> audience = network.audience(transmitter);
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (!advertisements.test(origin) || sequences[origin] != sequence)
+          return;
+
+        heard[origin] |= audience;
+
+        if (network.covered(heard[origin])) {
+          advertisements.reset(origin);
+          cancelled_floods++;
+        }
+      }
+
+      void Flooder::overheard_edge_drop(Address a, Address b, Address transmitter) {
+        std::bitset<ADDRESSES> audience = network.audience(transmitter);
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        for (auto drop = drops.begin(); drop != drops.end(); drop++) {
+          if (same(drop->edge, a, b)) {
+            drop->heard |= audience;
+
+            if (network.covered(drop->heard)) {
+              drops.erase(drop);
+              cancelled_floods++;
+            }
+
+            return;
+          }
+        }
+      }
+
+      void Flooder::send() {
+        std::bitset<ADDRESSES> pending;
+        std::array<uint8_t, ADDRESSES> age;
+        std::vector<Drop> edges;
+        bool originate;
+
+        lock.lock();
+
+        originate = own;
+        pending = advertisements;
+        age = ages;
+        edges.swap(drops);
+
+        own = false;
+        advertisements.reset();
+        armed = false;
+
+        lock.unlock();
+
+        Advertisement links;
+        uint16_t sequence;
+
+        if (originate) {
+          Packet packet(Packet::Type::LinkState);
+
+          packet.source = network.self()->address;
+          packet.sequence = network.originate(links);
+          packet.age = 0;
+          packet.length = links.size();
+          std::copy(links.begin(), links.end(), packet.data.links);
+
+          broadcast(packet);
+          sent_floods++;
+        }
+
+        // the latest advertisement, even if newer arrived meanwhile
+        for (int a = 1; a < MAX_ADDRESS; a++) {
+          if (!pending.test(a) || !network.advertisement(a, sequence, links))
+            continue;
+
+          Packet packet(Packet::Type::LinkState);
+
+          packet.source = a;
+          packet.sequence = sequence;
+          packet.age = age[a];
+          packet.length = links.size();
+          std::copy(links.begin(), links.end(), packet.data.links);
+
+          broadcast(packet);
+          sent_floods++;
+        }
+
+        for (Drop &drop : edges) {
+          Packet packet(drop.edge[0], drop.edge[1]);
+
+          broadcast(packet);
+          sent_floods++;
+        }
+      }
+
+      void Flooder::flush() {
+        send();
+      }
+
+      uint64_t Flooder::sent() const {
+        return sent_floods;
+      }
+
+      uint64_t Flooder::merged() const {
+        return merged_floods;
+      }
+
+      uint64_t Flooder::cancelled() const {
+        return cancelled_floods;
+      }
+    }
+  }
+}
@@ -0,0 +1,173 @@
+#ifndef PUT_RADIO_FLOODER_H
+#define PUT_RADIO_FLOODER_H
+
+#include <stdint.h>
+#include <array>
+#include <bitset>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <condition_variable>
+
+#include "../radio.h"
+#include "network.h"
+#include "packet.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * Scheduler of control floods (Packet::Type::LinkState and Packet::Type::EdgeDrop).
+       *
+       * Floods are not broadcasted at once. The first one waits random jitter
+       * (up to Flooder::window), every flood requested meanwhile joins it and
+       * they are broadcasted together. So nodes which learned the same change
+       * at the same moment (e.g. after power outage) do not transmit in lock-step.
+       *
+       * While waiting, floods are merged: own advertisement is originated when
+       * it is sent (with every change made in the window), only the latest
+       * advertisement of a node is flooded and the same EdgeDrop is sent once.
+       * Pending flood is cancelled if the same flood is overheard from neighbours
+       * and every neighbour of self heard it already (Network::covered()).
+       *
+       * Flooder is thread safe, it sends from its own thread.
+       */
+      class Flooder {
+       public:
+        //! Sends broadcast
+        typedef std::function<void(Packet &packet)> Broadcast;
+
+       private:
+        //! Pending EdgeDrop
+        struct Drop {
+          Edge edge;
+
+          //! Nodes which heard it already
+          std::bitset<ADDRESSES> heard;
+        };
+
+        Network &network;
+
+        Broadcast broadcast;
+
+        //! Longest jitter
+        const std::chrono::milliseconds window;
+
+        //! Guards pending floods
+        std::mutex lock;
+
+        std::condition_variable changed;
+
+        std::thread worker;
+
+        bool running = true;
+
+        //! Pending floods are sent at
+        std::chrono::steady_clock::time_point deadline;
+
+        //! True if any flood is pending
+        bool armed = false;
+
+        //! Own advertisement is pending
+        bool own = false;
+
+        //! Nodes with pending advertisement
+        std::bitset<ADDRESSES> advertisements;
+
+        //! Sequence number of pending advertisement of node
+        std::array<uint16_t, ADDRESSES> sequences;
+
+        //! Age of pending advertisement of node
+        std::array<uint8_t, ADDRESSES> ages;
+
+        //! Nodes which heard pending advertisement of node
+        std::vector<std::bitset<ADDRESSES>> heard;
+
+        //! Pending EdgeDrops
+        std::vector<Drop> drops;
+
+        std::mt19937 random;
+
+        std::atomic<uint64_t> sent_floods {0};
+        std::atomic<uint64_t> merged_floods {0};
+        std::atomic<uint64_t> cancelled_floods {0};
+
+        //! Start waiting for jitter if nothing is pending, lock must be held
+        void arm();
+
+        //! Broadcast pending floods
+        void send();
+
+       public:
+        /**
+         * Create flooder and start its thread.
+         *
+         * @param n Network (self, advertisements and neighbours)
+         * @param b Broadcasts packets
+         * @param w Longest jitter (0 sends floods at once, from the caller)
+         */
+        Flooder(Network &n, Broadcast b, std::chrono::milliseconds w);
+
+        //! Pending floods are dropped
+        ~Flooder();
+
+        //! Flood new advertisement of self
+        void advertise();
+
+        /**
+         * Flood advertisement of other node further.
+         *
+         * @param origin Advertising node
+         * @param sequence Sequence number of the advertisement
+         * @param age Age of the flooded advertisement
+         * @param transmitter Node from which the advertisement was received (0 if unknown)
+         */
+        void link_state(Address origin, uint16_t sequence, uint8_t age, Address transmitter);
+
+        /**
+         * Flood EdgeDrop.
+         *
+         * @param a Source
+         * @param b Destination
+         * @param transmitter Node from which the EdgeDrop was received (0 if dropped by self)
+         */
+        void edge_drop(Address a, Address b, Address transmitter);
+
+        /**
+         * Advertisement was received again, pending flood of it may be cancelled.
+         *
+         * @param origin Advertising node
+         * @param sequence Sequence number of the advertisement
+         * @param transmitter Node from which the advertisement was received (0 if unknown)
+         */
+        void overheard_link_state(Address origin, uint16_t sequence, Address transmitter);
+
+        /**
+         * EdgeDrop was received again, pending flood of it may be cancelled.
+         *
+         * @param a Source
+         * @param b Destination
+         * @param transmitter Node from which the EdgeDrop was received (0 if unknown)
+         */
+        void overheard_edge_drop(Address a, Address b, Address transmitter);
+
+        //! Broadcast pending floods now
+        void flush();
+
+        //! @return Number of broadcasted floods
+        uint64_t sent() const;
+
+        //! @return Number of floods merged into pending ones
+        uint64_t merged() const;
+
+        //! @return Number of floods cancelled, as every neighbour heard them
+        uint64_t cancelled() const;
+      };
+    }
+  }
+}
+#endif
@@ -0,0 +1,139 @@
+#ifndef PUT_RADIO_FRONTIER_H
+#define PUT_RADIO_FRONTIER_H
+
+#include <stdint.h>
+#include <array>
+
+#include "graph.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * Indexed 4-ary min-heap of nodes waiting for Dijkstra.
+       *
+       * Every address has its slot, so node is in the heap at most once
+       * and its key is decreased in place (no lazy deletion, no stale
+       * entries). Whole heap lives inline - nothing is allocated.
+       */
+      class Frontier {
+       private:
+        //! Heap of nodes
+        std::array<Address, ADDRESSES> heap;
+
+        //! Key of node
+        std::array<Metric, ADDRESSES> keys;
+
+        //! Position of node in the heap (Frontier::NONE if not in the heap)
+        std::array<uint16_t, ADDRESSES> positions;
+
+        //! Number of nodes in the heap
+        uint16_t count = 0;
+
+        static const uint16_t NONE = 0xFFFF;
+
+        //! Put node at position, updating its index
+        inline void place(Address node, uint16_t position) {
+          heap[position] = node;
+          positions[node] = position;
+        }
+
+        //! Move node towards the root
+        void up(uint16_t position) {
+          Address node = heap[position];
+
+          while (position > 0) {
+            uint16_t parent = (position - 1) / 4;
+
+            if (keys[heap[parent]] <= keys[node])
+              break;
+
+            place(heap[parent], position);
+            position = parent;
+          }
+
+          place(node, position);
+        }
+
+        //! Move node towards the leaves
+        void down(uint16_t position) {
+          Address node = heap[position];
+
+          while (true) {
+            uint16_t first = position * 4 + 1, smallest = position;
+            Metric key = keys[node];
+
+            for (uint16_t child = first; child < first + 4 && child < count; child++) {
+              if (keys[heap[child]] < key) {
+                key = keys[heap[child]];
+                smallest = child;
+              }
+            }
+
+            if (smallest == position)
+              break;
+
+            place(heap[smallest], position);
+            position = smallest;
+          }
+
+          place(node, position);
+        }
+
+       public:
+        Frontier() {
+          positions.fill(NONE);
+        }
+
+        /**
+         * Add node or decrease its key.
+         *
+         * @param node Node
+         * @param key Key, ignored if node is in the heap with lower key
+         */
+        void push(Address node, Metric key) {
+          if (positions[node] == NONE) {
+            keys[node] = key;
+            place(node, count++);
+            up(positions[node]);
+          } else if (key < keys[node]) {
+            keys[node] = key;
+            up(positions[node]);
+          }
+        }
+
+        /**
+         * Remove node with the lowest key.
+         *
+         * @return Node (heap must not be empty)
+         */
+        Address pop() {
+          Address top = heap[0];
+
+          positions[top] = NONE;
+
+          if (--count > 0) {
+            place(heap[count], 0);
+            down(0);
+          }
+
+          return top;
+        }
+
+        //! @return True if node is in the heap
+        inline bool contains(Address node) const {
+          return positions[node] != NONE;
+        }
+
+        inline bool empty() const {
+          return count == 0;
+        }
+
+        inline uint16_t size() const {
+          return count;
+        }
+      };
+    }
+  }
+}
+#endif
@@ -0,0 +1,129 @@
+#include "graph.h"
+#include <algorithm>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      const Metric Parameters::METRIC_SCALE;
+      const Metric Parameters::MAX_METRIC;
+      const Metric Parameters::LOSS_PENALTY;
+      const uint32_t Parameters::WEIGHT_SCALE;
+      const uint32_t Parameters::MIN_WEIGHT;
+      const uint32_t Parameters::TIME_CONSTANT;
+      const uint32_t Parameters::HALF_LIFE;
+
+      //! @return Average moved towards sample by weight, rounded towards sample (so it reaches it)
+      static inline Metric average(Metric average, uint64_t sample, uint32_t weight) {
+        uint64_t sum = uint64_t(average) * (Parameters::WEIGHT_SCALE - weight) + sample * weight;
+
+        if (sample > average)
+          sum += Parameters::WEIGHT_SCALE - 1;
+
+        return Metric(sum / Parameters::WEIGHT_SCALE);
+      }
+
+      void Parameters::sample(uint8_t r, bool error, uint16_t d, uint64_t now) {
+        uint32_t weight = WEIGHT_SCALE;
+
+        if (updated != 0) {
+          uint64_t elapsed = now > updated ? now - updated : 0;
+
+          weight = std::max(uint32_t(WEIGHT_SCALE * elapsed / (elapsed + TIME_CONSTANT)), MIN_WEIGHT);
+        }
+
+        retries = average(retries, uint64_t(r) * METRIC_SCALE, weight);
+        losses = average(losses, error ? METRIC_SCALE : 0, weight);
+        delay = average(delay, uint64_t(d) * METRIC_SCALE, weight);
+        updated = std::max(now, uint64_t(1));
+        halvings = 0;
+      }
+
+      bool Parameters::decay(uint64_t now) {
+        if (updated == 0 || now < updated + HALF_LIFE)
+          return false;
+
+        // after 32 halvings nothing is left
+        uint64_t periods = std::min((now - updated) / HALF_LIFE, uint64_t(32));
+
+        if (periods <= halvings)
+          return false;
+
+        unsigned shift = unsigned(periods) - halvings;
+        Metric cost = metric();
+
+        retries = shift < 32 ? retries >> shift : 0;
+        losses = shift < 32 ? losses >> shift : 0;
+        halvings = uint8_t(periods);
+
+        return metric() != cost;
+      }
+
+      uint16_t Parameters::milliseconds() const {
+        return uint16_t(std::min((delay + METRIC_SCALE / 2) / METRIC_SCALE, Metric(UINT16_MAX)));
+      }
+
+      float Parameters::antireliability() const {
+        return (retries + LOSS_PENALTY * float(losses)) / METRIC_SCALE;
+      }
+
+      Metric Parameters::metric() const {
+        uint64_t metric = uint64_t(retries) + uint64_t(LOSS_PENALTY) * losses;
+
+        return metric > MAX_METRIC ? MAX_METRIC : Metric(metric);
+      }
+
+      Graph::Graph() : records(index(MAX_ADDRESS - 1, MAX_ADDRESS) + 1), adjacency(ADDRESSES), lists(ADDRESSES) { }
+
+      bool Graph::connect(Address a, Address b) {
+        if (a == b || adjacent(a, b))
+          return false;
+
+        adjacency[a].set(b);
+        adjacency[b].set(a);
+        lists[a].push_back(b);
+        lists[b].push_back(a);
+        count++;
+
+        return true;
+      }
+
+      //! Remove value from unordered list (last element takes its place)
+      static void remove(Neighbours &list, Address value) {
+        for (Address &n : list) {
+          if (n == value) {
+            n = list.back();
+            list.pop_back();
+            return;
+          }
+        }
+      }
+
+      bool Graph::disconnect(Address a, Address b) {
+        if (!adjacent(a, b))
+          return false;
+
+        adjacency[a].reset(b);
+        adjacency[b].reset(a);
+        remove(lists[a], b);
+        remove(lists[b], a);
+
+        records[index(a, b)] = Parameters();
+        count--;
+
+        return true;
+      }
+
+      void Graph::clear() {
+        for (size_t a = 0; a < lists.size(); a++) {
+          for (Address b : lists[a])
+            records[index(a, b)] = Parameters();
+
+          adjacency[a].reset();
+          lists[a].clear();
+        }
+
+        count = 0;
+      }
+    }
+  }
+}
@@ -0,0 +1,229 @@
+#ifndef PUT_RADIO_GRAPH_H
+#define PUT_RADIO_GRAPH_H
+
+#include <stdint.h>
+#include <vector>
+#include <bitset>
+#include <utility>
+
+#include "../radio.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      //! Fixed-point path cost (Parameters::metric() and sums of it)
+      typedef uint32_t Metric;
+
+      //! Cost of path to unreachable node
+      const Metric UNREACHABLE = 0xFFFFFFFF;
+
+      //! @return Sum of costs, saturated at UNREACHABLE
+      inline Metric saturated(Metric a, Metric b) {
+        return a > UNREACHABLE - b ? UNREACHABLE : a + b;
+      }
+
+      /**
+       * Network edge parameters.
+       *
+       * Parameters are based on real measures, got from StatusFrame
+       * and ACK packets.
+       *
+       * Every measure is an exponentially weighted moving average in
+       * fixed-point (Parameters::METRIC_SCALE represents 1.0). Weight of a
+       * sample grows with time since the previous one, so a burst of samples
+       * is averaged (at least Parameters::MIN_WEIGHT each) and a sample after
+       * long silence replaces what is known. When no sample comes for
+       * Parameters::HALF_LIFE, retries and losses are halved
+       * (Parameters::decay()), so a link avoided after it degraded is tried
+       * again. Based on that edge "quality measure" is calculated and used as
+       * cost in Network::path() algorithm.
+       */
+      struct Parameters {
+        //! Average retries of a frame
+        Metric retries = 0;
+
+        //! Average share of undelivered frames
+        Metric losses = 0;
+
+        //! Average delay on edge [ms]
+        Metric delay = 10 * 1024;
+
+        //! Halvings by Parameters::decay() since the last sample
+        uint8_t halvings = 0;
+
+        //! Time of the last sample [ms] (0 if edge was not measured)
+        uint64_t updated = 0;
+
+        //! Fixed-point scale of averages and Parameters::metric() (antireliability of 1.0)
+        static const Metric METRIC_SCALE = 1024;
+
+        //! Maximal metric of single edge (sum over path through every address fits in Metric)
+        static const Metric MAX_METRIC = 0xFFFFFFFF / ADDRESSES;
+
+        //! Undelivered frame costs as much as this number of retries
+        static const Metric LOSS_PENALTY = 8;
+
+        //! Weight of samples is fixed-point, this is 1
+        static const uint32_t WEIGHT_SCALE = 256;
+
+        //! The lowest weight of sample (samples close to each other)
+        static const uint32_t MIN_WEIGHT = WEIGHT_SCALE / 8;
+
+        //! Sample this time after the previous one weighs half [ms]
+        static const uint32_t TIME_CONSTANT = 5000;
+
+        //! Retries and losses are halved after this time without samples [ms]
+        static const uint32_t HALF_LIFE = 15000;
+
+        /**
+         * Add measure of single frame.
+         *
+         * @param retries Number of retries
+         * @param error True if frame was not delivered
+         * @param delay Delay [ms]
+         * @param now Time of the measure [ms]
+         */
+        void sample(uint8_t retries, bool error, uint16_t delay, uint64_t now);
+
+        /**
+         * Halve retries and losses for every Parameters::HALF_LIFE without
+         * samples. Edges which were not measured are not changed.
+         *
+         * Parameters::updated is kept, so the next sample weighs by the
+         * whole silence.
+         *
+         * @param now Current time [ms]
+         * @return True if Parameters::metric() changed
+         */
+        bool decay(uint64_t now);
+
+        //! @return Average delay [ms], rounded
+        uint16_t milliseconds() const;
+
+        /**
+         * Reliability measure.
+         *
+         * Lower the number, reliability of the edge is bigger.
+         *
+         * @see Parameters::metric()
+         */
+        float antireliability() const;
+
+        /**
+         * Reliability measure in fixed-point - used as cost in Network::path()
+         *
+         * Average retries with Parameters::LOSS_PENALTY retries for every
+         * undelivered frame, saturated at MAX_METRIC.
+         *
+         * @see Network::path()
+         */
+        Metric metric() const;
+
+        /**
+         * Comparision operator based on antireliability().
+         */
+        static bool compare(Parameters* const &a, Parameters* b) {
+          return a->metric() < b->metric();
+        }
+      };
+
+      //! Adjacent nodes of single node (valid addresses are 1 till MAX_ADDRESS - 1)
+      typedef InlineVector<Address, ADDRESSES - 2> Neighbours;
+
+      /**
+       * Flat store of bidirectional edges, indexed by address.
+       *
+       * Edge parameters are kept in a triangular ADDRESSES x ADDRESSES matrix of records
+       * (single record for both directions), so Parameters pointers are stable
+       * and never freed. Every node has adjacency bitset (constant time
+       * Graph::adjacent()) and packed list of neighbours, which is iterated
+       * by Network::path().
+       *
+       * Graph is not synchronized, Network locks it.
+       */
+      class Graph {
+       private:
+        //! Edge records, Graph::index() of (a, b)
+        std::vector<Parameters> records;
+
+        //! Adjacency bitsets, by node address
+        std::vector<std::bitset<ADDRESSES>> adjacency;
+
+        //! Neighbours, by node address
+        std::vector<Neighbours> lists;
+
+        //! Number of edges
+        size_t count = 0;
+
+        //! Index of edge record (a != b)
+        static inline size_t index(Address a, Address b) {
+          if (a > b)
+            std::swap(a, b);
+
+          return size_t(b) * (b - 1) / 2 + a;
+        }
+
+       public:
+        //! Create empty graph (memory for every possible edge is allocated)
+        Graph();
+
+        /**
+         * Add edge, with default parameters.
+         *
+         * @param a Source
+         * @param b Destination (not equal to a)
+         * @return False if edge already exists
+         */
+        bool connect(Address a, Address b);
+
+        /**
+         * Remove edge, its parameters are reset.
+         *
+         * @param a Source
+         * @param b Destination
+         * @return False if edge does not exist
+         */
+        bool disconnect(Address a, Address b);
+
+        //! @return True if edge exists
+        inline bool adjacent(Address a, Address b) const {
+          return adjacency[a].test(b);
+        }
+
+        /**
+         * Get edge parameters, the same for (a, b) and (b, a).
+         *
+         * @param a Source
+         * @param b Destination
+         * @return Parameters or nullptr if edge does not exist
+         */
+        inline Parameters* edge(Address a, Address b) {
+          return adjacent(a, b) ? &records[index(a, b)] : nullptr;
+        }
+
+        inline const Parameters* edge(Address a, Address b) const {
+          return adjacent(a, b) ? &records[index(a, b)] : nullptr;
+        }
+
+        //! @return Neighbours of node (unordered)
+        inline const Neighbours &neighbours(Address a) const {
+          return lists[a];
+        }
+
+        //! @return Adjacency bitset of node
+        inline const std::bitset<ADDRESSES> &adjacent(Address a) const {
+          return adjacency[a];
+        }
+
+        //! @return Number of edges
+        inline size_t size() const {
+          return count;
+        }
+
+        //! Remove every edge
+        void clear();
+      };
+    }
+  }
+}
+#endif
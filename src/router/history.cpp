@@ -4,23 +4,12 @@ namespace PUT {
   namespace CS {
     namespace XbeeRouting {
 
-      Metadata::~Metadata() {
-        // packet should be deleted manually because of case in Dispatcher::tick(), when metadata have to be deleted, but pointer to packet should be valid
-        //delete packet;
-      }
-
-      void History::erase(Packet* packet) {
-        auto it = packets_history.find(packet->id());
+      void History::erase(const Packet &packet) {
+        auto it = packets_history.find(packet.id());
         Metadata* tmp = it->second;
 
         packets_history.erase(it);
 
-        if (packet == tmp->packet) {
-          delete tmp->packet;
-          packet = nullptr;
-        } else
-          delete tmp->packet;
-
         delete tmp;
       }
 
@@ -34,8 +23,8 @@ namespace PUT {
          frames_history.erase(frameId);
       }
 
-      Metadata* History::meta(Packet* packet) {
-        auto it = packets_history.find(packet->id());
+      Metadata* History::meta(const Packet &packet) {
+        auto it = packets_history.find(packet.id());
         return it != packets_history.end() ? it->second : nullptr;
       }
 
@@ -45,11 +34,11 @@ namespace PUT {
       }
 
       void History::add(Metadata* meta) {
-        packets_history[meta->packet->id()] = meta;
+        packets_history[meta->packet.id()] = meta;
         frames_history[meta->frame_id] = meta;
       }
 
-      uint8_t History::watch(Packet* packet, Path path) {
+      Metadata* History::watch(Packet &&packet, Path path) {
         lock();
 
         Metadata* meta = this->meta(packet);
@@ -57,24 +46,24 @@ namespace PUT {
         if (meta == nullptr)
           meta = new Metadata();
 
-        DLOG(INFO) << "Watching packet, visited size:  " << packet->visited.size();
-        meta->packet = packet;
+        DLOG(INFO) << "Watching packet, visited size:  " << packet.visited.size();
+        meta->packet = std::move(packet);
         meta->path_history.push_back(path);
         meta->frame_id = reserve_id();
 
-        if (packet->packet_id == 0) {
-          packet->packet_id = meta->frame_id;
-          DLOG(INFO) << "New frame id set to " << (int) packet->packet_id;
+        if (meta->packet.packet_id == 0) {
+          meta->packet.packet_id = meta->frame_id;
+          DLOG(INFO) << "New frame id set to " << (int) meta->packet.packet_id;
         }
 
-        meta->packet_id = packet->id();
+        meta->packet_id = meta->packet.id();
 
         add(meta);
 
         meta->send_time = std::chrono::steady_clock::now();
 
         unlock();
-        return meta->frame_id;
+        return meta;
       }
 
       uint8_t History::reserve_id() {
@@ -102,6 +91,12 @@ namespace PUT {
         id_occupation_lock.unlock();
       }
 
+      void History::release_id(uint8_t id) {
+        id_occupation_lock.lock();
+        id_occupation.reset(id - 1);
+        id_occupation_lock.unlock();
+      }
+
     }
   }
 }
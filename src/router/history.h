@@ -18,6 +18,9 @@
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
+      //! Paths of single packet
+      typedef std::vector<Path, BufferAllocator<Path>> Paths;
+
       /**
        * Descriptor of Packet history.
        *
@@ -27,16 +30,14 @@ namespace PUT {
        */
       struct Metadata {
         /**
-         * Packet to watch.
-         *
-         * Memory must be released with removing Metadata (it means that destructor doesn't delete this)
+         * Packet to watch (moved into history).
          */
-        Packet* packet;
+        Packet packet;
 
         /**
          * Unique packet id - it is the same on every node
          */
-        uint32_t packet_id; // xxFRTOID
+        PacketId packet_id; // xxFRTOID
 
         /**
          * Path history on current node.
@@ -44,7 +45,15 @@ namespace PUT {
          * There must be at least one Path. There are more
          * if packet was repeated.
          */
-        std::vector<Path> path_history;
+        Paths path_history;
+
+        /**
+         * Precomputed paths, used instead of the current one when delivery
+         * fails (the best one first).
+         *
+         * @see Dispatcher::route()
+         */
+        Paths alternatives;
 
         /**
          * Local Xbee frame ID
@@ -81,14 +90,20 @@ namespace PUT {
         static const uint8_t retransmission_max = 5;
 
 
-        // Pointer to packet is not deleted by destructor!!!
-        ~Metadata();
+        //! Metadata is allocated from Pool
+        static void* operator new(size_t size) {
+          return Pool<Metadata>::allocate(size);
+        }
+
+        static void operator delete(void* p) {
+          Pool<Metadata>::release(p);
+        }
       };
 
       class History {
        private:
-        using PacketsHistory = std::unordered_map<PacketId, Metadata*>;
-        using FramesHistory = std::unordered_map<uint8_t, Metadata*>;
+        using PacketsHistory = std::unordered_map<PacketId, Metadata*, std::hash<PacketId>, std::equal_to<PacketId>, BufferAllocator<std::pair<const PacketId, Metadata*>>>;
+        using FramesHistory = std::unordered_map<uint8_t, Metadata*, std::hash<uint8_t>, std::equal_to<uint8_t>, BufferAllocator<std::pair<const uint8_t, Metadata*>>>;
         /**
          * Keeps history of send Packets until they ACK or timeout.
          *
@@ -138,9 +153,9 @@ namespace PUT {
         /**
          * Erase packet and free metadata (with metadata->packet)
          *
-         * @param packet packet to erase
+         * @param packet packet to erase (may be metadata->packet itself)
          */
-        void erase(Packet* packet);
+        void erase(const Packet &packet);
 
         /**
          * Erase frame (do not free metadata or metadata->packet)
@@ -163,7 +178,7 @@ namespace PUT {
          *
          * @return metadata or nullptr if packet does not exists in history
          */
-        Metadata* meta(Packet* packet);
+        Metadata* meta(const Packet &packet);
 
         /**
          * Get metadata for frame.
@@ -191,6 +206,13 @@ namespace PUT {
          */
         void release_id(Frame* frame);
 
+        /**
+         * Release frame ID which will get no StatusFrame
+         *
+         * @param id Frame ID to release
+         */
+        void release_id(uint8_t id);
+
         /**
          * Add packet to history and makes the packet watched for delivery.
          *
@@ -204,11 +226,13 @@ namespace PUT {
          * node). It is so, because triplet of destination, source and frame_id makes unique
          * Packet::id() at given network state.
          *
-         * @return Packet local frame ID (must be set)
+         * @param p Packet (moved into history)
+         * @param path Path of packet
+         * @return Metadata of packet, with local frame ID and watched packet
          * @see Dispatcher::scan()
          * @see Dispatcher::deliver()
          */
-        uint8_t watch(Packet* p, Path path);
+        Metadata* watch(Packet &&p, Path path);
 
 
         //! lock mutex
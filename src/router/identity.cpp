@@ -0,0 +1,85 @@
+#include "identity.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <algorithm>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      bool Identity::update(const Frame &response) {
+        const CommandResponseFrame &r = response.data.command_response;
+        uint64_t a = 0;
+
+        if (response.type != Frame::Type::CommandResponse || r.status != 0)
+          return false;
+
+        if (memcmp(r.command, "NI", 2) == 0) {
+          name = std::string((char*)r.data, response.length);
+        } else if (memcmp(r.command, "ID", 2) == 0) {
+          memcpy(&a, r.data, std::min<uint16_t>(response.length, 2));
+          network = a;
+        } else if (memcmp(r.command, "SL", 2) == 0) {
+          memcpy(&a, r.data, std::min<uint16_t>(response.length, 4));
+          mac = (mac & 0xFFFFFFFF) | (a << 32);
+        } else if (memcmp(r.command, "SH", 2) == 0) {
+          memcpy(&a, r.data, std::min<uint16_t>(response.length, 4));
+          mac = (mac & 0xFFFFFFFF00000000) | a;
+        } else {
+          return false;
+        }
+
+        return true;
+      }
+
+      bool Identity::load(const std::string &path, const std::string &device) {
+        char line[512];
+        char port[256];
+        uint64_t m;
+        unsigned int n;
+        int offset = 0;
+        FILE* file = fopen(path.c_str(), "r");
+
+        if (file == NULL)
+          return false;
+
+        bool read = fgets(line, sizeof(line), file) != NULL;
+        fclose(file);
+
+        if (!read || sscanf(line, "%255s %" SCNx64 " %x %n", port, &m, &n, &offset) != 3 || offset == 0)
+          return false;
+
+        if (device != port || n > 0xFFFF)
+          return false;
+
+        mac = m;
+        network = n;
+        name = std::string(line + offset, strcspn(line + offset, "\n"));
+
+        return true;
+      }
+
+      bool Identity::save(const std::string &path, const std::string &device) const {
+        std::string temporary = path + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "w");
+
+        if (file == NULL)
+          return false;
+
+        bool written = fprintf(file, "%s %016" PRIx64 " %04x %s\n", device.c_str(), mac, network, name.c_str()) > 0;
+        written = (fclose(file) == 0) && written;
+
+        return written && rename(temporary.c_str(), path.c_str()) == 0;
+      }
+
+      bool Identity::operator==(const Identity &other) const {
+        return mac == other.mac && network == other.network && name == other.name;
+      }
+
+      bool Identity::operator!=(const Identity &other) const {
+        return !(*this == other);
+      }
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef PUT_RADIO_IDENTITY_H
+#define PUT_RADIO_IDENTITY_H
+
+#include <string>
+#include <stdint.h>
+
+#include "../radio.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * Identity of connected Xbee radio - parameters which are needed
+       * before the Router may start (NI, ID, SL and SH commands).
+       *
+       * Identity may be cached on disk, so warm restart does not need to
+       * wait for the radio. Cache file is a single text line:
+       *
+       *     <serial port> <MAC, hex> <network ID, hex> <node identifier>
+       */
+      class Identity {
+       public:
+        //! 8-byte Xbee radio MAC address (SL << 32 | SH, as Node::mac)
+        uint64_t mac = 0;
+
+        //! Network ID
+        uint16_t network = 0;
+
+        //! Node Identifier
+        std::string name;
+
+        /**
+         * Update identity with response to NI, ID, SL or SH command.
+         *
+         * @param response Frame::Type::CommandResponse
+         * @return False if response is not an identity parameter
+         */
+        bool update(const Frame &response);
+
+        /**
+         * Read identity from cache file.
+         *
+         * @param path Cache file path
+         * @param device Serial port which identity is expected
+         * @return False if file is missing, malformed or for other serial port
+         */
+        bool load(const std::string &path, const std::string &device);
+
+        /**
+         * Write identity to cache file (atomically, using rename).
+         *
+         * @param path Cache file path
+         * @param device Serial port of the radio
+         * @return False if file could not be written
+         */
+        bool save(const std::string &path, const std::string &device) const;
+
+        bool operator==(const Identity &other) const;
+        bool operator!=(const Identity &other) const;
+      };
+    }
+  }
+}
+#endif
@@ -3,41 +3,41 @@
 #include <fstream>
 #include <iostream>
 #include <queue>
+#include <array>
+#include <bitset>
 #include <vector>
 #include <limits>
+#include <chrono>
 #define UINT32_MAX std::numeric_limits<uint32_t>::max()
 
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
-      float Parameters::antireliability() const {
-        return (retries * (errors + 1)) / float(good + 1);
-      }
+      const uint16_t Frontier::NONE;
 
-      Network::Network(Address self) {
-        this->self_node = node(self);
-        this->self_node->self = true;
-      };
+      Network::Network(Address self) : advertisements(ADDRESSES) {
+        tree.fill(0);
+        tree_distance.fill(UNREACHABLE);
+        sequences.fill(0);
 
-      Network::~Network() {
         graphLock.lock();
 
-        for (auto &kv : nodes) {
-          delete kv.second;
-        }
+        insert(self);
+        this->self_node = &nodes[self];
+        this->self_node->self = true;
 
-        nodes.clear();
+        publish();
 
-        for (auto &m1 : neighbours) {
-          for (auto &m2 : m1.second) {
-            if (m1.first < m2.first)
-              delete m2.second;
-          }
+        graphLock.unlock();
+      };
 
-          m1.second.clear();
-        }
+      Network::~Network() {
+        all_pairs(false);
 
-        neighbours.clear();
+        graphLock.lock();
+
+        present.reset();
+        topology.clear();
 
         graphLock.unlock();
       }
@@ -47,94 +47,169 @@ namespace PUT {
 
         DLOG(INFO) << "Merging two network graphs";
 
+        graphLock.lock();
+
         for (int i = 0; i < length; i++) {
-          dirty |= add_edge(edges[i][0], edges[i][1]);
+          dirty |= connect(edges[i][0], edges[i][1]);
         }
 
+        if (dirty)
+          publish();
+
+        graphLock.unlock();
+
         DLOG(INFO) << "Finished merging";
 
         return dirty;
       }
 
       bool Network::add_edge(Address a, Address b) {
-        if (a == b || a == 0 || a == 255 || b == 0 || b == 255)
-          return false;
+        graphLock.lock();
 
-        bool dirty = false;
+        bool dirty = connect(a, b);
 
-        add_node(a);
-        add_node(b);
+        if (dirty)
+          publish();
 
-        graphLock.lock();
-        auto it_a = neighbours.find(a);
+        graphLock.unlock();
 
-        if (it_a == neighbours.end()) {
-          dirty = true;
-          it_a = neighbours.emplace(a, XbeeGraphMap::mapped_type()).first;
-        }
+        return dirty;
+      }
 
-        auto it_b = neighbours.find(b);
+      bool Network::connect(Address a, Address b) {
+        if (a == b || a == 0 || a == MAX_ADDRESS || b == 0 || b == MAX_ADDRESS)
+          return false;
 
-        if (it_b == neighbours.end()) {
-          dirty = true;
-          it_b = neighbours.emplace(b, XbeeGraphMap::mapped_type()).first;
-        }
+        bool dirty = false;
 
-        auto it = it_a->second.find(b);
+        insert(a);
+        insert(b);
 
-        if (it == it_a->second.end()) {
+        if (topology.connect(a, b)) {
           dirty = true;
-          Parameters* p = new Parameters();
-
-          it_a->second[b] = p;
-          it_b->second[a] = p;
+          edges_version++;
+          changed(a, b, false);
 
           // DO NOT TOUCH, ever!
           printf("  EDGE %d %d\n", a, b);
           fflush(stdout);
         }
 
-        graphLock.unlock();
-
         return dirty;
       }
 
       Parameters* Network::edge(Address a, Address b) {
         add_edge(a, b);
 
-        return neighbours[a][b];
+        std::lock_guard<std::mutex> lock(graphLock);
+
+        return topology.edge(a, b);
+      }
+
+      Parameters Network::parameters(Address a, Address b) const {
+        std::shared_ptr<const Snapshot> s = current();
+
+        for (const Snapshot::Link* link = s->begin(a); link != s->end(a); link++)
+          if (link->node == b)
+            return link->parameters;
+
+        return Parameters();
+      }
+
+      Neighbours Network::neighbours(Address a) const {
+        std::shared_ptr<const Snapshot> s = current();
+        Neighbours neighbours;
+
+        for (const Snapshot::Link* link = s->begin(a); link != s->end(a); link++)
+          neighbours.push_back(link->node);
+
+        return neighbours;
       }
 
-      void Network::update(Address a, Address b, uint8_t retries, uint8_t error, uint16_t delay) {
-        Parameters* parameters = edge(a, b);
+      void Network::update(Address a, Address b, uint8_t retries, uint8_t error, uint16_t delay, uint64_t now) {
+        graphLock.lock();
+
+        connect(a, b);
+
+        Parameters* parameters = topology.edge(a, b);
+
+        if (parameters == nullptr) {
+          graphLock.unlock();
+          return;
+        }
+
+        Metric cost = parameters->metric();
+
+        parameters->sample(retries, error > 0, delay, now);
+
+        if (parameters->metric() != cost)
+          changed(a, b, parameters->metric() > cost);
+
+        Parameters updated = *parameters;
+
+        publish();
 
-        parameters->retries = std::min(parameters->retries + retries, UINT32_MAX);
-        parameters->errors = std::min(parameters->errors + (error > 0), UINT32_MAX);
-        parameters->good = std::min(parameters->good + (error == 0), UINT32_MAX);
-        parameters->delay = (uint16_t)round((double(parameters->delay) + double(delay)) / 2);
+        graphLock.unlock();
 
-        printf("UPDATE %d %d - retries %d, errors %d, good %d, delay %d, antireliability %f\n", a, b, parameters->retries, parameters->errors, parameters->good, parameters->delay, parameters->antireliability());
+        printf("UPDATE %d %d - retries %.2f, losses %.2f, delay %d, antireliability %f\n", a, b, double(updated.retries) / Parameters::METRIC_SCALE, double(updated.losses) / Parameters::METRIC_SCALE, updated.milliseconds(), updated.antireliability());
         fflush(stdout);
       }
 
+      size_t Network::decay(uint64_t now) {
+        size_t decayed = 0;
+
+        graphLock.lock();
+
+        for (int a = 1; a < MAX_ADDRESS; a++)
+          for (Address b : topology.neighbours(a))
+            if (a < b && topology.edge(a, b)->decay(now)) {
+              changed(a, b, false);
+              decayed++;
+            }
+
+        if (decayed > 0)
+          publish();
+
+        graphLock.unlock();
+
+        return decayed;
+      }
+
+      uint64_t Network::clock() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+
       bool Network::add_node(Address a) {
+        graphLock.lock();
+
+        bool dirty = insert(a);
+
+        if (dirty)
+          publish();
+
+        graphLock.unlock();
+
+        return dirty;
+      }
+
+      bool Network::insert(Address a) {
         bool dirty = false;
 
-        if (a == 0 || a == 255)
+        if (a == 0 || a == MAX_ADDRESS)
           return false;
 
-        auto it = nodes.find(a);
-
-        if (it == nodes.end()) {
+        if (!present.test(a)) {
           if (a > max_address)
             max_address = a;
 
           dirty = true;
-          graphLock.lock();
-          nodes[a] = new Node();
-          nodes[a]->address = a;
-          nodes[a]->mac = 0;
-          graphLock.unlock();
+          present.set(a);
+
+          // self keeps its identity when it joins again
+          if (&nodes[a] != self_node) {
+            nodes[a] = Node();
+            nodes[a].address = a;
+          }
 
           DLOG(INFO) << "Adding node " << (int) a;
         }
@@ -143,73 +218,373 @@ namespace PUT {
       }
 
       Node* Network::node(Address a) {
-        add_node(a);
+        Node* n = current()->nodes[a];
+
+        if (n != nullptr)
+          return n;
 
-        return nodes.find(a)->second;
+        std::lock_guard<std::mutex> lock(graphLock);
+
+        if (insert(a))
+          publish();
+
+        return present.test(a) ? &nodes[a] : nullptr;
       }
 
       uint64_t Network::mac(Address a) const {
-        auto it = nodes.find(a);
+        std::shared_ptr<const Snapshot> s = current();
 
-        if (it == nodes.end())
+        if (s->nodes[a] == nullptr)
           return 0;
 
-        return it->second->mac != 0 ? it->second->mac : Frame::BROADCAST;
+        return s->directory.mac(a) != 0 ? s->directory.mac(a) : Frame::BROADCAST;
+      }
+
+      void Network::mac(Address a, uint64_t mac) {
+        graphLock.lock();
+
+        insert(a);
+
+        if (!present.test(a)) {
+          graphLock.unlock();
+          return;
+        }
+
+        Node* n = &nodes[a];
+        bool unknown = n->mac == 0;
+
+        n->mac = mac;
+        directory.set(a, mac);
+
+        // unknown MAC of first hop is penalized by path()
+        if (unknown != (mac == 0) && topology.adjacent(self_node->address, a))
+          changed(self_node->address, a, mac == 0);
+
+        publish();
+
+        graphLock.unlock();
+      }
+
+      Address Network::from_mac(uint64_t mac) const {
+        return current()->directory.find(mac);
       }
 
-      // FIXME make it O(1)
-      Address Network::from_mac(uint64_t mac) {
-        for (auto &node : nodes) {
-          if (node.second->mac == mac) {
-            return node.second->address;
+      std::shared_ptr<Snapshot> Network::recycle() {
+        for (std::shared_ptr<Snapshot> &s : recycled) {
+          if (s == nullptr) {
+            s = std::make_shared<Snapshot>();
+            return s;
+          }
+
+          // held only here, so no reader (nor Routes) can take it any more
+          if (s.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return s;
           }
         }
 
-        return 0;
+        return std::make_shared<Snapshot>();
       }
 
-      const float INFINITE_DISTANCE = 9999999;
+      void Network::publish() {
+        std::shared_ptr<Snapshot> s = recycle();
+        size_t links = 0;
 
-      Path Network::path(Address from, Address to, Path visited) {
-        DLOG(INFO) << "Finding path from " << (int)from << " to " << (int) to;
+        s->nodes.fill(nullptr);
+        s->directory = directory;
+        s->links.resize(2 * topology.size());
 
-        graphLock.lock();
+        for (int a = 1; a < MAX_ADDRESS; a++)
+          if (present.test(a))
+            s->nodes[a] = &nodes[a];
 
-        std::vector<float> distance(max_address + 1, INFINITE_DISTANCE);
-        std::vector<Address> previous(max_address + 1, 0);
-        std::priority_queue< Destination, std::vector<Destination>, std::greater<Destination> > queue;
-        Address next_node, current_node;
-        float next_distance, current_distance;
-        Path path;
+        for (int a = 0; a < ADDRESSES; a++) {
+          s->first[a] = links;
 
-        distance[from] = 0;
-        queue.push(Destination(0.0f, from));
+          for (Address b : topology.neighbours(a)) {
+            const Parameters* parameters = topology.edge(a, b);
+
+            s->links[links++] = Snapshot::Link { b, parameters->metric(), *parameters };
+          }
+        }
+
+        s->first[ADDRESSES] = links;
+
+        if (tree_version != graph_version) {
+          search(*s, self_node->address, 0, std::bitset<ADDRESSES>(), tree_distance, tree);
+          tree_version = graph_version;
+        }
+
+        s->tree = tree;
+        s->distance = tree_distance;
+        s->version = graph_version;
+        s->topology_version = edges_version;
+
+        std::atomic_store(&snapshot, std::shared_ptr<const Snapshot>(s));
+
+        // taken, so the worker does not miss the snapshot between check and wait
+        routesLock.lock();
+        routesLock.unlock();
+        routesChanged.notify_one();
+      }
+
+      std::shared_ptr<const Routes> Network::compute(const std::shared_ptr<const Snapshot> &snapshot) {
+        std::shared_ptr<Routes> routes = std::make_shared<Routes>();
+        std::array<Metric, ADDRESSES> distance;
+        std::array<Address, ADDRESSES> chain;
+
+        routes->snapshot = snapshot;
+
+        for (int from = 0; from < ADDRESSES; from++) {
+          std::array<Address, ADDRESSES> &previous = routes->previous[from];
+          std::array<Address, ADDRESSES> &next = routes->next[from];
+
+          next.fill(0);
+
+          if (snapshot->nodes[from] == nullptr) {
+            previous.fill(0);
+            continue;
+          }
+
+          search(*snapshot, from, 0, std::bitset<ADDRESSES>(), distance, previous);
+
+          // first hop is shared by the whole branch, walk up till known one
+          for (int to = 0; to < ADDRESSES; to++) {
+            size_t length = 0;
+            Address a = to;
+
+            if (previous[a] == 0 || next[a] != 0)
+              continue;
+
+            while (next[a] == 0 && previous[a] != from) {
+              chain[length++] = a;
+              a = previous[a];
+            }
+
+            Address hop = next[a] != 0 ? next[a] : a;
+
+            next[a] = hop;
+
+            for (size_t i = 0; i < length; i++)
+              next[chain[i]] = hop;
+          }
+        }
+
+        return routes;
+      }
+
+      std::shared_ptr<const Routes> Network::routes_for(const std::shared_ptr<const Snapshot> &snapshot) const {
+        std::shared_ptr<const Routes> r = std::atomic_load(&routes);
+
+        return r != nullptr && r->snapshot == snapshot ? r : nullptr;
+      }
 
-        while (!queue.empty()) {
-          current_node = queue.top().second;
-          current_distance = queue.top().first;
-          queue.pop();
+      void Network::all_pairs(bool enabled) {
+        std::unique_lock<std::mutex> lock(routesLock);
 
-          if (current_distance <= distance[current_node]) {
-            auto adjacent = neighbours[current_node];
+        if (enabled == routesRunning)
+          return;
 
-            for (auto &nb : adjacent) {
-              next_node = nb.first;
-              next_distance = 0;
+        routesRunning = enabled;
 
-              next_distance += (current_node == from && nodes[next_node]->mac == 0) ? INFINITE_DISTANCE : 0;
-              next_distance += (std::find(visited.begin(), visited.end(), next_node) != visited.end()) ? INFINITE_DISTANCE : 0;
+        if (enabled) {
+          routesWorker = std::thread([this]() {
+            THREAD_NAME("AllPairs");
+            std::shared_ptr<const Snapshot> computed, latest;
 
-              if (distance[next_node] > (next_distance += (distance[current_node] + nb.second->antireliability()))) {
-                distance[next_node] = next_distance;
-                previous[next_node] = current_node;
-                queue.push(Destination(next_distance, next_node));
+            while (true) {
+              {
+                std::unique_lock<std::mutex> lock(routesLock);
+
+                routesChanged.wait(lock, [&]() {
+                  return !routesRunning || (latest = current()) != computed;
+                });
+
+                if (!routesRunning)
+                  return;
               }
+
+              std::atomic_store(&routes, compute(latest));
+              computed = latest;
+
+              DLOG(INFO) << "Routes computed for graph version " << latest->version;
+            }
+          });
+
+          return;
+        }
+
+        lock.unlock();
+        routesChanged.notify_all();
+        routesWorker.join();
+
+        std::atomic_store(&routes, std::shared_ptr<const Routes>());
+      }
+
+      bool Network::all_pairs_ready() const {
+        return routes_for(current()) != nullptr;
+      }
+
+      void Network::search(const Snapshot &snapshot, Address from, Address to, const std::bitset<ADDRESSES> &excluded, std::array<Metric, ADDRESSES> &distance, std::array<Address, ADDRESSES> &previous, const std::array<std::bitset<ADDRESSES>, ADDRESSES>* removed) {
+        Frontier frontier;
+
+        distance.fill(UNREACHABLE);
+        previous.fill(0);
+
+        distance[from] = 0;
+        frontier.push(from, 0);
+
+        while (!frontier.empty()) {
+          Address current = frontier.pop();
+
+          if (current == to)
+            break;
+
+          for (const Snapshot::Link* link = snapshot.begin(current); link != snapshot.end(current); link++) {
+            Address next = link->node;
+
+            if (excluded.test(next) || (current == from && snapshot.directory.mac(next) == 0))
+              continue;
+
+            if (removed != nullptr && (*removed)[current].test(next))
+              continue;
+
+            Metric d = saturated(distance[current], link->cost);
+
+            if (d < distance[next]) {
+              distance[next] = d;
+              previous[next] = current;
+              frontier.push(next, d);
             }
           }
         }
+      }
 
-        graphLock.unlock();
+      bool Network::relax(Address a, Address b, Frontier &frontier) {
+        if (a == self_node->address && nodes[b].mac == 0)
+          return false;
+
+        Metric d = saturated(tree_distance[a], topology.edge(a, b)->metric());
+
+        if (d < tree_distance[b]) {
+          tree_distance[b] = d;
+          tree[b] = a;
+          frontier.push(b, d);
+
+          return true;
+        }
+
+        return false;
+      }
+
+      void Network::propagate(Frontier &frontier) {
+        while (!frontier.empty()) {
+          Address current = frontier.pop();
+
+          for (Address next : topology.neighbours(current))
+            relax(current, next, frontier);
+        }
+      }
+
+      void Network::changed(Address a, Address b, bool costlier) {
+        if (tree_version != graph_version) {
+          graph_version++;
+          return;
+        }
+
+        Frontier frontier;
+
+        if (!costlier) {
+          bool shorter = relax(a, b, frontier);
+          shorter |= relax(b, a, frontier);
+
+          if (!shorter)
+            return;
+        } else {
+          Address child = tree[b] == a ? b : (tree[a] == b ? a : 0);
+
+          if (child == 0)
+            return;
+
+          // subtree of the child is detached, it is found through tree links
+          std::array<Address, ADDRESSES> subtree;
+          std::bitset<ADDRESSES> detached;
+          size_t size = 0;
+
+          subtree[size++] = child;
+          detached.set(child);
+
+          for (size_t i = 0; i < size; i++)
+            for (Address n : topology.neighbours(subtree[i]))
+              if (tree[n] == subtree[i] && !detached.test(n)) {
+                subtree[size++] = n;
+                detached.set(n);
+              }
+
+          for (size_t i = 0; i < size; i++) {
+            tree[subtree[i]] = 0;
+            tree_distance[subtree[i]] = UNREACHABLE;
+          }
+
+          for (size_t i = 0; i < size; i++)
+            for (Address n : topology.neighbours(subtree[i]))
+              if (!detached.test(n) && (tree[n] != 0 || n == self_node->address))
+                relax(n, subtree[i], frontier);
+        }
+
+        propagate(frontier);
+
+        tree_version = ++graph_version;
+      }
+
+      Path Network::path(Address from, Address to, const Visited &visited) const {
+        DLOG(INFO) << "Finding path from " << (int)from << " to " << (int) to;
+
+        std::bitset<ADDRESSES> avoided;
+
+        for (Address a : visited)
+          avoided.set(a);
+
+        return path(current(), from, to, avoided);
+      }
+
+      Path Network::path(const std::shared_ptr<const Snapshot> &s, Address from, Address to, const std::bitset<ADDRESSES> &avoided) const {
+        // every address fits, bookkeeping lives on the stack
+        std::array<Metric, ADDRESSES> distance;
+        std::array<Address, ADDRESSES> previous;
+        Address current_node;
+        Path path;
+
+        if (from == self_node->address) {
+          const std::array<Address, ADDRESSES> &tree = s->tree;
+
+          // tree path is the shortest one as long as it avoids visited nodes
+          for (current_node = to; tree[current_node] != 0 && !avoided.test(current_node); current_node = tree[current_node]);
+
+          if (tree[current_node] == 0) {
+            for (current_node = to; tree[current_node] != 0; current_node = tree[current_node])
+              path.push_front(current_node);
+
+            hits++;
+
+            return path;
+          }
+
+          misses++;
+        } else if (std::shared_ptr<const Routes> r = routes_for(s)) {
+          const std::array<Address, ADDRESSES> &tree = r->previous[from];
+
+          for (current_node = to; tree[current_node] != 0 && !avoided.test(current_node); current_node = tree[current_node]);
+
+          if (tree[current_node] == 0) {
+            for (current_node = to; tree[current_node] != 0; current_node = tree[current_node])
+              path.push_front(current_node);
+
+            return path;
+          }
+        }
+
+        search(*s, from, to, avoided, distance, previous);
 
         current_node = to;
 
@@ -221,41 +596,163 @@ namespace PUT {
         return path;
       }
 
+      uint8_t Network::paths(Address from, Address to, const Visited &visited, Path* paths, Metric* costs, uint8_t k) const {
+        std::shared_ptr<const Snapshot> s = current();
+        std::array<std::bitset<ADDRESSES>, ADDRESSES> removed;
+        std::array<Metric, ADDRESSES> distance;
+        std::array<Address, ADDRESSES> previous;
+        std::bitset<ADDRESSES> avoided;
+        uint8_t found = 0;
+
+        for (Address a : visited)
+          avoided.set(a);
+
+        while (found < k) {
+          Path &path = paths[found];
+
+          if (found == 0) {
+            path = this->path(s, from, to, avoided);
+          } else {
+            search(*s, from, to, avoided, distance, previous, &removed);
+            path.clear();
+
+            for (Address current_node = to; previous[current_node] != 0; current_node = previous[current_node])
+              path.push_front(current_node);
+          }
+
+          if (path.empty())
+            break;
+
+          Metric cost = 0;
+          Address a = from;
+
+          for (Address b : path) {
+            for (const Snapshot::Link* link = s->begin(a); link != s->end(a); link++)
+              if (link->node == b)
+                cost = saturated(cost, link->cost);
+
+            removed[a].set(b);
+            removed[b].set(a);
+            a = b;
+          }
+
+          if (costs != nullptr)
+            costs[found] = cost;
+
+          found++;
+        }
+
+        return found;
+      }
+
+      bool Network::cost(Address from, const Path &path, Metric &cost) const {
+        std::shared_ptr<const Snapshot> s = current();
+        Address a = from;
+
+        cost = 0;
+
+        if (path.empty() || s->directory.mac(path.front()) == 0)
+          return false;
+
+        for (Address b : path) {
+          const Snapshot::Link* link = s->begin(a);
+
+          while (link != s->end(a) && link->node != b)
+            link++;
+
+          if (link == s->end(a))
+            return false;
+
+          cost = saturated(cost, link->cost);
+          a = b;
+        }
+
+        return true;
+      }
+
+      Address Network::next_hop(Address to) const {
+        std::shared_ptr<const Snapshot> s = current();
+
+        if (s->tree[to] == 0)
+          return 0;
+
+        while (s->tree[to] != self_node->address)
+          to = s->tree[to];
+
+        return to;
+      }
+
+      Address Network::next_hop(Address from, Address to) const {
+        std::shared_ptr<const Snapshot> s = current();
+
+        if (std::shared_ptr<const Routes> r = routes_for(s))
+          return r->next[from][to];
+
+        Path p = path(from, to, Visited());
+
+        return p.empty() ? 0 : p.front();
+      }
+
+      void Network::invalidate() {
+        std::lock_guard<std::mutex> lock(graphLock);
+
+        graph_version++;
+        publish();
+      }
+
+      uint64_t Network::version() const {
+        return current()->version;
+      }
+
+      uint64_t Network::topology_version() const {
+        return current()->topology_version;
+      }
+
+      uint64_t Network::cache_hits() const {
+        return hits.load();
+      }
+
+      uint64_t Network::cache_misses() const {
+        return misses.load();
+      }
+
       bool Network::adjacent(Address a, Address b) const {
-        auto it_a = neighbours.find(a);
+        std::shared_ptr<const Snapshot> s = current();
 
-        return it_a != neighbours.end() && it_a->second.find(b) != it_a->second.end();
+        for (const Snapshot::Link* link = s->begin(a); link != s->end(a); link++)
+          if (link->node == b)
+            return true;
+
+        return false;
       }
 
       bool Network::drop(Address a, Address b) {
-        bool dirty = false;
         graphLock.lock();
 
-        auto it_a = neighbours.find(a);
+        bool dirty = disconnect(a, b);
 
-        if (it_a != neighbours.end()) {
-          auto it_ab = it_a->second.find(b);
+        if (dirty)
+          publish();
 
-          if (it_ab != it_a->second.end()) {
-            dirty = true;
-            delete it_ab->second;
-            it_a->second.erase(it_ab);
-          }
-        }
+        graphLock.unlock();
 
-        auto it_b = neighbours.find(b);
+        return dirty;
+      }
 
-        if (it_b != neighbours.end()) {
-          auto it_ba = it_b->second.find(a);
+      void Network::remove(Address a) {
+        present.reset(a);
+        directory.set(a, 0);
+      }
 
-          if (it_ba != it_b->second.end()) {
-            dirty = true;
-            it_b->second.erase(it_ba);
-          }
-        }
+      bool Network::disconnect(Address a, Address b) {
+        if (!topology.disconnect(a, b))
+          return false;
+
+        edges_version++;
+        changed(a, b, true);
 
-        if (it_a->second.empty()) {
-          nodes.erase(a);
+        if (topology.neighbours(a).empty()) {
+          remove(a);
 
           if (a == max_address)
             max_address--;
@@ -263,14 +760,168 @@ namespace PUT {
           DLOG(INFO) << "Dropping node " << (int) a;
         }
 
-        if (it_b->second.empty()) {
-          nodes.erase(b);
+        if (topology.neighbours(b).empty()) {
+          remove(b);
           DLOG(INFO) << "Dropping node " << (int) b;
         }
 
-        graphLock.unlock();
+        return true;
+      }
 
-        return dirty;
+      bool Network::lists(Address a, Address b) const {
+        if (!advertised.test(a))
+          return false;
+
+        for (const AdvertisedLink &link : advertisements[a])
+          if (link.node == b)
+            return true;
+
+        return false;
+      }
+
+      //! 16-bit hash of advertisement (murmur3 finalizer)
+      static uint16_t fingerprint(Address a, uint16_t sequence) {
+        uint32_t h = (uint32_t(a) << 16) | sequence;
+
+        h ^= h >> 16;
+        h *= 0x85EBCA6B;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35;
+        h ^= h >> 16;
+
+        return h ^ (h >> 16);
+      }
+
+      void Network::record(Address origin, uint16_t sequence) {
+        if (advertised.test(origin))
+          digests[bucket(origin)] ^= fingerprint(origin, sequences[origin]);
+
+        digests[bucket(origin)] ^= fingerprint(origin, sequence);
+        advertised.set(origin);
+        sequences[origin] = sequence;
+      }
+
+      bool Network::link_state(Address origin, uint16_t sequence, const Advertisement &links) {
+        if (origin == 0 || origin == MAX_ADDRESS)
+          return false;
+
+        std::lock_guard<std::mutex> lock(graphLock);
+
+        if (advertised.test(origin) && int16_t(sequence - sequences[origin]) <= 0)
+          return false;
+
+        record(origin, sequence);
+        advertisements[origin] = links;
+
+        Address self = self_node->address;
+
+        if (origin == self)
+          return true;
+
+        std::bitset<ADDRESSES> listed;
+        bool dirty = false;
+
+        for (const AdvertisedLink &link : links) {
+          Address b = link.node;
+
+          // edge of self exists only while self hears the origin
+          if (b == 0 || b == MAX_ADDRESS || b == origin || b == self)
+            continue;
+
+          listed.set(b);
+          dirty |= connect(origin, b);
+
+          Parameters* parameters = topology.edge(origin, b);
+          Metric cost = parameters->metric();
+
+          if (std::min(cost, Metric(UINT16_MAX)) != link.cost) {
+            // metric() of these parameters is exactly the advertised cost
+            parameters->retries = link.cost;
+            parameters->losses = 0;
+            parameters->updated = 0;
+
+            changed(origin, b, parameters->metric() > cost);
+            dirty = true;
+          }
+        }
+
+        // neighbours are copied, disconnect() changes them
+        Neighbours neighbours = topology.neighbours(origin);
+
+        // edge stays while the other end advertises it (origin may not know it yet)
+        for (Address b : neighbours)
+          if (!listed.test(b) && b != self && !lists(b, origin))
+            dirty |= disconnect(origin, b);
+
+        if (dirty)
+          publish();
+
+        return true;
+      }
+
+      uint16_t Network::originate(Advertisement &links) {
+        std::lock_guard<std::mutex> lock(graphLock);
+        Address self = self_node->address;
+
+        links.clear();
+
+        for (Address b : topology.neighbours(self)) {
+          AdvertisedLink link;
+
+          link.node = b;
+          link.cost = std::min(topology.edge(self, b)->metric(), Metric(UINT16_MAX));
+
+          // over Packet::MAX_LINKS links are not advertised
+          links.push_back(link);
+        }
+
+        record(self, sequences[self] + 1);
+        advertisements[self] = links;
+
+        return sequences[self];
+      }
+
+      bool Network::advertisement(Address a, uint16_t &sequence, Advertisement &links) {
+        std::lock_guard<std::mutex> lock(graphLock);
+
+        if (!advertised.test(a))
+          return false;
+
+        sequence = sequences[a];
+        links = advertisements[a];
+
+        return true;
+      }
+
+      Digest Network::digest() {
+        std::lock_guard<std::mutex> lock(graphLock);
+
+        return digests;
+      }
+
+      std::bitset<ADDRESSES> Network::audience(Address transmitter) const {
+        std::shared_ptr<const Snapshot> s = current();
+        std::bitset<ADDRESSES> heard;
+
+        if (transmitter == 0)
+          return heard;
+
+        heard.set(transmitter);
+
+        for (const Snapshot::Link* link = s->begin(transmitter); link != s->end(transmitter); link++)
+          heard.set(link->node);
+
+        return heard;
+      }
+
+      bool Network::covered(const std::bitset<ADDRESSES> &heard) const {
+        std::shared_ptr<const Snapshot> s = current();
+
+        for (const Snapshot::Link* link = s->begin(self_node->address); link != s->end(self_node->address); link++)
+          if (!heard.test(link->node))
+            return false;
+
+        return true;
       }
 
       Node* Network::self() const {
@@ -278,23 +929,30 @@ namespace PUT {
       }
 
       Edge* Network::graph(uint8_t &length) const {
-        Edge* e = (Edge*)malloc(length * 2 * sizeof(Address));
+        Edge* e = (Edge*)Buffers::allocate(length * 2 * sizeof(Address));
+
+        length = graph(e, length);
+
+        return e;
+      }
 
+      uint8_t Network::graph(Edge* edges, uint8_t capacity) const {
+        std::shared_ptr<const Snapshot> s = current();
         int i = 0;
 
-        for (auto &m1 : neighbours) {
-          for (auto &m2 : m1.second) {
-            if (m1.first < m2.first) {
-              e[i][0] = m1.first;
-              e[i][1] = m2.first;
+        for (int a = 1; a < MAX_ADDRESS; a++) {
+          for (const Snapshot::Link* link = s->begin(a); link != s->end(a); link++) {
+            Address b = link->node;
+
+            if (a < b && i < capacity) {
+              edges[i][0] = a;
+              edges[i][1] = b;
               i++;
             }
           }
         }
 
-        length = i; //TODO what when delete and i< real_length!
-
-        return e;
+        return i; //TODO what when delete and i< real_length!
       }
 
     }
@@ -7,72 +7,103 @@
 #include <deque>
 #include <algorithm>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <array>
+#include <bitset>
+#include <memory>
 #include <cmath>
 
 #include "../radio.h"
 #include "node.h"
+#include "graph.h"
+#include "frontier.h"
+#include "directory.h"
 #include "packet.h"
-#include <unordered_map>
 
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
       /**
-       * Map of map  type shortcut.
+       * Immutable state of the Network, as published by the last change.
        *
-       * Use unordered map (since C++11) - it is faster then std::map
-       * (which is typically implemented as binary search trees)
+       * Neighbours of every node are packed one after another (with
+       * parameters and cost of the edge), so readers traverse the graph
+       * without touching Graph, which writers change.
        */
-      template <class K, class V>
-      class GraphMap : public std::unordered_map<K, std::unordered_map<K, V>> { };
+      struct Snapshot {
+        //! Edge as seen from one of its ends
+        struct Link {
+          //! The other end
+          Address node;
 
-      /**
-       * Network edge parameters.
-       *
-       * Parameters are based on real measures, got from StatusFrame
-       * and ACK packets.
-       *
-       * Parameters on single edge are constantly changing, summing every
-       * parameter. Based on that edge "quality measure" is calculated
-       * and used as cost in Network::path() algorithm.
-       */
-      struct Parameters {
-        //! Number of delivered packages
-        uint32_t good = 0;
+          //! Cost used by Network::path() (Parameters::metric())
+          Metric cost;
 
-        //! Number of undelivered packages
-        uint32_t errors = 0;
+          //! Parameters of the edge
+          Parameters parameters;
+        };
 
-        //! Number of retries
-        uint32_t retries = 0;
+        //! Version of the graph
+        uint64_t version = 0;
 
-        // Delay on edge [ms]
-        uint16_t delay = 10;
+        //! Version of the set of edges (changed by every added or dropped edge)
+        uint64_t topology_version = 0;
 
-        /**
-         * Reliability measure - used as cost in Network::path()
-         *
-         * Lower the number, reliability of the edge is bigger.
-         *
-         * @see Network::path()
-         */
-        float antireliability() const;
+        //! Nodes by address (nullptr if node is not in the network)
+        std::array<Node*, ADDRESSES> nodes;
 
-        /**
-         * Comparision operator based on antireliability().
-         */
-        static bool compare(Parameters* const &a, Parameters* b) {
-          return a->antireliability() < b->antireliability();
+        //! MAC addresses of nodes in the network
+        Directory directory;
+
+        //! Links of node a are links[first[a]] till links[first[a + 1]]
+        std::array<uint32_t, ADDRESSES + 1> first;
+
+        //! Links of every node
+        std::vector<Link> links;
+
+        //! Shortest path tree rooted at self - previous hop (0 for self and unreachable nodes)
+        std::array<Address, ADDRESSES> tree;
+
+        //! Distance from self in the shortest path tree
+        std::array<Metric, ADDRESSES> distance;
+
+        //! @return First link of node
+        inline const Link* begin(Address a) const {
+          return links.data() + first[a];
+        }
+
+        //! @return Link after the last link of node
+        inline const Link* end(Address a) const {
+          return links.data() + first[a + 1];
         }
       };
 
+      //! Links advertised by single node (Packet::Type::LinkState)
+      typedef InlineVector<AdvertisedLink, Packet::MAX_LINKS> Advertisement;
+
+      //! Digest of known advertisements, in buckets by address of advertising node
+      typedef std::array<uint16_t, Packet::DIGEST_BUCKETS> Digest;
+
       /**
-          * XbeeGraphMap structure typedef.
-          *
-          * Now it is using pointers but insert/erase methods
-          * can be override to implements symetric memory coppying.
-          */
-      using XbeeGraphMap = GraphMap<Address, Parameters*>;
+       * Paths between every pair of nodes in single Snapshot, computed in
+       * background (see Network::all_pairs()).
+       *
+       * Row of a source is its shortest path tree (the same as Network::path()
+       * would find) with first hop of every path, so for the whole address
+       * space it takes 128 KB (4 MB with 16-bit addresses).
+       */
+      struct Routes {
+        //! Snapshot the routes are computed for
+        std::shared_ptr<const Snapshot> snapshot;
+
+        //! First hop from source to destination (0 if destination is not reachable)
+        std::array<std::array<Address, ADDRESSES>, ADDRESSES> next;
+
+        //! Previous hop on path from source to destination (0 for source and unreachable nodes)
+        std::array<std::array<Address, ADDRESSES>, ADDRESSES> previous;
+      };
 
       /**
        * Represents network state visible on self node.
@@ -80,25 +111,237 @@ namespace PUT {
        * Network is made of nodes, which are connected with edges. Every edge
        * is described using Parameters. Edges are bidirectional and only single
        * edge connecting two nodes may exist in network.
+       *
+       * Writers (adding and dropping edges and nodes, updates) are serialized
+       * with Network::graphLock and publish new Snapshot after every change.
+       * Readers (paths, adjacency, MAC addresses, graph dumps) use the
+       * latest Snapshot and never take the lock - long Dijkstra does not
+       * block writers and readers never see half done change. Snapshot is
+       * freed when the last reader drops it.
        */
       class Network {
        friend class Router;
+       friend class Checkpoint;
 
        private:
-        //! Logical address to Node map
-        std::map< Address, Node* > nodes;
+        //! Nodes by address, slot is reused when node joins again (pointers stay valid)
+        std::array< Node, ADDRESSES > nodes;
+
+        //! Nodes in the network
+        std::bitset<ADDRESSES> present;
+
+        //! MAC addresses of nodes in the network, kept with Node::mac
+        Directory directory;
 
         //! Self Node definition.
-        Node* self_node;
+        Node* self_node = nullptr;
 
-        //! Adjacency map
-        XbeeGraphMap neighbours;
+        //! Edges and adjacency
+        Graph topology;
 
         //! Must lock if changing graph
         std::mutex graphLock;
 
-        //! Maximal address in the node - lower the better, used by Network::path()
+        //! Latest published state (use std::atomic_load() and std::atomic_store())
+        std::shared_ptr<const Snapshot> snapshot;
+
+        //! Number of Snapshots kept for reuse
+        static const size_t SNAPSHOTS = 4;
+
+        //! Published Snapshots, reused by publish() when no reader holds them (graph must be locked)
+        std::array<std::shared_ptr<Snapshot>, SNAPSHOTS> recycled;
+
+        //! Maximal address in the network
         Address max_address = 0;
+
+        //! Version of the graph, changed by every change relevant for paths from self
+        uint64_t graph_version = 1;
+
+        //! Version of the graph the shortest path tree is valid for
+        uint64_t tree_version = 0;
+
+        //! Version of the set of edges, changed by every connect() and disconnect()
+        uint64_t edges_version = 1;
+
+        //! Shortest path tree rooted at self - previous hop (0 for self and unreachable nodes)
+        std::array<Address, ADDRESSES> tree;
+
+        //! Distance from self to node in the shortest path tree
+        std::array<Metric, ADDRESSES> tree_distance;
+
+        //! Number of paths served from the tree
+        mutable std::atomic<uint64_t> hits {0};
+
+        //! Number of paths which needed Dijkstra (visited nodes on the tree path)
+        mutable std::atomic<uint64_t> misses {0};
+
+        //! Latest computed Routes, nullptr if all pairs mode is disabled (use std::atomic_load() and std::atomic_store())
+        std::shared_ptr<const Routes> routes;
+
+        //! Thread computing Routes for every published Snapshot
+        std::thread routesWorker;
+
+        //! Guards Network::routesRunning, Network::routesChanged waits on it
+        std::mutex routesLock;
+
+        //! Notified by publish() and when all pairs mode is disabled
+        std::condition_variable routesChanged;
+
+        //! True while Network::routesWorker should run
+        bool routesRunning = false;
+
+        //! Latest link-state advertisement of node (by address), graph must be locked
+        std::vector<Advertisement> advertisements;
+
+        //! Sequence number of the latest advertisement of node, graph must be locked
+        std::array<uint16_t, ADDRESSES> sequences;
+
+        //! Nodes with known advertisement, graph must be locked
+        std::bitset<ADDRESSES> advertised;
+
+        //! Digest of advertisements, graph must be locked
+        Digest digests {};
+
+        /**
+         * Dijkstra from single source over snapshot.
+         *
+         * Excluded nodes and adjacent nodes with unknown MAC address are
+         * never entered. Search stops as soon as destination is reached.
+         *
+         * @param snapshot Network state
+         * @param from Source address
+         * @param to Destination address (0 to reach every node)
+         * @param excluded Nodes which must not be visited
+         * @param distance Distance from source (valid for settled nodes)
+         * @param previous Previous hop on the path (0 for source and unreachable nodes)
+         * @param removed Edges which must not be used (by node, both directions set), may be nullptr
+         * @see Network::path()
+         */
+        static void search(const Snapshot &snapshot, Address from, Address to, const std::bitset<ADDRESSES> &excluded, std::array<Metric, ADDRESSES> &distance, std::array<Address, ADDRESSES> &previous, const std::array<std::bitset<ADDRESSES>, ADDRESSES>* removed = nullptr);
+
+        /**
+         * Find the most reliable path in snapshot.
+         *
+         * @param snapshot Network state
+         * @param from Source address
+         * @param to Destination address
+         * @param avoided Visited nodes
+         * @return The most reliable path
+         * @see Network::path()
+         */
+        Path path(const std::shared_ptr<const Snapshot> &snapshot, Address from, Address to, const std::bitset<ADDRESSES> &avoided) const;
+
+        /**
+         * Publish current state of the graph, graph must be locked.
+         *
+         * Shortest path tree is rebuilt if it is not valid. Snapshot is
+         * filled in place of one dropped by every reader, so steady state
+         * updates do not allocate memory.
+         */
+        void publish();
+
+        /**
+         * Get Snapshot to fill, graph must be locked.
+         *
+         * @return Recycled Snapshot no reader holds, new one if every
+         *         recycled Snapshot is in use
+         */
+        std::shared_ptr<Snapshot> recycle();
+
+        //! @return Latest published state
+        inline std::shared_ptr<const Snapshot> current() const {
+          return std::atomic_load(&snapshot);
+        }
+
+        /**
+         * Compute paths between every pair of nodes - single search() from
+         * every node.
+         *
+         * @param snapshot Network state
+         * @return Routes for the snapshot
+         */
+        static std::shared_ptr<const Routes> compute(const std::shared_ptr<const Snapshot> &snapshot);
+
+        /**
+         * Get Routes computed for snapshot.
+         *
+         * @param snapshot Network state
+         * @return Routes or nullptr if they are not computed yet (or all pairs mode is disabled)
+         */
+        std::shared_ptr<const Routes> routes_for(const std::shared_ptr<const Snapshot> &snapshot) const;
+
+        /**
+         * Create node if not existing, graph must be locked.
+         *
+         * @param a Address
+         * @return True if new node created
+         */
+        bool insert(Address a);
+
+        /**
+         * Create edge if not existing, graph must be locked.
+         *
+         * @param a Source
+         * @param b Destination
+         * @return True if new edge added
+         */
+        bool connect(Address a, Address b);
+
+        /**
+         * Remove node from the network (its slot stays), graph must be locked.
+         *
+         * @param a Address
+         */
+        void remove(Address a);
+
+        /**
+         * Remove edge if existing, graph must be locked.
+         *
+         * Nodes left without edges are removed from the network.
+         *
+         * @param a Source
+         * @param b Destination
+         * @return True if edge is removed
+         */
+        bool disconnect(Address a, Address b);
+
+        //! @return True if the latest advertisement of a lists b, graph must be locked
+        bool lists(Address a, Address b) const;
+
+        //! Remember sequence number of the latest advertisement of node, graph must be locked
+        void record(Address origin, uint16_t sequence);
+
+        /**
+         * Relax edge of the shortest path tree, the same way as search() does.
+         *
+         * @param a Source (already in the tree)
+         * @param b Destination
+         * @param frontier Destination is pushed here if its path is shortened
+         * @return True if path to destination is shortened
+         */
+        bool relax(Address a, Address b, Frontier &frontier);
+
+        //! Continue Dijkstra over the shortest path tree until frontier is empty
+        void propagate(Frontier &frontier);
+
+        /**
+         * Repair the shortest path tree after change of an edge, graph must
+         * be locked (Ramalingam-Reps).
+         *
+         * Cheaper (or new) edge is relaxed in both directions and shortened
+         * paths are propagated. Costlier (or removed) tree edge detaches
+         * subtree of its child - every node of the subtree is reconnected
+         * through the best edge from the rest of the tree, then Dijkstra
+         * continues over the subtree only. Costlier edge out of the tree
+         * changes nothing.
+         *
+         * If the tree is not valid, it is left to be rebuilt by publish().
+         *
+         * @param a Source
+         * @param b Destination
+         * @param costlier True if cost of edge is raised or edge is removed
+         */
+        void changed(Address a, Address b, bool costlier);
        public:
         /**
          * Construct network with self node.
@@ -108,7 +351,7 @@ namespace PUT {
         Network(Address self);
 
         /**
-         * Destroy network - releases memory used by nodes and edges.
+         * Destroy network - stops computing Routes and clears the graph.
          */
         ~Network();
 
@@ -168,11 +411,97 @@ namespace PUT {
          */
         bool drop(Address a, Address b);
 
+        /**
+         * Apply link-state advertisement of node.
+         *
+         * Advertisement is ignored unless its sequence number is newer than
+         * sequence number of the last advertisement of the node (numbers
+         * wrap around, as in serial number arithmetic). Newer advertisement
+         * replaces adjacency of the node: advertised edges are added, edges
+         * which are not advertised any more are removed. Cost of advertised
+         * edge is taken over, parameters are set so Parameters::metric()
+         * equals the cost.
+         *
+         * Edges of self are neither added nor changed - self measures them
+         * and drops them when heartbeat is lost.
+         *
+         * If advertisement of self is newer than the last one originated
+         * (self was restarted and network remembers old advertisements), its
+         * sequence number is taken over - new advertisement must be
+         * originated with Network::originate().
+         *
+         * @param origin Advertising node
+         * @param sequence Sequence number of the advertisement
+         * @param links Links of the node
+         * @return True if advertisement is new (it should be flooded further)
+         * @see Packet::Type::LinkState
+         */
+        bool link_state(Address origin, uint16_t sequence, const Advertisement &links);
+
+        /**
+         * Create new link-state advertisement of self, with current edges of
+         * self and their costs.
+         *
+         * @param links Links of self
+         * @return Sequence number of the advertisement
+         */
+        uint16_t originate(Advertisement &links);
+
+        /**
+         * Get the latest link-state advertisement of node.
+         *
+         * @param a Address
+         * @param sequence Sequence number of the advertisement
+         * @param links Links of the node
+         * @return False if no advertisement of the node is known
+         */
+        bool advertisement(Address a, uint16_t &sequence, Advertisement &links);
+
+        /**
+         * Get nodes which heard broadcast of transmitter.
+         *
+         * @param transmitter Address of node which broadcasted (0 if unknown)
+         * @return The transmitter and nodes adjacent to it (none if unknown)
+         */
+        std::bitset<ADDRESSES> audience(Address transmitter) const;
+
+        /**
+         * Check if broadcasts reached every neighbour of self.
+         *
+         * Flooding broadcast further from self is needed only if some
+         * neighbour of self has not heard it yet.
+         *
+         * @param heard Nodes which heard the broadcast (Network::audience() of transmitters)
+         * @return True if every neighbour of self heard it
+         */
+        bool covered(const std::bitset<ADDRESSES> &heard) const;
+
+        /**
+         * Get digest of known advertisements.
+         *
+         * Every bucket is XOR of fingerprints of (node, sequence number)
+         * of the latest advertisements of nodes in the bucket (address modulo
+         * number of buckets), so it is updated in constant time and two nodes
+         * know the same advertisements (with high probability) if their
+         * digests are equal. Buckets which differ tell which advertisements
+         * must be exchanged.
+         *
+         * @return Digest
+         * @see Network::bucket()
+         */
+        Digest digest();
+
+        //! @return Bucket of node in Network::digest()
+        static inline uint8_t bucket(Address a) {
+          return a % Packet::DIGEST_BUCKETS;
+        }
+
         /**
          * Get edge parameters.
          *
          * If edge is not existing, it is created and default parameters
-         * are returned.
+         * are returned. Parameters changed directly (not with Network::update())
+         * are not seen by readers until Network::invalidate() is called.
          *
          * @param a Source
          * @param b Destination
@@ -180,6 +509,23 @@ namespace PUT {
          */
         Parameters* edge(Address a, Address b);
 
+        /**
+         * Get published edge parameters.
+         *
+         * @param a Source
+         * @param b Destination
+         * @return Parameters of edge (default if edge does not exist)
+         */
+        Parameters parameters(Address a, Address b) const;
+
+        /**
+         * Get adjacent nodes.
+         *
+         * @param a Address
+         * @return Neighbours of the node (unordered)
+         */
+        Neighbours neighbours(Address a) const;
+
         /**
          * Get node definition.
          *
@@ -206,6 +552,16 @@ namespace PUT {
          */
         Edge* graph(uint8_t &length) const;
 
+        /**
+         * Dumps edges in the network to caller provided array.
+         *
+         * @param edges Array of at least capacity edges
+         * @param capacity Maximal number of edges
+         * @return Number of edges written
+         * @see Packet::Type::Graph
+         */
+        uint8_t graph(Edge* edges, uint8_t capacity) const;
+
         /**
          * Finds MAC address of the logical Node.
          *
@@ -223,44 +579,64 @@ namespace PUT {
         uint64_t mac(Address a) const;
 
         /**
-         * Updates parameters of given edge.
+         * Set MAC address of the logical Node.
          *
-         * Retries and error are added to current edge parameters
-         * (arithmetical sum is made). Parameters::good is incremented
-         * if error is equal to 0x00.
+         * Node is created if not existing. Setting MAC address of node
+         * adjacent to self may change paths from self.
          *
-         * The method mantains parameters overflow - they would never
-         * overflow, they will stop at UINT32_MAX if so would happen.
+         * @param a Address
+         * @param mac MAC address
+         */
+        void mac(Address a, uint64_t mac);
+
+        /**
+         * Updates parameters of given edge.
+         *
+         * Retries, error and delay are sampled into moving averages
+         * of the edge (Parameters::sample()).
          *
          * @param a Source
          * @param b Destination
          * @param retries Number of retries
          * @param error Number of undelivered packets
          * @param delay Delay on edge (a,b) [ms]
+         * @param now Time of the measure [ms]
          * @see RemoteParameters
          * @see Parameters
          * @see StatusFrame
          */
-        void update(Address a, Address b, uint8_t retries, uint8_t error, uint16_t delay);
+        void update(Address a, Address b, uint8_t retries, uint8_t error, uint16_t delay, uint64_t now = clock());
+
+        /**
+         * Decay measures of edges which got no samples for a while
+         * (Parameters::decay()), so avoided edges are tried again.
+         *
+         * @param now Current time [ms]
+         * @return Number of edges which got cheaper
+         */
+        size_t decay(uint64_t now = clock());
+
+        //! @return Monotonic time of edge measures [ms]
+        static uint64_t clock();
 
         /**
          * Find the most reliable path connecting two nodes, without visiting
-         * already visited nodes if possible.
+         * already visited nodes.
          *
          * Algorithm is based on modified Dijsktra shortest path algorithm
-         * implemented using priority queue.
+         * implemented using indexed heap (Frontier), it stops when destination
+         * is reached.
          *
-         * The state of the graph is locked while algorithm is running.
          * Algorithm returns every hop till destination, without source, where
-         * sum of the antireliability measure is lowest on the whole path.
+         * sum of the antireliability measure (fixed-point Parameters::metric())
+         * is lowest on the whole path.
          *
          * Path where sum of the antireliability measures on each edge is lowest,
          * is the most reliable path.
          *
-         * Algorithm may return path with already visited node if there is no
-         * other way to resolve the problem. Algorithm will ensure that
-         * first hop is adjacent to source, however it may return a node with
-         * no MAC address known, if there is no other path to destination.
+         * Visited nodes are excluded from the path, so as nodes adjacent to
+         * source with no MAC address known (there is no way to send them
+         * a frame).
          *
          * In perfect conditions (adjacent nodes have MAC known addresses
          * and visited nodes are not in the path) the algorithm will return
@@ -269,6 +645,14 @@ namespace PUT {
          * If connecting source with destination, by any means neccessary,
          * is not possible, empty path will be returned.
          *
+         * Paths from self are taken from the shortest path tree, which is
+         * repaired on every change of the graph. Paths from other nodes are
+         * taken from Routes, if all pairs mode is enabled and they are
+         * computed for the latest graph. If the path goes through visited
+         * node, Dijkstra is run for the packet.
+         *
+         * Graph is not locked, path is found in the latest snapshot.
+         *
          * @param from Source address
          * @param to Destination address
          * @param visited Already visited Node addresses
@@ -277,9 +661,107 @@ namespace PUT {
          * @see Dispatcher::deliver()
          * @see Packet::Type::Data
          */
-        Path path(Address from, Address to, Path visited);
+        Path path(Address from, Address to, const Visited &visited) const;
+
+        /**
+         * Find edge-disjoint paths connecting two nodes, without visiting
+         * already visited nodes.
+         *
+         * The first path is the one Network::path() returns, every next one
+         * is the most reliable path which uses none of the edges of previous
+         * paths (so first hops of the paths are different). Paths are found
+         * greedily, so they are ordered by cost.
+         *
+         * @param from Source address
+         * @param to Destination address
+         * @param visited Already visited Node addresses
+         * @param paths Array of at least k paths, found paths are written here
+         * @param costs Array of at least k costs (sum of Parameters::metric()), may be nullptr
+         * @param k Maximal number of paths
+         * @return Number of paths found
+         * @see Dispatcher::route()
+         */
+        uint8_t paths(Address from, Address to, const Visited &visited, Path* paths, Metric* costs, uint8_t k) const;
+
+        /**
+         * Get current cost of path found before.
+         *
+         * Path is usable if every its edge is still in the network and MAC
+         * address of the first hop is known.
+         *
+         * @param from Source address
+         * @param path Path from source (source not included)
+         * @param cost Sum of Parameters::metric() of path edges
+         * @return False if path is not usable
+         * @see Dispatcher::route()
+         */
+        bool cost(Address from, const Path &path, Metric &cost) const;
+
+        /**
+         * First hop on the most reliable path from self.
+         *
+         * @param to Destination address
+         * @return Adjacent node or 0 if destination is not reachable
+         * @see Network::path()
+         */
+        Address next_hop(Address to) const;
+
+        /**
+         * First hop on the most reliable path between any two nodes.
+         *
+         * Constant time if all pairs mode is enabled and Routes are computed
+         * for the latest graph, otherwise Network::path() is used.
+         *
+         * @param from Source address
+         * @param to Destination address
+         * @return Node adjacent to source or 0 if destination is not reachable
+         * @see Network::all_pairs()
+         */
+        Address next_hop(Address from, Address to) const;
+
+        /**
+         * Enable or disable all pairs mode.
+         *
+         * When enabled, background thread computes Routes for every published
+         * graph (changes made while computing are coalesced) and publishes
+         * them atomically. Readers use Routes only if they are computed for
+         * the latest graph, so they never see outdated paths.
+         *
+         * Must not be called concurrently with itself.
+         *
+         * @param enabled True to start, false to stop the thread
+         */
+        void all_pairs(bool enabled);
+
+        //! @return True if Routes are computed for the latest graph
+        bool all_pairs_ready() const;
+
+        /**
+         * Rebuild the shortest path tree and publish the graph, must be
+         * called after Parameters returned by Network::edge() are changed
+         * directly.
+         */
+        void invalidate();
+
+        //! @return Version of the graph (changes whenever paths from self may change)
+        uint64_t version() const;
+
+        /**
+         * Version of the set of edges - unlike version(), it changes also
+         * when added or dropped edge does not change the shortest path tree
+         * of self, so the other paths (Network::paths()) may change.
+         *
+         * @return Version of the set of edges
+         */
+        uint64_t topology_version() const;
+
+        //! @return Number of paths from self served from the shortest path tree
+        uint64_t cache_hits() const;
+
+        //! @return Number of paths from self which needed Dijkstra
+        uint64_t cache_misses() const;
 
-        Address from_mac(uint64_t mac);
+        Address from_mac(uint64_t mac) const;
       };
     }
   }
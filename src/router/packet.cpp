@@ -7,126 +7,279 @@
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
-      Packet::Packet(Packet* p, Address src, Address stat) : type(Type::Ack) {
-        packet_id = p->packet_id;
-        destination = p->visited.empty() ? p->source : p->visited.back();
-        origin = p->source;
+      const size_t Packet::MAX_PAYLOAD;
+      const uint8_t Packet::MAX_EDGES;
+      const uint8_t Packet::MAX_PARAMETERS;
+      const uint8_t Packet::MAX_LINKS;
+      const uint8_t Packet::MAX_AGE;
+      const uint8_t Packet::DIGEST_BUCKETS;
+      const uint8_t PacketView::PARAMETER_SIZE;
+      const uint8_t PacketView::LINK_SIZE;
+
+      //! Write address at l (host byte order)
+      static inline void put(unsigned char* buffer, uint8_t &l, Address a) {
+        memcpy(buffer + l, &a, sizeof(Address));
+        l += sizeof(Address);
+      }
+
+      //! Read address at p (host byte order)
+      static inline Address get(const uint8_t* buffer, uint8_t &p) {
+        Address a;
+
+        memcpy(&a, buffer + p, sizeof(Address));
+        p += sizeof(Address);
+
+        return a;
+      }
+
+      Packet::Packet(const Packet &p, Address src, Address stat) : type(Type::Ack) {
+        packet_id = p.packet_id;
+        destination = p.visited.empty() ? p.source : p.visited.back();
+        origin = p.source;
         source = src;
         length = 0;
         status = stat;
       }
 
-      Packet::~Packet() {
-        if (this == nullptr)
-          return;
+      Packet::Packet(Packet &&p) : type(Type::Internal) {
+        data.frame = nullptr;
+        *this = std::move(p);
+      }
+
+      Packet &Packet::operator=(Packet &&p) {
+        if (this == &p)
+          return *this;
+
+        if (type == Type::Internal)
+          delete data.frame;
+
+        type = p.type;
+        source = p.source;
+        destination = p.destination;
+        origin = p.origin;
+        length = p.length;
+        port = p.port;
+        mac = p.mac;
+        packet_id = p.packet_id;
+        status = p.status;
+        sequence = p.sequence;
+        age = p.age;
+        visited = std::move(p.visited);
 
         switch (type) {
           case Type::Internal:
-            delete data.frame;
-            data.frame = nullptr;
+            data.frame = p.data.frame;
+            p.data.frame = nullptr;
             break;
 
           case Type::Data:
+            memcpy(data.content, p.data.content, length);
+            break;
 
-            // case Type::Jumbo:
-            if (length > 0)
-              free(data.content);
-
-            data.content = nullptr;
-            length = 0;
+          case Type::Ack:
+            memcpy(data.parameters, p.data.parameters, length * sizeof(RemoteParameters));
             break;
 
           case Type::Graph:
-            if (length > 0)
-              free(data.edges);
+            memcpy(data.edges, p.data.edges, length * sizeof(Edge));
+            break;
 
-            data.edges = nullptr;
-            length = 0;
+          case Type::LinkState:
+            memcpy(data.links, p.data.links, length * sizeof(AdvertisedLink));
             break;
 
-          case Type::Ack:
-            if (length > 0)
-              delete data.parameters;
+          case Type::NodeBroadcast:
+            data.address = p.data.address;
+            memcpy(digest, p.digest, length * sizeof(uint16_t));
+            break;
 
-            data.parameters = nullptr;
-            length = 0;
+          case Type::EdgeDrop:
+            data.edge[0] = p.data.edge[0];
+            data.edge[1] = p.data.edge[1];
+            break;
 
           default:
             break;
         }
+
+        p.length = 0;
+
+        return *this;
+      }
+
+      Packet::~Packet() {
+        if (type == Type::Internal)
+          delete data.frame;
       }
 
       PacketId Packet::id() const {
+        const int width = 8 * sizeof(Address);
+
         if (type == Packet::Type::Ack)
-          return (((uint32_t)source) << 16) | (((uint32_t)origin) << 8) | packet_id;
+          return (((PacketId)source) << (8 + width)) | (((PacketId)origin) << 8) | packet_id;
         else
-          return (((uint32_t)destination) << 16) | (((uint32_t)source) << 8) | packet_id;
+          return (((PacketId)destination) << (8 + width)) | (((PacketId)source) << 8) | packet_id;
+      }
+
+      Packet::Packet(const PacketView &p, Address src, Address stat) : type(Type::Ack) {
+        packet_id = p.packet_id;
+        destination = p.visited_count == 0 ? p.source : p.visited[p.visited_count - 1];
+        origin = p.source;
+        source = src;
+        length = 0;
+        status = stat;
+      }
+
+      Packet::Packet(const PacketView &view) : type(Type::Internal) {
+        data.frame = nullptr;
+        from_view(view);
       }
 
       Packet::Type Packet::from_frame(Frame* frame) {
-        uint8_t p = 0;
-        uint8_t l = 0;
-        uint8_t visited_count = 0;
-        mac = frame->data.receive.mac;
+        PacketView view;
+
+        view.from_frame(frame->data.receive, frame->length);
+
+        return from_view(view);
+      }
 
-        type = (Packet::Type)(frame->data.receive.data[p++]);
-        l = frame->length;
+      Packet::Type Packet::from_view(const PacketView &view) {
+        if (type == Type::Internal)
+          delete data.frame;
+
+        type = view.type;
+        source = view.source;
+        destination = view.destination;
+        origin = view.origin;
+        length = view.length;
+        port = view.port;
+        packet_id = view.packet_id;
+        status = view.status;
+        sequence = view.sequence;
+        age = view.age;
+        mac = view.mac;
+
+        visited.assign(view.visited, view.visited + view.visited_count);
 
         switch (type) {
           case Type::Data:
-            destination = frame->data.receive.data[p++];
-            source = frame->data.receive.data[p++];
-            packet_id = frame->data.receive.data[p++];
-            port = frame->data.receive.data[p++];
-            visited_count = frame->data.receive.data[p++];
+            memcpy(data.content, view.data.content, length);
+            break;
 
-            for (int i = 0; i < visited_count; i++)
-              visited.push_back(frame->data.receive.data[p++]);
+          case Type::Ack:
+            if (length > MAX_PARAMETERS) {
+              LOG(WARNING) << "Ack of " << (int) length << " hops is truncated to " << (int) MAX_PARAMETERS;
+              length = MAX_PARAMETERS;
+            }
+
+            for (int i = 0; i < length; i++)
+              data.parameters[i] = view.parameter(i);
 
-            length = l - p;
-            DLOG(INFO) << "Deserializing data frame, content length is " << (int) length;
-            data.content = (uint8_t*)malloc(length * sizeof(uint8_t));
-            memcpy(data.content, frame->data.receive.data + p, length);
-            p += length;
             break;
 
-          case Type::Ack:
-            destination = frame->data.receive.data[p++];
-            source = frame->data.receive.data[p++];
-            packet_id = frame->data.receive.data[p++];
+          case Type::NodeBroadcast:
+            data.address = view.data.address;
+            length = std::min(length, DIGEST_BUCKETS);
 
-            origin = frame->data.receive.data[p++];
-            status = frame->data.receive.data[p++];
+            for (int i = 0; i < length; i++)
+              digest[i] = view.bucket(i);
 
-            length = (l - p) / 4;
-            data.parameters = (RemoteParameters*)malloc(length * sizeof(RemoteParameters));
+            break;
 
-            for (int i = 0; i < length; i++) {
-              data.parameters[i].hop = frame->data.receive.data[p++];
-              data.parameters[i].delay = ((uint16_t)frame->data.receive.data[p++]) << 8;
-              data.parameters[i].delay |= frame->data.receive.data[p++];
-              data.parameters[i].errors = frame->data.receive.data[p] >> 4;
-              data.parameters[i].retries = (frame->data.receive.data[p++] << 4) >> 4;
+          case Type::EdgeDrop:
+            data.edge[0] = view.data.edge[0];
+            data.edge[1] = view.data.edge[1];
+            break;
+
+          case Type::Graph:
+            if (length > MAX_EDGES) {
+              LOG(WARNING) << "Graph of " << (int) length << " edges is truncated to " << (int) MAX_EDGES;
+              length = MAX_EDGES;
             }
 
-            p += length;
+            memcpy(data.edges, view.data.edges, length * sizeof(Edge));
             break;
 
-          case Type::NodeBroadcast:
-            data.address = frame->data.receive.data[p++];
+          case Type::LinkState:
+            if (length > MAX_LINKS) {
+              LOG(WARNING) << "Link-state of " << (int) length << " links is truncated to " << (int) MAX_LINKS;
+              length = MAX_LINKS;
+            }
+
+            for (int i = 0; i < length; i++)
+              data.links[i] = view.link(i);
+
             break;
 
-          case Type::EdgeDrop:
+          default:
+            break;
+        }
+
+        return type;
+      }
+
+      Packet::Type PacketView::from_frame(const ReceiveFrame &frame, uint16_t l) {
+        uint8_t p = 0;
+        mac = frame.mac;
+
+        type = (Packet::Type)(frame.data[p++]);
+
+        switch (type) {
+          case Packet::Type::Data:
+            destination = get(frame.data, p);
+            source = get(frame.data, p);
+            packet_id = frame.data[p++];
+            port = frame.data[p++];
+            visited_count = frame.data[p++];
+            visited = (const Address*)(frame.data + p);
+            p += visited_count * sizeof(Address);
+
+            length = l - p;
+            DLOG(INFO) << "Deserializing data frame, content length is " << (int) length;
+            data.content = frame.data + p;
+            break;
+
+          case Packet::Type::Ack:
+            destination = get(frame.data, p);
+            source = get(frame.data, p);
+            packet_id = frame.data[p++];
+
+            origin = get(frame.data, p);
+            status = get(frame.data, p);
+
+            length = (l - p) / PARAMETER_SIZE;
+            data.parameters = frame.data + p;
+            break;
+
+          case Packet::Type::NodeBroadcast:
+            data.address = get(frame.data, p);
+
+            length = (l - p) / 2;
+            digest = frame.data + p;
+            break;
+
+          case Packet::Type::EdgeDrop:
             length = 2;
-            data.edge[0] = frame->data.receive.data[p++];
-            data.edge[1] = frame->data.receive.data[p++];
+            data.edge[0] = get(frame.data, p);
+            data.edge[1] = get(frame.data, p);
             break;
 
-          case Type::Graph:
-            length = (l - 1) / 2;
-            data.edges = (Edge*)malloc(length * sizeof(Address) * 2);
-            memcpy(data.edges, frame->data.receive.data + p, length * 2);
-            p += length * 2;
+          case Packet::Type::Graph:
+            // edges are aligned to address size
+            p = sizeof(Address);
+            length = (l - p) / sizeof(Edge);
+            data.edges = (Edge*)(frame.data + p);
+            break;
+
+          case Packet::Type::LinkState:
+            destination = get(frame.data, p);
+            source = get(frame.data, p);
+            sequence = ((uint16_t)frame.data[p++]) << 8;
+            sequence |= frame.data[p++];
+            age = frame.data[p++];
+
+            length = (l - p) / LINK_SIZE;
+            data.links = frame.data + p;
             break;
 
           default:
@@ -137,42 +290,72 @@ namespace PUT {
         return type;
       }
 
-      Frame* Packet::to_frame() {
-        Frame* frame = new Frame(Frame::Type::Transmit);
+      RemoteParameters PacketView::parameter(uint8_t i) const {
+        RemoteParameters parameters;
+        const uint8_t* p = data.parameters + PARAMETER_SIZE * i;
+        uint8_t o = 0;
+
+        parameters.hop = get(p, o);
+        parameters.delay = ((uint16_t)p[o]) << 8;
+        parameters.delay |= p[o + 1];
+        parameters.errors = p[o + 2] >> 4;
+        parameters.retries = (p[o + 2] << 4) >> 4;
+
+        return parameters;
+      }
+
+      AdvertisedLink PacketView::link(uint8_t i) const {
+        AdvertisedLink link;
+        const uint8_t* p = data.links + LINK_SIZE * i;
+        uint8_t o = 0;
+
+        link.node = get(p, o);
+        link.cost = ((uint16_t)p[o]) << 8;
+        link.cost |= p[o + 1];
+
+        return link;
+      }
+
+      uint16_t PacketView::bucket(uint8_t i) const {
+        return (((uint16_t)digest[2 * i]) << 8) | digest[2 * i + 1];
+      }
 
-        unsigned char d[256];
+      uint8_t Packet::serialize(unsigned char* header, const uint8_t* &payload, uint16_t &payload_length) const {
         uint8_t l = 0;
 
-        d[l++] = (unsigned char)type;
+        payload = nullptr;
+        payload_length = 0;
+
+        header[l++] = (unsigned char)type;
 
         switch (type) {
           case Type::Data:
-            d[l++] = destination;
-            d[l++] = source;
-            d[l++] = packet_id;
-            d[l++] = port;
-            d[l++] = visited.size();
+            put(header, l, destination);
+            put(header, l, source);
+            header[l++] = packet_id;
+            header[l++] = port;
+            header[l++] = visited.size();
 
-            for (uint8_t n : visited)
-              d[l++] = n;
+            for (Address n : visited)
+              put(header, l, n);
 
             DLOG(INFO) << "Serializing data frame, content length is " << (int) length;
-            memcpy(d + l, data.content, length);
-            l += length;
+            payload = data.content;
+            payload_length = length;
             break;
 
           case Type::Ack:
-            d[l++] = destination;
-            d[l++] = source;
-            d[l++] = packet_id;
-            d[l++] = origin;
-            d[l++] = status;
+            put(header, l, destination);
+            put(header, l, source);
+            header[l++] = packet_id;
+            put(header, l, origin);
+            put(header, l, status);
 
             for (int i = 0; i < length; i++) {
-              d[l++] = data.parameters[i].hop;
-              d[l++] = data.parameters[i].delay >> 8;
-              d[l++] = (data.parameters[i].delay << 8) >> 8;
-              d[l++] = (data.parameters[i].errors << 4) | ((data.parameters[i].retries << 4) >> 4);
+              put(header, l, data.parameters[i].hop);
+              header[l++] = data.parameters[i].delay >> 8;
+              header[l++] = (data.parameters[i].delay << 8) >> 8;
+              header[l++] = (data.parameters[i].errors << 4) | ((data.parameters[i].retries << 4) >> 4);
             }
 
             // FOR POSTERITY: my fault ALJ
@@ -180,17 +363,42 @@ namespace PUT {
             break;
 
           case Type::NodeBroadcast:
-            d[l++] = data.address;
+            put(header, l, data.address);
+
+            for (int i = 0; i < length; i++) {
+              header[l++] = digest[i] >> 8;
+              header[l++] = digest[i] & 0xFF;
+            }
+
             break;
 
           case Type::EdgeDrop:
-            d[l++] = data.edge[0];
-            d[l++] = data.edge[1];
+            put(header, l, data.edge[0]);
+            put(header, l, data.edge[1]);
             break;
 
           case Type::Graph:
-            memcpy(d + l, data.edges, length * 2);
-            l += length * 2;
+            // edges are aligned to address size
+            while (l < sizeof(Address))
+              header[l++] = 0;
+
+            payload = (const uint8_t*)data.edges;
+            payload_length = length * sizeof(Edge);
+            break;
+
+          case Type::LinkState:
+            put(header, l, destination);
+            put(header, l, source);
+            header[l++] = sequence >> 8;
+            header[l++] = sequence & 0xFF;
+            header[l++] = age;
+
+            for (int i = 0; i < length; i++) {
+              put(header, l, data.links[i].node);
+              header[l++] = data.links[i].cost >> 8;
+              header[l++] = data.links[i].cost & 0xFF;
+            }
+
             break;
 
           default:
@@ -198,9 +406,21 @@ namespace PUT {
             break;
         }
 
-        frame->length = l;
-        frame->data.transmit.data = (unsigned char*)malloc(frame->length * sizeof(unsigned char));
-        memcpy(frame->data.transmit.data, d, frame->length);
+        return l;
+      }
+
+      Frame* Packet::to_frame() {
+        Frame* frame = new Frame(Frame::Type::Transmit);
+        unsigned char* d = (unsigned char*)Buffers::allocate(Frame::MAX_SIZE * sizeof(unsigned char));
+        const uint8_t* payload;
+        uint16_t payload_length;
+        uint8_t l = serialize(d, payload, payload_length);
+
+        if (payload_length > 0)
+          memcpy(d + l, payload, payload_length);
+
+        frame->length = l + payload_length;
+        frame->data.transmit.data = d;
 
         return frame;
       }
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <algorithm>
 #include <vector>
 #include <deque>
 
@@ -65,6 +66,24 @@ namespace PUT {
         uint8_t retries = 0;
       };
 
+      /**
+       * Single link of Packet::Type::LinkState.
+       *
+       * Describes edge from advertising node to its adjacent node, with cost
+       * of the edge as seen by the advertising node.
+       *
+       * @see Network::link_state()
+       */
+      struct AdvertisedLink {
+        //! Adjacent node
+        Address node = 0;
+
+        //! Cost of the edge (Parameters::metric(), saturated at UINT16_MAX)
+        uint16_t cost = 0;
+      };
+
+      struct PacketView;
+
       /**
        * Packet is the data type which is exchanged on Network level.
        * Packet is encapsulated into Xbee Frame.
@@ -88,7 +107,9 @@ namespace PUT {
           //! Drop every routing data
           // Reset = 0xFF - 0x03,
           //! Got graph
-          Graph = 0xFF - 0x04
+          Graph = 0xFF - 0x04,
+          //! Link-state advertisement of single node
+          LinkState = 0xFF - 0x05
         } type;
 
         //! Packet source address
@@ -98,8 +119,26 @@ namespace PUT {
         //! Ack origin (source address of coresponding packet to ack)
         Address origin;
 
+        //! Size of inline payload storage (Packet::length is uint8_t)
+        static const size_t MAX_PAYLOAD = 255;
+
+        //! Maximal number of edges if Type::Graph
+        static const uint8_t MAX_EDGES = MAX_PAYLOAD / sizeof(Edge);
+
+        //! Maximal number of ack entries if Type::Ack
+        static const uint8_t MAX_PARAMETERS = MAX_PAYLOAD / sizeof(RemoteParameters);
+
+        //! Maximal number of links if Type::LinkState (header takes 4 bytes and two addresses)
+        static const uint8_t MAX_LINKS = (MAX_PAYLOAD - 4 - 2 * sizeof(Address)) / sizeof(AdvertisedLink);
+
+        //! Hops after which Type::LinkState is not flooded further
+        static const uint8_t MAX_AGE = 32;
+
+        //! Number of topology digest buckets if Type::NodeBroadcast
+        static const uint8_t DIGEST_BUCKETS = 16;
+
         //! Data length - describes data count in Packet::data union
-        uint8_t length;
+        uint8_t length = 0;
 
         /**
          * Port number used when Packet::Type::Data.
@@ -110,22 +149,33 @@ namespace PUT {
          */
         uint8_t port = 0;
 
-        //! Packet content
-        union {
+        /**
+         * Packet content.
+         *
+         * Variable data is stored inline, only Packet::length elements
+         * are valid (and copied when packet is moved).
+         */
+        union Payload {
           //! Simple binary data if Type::Data
-          uint8_t* content;
+          uint8_t content[MAX_PAYLOAD];
 
-          //! Frame if Type::Internal
+          //! Frame if Type::Internal (owned by packet)
           Frame* frame;
           //! Node address if Type::NodeBroadcast
           Address address;
           //! Edge if Type::EdgeDrop
           Edge edge;
           //! Array of edges if Type::Graph
-          Edge* edges;
+          Edge edges[MAX_EDGES];
 
           //! Edge parameters if Type::Ack
-          RemoteParameters* parameters;
+          RemoteParameters parameters[MAX_PARAMETERS];
+
+          //! Links of Packet::source if Type::LinkState
+          AdvertisedLink links[MAX_LINKS];
+
+          //! Payload is not initialized, packet constructors set what they use
+          Payload() { }
         } data;
 
         /**
@@ -170,11 +220,34 @@ namespace PUT {
          */
         Address status = 0;
 
+        /**
+         * Sequence number of advertisement if Type::LinkState.
+         *
+         * Every new advertisement of the node has next number, older
+         * or repeated advertisements are ignored (serial number arithmetic,
+         * so numbers wrap around).
+         */
+        uint16_t sequence = 0;
+
+        /**
+         * Age of advertisement if Type::LinkState - number of hops it was
+         * flooded over, it is not flooded after Packet::MAX_AGE.
+         */
+        uint8_t age = 0;
+
+        /**
+         * Topology digest of sender if Type::NodeBroadcast, Packet::length
+         * buckets are valid (none if sender does not send digests).
+         *
+         * @see Network::digest()
+         */
+        uint16_t digest[DIGEST_BUCKETS];
+
         /**
          * Path containing every node between source and self (ideally destination),
          * which was visited.
          */
-        Path visited;
+        Visited visited;
 
         /**
          * Get unique ID of packet.
@@ -185,7 +258,8 @@ namespace PUT {
          * is the same!
          *
          * ID is created of Packet::destination, Packet::source and Packet::frame_id
-         * in form of zDSF, where z is not used byte.
+         * in form of zDSF, where z is not used byte (addresses are two bytes wide
+         * if built with XBEE_WIDE_ADDRESS).
          *
          * @see Packet::frame_id
          */
@@ -194,14 +268,18 @@ namespace PUT {
         /**
          * Create internal packet
          */
-        Packet() : type(Type::Internal) { };
+        Packet() : type(Type::Internal) {
+          data.frame = nullptr;
+        };
 
         /**
          * Create packet of given type
          *
          * @param t Packet Type
          */
-        Packet(Type t) : type(t) { };
+        Packet(Type t) : type(t) {
+          data.frame = nullptr;
+        };
 
         /**
          * Create Packet::Type::Data with simple string data.
@@ -209,9 +287,8 @@ namespace PUT {
          * @param s String data (no nulls here!)
          */
         Packet(std::string s) {
-          length = s.size();
-          data.content = (uint8_t*)malloc(length * sizeof(uint8_t));
-          strcpy((char*)data.content, s.c_str());
+          length = std::min(s.size(), MAX_PAYLOAD);
+          memcpy(data.content, s.c_str(), length);
           type = Type::Data;
         };
 
@@ -244,7 +321,40 @@ namespace PUT {
          * @param src Address of node from which ack will be send
          * @param stat Status for ack
          */
-        Packet(Packet* p, Address src, Address stat);
+        Packet(const Packet &p, Address src, Address stat);
+
+        /**
+         * Create Packet::Type::Ack from source for given packet view with given status.
+         *
+         * @param p Packet view for which ack is created
+         * @param src Address of node from which ack will be send
+         * @param stat Status for ack
+         */
+        Packet(const PacketView &p, Address src, Address stat);
+
+        /**
+         * Create owning copy of packet view.
+         *
+         * Used when Packet must outlive the receive buffer, e.g. when
+         * it is stored in History.
+         *
+         * @param view Packet view
+         */
+        Packet(const PacketView &view);
+
+        /**
+         * Move packet, payload is copied (only Packet::length elements)
+         * and Frame of Type::Internal is taken over.
+         *
+         * @param p Packet to move from (becomes empty)
+         */
+        Packet(Packet &&p);
+
+        Packet &operator=(Packet &&p);
+
+        //! Packets are not copied - they are moved or ack is created
+        Packet(const Packet &) = delete;
+        Packet &operator=(const Packet &) = delete;
 
         /**
          * Creates Packet from Frame.
@@ -257,6 +367,31 @@ namespace PUT {
          */
         Type from_frame(Frame* frame);
 
+        /**
+         * Copies Packet from its view.
+         *
+         * Variable data (content, visited nodes, edges, ack parameters) is copied.
+         *
+         * @param view Packet view
+         * @return Packet type
+         */
+        Type from_view(const PacketView &view);
+
+        /**
+         * Serializes Packet header into caller provided buffer.
+         *
+         * Variable data which is already in wire format (Packet::Type::Data content,
+         * Packet::Type::Graph edges) is not copied, it is returned as payload which
+         * should be sent right after the header.
+         *
+         * @param header Buffer for header (at least Frame::MAX_SIZE bytes)
+         * @param payload Payload to send after header (may be nullptr)
+         * @param payload_length Length of payload
+         * @return Length of header
+         * @see Xbee::send(const Packet&, uint8_t, uint64_t, uint16_t, uint8_t, uint8_t)
+         */
+        uint8_t serialize(unsigned char* header, const uint8_t* &payload, uint16_t &payload_length) const;
+
         /**
          * Encapsulates Packet into Frame.
          *
@@ -284,11 +419,128 @@ namespace PUT {
         Frame* to_frame(uint8_t id, uint64_t mac, uint16_t network, uint8_t radius = 0x00, uint8_t options = 0x00);
 
         /**
-         * Destroys packet and every associated data.
-         *
-         * Does clean memory if Type::Data, Type::Jumbo, Type::Ack or Type::Internal.
+         * Destroys packet, Frame is deleted if Type::Internal.
          */
         ~Packet();
+
+        //! Packets are allocated from Pool
+        static void* operator new(size_t size) {
+          return Pool<Packet>::allocate(size);
+        }
+
+        static void operator delete(void* p) {
+          Pool<Packet>::release(p);
+        }
+      };
+
+      /**
+       * Non-owning view of Packet encapsulated in received Frame.
+       *
+       * Variable fields (visited nodes, content, edges and ack parameters)
+       * point directly into frame data, so decoding does not allocate memory.
+       * Addresses are sent in host byte order (as Graph edges always were),
+       * so arrays of them are used in place.
+       * Owning Packet is created from the view only if it has to outlive the
+       * buffer (e.g. when it is stored in History).
+       *
+       * @see Packet
+       * @see FrameView
+       */
+      struct PacketView {
+        //! Bytes of single ack entry on air
+        static const uint8_t PARAMETER_SIZE = sizeof(Address) + 3;
+
+        //! Bytes of single advertised link on air
+        static const uint8_t LINK_SIZE = sizeof(Address) + 2;
+
+        //! Packet type
+        Packet::Type type = Packet::Type::Internal;
+
+        //! Packet source address
+        Address source = 0;
+        //! Packet destination address
+        Address destination = 0;
+        //! Ack origin
+        Address origin = 0;
+
+        //! Data length - describes data count in PacketView::data union
+        uint8_t length = 0;
+
+        //! Port number used when Packet::Type::Data
+        uint8_t port = 0;
+
+        //! Constant packet ID
+        uint8_t packet_id = 0;
+
+        //! Ack delivery status
+        Address status = 0;
+
+        //! Sequence number of advertisement if Type::LinkState
+        uint16_t sequence = 0;
+
+        //! Age of advertisement if Type::LinkState
+        uint8_t age = 0;
+
+        //! Serialized topology digest if Type::NodeBroadcast (2 bytes per bucket)
+        const uint8_t* digest = nullptr;
+
+        //! MAC address of packet sender
+        uint64_t mac = 0;
+
+        //! Visited nodes (points into frame data)
+        const Address* visited = nullptr;
+
+        //! Number of visited nodes
+        uint8_t visited_count = 0;
+
+        //! Packet content, points into frame data
+        union {
+          //! Simple binary data if Type::Data
+          uint8_t* content;
+          //! Node address if Type::NodeBroadcast
+          Address address;
+          //! Edge if Type::EdgeDrop
+          Edge edge;
+          //! Array of edges if Type::Graph
+          Edge* edges;
+          //! Serialized edge parameters if Type::Ack (PacketView::PARAMETER_SIZE bytes each)
+          uint8_t* parameters;
+          //! Serialized links if Type::LinkState (PacketView::LINK_SIZE bytes each)
+          uint8_t* links;
+        } data;
+
+        /**
+         * Decodes packet from received frame, without copying.
+         *
+         * @param frame Receive frame (its data must outlive the view)
+         * @param l Length of frame data
+         * @return Packet type
+         */
+        Packet::Type from_frame(const ReceiveFrame &frame, uint16_t l);
+
+        /**
+         * Decodes single ack entry.
+         *
+         * @param i Index of entry (less than length)
+         * @return Edge parameters
+         */
+        RemoteParameters parameter(uint8_t i) const;
+
+        /**
+         * Decodes single link of advertisement.
+         *
+         * @param i Index of link (less than length)
+         * @return Link
+         */
+        AdvertisedLink link(uint8_t i) const;
+
+        /**
+         * Decodes single bucket of topology digest.
+         *
+         * @param i Index of bucket (less than length)
+         * @return Digest of bucket
+         */
+        uint16_t bucket(uint8_t i) const;
       };
     }
   }
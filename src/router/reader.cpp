@@ -0,0 +1,107 @@
+#include "reader.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <algorithm>
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      ssize_t FrameReader::fill(int fd) {
+        size_t free_space = buffer_size - available();
+        size_t start = head & (buffer_size - 1);
+        struct iovec parts[2];
+        int count = 1;
+        ssize_t status;
+
+        if (free_space == 0)
+          return 0;
+
+        // free space may wrap around the end of the buffer
+        parts[0].iov_base = buffer + start;
+        parts[0].iov_len = std::min(free_space, buffer_size - start);
+
+        if (parts[0].iov_len < free_space) {
+          parts[1].iov_base = buffer;
+          parts[1].iov_len = free_space - parts[0].iov_len;
+          count = 2;
+        }
+
+        do {
+          status = readv(fd, parts, count);
+        } while (status == -1 && errno == EINTR);
+
+        if (status > 0) {
+          head += status;
+          bytes_read.fetch_add(status, std::memory_order_relaxed);
+        }
+
+        return status;
+      }
+
+      bool FrameReader::next(FrameView &view) {
+        while (available() > 0) {
+          // drop everything until start delimiter
+          if (at(0) != 0x7E) {
+            if (!resyncing) {
+              resyncing = true;
+              resyncs.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            tail++;
+            continue;
+          }
+
+          resyncing = false;
+
+          if (available() < 3)
+            return false;
+
+          size_t length = (((uint16_t)at(1)) << 8) | at(2);
+
+          // impossible length, so it was not the delimiter
+          if (length == 0 || length + 4 > (size_t)Frame::MAX_SIZE) {
+            tail++;
+            continue;
+          }
+
+          if (available() < length + 4)
+            return false;
+
+          uint8_t checksum = 0;
+
+          for (size_t i = 0; i <= length; i++)
+            checksum += at(3 + i);
+
+          // checksum over data and checksum byte itself must be 0xFF
+          if (checksum != 0xFF) {
+            checksum_failures.fetch_add(1, std::memory_order_relaxed);
+            tail++;
+            continue;
+          }
+
+          for (size_t i = 0; i < length + 4; i++)
+            frame[i] = at(i);
+
+          frame_length = length + 4;
+          tail += frame_length;
+          frames_decoded.fetch_add(1, std::memory_order_relaxed);
+
+          view.unserialize(frame);
+
+          return true;
+        }
+
+        return false;
+      }
+
+      Frame* FrameReader::next() {
+        FrameView view;
+
+        return next(view) ? new Frame(view) : nullptr;
+      }
+    }
+  }
+}
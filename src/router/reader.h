@@ -0,0 +1,142 @@
+#ifndef PUT_RADIO_READER_H
+#define PUT_RADIO_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+#include "../radio.h"
+
+namespace PUT {
+  namespace CS {
+    namespace XbeeRouting {
+      /**
+       * Buffered reader of Xbee API frames.
+       *
+       * Bytes are pulled from the serial port in bulk into a ring buffer,
+       * then incremental decoder looks for start delimiter (0x7E), reads
+       * frame length and validates checksum. Single read may carry
+       * several frames - every one of them is decoded before the next
+       * read is needed.
+       *
+       * If garbage is found between frames (or frame is malformed), decoder
+       * drops bytes until next start delimiter (resynchronization).
+       *
+       * Not thread safe - there should be only one reading thread.
+       */
+      class FrameReader {
+       private:
+        //! Size of ring buffer - must be power of 2
+        static const size_t buffer_size = 1024;
+
+        //! Ring buffer
+        unsigned char buffer[buffer_size];
+
+        //! Write position (never wrapped, masked when accessed)
+        size_t head = 0;
+
+        //! Read position (never wrapped, masked when accessed)
+        size_t tail = 0;
+
+        //! Last decoded frame, continuous in memory
+        unsigned char frame[Frame::MAX_SIZE];
+
+        //! Length of last decoded frame
+        size_t frame_length = 0;
+
+        //! True when bytes are being dropped, looking for start delimiter
+        bool resyncing = false;
+
+        //! Number of bytes read from serial port
+        std::atomic<uint64_t> bytes_read {0};
+
+        //! Number of valid frames decoded
+        std::atomic<uint64_t> frames_decoded {0};
+
+        //! Number of frames dropped because of invalid checksum
+        std::atomic<uint64_t> checksum_failures {0};
+
+        //! Number of times decoder had to look for start delimiter
+        std::atomic<uint64_t> resyncs {0};
+
+        /**
+         * Byte in the buffer at given offset from read position.
+         *
+         * @param offset Offset from read position
+         * @return Byte
+         */
+        inline unsigned char at(size_t offset) const {
+          return buffer[(tail + offset) & (buffer_size - 1)];
+        }
+
+       public:
+        /**
+         * Blocking. Read as many bytes as available (and fit into buffer)
+         * from the descriptor, using single system call.
+         *
+         * @param fd Descriptor
+         * @return Number of read bytes, 0 on end of file, -1 on error
+         */
+        ssize_t fill(int fd);
+
+        /**
+         * Decode next complete frame from the buffer, without copying.
+         *
+         * @param view View of the frame (valid until next call to next())
+         * @return True if frame was decoded, false if no complete frame is buffered
+         */
+        bool next(FrameView &view);
+
+        /**
+         * Decode next complete frame from the buffer.
+         *
+         * @return Frame (must be deleted) or nullptr if no complete frame is buffered
+         */
+        Frame* next();
+
+        /**
+         * Number of buffered, not yet decoded bytes.
+         *
+         * @return Number of bytes
+         */
+        inline size_t available() const {
+          return head - tail;
+        }
+
+        /**
+         * Raw bytes of last decoded frame.
+         *
+         * @param length Length of the frame
+         * @return Frame bytes (valid until next call to next())
+         */
+        inline const unsigned char* last(size_t &length) const {
+          length = frame_length;
+          return frame;
+        }
+
+        //! @return Number of bytes read from serial port
+        inline uint64_t bytes() const {
+          return bytes_read.load(std::memory_order_relaxed);
+        }
+
+        //! @return Number of valid frames decoded
+        inline uint64_t frames() const {
+          return frames_decoded.load(std::memory_order_relaxed);
+        }
+
+        //! @return Number of frames with invalid checksum
+        inline uint64_t checksum_errors() const {
+          return checksum_failures.load(std::memory_order_relaxed);
+        }
+
+        //! @return Number of resynchronizations
+        inline uint64_t resynchronizations() const {
+          return resyncs.load(std::memory_order_relaxed);
+        }
+      };
+    }
+  }
+}
+#endif
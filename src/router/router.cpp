@@ -7,35 +7,91 @@
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
-      Router::Router(char* serial_port, uint8_t address): xbee(serial_port), network(address), self(network.self()), driver(), dispatcher(xbee, network, driver) {
-        uint8_t length;
-        char* result;
-        uint64_t a = 0;
-
-        // Node Identifier
-        result = xbee.get("NI", length);
-        self->name = std::string(result);
-        free(result);
-
-        // Network ID
-        result = xbee.get("ID", length);
-        memcpy(&a, result, 2);
-        self->network = a;
-        free(result);
-
-        // Serial Number Low
-        result = xbee.get("SL", length);
-        a = 0;
-        memcpy(&a, result, 4);
-        self->mac = a << 32;
-        free(result);
-
-        // Serial Number High
-        result = xbee.get("SH", length);
-        a = 0;
-        memcpy(&a, result, 4);
-        self->mac |= a;
-        free(result);
+      //! Longest jitter of control floods from environment variable
+      static std::chrono::milliseconds flood_jitter() {
+        const char* value = getenv("XBEE_FLOOD_JITTER");
+
+        return std::chrono::milliseconds(value != NULL && *value != '\0' ? strtoul(value, NULL, 10) : 100);
+      }
+
+      Router::Router(char* serial_port, Address address):
+        identity_cache(getenv("XBEE_IDENTITY_CACHE") != NULL ? getenv("XBEE_IDENTITY_CACHE") : ""),
+        device(serial_port),
+        xbee(serial_port, !load_identity()),
+        network(address), self(network.self()), driver(), dispatcher(xbee, network, driver),
+        flooder(network, [this](Packet &packet) { dispatcher.broadcast(packet); }, flood_jitter()) {
+        Frame* result;
+
+        startup.connected = std::chrono::steady_clock::now();
+
+        if (getenv("XBEE_ALL_PAIRS") != NULL)
+          network.all_pairs(true);
+
+        if (startup.cached) {
+          // responses are received by process(), routing starts immediately
+          request_identity(validation);
+          auto requested = std::chrono::steady_clock::now();
+
+          identityValidator = std::thread([this, requested]() {
+            THREAD_NAME("IdentityCheck");
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            Identity radio = identity;
+            Frame* response;
+
+            for (auto &request : validation) {
+              if (request.wait_until(deadline) != std::future_status::ready || (response = request.get()) == nullptr) {
+                LOG(WARNING) << "Cached radio identity could not be validated";
+
+                // unanswered requests would hold their frame IDs forever
+                xbee.expire(requested);
+                return;
+              }
+
+              radio.update(*response);
+              delete response;
+            }
+
+            if (radio == identity) {
+              LOG(INFO) << "Cached radio identity is valid";
+              return;
+            }
+
+            LOG(WARNING) << "Cached radio identity is outdated, using identity reported by radio";
+
+            identity = radio;
+            apply_identity();
+
+            if (!identity.save(identity_cache, device))
+              LOG(WARNING) << "Could not write radio identity cache " << identity_cache;
+          });
+        } else {
+          std::future<Frame*> requests[4];
+          request_identity(requests);
+
+          for (auto &request : requests) {
+            if ((result = xbee.wait(request)) != nullptr) {
+              identity.update(*result);
+              delete result;
+            }
+          }
+
+          if (!identity_cache.empty() && !identity.save(identity_cache, device))
+            LOG(WARNING) << "Could not write radio identity cache " << identity_cache;
+        }
+
+        apply_identity();
+        startup.identified = std::chrono::steady_clock::now();
+
+        const char* topology_cache = getenv("XBEE_TOPOLOGY_CACHE");
+
+        if (topology_cache != NULL && *topology_cache != '\0') {
+          size_t nodes, edges;
+
+          if (!checkpoint.open(topology_cache))
+            LOG(WARNING) << "Could not open topology cache " << topology_cache;
+          else if (checkpoint.restore(network, nodes, edges))
+            LOG(INFO) << "Restored " << nodes << " nodes and " << edges << " edges from topology cache";
+        }
 
         unsigned char t[1];
 
@@ -46,15 +102,16 @@ namespace PUT {
         xbee.command("MT", t, 1);
 
         driver.self([this](Address destination, uint8_t port, Address source, uint8_t* data, size_t length) {
-          if (destination != Driver::SELF) {
-            Packet* packet = new Packet(Packet::Type::Data);
-            packet->source = (source == Driver::SELF) ? self->address : source;
-            packet->destination = destination;
-            packet->port = port;
-            packet->length = length;
-            packet->data.content = (uint8_t*)malloc(packet->length);
-            memcpy(packet->data.content, data, length);
-            dispatcher.deliver(packet);
+          if (destination != Driver::SELF && length > Packet::MAX_PAYLOAD) {
+            LOG(WARNING) << "Dropping " << length << " bytes of data for " << (int) destination << ", packet fits " << Packet::MAX_PAYLOAD;
+          } else if (destination != Driver::SELF) {
+            Packet packet(Packet::Type::Data);
+            packet.source = (source == Driver::SELF) ? self->address : source;
+            packet.destination = destination;
+            packet.port = port;
+            packet.length = length;
+            memcpy(packet.data.content, data, length);
+            dispatcher.deliver(std::move(packet));
           }
         });
 
@@ -62,10 +119,14 @@ namespace PUT {
 
         nodeBroadcaster = std::thread([this]() {
           THREAD_NAME("NodeBroadcast");
-          Packet packet(self->address);
 
           while (nodeBroadcasterRun.load()) {
-            dispatcher.broadcast(&packet);
+            heartbeat();
+
+            if (checkpoint.opened() && !checkpoint.save(network))
+              LOG(WARNING) << "Could not write topology cache";
+
+            LOG(INFO) << "Floods: " << flooder.sent() << " sent, " << flooder.merged() << " merged, " << flooder.cancelled() << " cancelled";
 
             std::this_thread::sleep_for(std::chrono::seconds(15)); //! TODO
           }
@@ -76,162 +137,327 @@ namespace PUT {
 
           while (true) {
             auto last = std::chrono::steady_clock::now() - std::chrono::seconds(20);
-            auto adjacent = network.neighbours.find(self->address);
             std::vector<Address> broken;
 
-            if (adjacent != network.neighbours.end())
-              for (auto& neighbour : adjacent->second)
-                if (network.node(neighbour.first)->last_tick < last)
-                  broken.push_back(neighbour.first);
+            for (Address neighbour : network.neighbours(self->address))
+              if (network.node(neighbour)->last_tick < last)
+                broken.push_back(neighbour);
 
             for (Address broken_node : broken) {
               network.drop(self->address, broken_node);
-
-              Packet* p = new Packet(Packet::Type::EdgeDrop);
-              p->data.edge[0] = self->address;
-              p->data.edge[1] = broken_node;
-
-              dispatcher.broadcast(p);
-              delete p;
+              flooder.edge_drop(self->address, broken_node, 0);
             }
 
+            network.decay();
+
             std::this_thread::sleep_for(std::chrono::seconds(3));
           }
         });
 
+        startup.configured = std::chrono::steady_clock::now();
+        report_startup();
+        report_route();
       }
 
       Router::~Router() {
+        if (identityValidator.joinable())
+          identityValidator.join();
+      }
+
+      bool Router::load_identity() {
+        startup.cached = !identity_cache.empty() && identity.load(identity_cache, device);
+
+        return startup.cached;
+      }
+
+      void Router::request_identity(std::future<Frame*> (&requests)[4]) {
+        requests[0] = xbee.request("NI"); // Node Identifier
+        requests[1] = xbee.request("ID"); // Network ID
+        requests[2] = xbee.request("SL"); // Serial Number Low
+        requests[3] = xbee.request("SH"); // Serial Number High
+      }
+
+      void Router::apply_identity() {
+        self->name = identity.name;
+        self->network = identity.network;
+        network.mac(self->address, identity.mac);
+      }
+
+      void Router::report_startup() {
+        auto ms = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+          return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
+        };
+
+        LOG(INFO) << "Started in " << ms(startup.start, startup.configured) << " ms"
+                  << " - connect " << ms(startup.start, startup.connected) << " ms"
+                  << " (radio reset " << (long long)xbee.reset_time().count() << " ms)"
+                  << ", identity " << ms(startup.connected, startup.identified) << " ms"
+                  << (startup.cached ? " (cached)" : " (radio)")
+                  << ", configure " << ms(startup.identified, startup.configured) << " ms";
+      }
+
+      void Router::report_route() {
+        if (startup.routed)
+          return;
+
+        for (int a = 1; a < MAX_ADDRESS; a++) {
+          if (a == self->address || network.next_hop(a) == 0)
+            continue;
+
+          startup.routed = true;
+          LOG(INFO) << "First route (to " << a << " through " << (int) network.next_hop(a) << ") "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startup.start).count()
+                    << " ms after start";
+          return;
+        }
       }
 
       Packet* Router::receive() {
-        Frame* frame = xbee.receive();
-        Packet* packet = new Packet();
+        FrameView frame;
+        PacketView view;
+        Packet* packet;
 
-        if (frame->type == Frame::Type::Receive) {
-          packet->from_frame(frame);
+        xbee.receive(frame);
 
-          delete frame;
+        if (frame.type == Frame::Type::Receive) {
+          view.from_frame(frame.data.receive, frame.length);
+          packet = new Packet(view);
         } else {
+          packet = new Packet();
           packet->type = Packet::Type::Internal;
-          packet->length = frame->length;
-          packet->data.frame = frame;
+          packet->length = frame.length;
+          packet->data.frame = new Frame(frame);
         }
 
         return packet;
       }
 
       void Router::process() {
-        Packet* packet = receive();
-        Packet* response;
+        FrameView frame;
+        PacketView packet;
+
+        xbee.receive(frame);
+
+        // status frames and command responses are small, they are copied
+        if (frame.type != Frame::Type::Receive) {
+          Packet internal;
+          internal.length = frame.length;
+          internal.data.frame = new Frame(frame);
+
+          dispatcher.scan(internal);
+          return;
+        }
+
+        // packet is decoded in place, it is copied only if it outlives receive buffer
+        packet.from_frame(frame.data.receive, frame.length);
 
         dispatcher.scan(packet);
 
-        switch (packet->type) {
+        switch (packet.type) {
           case Packet::Type::Data:
 
             // route to next hop or send to redis if local or broadcast
-            if (packet->destination == self->address || packet->destination == 0) {
-              driver.deliver(packet->source, Driver::SELF, packet->port, packet->data.content, packet->length);
+            if (packet.destination == self->address || packet.destination == 0) {
+              driver.deliver(packet.source, Driver::SELF, packet.port, packet.data.content, packet.length);
 
-              DLOG(INFO) << "Received data: " << (char*) packet->data.content << " from " << (int) packet->source;
+              DLOG(INFO) << "Received data: " << (char*) packet.data.content << " from " << (int) packet.source;
               std::stringstream ss;
-              ss << "Data route was " << (int) packet->source << " ";
-              // while (!packet->visited.empty()) {
-              // ss << (int) packet->visited.front() << " ";
-              // packet->visited.pop_front();
-              // }
-              // ss << (int) packet->destination;
+              ss << "Data route was " << (int) packet.source << " ";
+              // for (int i = 0; i < packet.visited_count; i++)
+              // ss << (int) packet.visited[i] << " ";
+              // ss << (int) packet.destination;
               // DLOG(INFO) << ss.str();
 
-              delete packet;
-
             } else {
-              DLOG(INFO) << "Received data packet for routing from " << (int) packet->source << " to " << (int) packet->destination;
+              DLOG(INFO) << "Received data packet for routing from " << (int) packet.source << " to " << (int) packet.destination;
+
+              // packet is stored in history until ack
+              Packet owned(packet);
+
               // visited myself
-              packet->visited.push_back(self->address);
+              owned.visited.push_back(self->address);
 
               // next hop! assuming packet is deliver()
-              dispatcher.deliver(packet);
+              dispatcher.deliver(std::move(owned));
+
+              if (!startup.forwarded) {
+                startup.forwarded = true;
+                LOG(INFO) << "First packet forwarded "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startup.start).count()
+                          << " ms after start";
+              }
             }
 
             break;
 
           case Packet::Type::Ack:
-            for (int i = 0; i < packet->length; i++) {
-              DLOG(INFO) << (int) packet->data.parameters[i].hop
-                         << ": errors " << (int) packet->data.parameters[i].errors
-                         << ", retries " << (int) packet->data.parameters[i].retries
-                         << ", lag " << (int) packet->data.parameters[i].delay
+            for (int i = 0; i < packet.length; i++) {
+              RemoteParameters parameters = packet.parameter(i);
+
+              DLOG(INFO) << (int) parameters.hop
+                         << ": errors " << (int) parameters.errors
+                         << ", retries " << (int) parameters.retries
+                         << ", lag " << (int) parameters.delay
                          << " ms";
             }
 
-            delete packet;
             break;
 
-          case Packet::Type::Internal:
-            delete packet;
-            break;
+          case Packet::Type::NodeBroadcast: {
+            std::bitset<Packet::DIGEST_BUCKETS> stale;
+            // restored (or dropped) edge to node with known MAC is discovered again
+            bool discovered = network.node(packet.data.address)->mac == 0 || !network.adjacent(self->address, packet.data.address);
 
-          case Packet::Type::NodeBroadcast:
             // add node if not adjacent
-            if (network.node(packet->data.address)->mac == 0) {
-              heartbeat();
+            if (discovered) {
+              network.mac(packet.data.address, packet.mac);
 
-              network.node(packet->data.address)->mac = packet->mac;
+              network.add_edge(packet.data.address, self->address);
 
-              network.add_edge(packet->data.address, self->address);
+              flooder.advertise();
 
-              response = new Packet(Packet::Type::Graph);
-              response->data.edges = network.graph(response->length);
+              // neighbour without digest gets every advertisement
+              if (packet.length == 0)
+                stale.set();
+            }
 
-              dispatcher.broadcast(response);
+            // advertisements are exchanged only if topology views differ
+            if (packet.length == Packet::DIGEST_BUCKETS) {
+              Digest digest = network.digest();
 
-              delete response;
+              for (int i = 0; i < Packet::DIGEST_BUCKETS; i++)
+                stale[i] = digest[i] != packet.bucket(i);
             }
 
-            network.node(packet->data.address)->last_tick = std::chrono::steady_clock::now();
+            if (stale.any())
+              synchronize(packet.data.address, stale, discovered);
+
+            // sent after advertisements, so the digest matches once they are received
+            if (discovered)
+              heartbeat(packet.data.address);
 
-            delete packet;
+            network.node(packet.data.address)->last_tick = std::chrono::steady_clock::now();
 
             break;
+          }
 
-          case Packet::Type::EdgeDrop:
-            if (network.drop(packet->data.edge[0], packet->data.edge[1]) || network.drop(packet->data.edge[1], packet->data.edge[0])) {
-              DLOG(INFO) << "Edge " << packet->data.edge[0] << "->" << packet->data.edge[1] << "dropped at node: " << self->address;
-              DLOG(INFO) << "Broadcasting EdgeDrop from " << self->address << " for edge " << packet->data.edge[0] << "->" << packet->data.edge[1];
-              dispatcher.broadcast(packet);
+          case Packet::Type::EdgeDrop: {
+            Address transmitter = network.from_mac(packet.mac);
+
+            if (network.drop(packet.data.edge[0], packet.data.edge[1]) || network.drop(packet.data.edge[1], packet.data.edge[0])) {
+              DLOG(INFO) << "Edge " << packet.data.edge[0] << "->" << packet.data.edge[1] << "dropped at node: " << self->address;
+              DLOG(INFO) << "Flooding EdgeDrop from " << self->address << " for edge " << packet.data.edge[0] << "->" << packet.data.edge[1];
+
+              flooder.edge_drop(packet.data.edge[0], packet.data.edge[1], transmitter);
+            } else {
+              flooder.overheard_edge_drop(packet.data.edge[0], packet.data.edge[1], transmitter);
             }
 
-            delete packet;
             break;
+          }
 
           case Packet::Type::Graph:
-            if (network.merge(packet->data.edges, packet->length)) {
-              response = new Packet(Packet::Type::Graph);
-              response->data.edges = network.graph(response->length);
+            // sent by nodes which flood whole graph, it is not flooded further
+            network.merge(packet.data.edges, packet.length);
 
-              dispatcher.broadcast(response);
+            break;
 
-              delete response;
+          case Packet::Type::LinkState: {
+            Advertisement links;
+
+            for (int i = 0; i < packet.length; i++)
+              links.push_back(packet.link(i));
+
+            Address transmitter = network.from_mac(packet.mac);
+
+            if (!network.link_state(packet.source, packet.sequence, links)) {
+              if (packet.destination == 0)
+                flooder.overheard_link_state(packet.source, packet.sequence, transmitter);
+
+              break;
+            }
+
+            // own advertisement from before restart, the newer one is flooded
+            if (packet.source == self->address) {
+              flooder.advertise();
+              break;
             }
 
-            delete packet;
+            // advertisements sent to self when synchronizing are not flooded
+            if (packet.destination == 0 && packet.age < Packet::MAX_AGE)
+              flooder.link_state(packet.source, packet.sequence, packet.age + 1, transmitter);
+
             break;
+          }
 
           default:
             LOG(FATAL) << "Processing unknown packet type, aborting ...";
-            delete packet;
         }
+
+        report_route();
       }
 
-      void Router::heartbeat() {
+      void Router::heartbeat(Address neighbour) {
         Packet packet(self->address);
-        dispatcher.broadcast(&packet);
+        Digest digest = network.digest();
+
+        packet.length = digest.size();
+        std::copy(digest.begin(), digest.end(), packet.digest);
+
+        if (neighbour == 0) {
+          dispatcher.broadcast(packet);
+        } else {
+          packet.destination = neighbour;
+          dispatcher.send(packet);
+        }
       }
 
-      void Router::run(char* serial_port, uint8_t address) {
+      void Router::synchronize(Address neighbour, const std::bitset<Packet::DIGEST_BUCKETS> &buckets, bool flooded) {
+        Advertisement links;
+        Packet packet(Packet::Type::LinkState);
+        uint16_t sequence;
+
+        // advertisement of the neighbour as well, if it was restarted it takes over the sequence number
+        for (int a = 1; a < MAX_ADDRESS; a++) {
+          if ((flooded && a == self->address) || !buckets.test(Network::bucket(a)) || !network.advertisement(a, sequence, links))
+            continue;
+
+          packet.destination = neighbour;
+          packet.source = a;
+          packet.sequence = sequence;
+          packet.age = 0;
+          packet.length = links.size();
+          std::copy(links.begin(), links.end(), packet.data.links);
+
+          dispatcher.send(packet);
+        }
+      }
+
+      //! Pool size from environment variable
+      static size_t pool_size(const char* variable, size_t fallback) {
+        const char* value = getenv(variable);
+
+        return value != NULL && *value != '\0' ? strtoul(value, NULL, 10) : fallback;
+      }
+
+      void Router::configure_pools() {
+        Pool<Frame>::slab().configure(pool_size("XBEE_POOL_FRAMES", 256));
+        Pool<Packet>::slab().configure(pool_size("XBEE_POOL_PACKETS", 512));
+        Pool<Metadata>::slab().configure(pool_size("XBEE_POOL_METADATA", 256));
+        Buffers::small().configure(pool_size("XBEE_POOL_SMALL_BUFFERS", 2048));
+        Buffers::large().configure(pool_size("XBEE_POOL_BUFFERS", 1024));
+
+        LOG(INFO) << "Pools: " << Pool<Frame>::slab().size() << " frames, "
+                  << Pool<Packet>::slab().size() << " packets, "
+                  << Pool<Metadata>::slab().size() << " metadata, "
+                  << Buffers::small().size() << " small and "
+                  << Buffers::large().size() << " large buffers";
+      }
+
+      void Router::run(char* serial_port, Address address) {
         THREAD_NAME("Router");
+        configure_pools();
+
         Router router(serial_port, address);
 
         printf("ROUTER RUN\r\n");
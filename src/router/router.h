@@ -4,26 +4,51 @@
 #include <string>
 #include <map>
 #include <thread>
+#include <future>
+#include <chrono>
 
 
 #include "../radio.h"
 
 #include "xbee.h"
+#include "identity.h"
 #include "node.h"
 #include "packet.h"
 #include "network.h"
 #include "dispatcher.h"
+#include "flooder.h"
+#include "checkpoint.h"
 #include "../driver/driver.h"
 
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
+      /**
+       * Router startup timing, from Router creation to first forwarded packet.
+       */
+      struct Startup {
+        //! Router creation
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        //! Radio connected and services (Redis) started
+        std::chrono::steady_clock::time_point connected;
+        //! Self identity known
+        std::chrono::steady_clock::time_point identified;
+        //! Radio configured and router threads started
+        std::chrono::steady_clock::time_point configured;
+        //! True if identity was read from cache
+        bool cached = false;
+        //! True after first packet was forwarded
+        bool forwarded = false;
+        //! True after first node became reachable from self
+        bool routed = false;
+      };
+
       /**
        * Network Router.
        *
        * Router creates instance of Xbee radio and redirects packets to local Redis
        * or to other Nodes. Every node is identified by unique 8 byte Address
-       * (values from 1-255). Address 0 represents any node and its used in broadcasting
+       * (values from 1-254, 1-1022 if built with XBEE_WIDE_ADDRESS). Address 0 represents any node and its used in broadcasting
        * to prevent from further routing.
        *
        * Any node may join or leave network at any time. Packets must delivered to destination
@@ -35,30 +60,43 @@ namespace PUT {
        *   1. Discover network topology
        *
        *      To join the network, Node broadcasts Packet::Type::NodeBroadcast,
-       *      if any other Node receives this broadcast it broadcasts new NodeBroadcast for
-       *      itself. An Edge (and Node) from received Node to itself is added, unless
-       *      already in the Network. If the edge was added, every Edge in the Network
-       *      is broadcasted as Packet::Type::Graph.
+       *      if any other Node receives this broadcast it sends new NodeBroadcast for
+       *      itself back. An Edge (and Node) from received Node to itself is added, unless
+       *      already in the Network. If the edge was added, new link-state advertisement
+       *      of self (Packet::Type::LinkState - adjacent nodes and costs of edges, with
+       *      next sequence number) is broadcasted.
+       *
+       *      NodeBroadcast carries digest of advertisements known to its sender
+       *      (Network::digest()). Receiver compares it with its own digest and sends the
+       *      latest advertisements from buckets which differ directly to the sender, so
+       *      new node learns the whole network and nodes with matching views exchange
+       *      nothing.
        *
-       *      When Packet::Type::Graph is received, edges from the packet are merged
-       *      with local Network graph. If it has changed, the new Packet::Type::Graph
-       *      is broadcasted with current Network grpah.
+       *      When Packet::Type::LinkState is received, it replaces edges of its node in
+       *      local Network graph. Only advertisement with sequence number newer than
+       *      the last seen one is broadcasted further (duplicates are suppressed), so
+       *      single change is flooded at most once by every node. Floods wait for random
+       *      jitter, changes which come meanwhile are sent together and flood is cancelled
+       *      if every neighbour overheard it from other nodes (see Flooder).
+       *      Packet::Type::Graph from older nodes is merged, but not broadcasted.
        *
        *
        *   2. Maintain network topology and state
        *
        *      When Packet::Type::EdgeDrop is received, the Edge is removed from the
-       *      Network. If it was removed successfully, the EdgeDrop is broadcasted.
+       *      Network. If it was removed successfully, the EdgeDrop is flooded further.
        *      This operation allows to remove faulty edges in whole Network. If in the graph
        *      exists a Node without any edge, it should be removed locally.
        *
        *      Once in a while, a heartbeat is broadcasted. The Packet::Type::NodeBroadcast
        *      is broadcasted and procedure similiar to 1) is happening in the Network.
-       *      This allows rediscovering Node if it was dropped (in case of Packet::Type::EdgeDrop).
+       *      This allows rediscovering Node if it was dropped (in case of Packet::Type::EdgeDrop)
+       *      and repairs advertisements lost while flooding.
        *
        *      With every Packet::Type::Ack Parameters of Edge are updated. For every Edge
-       *      in the Ack, network parameters are increased by values from Ack (so antireliability
-       *      measure is updated too).
+       *      in the Ack, values from Ack are sampled into moving averages of the edge (so
+       *      antireliability measure is updated too). Edges without samples decay, so edges
+       *      avoided after failures are tried again.
        *
        *
        *   3. Deliver packets from source to destination
@@ -69,7 +107,7 @@ namespace PUT {
        *
        *      Path is obtained using Network::path() - Dijkstra shortest path algorithm.
        *      For every edge in the network an antireliability measure is calculated based on
-       *      parameters such as number of packets delivered, undelivered and retried. With
+       *      recent averages of packets undelivered and retried. With
        *      every Packet::Type::Ack graph parameters are updated, so path is always the
        *      most reliable, based on latest local graph state.
        *
@@ -105,6 +143,23 @@ namespace PUT {
        *      where error was found), according to 3) packet delivery is repeated.
        *
        *
+       * Warm restart: if XBEE_IDENTITY_CACHE environment variable is set, radio identity
+       * is kept in this file. When the cache is valid, radio is not restarted and the
+       * Router starts immediately - identity is validated against the radio in background
+       * and the cache is updated if needed.
+       *
+       * If XBEE_TOPOLOGY_CACHE environment variable is set, nodes, MAC addresses, edges and
+       * their Parameters are written to this file with every heartbeat and restored when
+       * the Router starts (see Checkpoint), so paths are known before the first heartbeat
+       * of neighbours comes. Restored neighbours are dropped if they send no heartbeat.
+       *
+       * If XBEE_ALL_PAIRS environment variable is set, Network keeps paths between every
+       * pair of nodes, computed in background after every change of the graph
+       * (see Network::all_pairs()).
+       *
+       * Link-state advertisements and EdgeDrop are flooded after random jitter, up to
+       * XBEE_FLOOD_JITTER milliseconds (100 by default, 0 floods at once), see Flooder.
+       *
        * Data which destination is self, are sent to Redis channel and are available to local
        * services via XbeeRouting::Driver. Data which must be delivered to other nodes, are read from
        * specific Redis channel as documented in Driver.
@@ -116,6 +171,18 @@ namespace PUT {
        */
       class Router {
        private:
+        //! Startup timing
+        Startup startup;
+
+        //! Radio identity cache path (empty if disabled)
+        std::string identity_cache;
+
+        //! Radio serial port
+        std::string device;
+
+        //! Self identity, initially from cache
+        Identity identity;
+
         /**driver
          * Xbee radio definition.
          *
@@ -131,6 +198,9 @@ namespace PUT {
          */
         Network network;
 
+        //! Topology kept on disk for warm restart (closed if disabled)
+        Checkpoint checkpoint;
+
         /**
          * Self Node definition.
          *
@@ -155,6 +225,12 @@ namespace PUT {
          */
         Dispatcher dispatcher;
 
+        /**
+         * Control floods (link-state advertisements and EdgeDrop) are
+         * broadcasted through Flooder, with random jitter.
+         */
+        Flooder flooder;
+
         /**
          * Node broadcaster thread.
          *
@@ -171,13 +247,48 @@ namespace PUT {
          * Broadcasting is enabled when true.
          */
         std::atomic_bool nodeBroadcasterRun;
+
+        //! Identity requests which validate cached identity
+        std::future<Frame*> validation[4];
+
+        /**
+         * Cached identity validator thread.
+         *
+         * Waits for responses to validation requests (they are received
+         * by Router::process()) and updates self and cache if the radio differs.
+         */
+        std::thread identityValidator;
+
+        /**
+         * Read identity from cache (if enabled).
+         *
+         * @return True if cached identity is used
+         */
+        bool load_identity();
+
+        /**
+         * Request identity parameters (NI, ID, SL, SH) at once.
+         *
+         * @param requests Futures of responses
+         */
+        void request_identity(std::future<Frame*> (&requests)[4]);
+
+        //! Copy identity to self Node
+        void apply_identity();
+
+        //! Log startup time breakdown
+        void report_startup();
+
+        //! Log time of the first route from self, once any node is reachable
+        void report_route();
        public:
         /**
          * Creates new Router instance.
          *
          * Router connects to Xbee and create empty Network graph. To obtain parameters
          * needed to initialize self, AT commands are sent to Xbee (NI - Node Identifier,
-         * ID - Network ID, SL/SH - MAC address).
+         * ID - Network ID, SL/SH - MAC address). They are sent at once and, with valid
+         * identity cache, they are not awaited at all.
          *
          * Temporarely power level is set to the lowest, number of broadcast retransmissions
          * to single and console is made.
@@ -187,7 +298,7 @@ namespace PUT {
          * @param serial_port Serial port path
          * @param address Node address
          */
-        Router(char* serial_port, uint8_t address);
+        Router(char* serial_port, Address address);
 
         /**
          * Destroys router.
@@ -233,15 +344,45 @@ namespace PUT {
         void process();
 
         /**
-         * Send NodeBroadcast to inform about yourself.
+         * Send the latest advertisement of every known node in given digest
+         * buckets to adjacent node (database exchange).
+         *
+         * Advertisements are sent directly to the node, it does not flood them.
+         *
+         * @param neighbour Adjacent node
+         * @param buckets Buckets of Network::digest() which differ
+         * @param flooded True if own advertisement is being flooded (it is not sent again)
+         */
+        void synchronize(Address neighbour, const std::bitset<Packet::DIGEST_BUCKETS> &buckets, bool flooded = false);
+
+        /**
+         * Send NodeBroadcast to inform about yourself, with digest of known
+         * advertisements.
          *
          * Heartbeat is send upon start of the router and once in a while
          * to ensure freshness of the Network graph, as described in Router
-         * description.
+         * description. Newly discovered node gets it directly, so other
+         * neighbours do not compare digests while advertisements are flooded.
          *
+         * @param neighbour Adjacent node or 0 to broadcast
          * @see Router
          */
-        void heartbeat();
+        void heartbeat(Address neighbour = 0);
+
+        /**
+         * Allocate pools of frames, packets, metadata and buffers, so packet
+         * path does not use the heap. Sizes are read from environment variables
+         * XBEE_POOL_FRAMES, XBEE_POOL_PACKETS, XBEE_POOL_METADATA,
+         * XBEE_POOL_SMALL_BUFFERS (64 bytes each) and XBEE_POOL_BUFFERS
+         * (512 bytes each), 0 disables a pool.
+         *
+         * Must be called before any thread is started. When a pool is
+         * exhausted, objects are allocated from the heap.
+         *
+         * @see Pool
+         * @see Buffers
+         */
+        static void configure_pools();
 
         /**
          * Blocking. Create router instance, start discovery and process frames.
@@ -249,7 +390,7 @@ namespace PUT {
          * @param serial_port Serial port device path
          * @param address Logical address of the Node
          */
-        static void run(char* serial_port, uint8_t address);
+        static void run(char* serial_port, Address address);
       };
     }
   }
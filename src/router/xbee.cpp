@@ -1,18 +1,20 @@
 #include "xbee.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
 #include <math.h>
 #include <stdint.h>
 
 namespace PUT {
   namespace CS {
     namespace XbeeRouting {
-      Xbee::Xbee(std::string d) : device(d) {
+      Xbee::Xbee(std::string d, bool reset) : device(d) {
         serial_mutex.lock();
 
         serial = open(device.c_str(), O_RDWR | O_NOCTTY);
@@ -29,56 +31,114 @@ namespace PUT {
         options.c_cflag &= ~CSIZE;
         options.c_cflag |= CS8;
         options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
-        options.c_iflag &= ~(IXON | IXOFF | IXANY);
+        options.c_iflag &= ~(IXON | IXOFF | IXANY | ICRNL | INLCR | IGNCR | ISTRIP);
         options.c_oflag &= ~OPOST;
 
         tcsetattr(serial, TCSANOW, &options);
 
         fcntl(serial, F_SETFL, 0);
 
-        if (getenv("IN_SIMULATOR") == NULL)
-          sleep(1);
-
         tcflush(serial, TCIOFLUSH);
 
         serial_mutex.unlock();
 
-        // reset
+        const char* capture_path = getenv("XBEE_CAPTURE");
+
+        if (capture_path != NULL && *capture_path != '\0') {
+          capturing = capture.open(capture_path);
+
+          if (!capturing)
+            LOG(WARNING) << "Could not create capture " << capture_path << " (" << strerror(errno) << ")";
+        }
+
+        hexdump = getenv("XBEE_HEXDUMP") != NULL;
+
+        writer = std::thread([this]() {
+          THREAD_NAME("XbeeWriter");
+
+          write_queue();
+        });
+
+        if (!reset)
+          return;
+
+        auto start = std::chrono::steady_clock::now();
+
         command("FR");
 
-        if (getenv("IN_SIMULATOR") == NULL)
-          sleep(1);
+        if (!ready(reset_timeout))
+          LOG(WARNING) << "Radio did not report reset in " << reset_timeout.count() << " ms";
+
+        reset_duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
       }
 
       Xbee::~Xbee() {
+        // queued frames are written before writer stops
+        queue_mutex.lock();
+        writer_run = false;
+        queue_mutex.unlock();
+        queue_ready.notify_one();
+
+        writer.join();
+
         serial_mutex.lock();
         close(serial);
+
+        delete deferred_frame;
+
+        for (Frame* frame : deferred)
+          delete frame;
       }
 
       char* Xbee::get(const char* cmd, uint8_t &length) {
-        command(cmd);
+        std::future<Frame*> response = request(cmd);
+        Frame* frame = wait(response);
+        char* value;
 
-        Frame* frame;
-        bool should_run = true;
-        char* response;
         length = 0;
 
-        while (should_run) {
-          frame = receive();
+        if (frame == nullptr)
+          return nullptr;
 
-          if (strcmp(cmd, (char*)frame->data.command_response.command) == 0) {
-            should_run = false;
-            length = frame->length;
-            response = (char*)malloc(length * sizeof(char));
-            memcpy(response, (char*)frame->data.command_response.data, length);
-          }
+        length = frame->length;
+        value = (char*)malloc(length * sizeof(char));
+        memcpy(value, (char*)frame->data.command_response.data, length);
 
-          delete frame;
-        }
+        delete frame;
+
+        return value;
+      }
+
+      std::future<Frame*> Xbee::request(const char* cmd, unsigned char* params, uint8_t length) {
+        std::future<Frame*> response;
+
+        send_command(nullptr, cmd, params, length, &response);
 
         return response;
       }
 
+      std::future<Frame*> Xbee::request(Node* node, const char* cmd, unsigned char* params, uint8_t length) {
+        std::future<Frame*> response;
+
+        send_command(node, cmd, params, length, &response);
+
+        return response;
+      }
+
+      Frame* Xbee::wait(std::future<Frame*> &response) {
+        FrameView frame;
+
+        while (response.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+          if (!next(frame, true))
+            return nullptr;
+
+          if (!respond(frame))
+            deferred.push_back(new Frame(frame));
+        }
+
+        return response.get();
+      }
+
       void Xbee::command(const char* cmd) {
         command(cmd, NULL, 0);
       }
@@ -88,113 +148,471 @@ namespace PUT {
       }
 
       void Xbee::command(const char* cmd, unsigned char* params, uint8_t length) {
-        Frame* request = new Frame(Frame::Type::Command);
+        send_command(nullptr, cmd, params, length, nullptr);
+      }
 
-        request->data.command.id = 1;
-        memcpy(&request->data.command.command, cmd, 2);
+      void Xbee::command(Node* node, const char* cmd, unsigned char* params, uint8_t length) {
+        send_command(node, cmd, params, length, nullptr);
+      }
+
+      uint8_t Xbee::reserve_command(const char* cmd, std::future<Frame*>* response) {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+
+        // 0 disables response, IDs of pending requests are skipped
+        for (int i = 0; i < 0xFF; i++) {
+          command_id++;
+
+          if (command_id == 0)
+            command_id++;
+
+          if (requests.count(command_id) == 0) {
+            if (response != nullptr) {
+              Request &r = requests[command_id];
+
+              memcpy(r.command, cmd, 2);
+              r.sent = std::chrono::steady_clock::now();
+              *response = r.response.get_future();
+            }
+
+            return command_id;
+          }
+        }
+
+        LOG(WARNING) << "Every frame ID is pending, " << std::string(cmd, 2) << " command gets no response";
+
+        if (response != nullptr) {
+          std::promise<Frame*> failed;
+
+          failed.set_value(nullptr);
+          *response = failed.get_future();
+        }
+
+        return 0;
+      }
+
+      void Xbee::send_command(Node* node, const char* cmd, unsigned char* params, uint8_t length, std::future<Frame*>* response) {
+        Frame request(node == nullptr ? Frame::Type::Command : Frame::Type::RemoteCommand);
+        uint8_t id = reserve_command(cmd, response);
+        unsigned char* data = nullptr;
+
+        // request which gets no response is not worth sending
+        if (id == 0 && response != nullptr)
+          return;
 
         if (length > 0) {
-          request->length = length;
-          request->data.command.data = (unsigned char*)malloc(length * sizeof(unsigned char));
-          memcpy(request->data.command.data, params, length);
+          request.length = length;
+          data = (unsigned char*)Buffers::allocate(length * sizeof(unsigned char));
+          memcpy(data, params, length);
+        }
+
+        if (node == nullptr) {
+          request.data.command.id = id;
+          memcpy(&request.data.command.command, cmd, 2);
+          request.data.command.data = data;
+        } else {
+          request.data.remote_command.id = id;
+          memcpy(&request.data.remote_command.command, cmd, 2);
+          request.data.remote_command.mac = node->mac;
+          request.data.remote_command.network = node->network;
+          request.data.remote_command.options = 0x00;
+          request.data.remote_command.data = data;
         }
 
-        send(request);
+        if (send(&request) || response == nullptr)
+          return;
+
+        // command was dropped, response will never come
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        auto r = requests.find(id);
 
-        delete request;
+        r->second.response.set_value(nullptr);
+        requests.erase(r);
       }
 
-      void Xbee::command(Node* node, const char* cmd, unsigned char* params, uint8_t length) {
-        Frame* request = new Frame(Frame::Type::RemoteCommand);
+      size_t Xbee::expire(std::chrono::steady_clock::time_point sent) {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        size_t expired = 0;
 
-        request->data.remote_command.id = 1;
-        memcpy(&request->data.remote_command.command, cmd, 2);
+        for (auto r = requests.begin(); r != requests.end(); ) {
+          if (r->second.sent > sent) {
+            r++;
+            continue;
+          }
 
-        request->data.remote_command.mac = node->mac;
-        request->data.remote_command.network = node->network;
-        request->data.remote_command.options = 0x00;
+          r->second.response.set_value(nullptr);
+          r = requests.erase(r);
+          expired++;
+        }
 
-        if (length > 0) {
-          request->length = length;
-          memcpy(request->data.remote_command.data, params, length);
+        return expired;
+      }
+
+      bool Xbee::respond(const FrameView &frame) {
+        uint8_t id;
+        const unsigned char* command;
+
+        if (frame.type == Frame::Type::CommandResponse) {
+          id = frame.data.command_response.id;
+          command = frame.data.command_response.command;
+        } else if (frame.type == Frame::Type::RemoteCommandResponse) {
+          id = frame.data.remote_command_response.id;
+          command = frame.data.remote_command_response.command;
+        } else {
+          return false;
         }
 
-        send(request);
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        auto r = requests.find(id);
+
+        if (r == requests.end() || memcmp(r->second.command, command, 2) != 0)
+          return false;
 
-        delete request;
+        r->second.response.set_value(new Frame(frame));
+        requests.erase(r);
+
+        return true;
       }
 
-      Frame* Xbee::receive() {
-        unsigned char* packet = (unsigned char*)malloc(300);
-        int offset = 0, length = 0;
-        int status = 0;
-        unsigned char c;
+      bool Xbee::next(FrameView &frame, bool wait) {
+        ssize_t status;
+
+        while (!frame_reader.next(frame)) {
+          if (!wait)
+            return false;
 
-        Frame* frame = new Frame((Frame::Type)0x00);
+          status = frame_reader.fill(serial);
 
-        while ((status = read(serial, &c, 1))) {
           if (status == -1) {
             fprintf(stderr, "Hardware disconnected\n");
             fflush(stderr);
             exit(1);
           }
 
-          if (c == 0x7E && offset == 0) {
-          } else if (offset == 1) {
-            length = ((uint16_t)c) << 8;
-          } else if (offset == 2) {
-            length |= ((uint16_t)c);
-          }
+          if (status == 0)
+            return false;
+        }
 
-          packet[offset++] = c;
+        if (capturing || hexdump) {
+          size_t length;
+          const unsigned char* packet = frame_reader.last(length);
 
-          if (offset == length + 4) {
-#ifndef RASPBERRY
-            printf("\033[0;33m");
+          trace(Capture::Direction::Received, packet, length);
+        }
 
-            for (int i = 0; i < offset; i++) {
-              printf("%.2X ", packet[i]);
-            }
+        return true;
+      }
 
-            printf("\033[0m\n");
-#endif
+      bool Xbee::decode(FrameView &frame, bool wait) {
+        delete deferred_frame;
+        deferred_frame = nullptr;
 
-            frame->unserialize(packet);
+        if (!deferred.empty()) {
+          deferred_frame = deferred.front();
+          deferred.pop_front();
 
-            break;
+          frame.assign(*deferred_frame);
+
+          return true;
+        }
+
+        while (next(frame, wait)) {
+          if (!respond(frame))
+            return true;
+        }
+
+        return false;
+      }
+
+      bool Xbee::ready(std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        struct pollfd input = { serial, POLLIN, 0 };
+        FrameView frame;
+        int status;
+
+        while (true) {
+          // frames sent before reset are stale
+          while (next(frame, false)) {
+            if (frame.type == Frame::Type::ModemStatus)
+              return true;
           }
+
+          auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+          if (left <= 0)
+            return false;
+
+          status = poll(&input, 1, left);
+
+          if (status == -1 && errno == EINTR)
+            continue;
+
+          if (status == 0)
+            return false;
+
+          if (status == -1 || frame_reader.fill(serial) <= 0)
+            return false;
         }
+      }
+
+      std::chrono::milliseconds Xbee::reset_time() const {
+        return reset_duration;
+      }
+
+      Frame* Xbee::receive() {
+        FrameView frame;
 
-        free(packet);
+        return decode(frame, true) ? new Frame(frame) : new Frame((Frame::Type)0x00);
+      }
 
-        return frame;
+      bool Xbee::receive(FrameView &frame) {
+        return decode(frame, true);
       }
 
-      void Xbee::send(Frame* frame) {
-        int length, status;
-        unsigned char* packet = frame->serialize(length);
+      size_t Xbee::receive(std::vector<Frame*> &frames) {
+        FrameView frame;
+        size_t count = 0;
+        bool received = decode(frame, true);
 
-        serial_mutex.lock();
-        status = write(serial, packet, length);
-        serial_mutex.unlock();
+        while (received) {
+          frames.push_back(new Frame(frame));
+          count++;
 
-        if (status == -1) {
-          fprintf(stderr, "Hardware disconnected\n");
-          fflush(stderr);
-          exit(1);
+          received = decode(frame, false);
         }
 
+        return count;
+      }
+
+      const FrameReader &Xbee::reader() const {
+        return frame_reader;
+      }
+
+      size_t Xbee::queue_depth() {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+
+        return queue_head - queue_tail;
+      }
+
+      uint64_t Xbee::sent() const {
+        return sent_frames.load(std::memory_order_relaxed);
+      }
+
+      uint64_t Xbee::dropped() const {
+        return dropped_frames.load(std::memory_order_relaxed);
+      }
+
+      double Xbee::coalescing() const {
+        uint64_t w = writes.load(std::memory_order_relaxed);
+
+        return w > 0 ? double(sent()) / w : 0;
+      }
+
+      std::chrono::microseconds Xbee::latency() const {
+        uint64_t s = sent();
+
+        return std::chrono::microseconds(s > 0 ? latency_sum.load(std::memory_order_relaxed) / s : 0);
+      }
+
+      std::chrono::microseconds Xbee::max_latency() const {
+        return std::chrono::microseconds(latency_max.load(std::memory_order_relaxed));
+      }
+
+      void Xbee::trace(Capture::Direction direction, const unsigned char* frame, size_t length) {
+        if (capturing)
+          capture.record(direction, frame, length);
+
 #ifndef RASPBERRY
-        printf("\033[0;32m");
+        if (!hexdump)
+          return;
 
-        for (int i = 0; i < length; i++) {
-          printf("%.2X ", packet[i]);
+        // received frames are yellow, sent ones are green
+        printf(direction == Capture::Direction::Received ? "\033[0;33m" : "\033[0;32m");
+
+        for (size_t i = 0; i < length; i++) {
+          printf("%.2X ", frame[i]);
         }
 
         printf("\033[0m\n");
 #endif
+      }
+
+      void Xbee::write_frame(struct iovec* parts, int count) {
+        ssize_t status;
+
+        serial_mutex.lock();
+
+        while (count > 0) {
+          status = writev(serial, parts, count);
+
+          if (status == -1 && errno == EINTR)
+            continue;
+
+          if (status == -1) {
+            serial_mutex.unlock();
+            fprintf(stderr, "Hardware disconnected\n");
+            fflush(stderr);
+            exit(1);
+          }
+
+          // skip written parts, continue with partially written one
+          while (count > 0 && (size_t)status >= parts->iov_len) {
+            status -= parts->iov_len;
+            parts++;
+            count--;
+          }
+
+          if (count > 0) {
+            parts->iov_base = (unsigned char*)parts->iov_base + status;
+            parts->iov_len -= status;
+          }
+        }
+
+        serial_mutex.unlock();
+      }
+
+      Xbee::Transmission* Xbee::reserve() {
+        if (queue_head - queue_tail == queue_size) {
+          dropped_frames.fetch_add(1, std::memory_order_relaxed);
+          LOG(WARNING) << "Transmit queue is full, dropping frame";
+
+          return nullptr;
+        }
+
+        return &queue[queue_head & (queue_size - 1)];
+      }
+
+      void Xbee::enqueue(std::unique_lock<std::mutex> &lock) {
+        queue[queue_head & (queue_size - 1)].enqueued = std::chrono::steady_clock::now();
+        queue_head++;
+
+        lock.unlock();
+        queue_ready.notify_one();
+      }
+
+      void Xbee::write_queue() {
+        struct iovec parts[queue_size];
+        std::unique_lock<std::mutex> lock(queue_mutex);
+
+        while (true) {
+          auto pending = [this]() {
+            return queue_head != queue_tail || !writer_run;
+          };
+
+          // capture is written when serial port is idle
+          if (capturing && !queue_ready.wait_for(lock, Capture::flush_interval, pending)) {
+            lock.unlock();
+            capture.flush();
+            lock.lock();
+            continue;
+          }
+
+          queue_ready.wait(lock, pending);
+
+          if (queue_head == queue_tail)
+            break;
+
+          // producers never touch slots between tail and head
+          size_t first = queue_tail, last = queue_head;
+          int count = 0;
+
+          lock.unlock();
+
+          for (size_t i = first; i != last; i++) {
+            Transmission &transmission = queue[i & (queue_size - 1)];
+            parts[count].iov_base = transmission.bytes;
+            parts[count].iov_len = transmission.length;
+            count++;
+          }
+
+          write_frame(parts, count);
+
+          auto now = std::chrono::steady_clock::now();
+
+          for (size_t i = first; i != last; i++) {
+            if (capturing || hexdump)
+              trace(Capture::Direction::Sent, queue[i & (queue_size - 1)].bytes, queue[i & (queue_size - 1)].length);
+
+            uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(now - queue[i & (queue_size - 1)].enqueued).count();
+            uint64_t max = latency_max.load(std::memory_order_relaxed);
+
+            latency_sum.fetch_add(latency, std::memory_order_relaxed);
+
+            while (latency > max && !latency_max.compare_exchange_weak(max, latency, std::memory_order_relaxed));
+          }
+
+          sent_frames.fetch_add(count, std::memory_order_relaxed);
+          writes.fetch_add(1, std::memory_order_relaxed);
+
+          lock.lock();
+          queue_tail = last;
+        }
+      }
+
+      bool Xbee::send(Frame* frame) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        Transmission* transmission = reserve();
+
+        if (transmission == nullptr)
+          return false;
+
+        transmission->length = frame->serialize(transmission->bytes);
+
+        enqueue(lock);
+
+        return true;
+      }
+
+      Xbee::Sent Xbee::send(const Packet &packet, uint8_t id, uint64_t mac, uint16_t network, uint8_t radius, uint8_t options) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        Transmission* transmission = reserve();
+
+        if (transmission == nullptr)
+          return Sent::QueueFull;
+
+        unsigned char* frame = transmission->bytes;
+        unsigned char checksum = 0;
+        const uint8_t* payload;
+        uint16_t payload_length;
+        uint16_t length;
+        TransmitFrame transmit;
+
+        transmit.id = id;
+        transmit.mac = mac;
+        transmit.network = network;
+        transmit.radius = radius;
+        transmit.options = options;
+
+        // API header (17 bytes), packet header and payload
+        length = packet.serialize(frame + 17, payload, payload_length);
+
+        // full payload behind long visited list does not fit into frame
+        if (size_t(17 + length + payload_length + 1) > sizeof(transmission->bytes)) {
+          dropped_frames.fetch_add(1, std::memory_order_relaxed);
+          LOG(WARNING) << "Frame of " << (17 + length + payload_length + 1) << " bytes does not fit " << sizeof(transmission->bytes) << ", dropping frame";
+
+          return Sent::Oversized;
+        }
+
+        if (payload_length > 0)
+          memcpy(frame + 17 + length, payload, payload_length);
+
+        frame[0] = 0x7e;
+        frame[3] = (unsigned char)Frame::Type::Transmit;
+        memcpy(frame + 4, &transmit, 13);
+
+        length += 14 + payload_length;
+        frame[1] = (length >> 8);
+        frame[2] = length;
+
+        for (int i = 0; i < length; i++)
+          checksum += frame[3 + i];
+
+        frame[3 + length] = 0xff - checksum;
+        transmission->length = 4 + length;
+
+        enqueue(lock);
 
-        free(packet);
+        return Sent::Queued;
       }
 
       void Xbee::send(Node* node, std::string data) {
@@ -206,7 +624,7 @@ namespace PUT {
         frame->data.transmit.radius = 0x00;
         frame->data.transmit.options = 0x00;
         frame->length = data.size();
-        frame->data.transmit.data = (unsigned char*)malloc(frame->length);
+        frame->data.transmit.data = (unsigned char*)Buffers::allocate(frame->length);
         memcpy(frame->data.transmit.data, data.c_str(), frame->length);
 
         send(frame);
@@ -223,7 +641,7 @@ namespace PUT {
         frame->data.transmit.radius = 0x00;
         frame->data.transmit.options = 0x00;
         frame->length = data.size();
-        frame->data.transmit.data = (unsigned char*)malloc(frame->length);
+        frame->data.transmit.data = (unsigned char*)Buffers::allocate(frame->length);
         memcpy(frame->data.transmit.data, data.c_str(), frame->length);
 
         send(frame);
@@ -3,8 +3,20 @@
 
 #include <string>
 #include <mutex>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <unordered_map>
+
+#include <sys/uio.h>
 
 #include "node.h"
+#include "reader.h"
+#include "capture.h"
 #include "../radio.h"
 
 namespace PUT {
@@ -16,32 +28,244 @@ namespace PUT {
        * Communication is done using Frame, Packet may be converted to Frame
        * if needed.
        *
+       * Sending never blocks - frames are serialized into transmit queue
+       * and written to serial port by dedicated writer thread. Every frame
+       * which is queued when writer wakes up is written with single system call.
+       *
+       * Every AT command gets its own frame ID. Responses to requested commands
+       * are taken out of the receive path and passed to waiting futures,
+       * other frames reach the receiver untouched.
+       *
        * @see Packet::to_frame()
        * @see Packet::from_frame()
        */
       class Xbee {
+       public:
+        //! Outcome of Xbee::send() of Packet
+        enum class Sent : uint8_t {
+          //! Frame is in transmit queue
+          Queued = 0,
+          //! Transmit queue is full, frame was dropped (sending later may succeed)
+          QueueFull = 1,
+          //! Frame does not fit Frame::MAX_SIZE, frame was dropped (it never fits)
+          Oversized = 2
+        };
+
        private:
         //! Serial port descriptor
         int serial;
-        //! Serial port lock
+        //! Serial port lock (held by writer thread while writing)
         std::mutex serial_mutex;
         //! Serial port device path
         std::string device;
         //! Network ID
         uint16_t network;
+        //! Buffered frame decoder (used only by receiving thread)
+        FrameReader frame_reader;
+
+        //! Traffic capture (path in XBEE_CAPTURE environment variable)
+        Capture capture;
+
+        //! True if traffic is captured
+        bool capturing = false;
+
+        //! True if frames are printed in hex (XBEE_HEXDUMP environment variable is set)
+        bool hexdump = false;
+
+        /**
+         * Serialized frame waiting in transmit queue.
+         */
+        struct Transmission {
+          //! Time of enqueuing
+          std::chrono::steady_clock::time_point enqueued;
+          //! Length of serialized frame
+          uint16_t length;
+          //! Serialized frame
+          unsigned char bytes[Frame::MAX_SIZE];
+        };
+
+        //! Size of transmit queue - must be power of 2
+        static const size_t queue_size = 64;
+
+        //! Transmit queue (ring buffer, many producers, single consumer)
+        Transmission queue[queue_size];
+
+        //! Next free slot in transmit queue (never wrapped)
+        size_t queue_head = 0;
+
+        //! Oldest unwritten slot in transmit queue (never wrapped)
+        size_t queue_tail = 0;
+
+        //! Transmit queue lock
+        std::mutex queue_mutex;
+
+        //! Signalled when frame is queued or writer should stop
+        std::condition_variable queue_ready;
+
+        //! Writer thread
+        std::thread writer;
+
+        //! Writer thread status, guarded by queue_mutex
+        bool writer_run = true;
+
+        //! Number of frames written to serial port
+        std::atomic<uint64_t> sent_frames {0};
+
+        //! Number of frames dropped because transmit queue was full or frame did not fit
+        std::atomic<uint64_t> dropped_frames {0};
+
+        //! Number of system calls used to write frames
+        std::atomic<uint64_t> writes {0};
+
+        //! Sum of enqueue to wire latencies [us]
+        std::atomic<uint64_t> latency_sum {0};
+
+        //! Maximal enqueue to wire latency [us]
+        std::atomic<uint64_t> latency_max {0};
+
+        /**
+         * AT command waiting for its response.
+         */
+        struct Request {
+          //! 2-byte AT command
+          unsigned char command[2];
+          //! Time of sending
+          std::chrono::steady_clock::time_point sent;
+          //! Fulfilled with copy of the response frame
+          std::promise<Frame*> response;
+        };
+
+        //! Requests waiting for response, by frame ID
+        std::unordered_map<uint8_t, Request> requests;
+
+        //! Requests lock
+        std::mutex requests_mutex;
+
+        //! Last frame ID given to AT command, guarded by requests_mutex
+        uint8_t command_id = 0;
+
+        //! Longest wait for ModemStatus after reset
+        const std::chrono::milliseconds reset_timeout = std::chrono::milliseconds(2000);
+
+        //! Time spent resetting the radio
+        std::chrono::milliseconds reset_duration = std::chrono::milliseconds(0);
+
+        //! Frames received while waiting for response (used only by receiving thread)
+        std::deque<Frame*> deferred;
+
+        //! Deferred frame currently returned as a view
+        Frame* deferred_frame = nullptr;
+
+        /**
+         * Give AT command a frame ID which is not used by any pending request.
+         *
+         * If every ID is pending, the command gets ID 0 (no response)
+         * and nullptr is set to the future.
+         *
+         * @param cmd 2-byte AT command
+         * @param response If not null, response is routed to this future
+         * @return Frame ID, 0 if none is free
+         */
+        uint8_t reserve_command(const char* cmd, std::future<Frame*>* response);
+
+        /**
+         * Serialize AT command into transmit queue.
+         *
+         * @param node Remote node or nullptr for local device
+         * @param cmd 2-byte AT command
+         * @param params AT command parameters
+         * @param length Number of bytes in command parameter
+         * @param response If not null, response is routed to this future
+         */
+        void send_command(Node* node, const char* cmd, unsigned char* params, uint8_t length, std::future<Frame*>* response);
+
+        /**
+         * Pass command response to its waiting request.
+         *
+         * @param frame Received frame
+         * @return True if frame was consumed by a request
+         */
+        bool respond(const FrameView &frame);
+
+        /**
+         * Wait until radio reports it is ready (Frame::Type::ModemStatus).
+         * Every frame received before is dropped.
+         *
+         * @param timeout Longest wait
+         * @return False on timeout (or end of file)
+         */
+        bool ready(std::chrono::milliseconds timeout);
+
+        /**
+         * Read next frame from serial port.
+         *
+         * @param frame View of decoded frame (valid until next read)
+         * @param wait If true, block until complete frame is received
+         * @return False if no frame is buffered (or end of file)
+         */
+        bool next(FrameView &frame, bool wait);
+
+        /**
+         * Reserve slot in transmit queue. Queue must be locked.
+         *
+         * @return Slot or nullptr if queue is full (frame is dropped)
+         */
+        Transmission* reserve();
+
+        /**
+         * Publish reserved slot to writer thread and unlock the queue.
+         *
+         * @param lock Queue lock
+         */
+        void enqueue(std::unique_lock<std::mutex> &lock);
+
+        /**
+         * Writer thread body - drains transmit queue until stopped.
+         */
+        void write_queue();
+
+        /**
+         * Decode next frame - deferred frames first, then buffered ones,
+         * reading serial port if needed.
+         *
+         * @param frame View of decoded frame (valid until next decode)
+         * @param wait If true, block until complete frame is received
+         * @return False if no frame is buffered (or end of file)
+         */
+        bool decode(FrameView &frame, bool wait);
+
+        /**
+         * Trace frame passing serial port - append it to the capture
+         * and print it if enabled.
+         *
+         * @param direction Direction
+         * @param frame Raw API frame
+         * @param length Frame length
+         */
+        void trace(Capture::Direction direction, const unsigned char* frame, size_t length);
+
+        /**
+         * Write frame parts to serial port, using single system call if possible.
+         *
+         * @param parts Frame parts (modified when partially written)
+         * @param count Number of parts
+         */
+        void write_frame(struct iovec* parts, int count);
 
        public:
         /**
          * Create instance of Xbee connection and gets essential paremeters.
          *
-         * After opening serial port, Xbee radio is restarted (FR command).
+         * After opening serial port, Xbee radio is restarted (FR command) and
+         * constructor returns as soon as the radio reports ModemStatus.
          * Then parameters like serial number (address), node identifier (network),
          * network address and power supply voltage are requested. They may be processed
          * in Router.
          *
          * @param d Serial port device path
+         * @param reset If false, radio is assumed to be running and it is not restarted
          */
-        Xbee(std::string d);
+        Xbee(std::string d, bool reset = true);
 
         /**
          * Destroy connection and close serial port
@@ -50,14 +274,69 @@ namespace PUT {
 
         /**
          * Blocking. Send simple AT command (usually parameter request)
-         * and wait for anwser. Every other frame is dropped!
+         * and wait for anwser. Other frames received meanwhile are kept
+         * for receive().
+         *
+         * Must be called by receiving thread (or before it is started).
          *
          * @param cmd 2-byte AT command
          * @param length Length of returned value
-         * @return Value
+         * @return Value (must be freed), nullptr on end of file
          */
         char* get(const char* cmd, uint8_t &length);
 
+        /**
+         * Non blocking. Send AT command to local device, response frame
+         * (Frame::Type::CommandResponse) is delivered to the future.
+         *
+         * The future is fulfilled by whichever thread receives the response,
+         * nullptr is set if the command could not be queued, every frame ID
+         * is pending or the request expired (expire()).
+         *
+         * @param cmd 2-byte AT command
+         * @param params AT command parameters
+         * @param length Number of bytes in command parameter
+         * @return Response frame (must be deleted)
+         */
+        std::future<Frame*> request(const char* cmd, unsigned char* params = nullptr, uint8_t length = 0);
+
+        /**
+         * Non blocking. Send AT command to remote device, response frame
+         * (Frame::Type::RemoteCommandResponse) is delivered to the future.
+         *
+         * @param node Node descriptor
+         * @param cmd 2-byte AT command
+         * @param params AT command parameters
+         * @param length Number of bytes in command parameter
+         * @return Response frame (must be deleted)
+         */
+        std::future<Frame*> request(Node* node, const char* cmd, unsigned char* params = nullptr, uint8_t length = 0);
+
+        /**
+         * Blocking. Receive frames until response is ready, other frames
+         * are kept for receive().
+         *
+         * Must be called by receiving thread (or before it is started),
+         * any other thread should simply wait for the future.
+         *
+         * @param response Future returned by request()
+         * @return Response frame (must be deleted), nullptr on end of file
+         */
+        Frame* wait(std::future<Frame*> &response);
+
+        /**
+         * Give up requests sent no later than given time - response will not
+         * be waited for, nullptr is set to their futures and their frame IDs
+         * are free again.
+         *
+         * Must be called when waiting for the future times out, otherwise
+         * the request holds its frame ID forever.
+         *
+         * @param sent Latest time of sending of expired requests
+         * @return Number of expired requests
+         */
+        size_t expire(std::chrono::steady_clock::time_point sent);
+
         /**
          * Send simple AT command to local device.
          *
@@ -96,6 +375,7 @@ namespace PUT {
          * Blocking. Wait and return for frame from Xbee radio.
          *
          * Does some processing on a frame, but never hold or purge a frame.
+         * The only exception are responses to request(), which go to their futures.
          *
          * If frame is Frame::Type::Receive, ATDB command is sent to get RSSI.
          * If frame is Frame::Type::Status, quality_error and quality_retry are updated.
@@ -107,11 +387,80 @@ namespace PUT {
         Frame* receive();
 
         /**
-         * Send frame to radio.
+         * Blocking. Wait for frame from Xbee radio, without copying it.
+         *
+         * The view points into internal receive buffer and it is valid only
+         * until next call to receive(). Frame must be copied (Frame::Frame(const FrameView&))
+         * if it has to outlive the buffer.
+         *
+         * @param frame View of received frame
+         * @return False on end of file
+         */
+        bool receive(FrameView &frame);
+
+        /**
+         * Blocking. Wait for at least one frame and return every complete
+         * frame which is already buffered.
+         *
+         * @param frames Received frames are appended here (must be deleted)
+         * @return Number of received frames, 0 on end of file
+         */
+        size_t receive(std::vector<Frame*> &frames);
+
+        /**
+         * Serial input statistics (bytes read, frames decoded, checksum
+         * failures and resynchronizations).
+         *
+         * @return Frame reader
+         */
+        const FrameReader &reader() const;
+
+        //! @return Time spent waiting for the radio to reset in constructor
+        std::chrono::milliseconds reset_time() const;
+
+        //! @return Number of frames waiting in transmit queue
+        size_t queue_depth();
+
+        //! @return Number of frames written to serial port
+        uint64_t sent() const;
+
+        //! @return Number of frames dropped because transmit queue was full or frame did not fit
+        uint64_t dropped() const;
+
+        //! @return Average number of frames written with single system call
+        double coalescing() const;
+
+        //! @return Average enqueue to wire latency
+        std::chrono::microseconds latency() const;
+
+        //! @return Maximal enqueue to wire latency
+        std::chrono::microseconds max_latency() const;
+
+        /**
+         * Send frame to radio. Non blocking, frame is serialized
+         * into transmit queue.
          *
          * @param frame Frame to send.
+         * @return False if transmit queue is full and frame was dropped
+         */
+        bool send(Frame* frame);
+
+        /**
+         * Send Packet encapsulated in Frame::Type::Transmit to radio. Non blocking.
+         *
+         * Frame is serialized directly into transmit queue slot, so no memory
+         * is allocated and Packet content is copied only once.
+         *
+         * @param packet Packet to send
+         * @param id Frame ID (0 disables StatusFrame)
+         * @param mac Destination MAC address
+         * @param network Network ID
+         * @param radius Broadcast radius
+         * @param options Transmit options
+         * @return Sent::Queued, or why the frame was dropped
+         * @see Packet::serialize()
          */
-        void send(Frame* frame);
+        Sent send(const Packet &packet, uint8_t id, uint64_t mac, uint16_t network, uint8_t radius = 0x00, uint8_t options = 0x00);
 
         /**
          * Send text to adjacent node.
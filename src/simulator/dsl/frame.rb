@@ -66,7 +66,7 @@ module XBee
         end
 
         s = [self.class.frame_type, *self].to_a.pack 'C' + matrix
-        checksum = 0xff - s.split('').map(&:ord).inject(&:+) % 0xff
+        checksum = 0xff - s.split('').map(&:ord).inject(&:+) % 0x100
 
         [0x7e, s.size].pack('CS>') + s + [checksum].pack('C')
       end
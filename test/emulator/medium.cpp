@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <string>
+
+#include "../../src/emulator/medium.h"
+#include "../../src/router/xbee.h"
+
+using namespace PUT::CS;
+
+//! Path of test fixture
+static std::string fixture(const char* name) {
+  std::string file(__FILE__);
+
+  return file.substr(0, file.rfind('/')) + "/../fixtures/" + name;
+}
+
+/**
+ * Topology and environment fixtures are read as simulator reads them
+ */
+TEST(EnvironmentTest, fixtures) {
+  XbeeRouting::Emulator::Yaml topology, definition;
+  XbeeRouting::Emulator::Environment environment;
+  std::mt19937 random;
+
+  ASSERT_TRUE(XbeeRouting::Emulator::Yaml::load(fixture("00_basic.network.yml"), topology));
+  ASSERT_TRUE(environment.topology(topology));
+  EXPECT_THAT(environment.nodes(), testing::ElementsAre("alfa", "beta", "gamma", "delta"));
+  EXPECT_THAT(environment.adjacent("delta"), testing::ElementsAre("beta", "gamma"));
+
+  ASSERT_TRUE(XbeeRouting::Emulator::Yaml::load(fixture("02_chain.network.yml"), topology));
+  ASSERT_TRUE(environment.topology(topology));
+  ASSERT_EQ(7u, environment.nodes().size());
+  EXPECT_THAT(environment.adjacent("2"), testing::ElementsAre("1", "3"));
+
+  ASSERT_TRUE(XbeeRouting::Emulator::Yaml::load(fixture("power_outage.environment.yml"), definition));
+  ASSERT_TRUE(environment.environment(definition));
+
+  EXPECT_EQ(0, environment.edge(0, "1", "2", "delay", -1, random));
+  EXPECT_EQ(1, environment.node(0, "3", "power", -1, random));
+
+  // power_outage, 10 s after start
+  EXPECT_EQ(1000, environment.edge(10, "2", "1", "delay", -1, random));
+  EXPECT_EQ(20, environment.edge(10, "1", "3", "delay", -1, random));
+  EXPECT_EQ(1, environment.edge(10, "1", "2", "errors", -1, random));
+  EXPECT_EQ(0, environment.node(15, "3", "power", -1, random));
+
+  // power_ok, 60 s after start
+  EXPECT_EQ(0, environment.edge(60, "2", "1", "delay", -1, random));
+  EXPECT_EQ(1, environment.node(60, "1", "power", -1, random));
+
+  // sped up timeline
+  ASSERT_TRUE(environment.environment(definition, 10));
+  EXPECT_EQ(1000, environment.edge(1, "2", "1", "delay", -1, random));
+}
+
+/**
+ * Router side Xbee talks to emulated radios over pty
+ */
+TEST(MediumTest, transmit) {
+  XbeeRouting::Emulator::Medium medium;
+
+  ASSERT_TRUE(medium.load(fixture("perfect.environment.yml"), fixture("02_chain.network.yml")));
+  ASSERT_TRUE(medium.start());
+
+  XbeeRouting::Emulator::Device* a = medium.devices()[0];
+  XbeeRouting::Emulator::Device* b = medium.devices()[1];
+  XbeeRouting::Emulator::Device* c = medium.devices()[2];
+
+  XbeeRouting::Xbee first(a->path(), false), second(b->path(), false);
+  uint8_t length;
+
+  // radios are attached by the first command
+  char* name = first.get("NI", length);
+  ASSERT_EQ(1, length);
+  EXPECT_EQ('1', name[0]);
+  free(name);
+  free(second.get("NI", length));
+
+  XbeeRouting::Packet packet(std::string("hello"));
+  packet.source = 1;
+  packet.destination = 2;
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(XbeeRouting::Xbee::Sent::Queued, first.send(packet, 5, b->mac, 0xFFFE));
+
+  XbeeRouting::FrameView frame;
+  ASSERT_TRUE(second.receive(frame));
+  ASSERT_EQ(XbeeRouting::Frame::Type::Receive, frame.type);
+  EXPECT_EQ(a->mac, frame.data.receive.mac);
+
+  // 20 ms edge delay
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+  XbeeRouting::PacketView view;
+  ASSERT_EQ(XbeeRouting::Packet::Type::Data, view.from_frame(frame.data.receive, frame.length));
+  ASSERT_EQ(5, view.length);
+  EXPECT_EQ(0, memcmp("hello", view.data.content, 5));
+
+  ASSERT_TRUE(first.receive(frame));
+  ASSERT_EQ(XbeeRouting::Frame::Type::Status, frame.type);
+  EXPECT_EQ(5, frame.data.status.id);
+  EXPECT_EQ(0, frame.data.status.status);
+
+  // not adjacent
+  ASSERT_EQ(XbeeRouting::Xbee::Sent::Queued, first.send(packet, 6, c->mac, 0xFFFE));
+  ASSERT_TRUE(first.receive(frame));
+  ASSERT_EQ(XbeeRouting::Frame::Type::Status, frame.type);
+  EXPECT_EQ(6, frame.data.status.id);
+  EXPECT_EQ(0x25, frame.data.status.status);
+
+  EXPECT_EQ(1u, medium.delivered());
+  EXPECT_EQ(1u, medium.lost());
+
+  // delivered at first attempt, not adjacent destination is tried every time
+  uint8_t data = (uint8_t) XbeeRouting::Packet::Type::Data;
+  EXPECT_EQ(1u + a->max_retransmissions() + 1, medium.frames(data));
+  EXPECT_NEAR(medium.frames(data) * (view.length + 4 + 2 * sizeof(XbeeRouting::Address) + XbeeRouting::Emulator::Medium::RF_OVERHEAD) * 8.0 / XbeeRouting::Emulator::Medium::RF_RATE * 1000, medium.airtime(data), 0.01);
+  EXPECT_EQ(0u, medium.frames((uint8_t) XbeeRouting::Packet::Type::Graph));
+}
+
+/**
+ * Hidden terminals: both neighbours of the node broadcast at once, it hears both
+ */
+TEST(MediumTest, collisions) {
+  XbeeRouting::Emulator::Medium medium;
+
+  ASSERT_TRUE(medium.load(fixture("perfect.environment.yml"), fixture("02_chain.network.yml")));
+  ASSERT_TRUE(medium.start());
+
+  XbeeRouting::Xbee first(medium.devices()[0]->path(), false);
+  XbeeRouting::Xbee second(medium.devices()[1]->path(), false);
+  XbeeRouting::Xbee third(medium.devices()[2]->path(), false);
+  uint8_t length;
+
+  free(first.get("NI", length));
+  free(second.get("NI", length));
+  free(third.get("NI", length));
+
+  // 200 bytes take over 70 ms of the channel
+  XbeeRouting::Packet packet(std::string(200, 'x'));
+  uint8_t data = (uint8_t) XbeeRouting::Packet::Type::Data;
+
+  ASSERT_EQ(XbeeRouting::Xbee::Sent::Queued, first.send(packet, 0, XbeeRouting::Frame::BROADCAST, 0xFFFE));
+  ASSERT_EQ(XbeeRouting::Xbee::Sent::Queued, third.send(packet, 0, XbeeRouting::Frame::BROADCAST, 0xFFFE));
+
+  for (int i = 0; i < 100 && medium.frames(data) < 2; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  // 1 and 3 do not hear each other, so only 2 gets overlapping frames
+  EXPECT_EQ(2u, medium.frames(data));
+  EXPECT_EQ(1u, medium.collisions());
+
+  // after the channel is free
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  ASSERT_EQ(XbeeRouting::Xbee::Sent::Queued, second.send(packet, 0, XbeeRouting::Frame::BROADCAST, 0xFFFE));
+
+  for (int i = 0; i < 100 && medium.frames(data) < 3; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  EXPECT_EQ(1u, medium.collisions());
+}
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#include "common.h"
+#include "../../src/router/xbee.h"
+#include "../../src/router/capture.h"
+
+using namespace PUT::CS;
+
+/**
+ * Frames passing the serial port are captured in order, with direction
+ */
+TEST(CaptureTest, xbeeTraffic) {
+  char path[] = "/tmp/captureXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  int radio = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_NE(-1, radio);
+  ASSERT_EQ(0, grantpt(radio));
+  ASSERT_EQ(0, unlockpt(radio));
+
+  std::vector<unsigned char> sent, received;
+
+  setenv("XBEE_CAPTURE", path, 1);
+
+  {
+    XbeeRouting::Xbee xbee(ptsname(radio), false);
+    xbee.command("NI");
+
+    XbeeRouting::FrameReader commands;
+    XbeeRouting::FrameView command;
+    size_t length;
+
+    while (!commands.next(command))
+      ASSERT_GT(commands.fill(radio), 0);
+
+    const unsigned char* bytes = commands.last(length);
+    sent.assign(bytes, bytes + length);
+
+    XbeeRouting::Frame response(XbeeRouting::Frame::Type::CommandResponse);
+    response.data.command_response.id = 0x42;
+    memcpy(response.data.command_response.command, "DB", 2);
+    response.data.command_response.status = 0;
+    response.data.command_response.data = nullptr;
+
+    unsigned char frame[XbeeRouting::Frame::MAX_SIZE];
+    received.assign(frame, frame + response.serialize(frame));
+    ASSERT_EQ((ssize_t)received.size(), write(radio, received.data(), received.size()));
+
+    XbeeRouting::FrameView view;
+    ASSERT_TRUE(xbee.receive(view));
+    EXPECT_EQ(XbeeRouting::Frame::Type::CommandResponse, view.type);
+  }
+
+  unsetenv("XBEE_CAPTURE");
+  close(radio);
+
+  FILE* file = fopen(path, "rb");
+  ASSERT_TRUE(file != NULL);
+
+  uint64_t started;
+  XbeeRouting::Capture::Record first, second, none;
+  std::vector<unsigned char> first_frame, second_frame, none_frame;
+
+  ASSERT_TRUE(XbeeRouting::Capture::read_header(file, started));
+  ASSERT_TRUE(XbeeRouting::Capture::read(file, first, first_frame));
+  ASSERT_TRUE(XbeeRouting::Capture::read(file, second, second_frame));
+  EXPECT_FALSE(XbeeRouting::Capture::read(file, none, none_frame));
+
+  fclose(file);
+  unlink(path);
+
+  EXPECT_GT(started, 0u);
+
+  EXPECT_EQ(XbeeRouting::Capture::Direction::Sent, first.direction);
+  EXPECT_EQ(sent, first_frame);
+  EXPECT_EQ(XbeeRouting::Capture::Direction::Received, second.direction);
+  EXPECT_EQ(received, second_frame);
+  EXPECT_LE(first.time, second.time);
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "common.h"
+#include "../../src/router/checkpoint.h"
+#include "../../src/router/network.h"
+
+using namespace PUT::CS;
+
+/**
+ * Nodes, MAC addresses, edges and measures survive restart
+ */
+TEST(CheckpointTest, restore) {
+  char path[] = "/tmp/checkpointXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  {
+    XbeeRouting::Network network(1);
+    XbeeRouting::Checkpoint checkpoint;
+
+    network.mac(1, 0x0013a20000000001);
+    network.mac(2, 0x0013a20000000002);
+    network.mac(3, 0x0013a20000000003);
+    network.add_edge(1, 2);
+    network.add_edge(2, 3);
+    network.add_edge(3, 4);
+    network.update(1, 2, 4, 0, 20);
+    SET_EDGE(network, 2, 3, 10, 1, 20);
+
+    ASSERT_TRUE(checkpoint.open(path));
+    ASSERT_TRUE(checkpoint.save(network));
+  }
+
+  XbeeRouting::Network network(1);
+  XbeeRouting::Checkpoint checkpoint;
+  size_t nodes, edges;
+
+  network.mac(1, 0x0013a200000000ff);
+
+  ASSERT_TRUE(checkpoint.open(path));
+  ASSERT_TRUE(checkpoint.restore(network, nodes, edges));
+
+  EXPECT_EQ(3u, nodes);
+  EXPECT_EQ(3u, edges);
+
+  // self keeps its own MAC, node 4 never had one
+  EXPECT_EQ(0x0013a200000000ffu, network.mac(1));
+  EXPECT_EQ(0x0013a20000000003u, network.mac(3));
+  EXPECT_EQ(uint64_t(XbeeRouting::Frame::BROADCAST), network.mac(4));
+  EXPECT_EQ(3, network.from_mac(0x0013a20000000003));
+
+  // measured edge keeps its averages, edge of other nodes its cost
+  XbeeRouting::Parameters measured = network.parameters(1, 2);
+  EXPECT_EQ(4u * XbeeRouting::Parameters::METRIC_SCALE, measured.retries);
+  EXPECT_NE(0u, measured.updated);
+  EXPECT_EQ(COUNTERS_METRIC(10, 1, 20), network.parameters(2, 3).metric());
+  EXPECT_EQ(0u, network.parameters(2, 3).updated);
+
+  // paths are known at once
+  EXPECT_EQ(2, network.next_hop(4));
+  EXPECT_THAT(network.path(1, 4, XbeeRouting::Visited()), testing::ElementsAre(2, 3, 4));
+
+  unlink(path);
+}
+
+/**
+ * Torn slot is ignored, the previous generation is restored
+ */
+TEST(CheckpointTest, torn) {
+  char path[] = "/tmp/checkpointXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  {
+    XbeeRouting::Network network(1);
+    XbeeRouting::Checkpoint checkpoint;
+
+    ASSERT_TRUE(checkpoint.open(path));
+
+    network.add_edge(1, 2);
+    ASSERT_TRUE(checkpoint.save(network));
+
+    network.add_edge(2, 3);
+    ASSERT_TRUE(checkpoint.save(network));
+  }
+
+  // generations are written to slots alternately, the last edge record of the newer one is damaged
+  fd = open(path, O_RDWR);
+  ASSERT_NE(-1, fd);
+  off_t size = lseek(fd, 0, SEEK_END);
+  unsigned char byte = 0xff;
+  off_t offset = sizeof(XbeeRouting::Checkpoint::Header) + 3 * sizeof(XbeeRouting::Checkpoint::NodeRecord) + sizeof(XbeeRouting::Checkpoint::EdgeRecord);
+  ASSERT_EQ(1, pwrite(fd, &byte, 1, offset));
+  close(fd);
+
+  XbeeRouting::Network network(1);
+  XbeeRouting::Checkpoint checkpoint;
+  size_t nodes, edges;
+
+  ASSERT_TRUE(checkpoint.open(path));
+  ASSERT_TRUE(checkpoint.restore(network, nodes, edges));
+
+  EXPECT_EQ(1u, edges);
+  EXPECT_TRUE(network.adjacent(1, 2));
+  EXPECT_FALSE(network.adjacent(2, 3));
+
+  // both slots damaged
+  fd = open(path, O_RDWR);
+  ASSERT_EQ(1, pwrite(fd, &byte, 1, size / 2 + sizeof(XbeeRouting::Checkpoint::Header)));
+  close(fd);
+
+  XbeeRouting::Network empty(1);
+  XbeeRouting::Checkpoint damaged;
+
+  ASSERT_TRUE(damaged.open(path));
+  EXPECT_FALSE(damaged.restore(empty, nodes, edges));
+
+  unlink(path);
+}
@@ -1,13 +1,50 @@
 #ifndef PUT_TEST_COMMON_H
 #define PUT_TEST_COMMON_H
 
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//! Edge cost of counters: good, errors (undelivered) and retries frames
+#define COUNTERS_METRIC(g, e, r) \
+  XbeeRouting::Metric(uint64_t(r) * (uint64_t(e) + 1) * XbeeRouting::Parameters::METRIC_SCALE / (uint64_t(g) + 1))
+
 //! setParameterHelper
 #define SET_EDGE(n, a, b, g, e, r) { \
   XbeeRouting::Parameters* tmp = n.edge(XbeeRouting::Address(a), XbeeRouting::Address(b));\
-  tmp->good = g; tmp->errors = e; tmp->retries = r; }
+  tmp->retries = COUNTERS_METRIC(g, e, r); tmp->losses = 0; n.invalidate(); }
 
 #define SET_EDGE_WITH_DELAY(n, a, b, g, e, r, d) { \
   XbeeRouting::Parameters* tmp = n.edge(XbeeRouting::Address(a), XbeeRouting::Address(b));\
-  tmp->good = g; tmp->errors = e; tmp->retries = r; tmp->delay=d; }
+  tmp->retries = COUNTERS_METRIC(g, e, r); tmp->losses = 0; tmp->delay = (d) * XbeeRouting::Parameters::METRIC_SCALE; n.invalidate(); }
+
+/**
+ * Create FIFO which stands for serial port of Xbee, its buffer holds only
+ * few frames, so writer blocks until the other end is read.
+ *
+ * @param path Buffer for FIFO path (at least 32 bytes)
+ * @return Non blocking descriptor of the other end, -1 on error
+ */
+inline int slow_serial_port(char* path) {
+  strcpy(path, "/tmp/serialXXXXXX");
+
+  int fd = mkstemp(path);
+
+  if (fd < 0)
+    return -1;
+
+  close(fd);
+  unlink(path);
+
+  if (mkfifo(path, 0600) != 0)
+    return -1;
+
+  fd = open(path, O_RDWR | O_NONBLOCK);
+  fcntl(fd, F_SETPIPE_SZ, 4096);
+
+  return fd;
+}
 
 #endif
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <random>
+
+#include "../../src/router/directory.h"
+
+using namespace PUT::CS;
+
+/**
+ * MAC address is found by address and address by MAC, changed MAC is reindexed
+ */
+TEST(DirectoryTest, find) {
+  XbeeRouting::Directory directory;
+
+  EXPECT_EQ(0, directory.find(0x0013a20040a1b2c3));
+  EXPECT_EQ(0, directory.find(0));
+
+  directory.set(3, 0x0013a20040a1b2c3);
+  directory.set(7, 0x0013a20040a1b2c4);
+
+  EXPECT_EQ(3, directory.find(0x0013a20040a1b2c3));
+  EXPECT_EQ(7, directory.find(0x0013a20040a1b2c4));
+  EXPECT_EQ(0x0013a20040a1b2c4u, directory.mac(7));
+  EXPECT_EQ(0, directory.find(0));
+
+  directory.set(3, 0x0013a20040a1b2c5);
+  EXPECT_EQ(0, directory.find(0x0013a20040a1b2c3));
+  EXPECT_EQ(3, directory.find(0x0013a20040a1b2c5));
+
+  directory.set(7, 0);
+  EXPECT_EQ(0, directory.find(0x0013a20040a1b2c4));
+  EXPECT_EQ(0u, directory.mac(7));
+}
+
+/**
+ * Shared MAC address gives the lowest address, the other one after it is removed
+ */
+TEST(DirectoryTest, shared) {
+  XbeeRouting::Directory directory;
+
+  directory.set(9, 1);
+  directory.set(4, 1);
+  directory.set(6, 1);
+  EXPECT_EQ(4, directory.find(1));
+
+  directory.set(4, 0);
+  EXPECT_EQ(6, directory.find(1));
+
+  directory.set(9, 2);
+  EXPECT_EQ(6, directory.find(1));
+  EXPECT_EQ(9, directory.find(2));
+}
+
+/**
+ * Every address with random MACs, changed and removed at random, matches linear scan
+ */
+TEST(DirectoryTest, matchesScan) {
+  XbeeRouting::Directory directory;
+  std::array<uint64_t, 256> macs;
+  std::mt19937_64 random(868);
+
+  macs.fill(0);
+
+  for (int i = 0; i < 20000; i++) {
+    XbeeRouting::Address a = 1 + random() % 254;
+    uint64_t mac = random() % 4 == 0 ? 0 : 0x0013a20000000000 + random() % 300;
+
+    directory.set(a, mac);
+    macs[a] = mac;
+
+    uint64_t probe = 0x0013a20000000000 + random() % 300;
+    XbeeRouting::Address expected = 0;
+
+    for (int b = 1; b < 255 && expected == 0; b++)
+      if (macs[b] == probe)
+        expected = b;
+
+    ASSERT_EQ(expected, directory.find(probe));
+    ASSERT_EQ(macs[a], directory.mac(a));
+  }
+}
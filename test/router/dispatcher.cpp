@@ -28,14 +28,14 @@ TEST(DispatcherTest, timeout) {
   SET_EDGE_WITH_DELAY(network, 6, 7, 15, 1, 2, delays[5]);
   SET_EDGE_WITH_DELAY(network, 7, 8, 15, 1, 2, delays[6]);
 
-  network.node(1)->mac = 1;
-  network.node(2)->mac = 1;
-  network.node(3)->mac = 1;
-  network.node(4)->mac = 1;
-  network.node(5)->mac = 1;
-  network.node(6)->mac = 1;
-  network.node(7)->mac = 1;
-  network.node(8)->mac = 1;
+  network.mac(1, 1);
+  network.mac(2, 1);
+  network.mac(3, 1);
+  network.mac(4, 1);
+  network.mac(5, 1);
+  network.mac(6, 1);
+  network.mac(7, 1);
+  network.mac(8, 1);
 
   XbeeRouting::Packet packet;
   packet.type = XbeeRouting::Packet::Type::Data;
@@ -45,11 +45,11 @@ TEST(DispatcherTest, timeout) {
 
   for (int i = 0; i < pathSize; i++) {
     packet.destination = i + 2;
-    XbeeRouting::Path path = network.path(self, XbeeRouting::Address(i + 2), XbeeRouting::Path());
+    XbeeRouting::Path path = network.path(self, XbeeRouting::Address(i + 2), XbeeRouting::Visited());
 
     ASSERT_EQ(i + 1, (int)path.size());
 
-    std::chrono::steady_clock::time_point timeout = dispatcher.timeout(&packet, path);
+    std::chrono::steady_clock::time_point timeout = dispatcher.timeout(packet, path);
     std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
     uint32_t delaySum = 0; for (int j = 0; j <= i; j++) delaySum += delays[j];
 
@@ -59,3 +59,215 @@ TEST(DispatcherTest, timeout) {
     prevTimeout = timeout;
   }
 }
+
+/**
+ * Packets are spread over edge-disjoint paths, the most reliable path gets
+ * more of them. The other paths are kept for failover.
+ */
+TEST(DispatcherTest, route) {
+  XbeeRouting::Xbee xbee("/dev/null");
+  XbeeRouting::Driver driver;
+  XbeeRouting::Network network(1);
+  XbeeRouting::Dispatcher dispatcher(xbee, network, driver);
+
+  // 1 - 2 - 5 is reliable, 1 - 3 - 5 is not, 1 - 4 - 5 has no retries yet
+  SET_EDGE(network, 1, 2, 100, 0, 1);
+  SET_EDGE(network, 2, 5, 100, 0, 1);
+  SET_EDGE(network, 1, 3, 100, 0, 100);
+  SET_EDGE(network, 3, 5, 100, 0, 100);
+  network.add_edge(1, 4);
+  network.add_edge(4, 5);
+
+  for (XbeeRouting::Address a = 1; a <= 5; a++)
+    network.mac(a, a);
+
+  XbeeRouting::Packet packet(XbeeRouting::Packet::Type::Data);
+  packet.source = 1;
+  packet.destination = 5;
+  packet.length = 0;
+
+  XbeeRouting::Paths alternatives;
+  XbeeRouting::Path path = dispatcher.route(packet, alternatives);
+
+  ASSERT_EQ(2u, path.size());
+  EXPECT_EQ(4, path.front());
+  ASSERT_EQ(2u, alternatives.size());
+  EXPECT_EQ(2, alternatives[0].front());
+  EXPECT_EQ(3, alternatives[1].front());
+
+  for (int i = 0; i < 12; i++) {
+    XbeeRouting::Packet p(XbeeRouting::Packet::Type::Data);
+    p.source = 1;
+    p.destination = 5;
+    p.length = 0;
+    p.packet_id = i + 1;
+
+    ASSERT_TRUE(dispatcher.deliver(std::move(p)));
+  }
+
+  EXPECT_EQ(12, dispatcher.load(2) + dispatcher.load(3) + dispatcher.load(4));
+  EXPECT_GT(dispatcher.load(2), 0);
+  EXPECT_GT(dispatcher.load(4), 0);
+  EXPECT_GT(dispatcher.load(4), dispatcher.load(3));
+  EXPECT_GE(dispatcher.load(2), dispatcher.load(3));
+}
+
+/**
+ * Packet whose frame is dropped by full transmit queue is not in flight,
+ * it is retransmitted after its timeout
+ */
+TEST(DispatcherTest, droppedFrame) {
+  char path[32];
+  int radio = slow_serial_port(path);
+  ASSERT_NE(-1, radio);
+
+  std::atomic_bool reading(false), stop(false);
+  std::thread serial([&]() {
+    unsigned char buffer[4096];
+
+    while (!stop.load()) {
+      if (!reading.load() || read(radio, buffer, sizeof(buffer)) <= 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  {
+    XbeeRouting::Xbee xbee(path, false);
+    XbeeRouting::Driver driver;
+    XbeeRouting::Network network(1);
+    XbeeRouting::Dispatcher dispatcher(xbee, network, driver);
+
+    network.add_edge(1, 2);
+    network.mac(1, 1);
+    network.mac(2, 2);
+
+    XbeeRouting::Packet filler(XbeeRouting::Packet::Type::Data);
+    filler.length = 200;
+    memset(filler.data.content, 'x', filler.length);
+
+    while (xbee.send(filler, 0, 2, 0xFFFE) == XbeeRouting::Xbee::Sent::Queued);
+
+    XbeeRouting::Packet packet(XbeeRouting::Packet::Type::Data);
+    packet.source = 1;
+    packet.destination = 2;
+    packet.length = 0;
+    packet.packet_id = 1;
+
+    ASSERT_TRUE(dispatcher.deliver(std::move(packet)));
+    EXPECT_EQ(0, dispatcher.load(2));
+
+    reading.store(true);
+
+    for (int i = 0; i < 200 && dispatcher.load(2) == 0; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(1, dispatcher.load(2));
+  }
+
+  stop.store(true);
+  serial.join();
+
+  close(radio);
+  unlink(path);
+}
+
+/**
+ * Packet which does not fit into frame fails at once, it is not retransmitted
+ */
+TEST(DispatcherTest, oversizedPacket) {
+  XbeeRouting::Xbee xbee("/dev/null");
+  XbeeRouting::Driver driver;
+  XbeeRouting::Network network(1);
+  XbeeRouting::Dispatcher dispatcher(xbee, network, driver);
+
+  network.add_edge(1, 2);
+  network.mac(1, 1);
+  network.mac(2, 2);
+
+  // forwarded packet, so it is not delivered back to the driver
+  XbeeRouting::Packet packet(XbeeRouting::Packet::Type::Data);
+  packet.source = 50;
+  packet.destination = 2;
+  packet.length = XbeeRouting::Packet::MAX_PAYLOAD;
+  packet.packet_id = 1;
+  memset(packet.data.content, 'x', packet.length);
+
+  // full payload behind long visited list
+  for (int i = 0; i < 40; i++)
+    packet.visited.push_back(i + 3);
+
+  EXPECT_FALSE(dispatcher.deliver(std::move(packet)));
+  EXPECT_EQ(1u, xbee.dropped());
+  EXPECT_EQ(0, dispatcher.load(2));
+}
+
+/**
+ * Paths are reused for the same destination, path which is not usable any
+ * more is not offered
+ */
+TEST(DispatcherTest, routeCache) {
+  XbeeRouting::Xbee xbee("/dev/null");
+  XbeeRouting::Driver driver;
+  XbeeRouting::Network network(1);
+  XbeeRouting::Dispatcher dispatcher(xbee, network, driver);
+
+  SET_EDGE(network, 1, 2, 100, 0, 1);
+  SET_EDGE(network, 2, 5, 100, 0, 1);
+  SET_EDGE(network, 1, 3, 100, 0, 100);
+  SET_EDGE(network, 3, 5, 100, 0, 100);
+  SET_EDGE(network, 1, 4, 100, 0, 200);
+  SET_EDGE(network, 4, 5, 100, 0, 200);
+
+  for (XbeeRouting::Address a = 1; a <= 5; a++)
+    network.mac(a, a);
+
+  XbeeRouting::Packet packet(XbeeRouting::Packet::Type::Data);
+  packet.source = 1;
+  packet.destination = 5;
+  packet.length = 0;
+
+  XbeeRouting::Paths alternatives;
+  XbeeRouting::Path path = dispatcher.route(packet, alternatives);
+
+  ASSERT_EQ(2u, path.size());
+  EXPECT_EQ(2, path.front());
+  ASSERT_EQ(2u, alternatives.size());
+  EXPECT_EQ(3, alternatives[0].front());
+  EXPECT_EQ(4, alternatives[1].front());
+
+  // edge out of the shortest path tree, the version stays
+  uint64_t version = network.version();
+  network.drop(3, 5);
+  EXPECT_EQ(version, network.version());
+
+  path = dispatcher.route(packet, alternatives);
+
+  EXPECT_EQ(2, path.front());
+  ASSERT_EQ(1u, alternatives.size());
+  EXPECT_EQ(4, alternatives[0].front());
+
+  // new disjoint path as long as the shortest one, the tree and version stay
+  network.mac(6, 6);
+  SET_EDGE(network, 1, 6, 100, 0, 2);
+  path = dispatcher.route(packet, alternatives);
+
+  version = network.version();
+  network.add_edge(6, 5);
+  EXPECT_EQ(version, network.version());
+
+  path = dispatcher.route(packet, alternatives);
+
+  EXPECT_EQ(2, path.front());
+  ASSERT_EQ(2u, alternatives.size());
+  EXPECT_EQ(6, alternatives[0].front());
+  EXPECT_EQ(4, alternatives[1].front());
+
+  // other visited nodes
+  packet.visited.push_back(2);
+  path = dispatcher.route(packet, alternatives);
+
+  ASSERT_EQ(2u, path.size());
+  EXPECT_EQ(6, path.front());
+  ASSERT_EQ(1u, alternatives.size());
+  EXPECT_EQ(4, alternatives[0].front());
+}
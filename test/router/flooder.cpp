@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../../src/router/flooder.h"
+
+using namespace PUT::CS;
+
+//! Broadcasted flood
+struct Flood {
+  XbeeRouting::Packet::Type type;
+  XbeeRouting::Address source;
+  uint16_t sequence;
+  uint8_t age;
+  uint8_t length;
+};
+
+//! Flooder which records broadcasts
+struct Recorder {
+  std::vector<Flood> floods;
+  std::mutex lock;
+
+  XbeeRouting::Flooder::Broadcast broadcast() {
+    return [this](XbeeRouting::Packet &packet) {
+      std::lock_guard<std::mutex> guard(lock);
+      floods.push_back(Flood { packet.type, packet.source, packet.sequence, packet.age, packet.length });
+    };
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return floods.size();
+  }
+};
+
+/**
+ * Changes made while waiting are sent together, own advertisement is originated when it is sent
+ */
+TEST(FlooderTest, merge) {
+  XbeeRouting::Network network(1);
+  XbeeRouting::Advertisement links;
+  Recorder recorder;
+
+  network.add_edge(1, 2);
+  network.add_edge(2, 3);
+  network.add_edge(3, 4);
+
+  XbeeRouting::Flooder flooder(network, recorder.broadcast(), std::chrono::hours(1));
+
+  flooder.advertise();
+  network.add_edge(1, 5);
+  flooder.advertise();
+
+  EXPECT_TRUE(network.link_state(3, 7, links));
+  flooder.link_state(3, 7, 2, 0);
+  EXPECT_TRUE(network.link_state(3, 8, links));
+  flooder.link_state(3, 8, 1, 0);
+
+  flooder.edge_drop(2, 3, 0);
+  flooder.edge_drop(3, 2, 0);
+
+  EXPECT_EQ(0u, recorder.size());
+  flooder.flush();
+
+  ASSERT_EQ(3u, recorder.size());
+  EXPECT_EQ(XbeeRouting::Packet::Type::LinkState, recorder.floods[0].type);
+  EXPECT_EQ(1, recorder.floods[0].source);
+  EXPECT_EQ(1, recorder.floods[0].sequence);
+  EXPECT_EQ(2, recorder.floods[0].length);
+
+  EXPECT_EQ(3, recorder.floods[1].source);
+  EXPECT_EQ(8, recorder.floods[1].sequence);
+  EXPECT_EQ(1, recorder.floods[1].age);
+
+  EXPECT_EQ(XbeeRouting::Packet::Type::EdgeDrop, recorder.floods[2].type);
+
+  EXPECT_EQ(3u, flooder.sent());
+  EXPECT_EQ(3u, flooder.merged());
+  EXPECT_EQ(0u, flooder.cancelled());
+
+  flooder.flush();
+  EXPECT_EQ(3u, recorder.size());
+}
+
+/**
+ * Flood is not sent if every neighbour of self heard it from other nodes
+ */
+TEST(FlooderTest, cancel) {
+  XbeeRouting::Network network(1);
+  XbeeRouting::Advertisement links;
+  Recorder recorder;
+
+  // 2 and 3 are neighbours of self, 4 hears both of them
+  network.add_edge(1, 2);
+  network.add_edge(1, 3);
+  network.add_edge(2, 4);
+  network.add_edge(3, 4);
+
+  XbeeRouting::Flooder flooder(network, recorder.broadcast(), std::chrono::hours(1));
+
+  EXPECT_TRUE(network.link_state(9, 1, links));
+  flooder.link_state(9, 1, 1, 2);
+
+  // older one and the same from 3
+  flooder.overheard_link_state(9, 0, 3);
+  flooder.overheard_link_state(9, 1, 3);
+
+  // 2 does not reach 3, 4 reaches both
+  flooder.edge_drop(4, 5, 2);
+  flooder.overheard_edge_drop(6, 7, 4);
+  flooder.overheard_edge_drop(5, 4, 4);
+
+  // heard by every neighbour already
+  flooder.edge_drop(6, 7, 4);
+
+  flooder.flush();
+
+  EXPECT_EQ(0u, recorder.size());
+  EXPECT_EQ(2u, flooder.cancelled());
+}
+
+/**
+ * Floods are sent after jitter shorter than window, or at once without window
+ */
+TEST(FlooderTest, jitter) {
+  XbeeRouting::Network network(1);
+  Recorder recorder;
+
+  network.add_edge(1, 2);
+
+  {
+    XbeeRouting::Flooder flooder(network, recorder.broadcast(), std::chrono::milliseconds(0));
+
+    flooder.advertise();
+    EXPECT_EQ(1u, recorder.size());
+  }
+
+  XbeeRouting::Flooder flooder(network, recorder.broadcast(), std::chrono::milliseconds(50));
+  auto start = std::chrono::steady_clock::now();
+
+  flooder.advertise();
+
+  while (recorder.size() < 2 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  ASSERT_EQ(2u, recorder.size());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+  EXPECT_EQ(2, recorder.floods[1].sequence);
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <random>
+#include <algorithm>
+
+#include "../../src/router/frontier.h"
+
+using namespace PUT::CS;
+
+/**
+ * Nodes are popped by key, key of node in the heap is decreased in place
+ */
+TEST(FrontierTest, decrease) {
+  XbeeRouting::Frontier frontier;
+
+  frontier.push(5, 50);
+  frontier.push(7, 70);
+  frontier.push(9, 10);
+  frontier.push(7, 5);
+  frontier.push(9, 90);
+
+  EXPECT_EQ(3, frontier.size());
+  EXPECT_TRUE(frontier.contains(5));
+
+  EXPECT_EQ(7, frontier.pop());
+  EXPECT_EQ(9, frontier.pop());
+  EXPECT_EQ(5, frontier.pop());
+  EXPECT_TRUE(frontier.empty());
+  EXPECT_FALSE(frontier.contains(5));
+}
+
+/**
+ * Every address at once, random keys and decreases
+ */
+TEST(FrontierTest, order) {
+  XbeeRouting::Frontier frontier;
+  std::vector<XbeeRouting::Metric> keys(256);
+  std::mt19937 random(255);
+
+  for (int a = 0; a < 256; a++) {
+    keys[a] = random() % 1000;
+    frontier.push(a, keys[a]);
+  }
+
+  for (int i = 0; i < 500; i++) {
+    int a = random() % 256;
+    keys[a] = std::min(keys[a], XbeeRouting::Metric(random() % 1000));
+    frontier.push(a, keys[a]);
+  }
+
+  XbeeRouting::Metric last = 0;
+
+  for (int i = 0; i < 256; i++) {
+    XbeeRouting::Address a = frontier.pop();
+
+    EXPECT_LE(last, keys[a]);
+    last = keys[a];
+  }
+
+  EXPECT_TRUE(frontier.empty());
+}
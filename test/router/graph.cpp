@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "common.h"
+#include "../../src/router/graph.h"
+
+using namespace PUT::CS;
+
+/**
+ * Edge is bidirectional, with single parameters record
+ */
+TEST(GraphTest, connect) {
+  XbeeRouting::Graph graph;
+
+  EXPECT_FALSE(graph.adjacent(3, 7));
+  EXPECT_TRUE(graph.edge(3, 7) == nullptr);
+
+  ASSERT_TRUE(graph.connect(3, 7));
+  EXPECT_FALSE(graph.connect(7, 3));
+  EXPECT_FALSE(graph.connect(5, 5));
+
+  EXPECT_TRUE(graph.adjacent(3, 7));
+  EXPECT_TRUE(graph.adjacent(7, 3));
+  EXPECT_EQ(graph.edge(3, 7), graph.edge(7, 3));
+  EXPECT_THAT(graph.neighbours(3), testing::ElementsAre(7));
+  EXPECT_THAT(graph.neighbours(7), testing::ElementsAre(3));
+  EXPECT_EQ(1u, graph.size());
+
+  ASSERT_TRUE(graph.connect(1, 254));
+  EXPECT_NE(graph.edge(3, 7), graph.edge(1, 254));
+}
+
+/**
+ * Removed edge leaves neighbour lists packed, parameters are reset
+ */
+TEST(GraphTest, disconnect) {
+  XbeeRouting::Graph graph;
+
+  ASSERT_TRUE(graph.connect(1, 2));
+  ASSERT_TRUE(graph.connect(1, 3));
+  ASSERT_TRUE(graph.connect(1, 4));
+
+  XbeeRouting::Parameters* parameters = graph.edge(1, 3);
+  parameters->losses = 10;
+
+  ASSERT_TRUE(graph.disconnect(3, 1));
+  EXPECT_FALSE(graph.disconnect(1, 3));
+
+  EXPECT_FALSE(graph.adjacent(1, 3));
+  EXPECT_THAT(graph.neighbours(1), testing::UnorderedElementsAre(2, 4));
+  EXPECT_TRUE(graph.neighbours(3).empty());
+  EXPECT_EQ(2u, graph.size());
+
+  // the same record is used again
+  ASSERT_TRUE(graph.connect(1, 3));
+  EXPECT_EQ(parameters, graph.edge(1, 3));
+  EXPECT_EQ(0u, parameters->losses);
+
+  graph.clear();
+  EXPECT_EQ(0u, graph.size());
+  EXPECT_TRUE(graph.neighbours(1).empty());
+  EXPECT_FALSE(graph.adjacent(1, 2));
+}
+
+/**
+ * Fixed-point metric follows antireliability and saturates
+ */
+TEST(GraphTest, metric) {
+  XbeeRouting::Parameters parameters;
+
+  EXPECT_EQ(0u, parameters.metric());
+
+  parameters.retries = XbeeRouting::Parameters::METRIC_SCALE;
+  parameters.losses = XbeeRouting::Parameters::METRIC_SCALE / 16;
+  EXPECT_FLOAT_EQ(1.5f, parameters.antireliability());
+  EXPECT_EQ(XbeeRouting::Parameters::METRIC_SCALE * 3 / 2, parameters.metric());
+
+  parameters.retries = UINT32_MAX;
+  parameters.losses = UINT32_MAX;
+  EXPECT_EQ(XbeeRouting::Parameters::MAX_METRIC, parameters.metric());
+
+  EXPECT_EQ(XbeeRouting::UNREACHABLE, XbeeRouting::saturated(XbeeRouting::UNREACHABLE - 1, 2));
+  EXPECT_EQ(5u, XbeeRouting::saturated(2, 3));
+}
+
+/**
+ * Averages follow recent samples, whatever the history was
+ */
+TEST(GraphTest, average) {
+  const XbeeRouting::Metric SCALE = XbeeRouting::Parameters::METRIC_SCALE;
+  XbeeRouting::Parameters parameters;
+  uint64_t now = 1000;
+
+  // the first sample is taken as it is
+  parameters.sample(2, false, 40, now);
+  EXPECT_EQ(2 * SCALE, parameters.retries);
+  EXPECT_EQ(0u, parameters.losses);
+  EXPECT_EQ(40, parameters.milliseconds());
+
+  // perfect for a long time, every 100 ms
+  for (int i = 0; i < 100000; i++)
+    parameters.sample(0, false, 20, now += 100);
+
+  EXPECT_EQ(0u, parameters.metric());
+  EXPECT_EQ(20, parameters.milliseconds());
+
+  // link breaks, it is costlier than a link with 1 retry after 8 frames (under a second)
+  for (int i = 0; i < 8; i++)
+    parameters.sample(3, true, 20, now += 100);
+
+  EXPECT_GT(parameters.metric(), SCALE);
+  EXPECT_GT(parameters.antireliability(), 5);
+
+  // and recovers as quickly
+  for (int i = 0; i < 24; i++)
+    parameters.sample(0, false, 20, now += 100);
+
+  EXPECT_LT(parameters.metric(), SCALE / 2);
+
+  // sample after silence weighs more
+  XbeeRouting::Parameters dense = parameters, sparse = parameters;
+
+  dense.sample(3, true, 20, now + 100);
+  sparse.sample(3, true, 20, now + 10000);
+  EXPECT_GT(sparse.metric(), dense.metric());
+  EXPECT_GT(sparse.losses, SCALE / 2);
+
+  // delay is averaged too, not halved with every sample
+  parameters.sample(0, false, 1000, now += 100);
+  EXPECT_GT(parameters.milliseconds(), 20);
+  EXPECT_LT(parameters.milliseconds(), 510);
+}
+
+/**
+ * Edge without samples decays, edge which was not measured does not
+ */
+TEST(GraphTest, decay) {
+  const uint32_t HALF_LIFE = XbeeRouting::Parameters::HALF_LIFE;
+  XbeeRouting::Parameters parameters, advertised;
+
+  parameters.sample(3, true, 20, 1000);
+  XbeeRouting::Metric metric = parameters.metric();
+
+  EXPECT_FALSE(parameters.decay(1000 + HALF_LIFE - 1));
+  EXPECT_EQ(metric, parameters.metric());
+
+  EXPECT_TRUE(parameters.decay(1000 + HALF_LIFE));
+  EXPECT_EQ(metric / 2, parameters.metric());
+
+  EXPECT_TRUE(parameters.decay(1000 + 3 * HALF_LIFE + 5));
+  EXPECT_EQ(metric / 8, parameters.metric());
+  EXPECT_FALSE(parameters.decay(1000 + 3 * HALF_LIFE + 10));
+  EXPECT_EQ(1000u, parameters.updated);
+
+  advertised.retries = 2048;
+  EXPECT_FALSE(advertised.decay(10 * HALF_LIFE));
+  EXPECT_EQ(2048u, advertised.metric());
+}
+
+/**
+ * Sample after long silence weighs the same, whether the edge decayed
+ * meanwhile or not
+ */
+TEST(GraphTest, sampleAfterDecay) {
+  const uint32_t SCALE = XbeeRouting::Parameters::METRIC_SCALE;
+  XbeeRouting::Parameters decayed, silent;
+
+  decayed.sample(0, false, 20, 1000);
+  silent.sample(0, false, 20, 1000);
+
+  // decayed every 3 s, as Network::decay() is called
+  for (uint64_t now = 1000; now <= 121000; now += 3000)
+    decayed.decay(now);
+
+  decayed.sample(10, false, 20, 121000);
+  silent.sample(10, false, 20, 121000);
+
+  EXPECT_EQ(silent.retries, decayed.retries);
+  EXPECT_GT(decayed.retries, 9 * SCALE);
+
+  // halvings start again after the sample
+  EXPECT_FALSE(decayed.decay(121000 + XbeeRouting::Parameters::HALF_LIFE - 1));
+  EXPECT_TRUE(decayed.decay(121000 + XbeeRouting::Parameters::HALF_LIFE));
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "../../src/router/identity.h"
+
+using namespace PUT::CS;
+
+//! Command response carrying given value
+static void respond(XbeeRouting::Identity &identity, const char* command, const void* value, uint16_t length) {
+  XbeeRouting::Frame frame(XbeeRouting::Frame::Type::CommandResponse);
+
+  memcpy(frame.data.command_response.command, command, 2);
+  frame.data.command_response.status = 0;
+  frame.length = length;
+  frame.data.command_response.data = (unsigned char*)malloc(length);
+  memcpy(frame.data.command_response.data, value, length);
+
+  EXPECT_TRUE(identity.update(frame));
+}
+
+/**
+ * Identity is assembled from command responses
+ */
+TEST(IdentityTest, update) {
+  XbeeRouting::Identity identity;
+  uint32_t low = 0x12345678, high = 0x0013a200;
+  uint16_t network = 0x7fff;
+
+  respond(identity, "NI", "node", 4);
+  respond(identity, "ID", &network, 2);
+  respond(identity, "SH", &high, 4);
+  respond(identity, "SL", &low, 4);
+
+  EXPECT_EQ("node", identity.name);
+  EXPECT_EQ(0x7fff, identity.network);
+  EXPECT_EQ(0x123456780013a200u, identity.mac);
+}
+
+/**
+ * Cache is valid only for the same serial port
+ */
+TEST(IdentityTest, cache) {
+  char path[] = "/tmp/identityXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  XbeeRouting::Identity identity, cached;
+  identity.mac = 0x0013a20040a1b2c3;
+  identity.network = 0x3332;
+  identity.name = "node with spaces";
+
+  ASSERT_TRUE(identity.save(path, "/dev/ttyUSB0"));
+
+  EXPECT_FALSE(cached.load(path, "/dev/ttyUSB1"));
+  ASSERT_TRUE(cached.load(path, "/dev/ttyUSB0"));
+  EXPECT_EQ(identity, cached);
+
+  unlink(path);
+  EXPECT_FALSE(cached.load(path, "/dev/ttyUSB0"));
+}
@@ -1,6 +1,12 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <set>
+
 #include "common.h"
 #include "../../src/router/network.h"
 
@@ -84,14 +90,14 @@ TEST(NetworkTest, nodeForbiddenAddress) {
   XbeeRouting::Network network(16);
 
   EXPECT_FALSE(network.add_node(0));
-  EXPECT_FALSE(network.add_node(255));
+  EXPECT_FALSE(network.add_node(XbeeRouting::MAX_ADDRESS));
 
   EXPECT_FALSE(network.add_edge(XbeeRouting::Address(127), XbeeRouting::Address(0)));
   EXPECT_FALSE(network.add_edge(XbeeRouting::Address(0), XbeeRouting::Address(127)));
-  EXPECT_FALSE(network.add_edge(XbeeRouting::Address(255), XbeeRouting::Address(6)));
-  EXPECT_FALSE(network.add_edge(XbeeRouting::Address(0), XbeeRouting::Address(255)));
+  EXPECT_FALSE(network.add_edge(XbeeRouting::MAX_ADDRESS, XbeeRouting::Address(6)));
+  EXPECT_FALSE(network.add_edge(XbeeRouting::Address(0), XbeeRouting::MAX_ADDRESS));
 
-  EXPECT_FALSE(network.add_edge(XbeeRouting::Address(255), XbeeRouting::Address(255)));
+  EXPECT_FALSE(network.add_edge(XbeeRouting::MAX_ADDRESS, XbeeRouting::MAX_ADDRESS));
   EXPECT_FALSE(network.add_edge(XbeeRouting::Address(0), XbeeRouting::Address(0)));
 }
 
@@ -346,24 +352,24 @@ TEST(NetworkTest, pathSingleChain) {
   SET_EDGE(network, 4, 5, 15, 2, 2);
   SET_EDGE(network, 3, 4, 999, 0, 2);
 
-  network.node(1)->mac = 1;
-  network.node(2)->mac = 1;
-  network.node(3)->mac = 1;
-  network.node(4)->mac = 1;
-  network.node(5)->mac = 1;
+  network.mac(1, 1);
+  network.mac(2, 1);
+  network.mac(3, 1);
+  network.mac(4, 1);
+  network.mac(5, 1);
 
   XbeeRouting::Path path, expectedPath;
 
   expectedPath = { XbeeRouting::Address(2), XbeeRouting::Address(3), XbeeRouting::Address(4), XbeeRouting::Address(5) };
-  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(5), XbeeRouting::Path());
+  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(5), XbeeRouting::Visited());
   EXPECT_THAT(path, testing::ContainerEq(expectedPath));
 
   expectedPath = { XbeeRouting::Address(2), XbeeRouting::Address(3) };
-  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(3), XbeeRouting::Path());
+  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(3), XbeeRouting::Visited());
   EXPECT_THAT(path, testing::ContainerEq(expectedPath));
 
   expectedPath = { XbeeRouting::Address(2) };
-  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(2), XbeeRouting::Path());
+  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(2), XbeeRouting::Visited());
   EXPECT_THAT(path, testing::ContainerEq(expectedPath));
 }
 
@@ -387,20 +393,20 @@ TEST(NetworkTest, pathNoChainGraph) {
   SET_EDGE(network, 7, 8, 25, 1, 3);
   SET_EDGE(network, 3, 6, 10, 12, 43);
 
-  network.node(1)->mac = 1;
-  network.node(2)->mac = 1;
-  network.node(3)->mac = 1;
-  network.node(4)->mac = 1;
-  network.node(5)->mac = 1;
-  network.node(6)->mac = 1;
-  network.node(7)->mac = 1;
-  network.node(8)->mac = 1;
-  network.node(9)->mac = 1;
+  network.mac(1, 1);
+  network.mac(2, 1);
+  network.mac(3, 1);
+  network.mac(4, 1);
+  network.mac(5, 1);
+  network.mac(6, 1);
+  network.mac(7, 1);
+  network.mac(8, 1);
+  network.mac(9, 1);
 
   XbeeRouting::Path path, expectedPath;
 
   expectedPath = { XbeeRouting::Address(2), XbeeRouting::Address(8), XbeeRouting::Address(7), XbeeRouting::Address(6) };
-  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(6), XbeeRouting::Path());
+  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(6), XbeeRouting::Visited());
   EXPECT_THAT(path, testing::ContainerEq(expectedPath));
 }
 
@@ -423,20 +429,20 @@ TEST(NetworkTest, pathInTreeGraph) {
   SET_EDGE(network, 6, 9, 71, 21, 15);
   SET_EDGE(network, 7, 9, 71, 12, 38);
 
-  network.node(1)->mac = 1;
-  network.node(2)->mac = 1;
-  network.node(3)->mac = 1;
-  network.node(4)->mac = 1;
-  network.node(5)->mac = 1;
-  network.node(6)->mac = 1;
-  network.node(7)->mac = 1;
-  network.node(8)->mac = 1;
-  network.node(9)->mac = 1;
+  network.mac(1, 1);
+  network.mac(2, 1);
+  network.mac(3, 1);
+  network.mac(4, 1);
+  network.mac(5, 1);
+  network.mac(6, 1);
+  network.mac(7, 1);
+  network.mac(8, 1);
+  network.mac(9, 1);
 
   XbeeRouting::Path path, expectedPath;
 
   expectedPath = { XbeeRouting::Address(3), XbeeRouting::Address(7), XbeeRouting::Address(8), XbeeRouting::Address(6), XbeeRouting::Address(9) };
-  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(9), XbeeRouting::Path());
+  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(9), XbeeRouting::Visited());
   EXPECT_THAT(path, testing::ContainerEq(expectedPath));
 }
 
@@ -458,20 +464,20 @@ TEST(NetworkTest, pathNoPath) {
   SET_EDGE(network, 4, 1, 72, 4, 41);
   SET_EDGE(network, 4, 9, 82, 2, 31);
 
-  network.node(1)->mac = 1;
-  network.node(2)->mac = 1;
-  network.node(3)->mac = 1;
-  network.node(4)->mac = 1;
-  network.node(5)->mac = 1;
-  network.node(6)->mac = 1;
-  network.node(7)->mac = 1;
-  network.node(8)->mac = 1;
-  network.node(9)->mac = 1;
+  network.mac(1, 1);
+  network.mac(2, 1);
+  network.mac(3, 1);
+  network.mac(4, 1);
+  network.mac(5, 1);
+  network.mac(6, 1);
+  network.mac(7, 1);
+  network.mac(8, 1);
+  network.mac(9, 1);
 
   XbeeRouting::Path path, expectedPath;
 
   expectedPath = { };
-  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(6), XbeeRouting::Path());
+  path = network.path(XbeeRouting::Address(1), XbeeRouting::Address(6), XbeeRouting::Visited());
   EXPECT_THAT(path, testing::ContainerEq(expectedPath));
 }
 
@@ -495,17 +501,18 @@ TEST(NetworkTest, pathNoChainGraphVisited) {
   SET_EDGE(network, 7, 8, 25, 1, 3);
   SET_EDGE(network, 3, 6, 10, 12, 43);
 
-  network.node(1)->mac = 1;
-  network.node(2)->mac = 1;
-  network.node(3)->mac = 1;
-  network.node(4)->mac = 1;
-  network.node(5)->mac = 1;
-  network.node(6)->mac = 1;
-  network.node(7)->mac = 1;
-  network.node(8)->mac = 1;
-  network.node(9)->mac = 1;
+  network.mac(1, 1);
+  network.mac(2, 1);
+  network.mac(3, 1);
+  network.mac(4, 1);
+  network.mac(5, 1);
+  network.mac(6, 1);
+  network.mac(7, 1);
+  network.mac(8, 1);
+  network.mac(9, 1);
 
-  XbeeRouting::Path path, expectedPath, visited;
+  XbeeRouting::Path path, expectedPath;
+  XbeeRouting::Visited visited;
 
   visited = { XbeeRouting::Address(1) };
   expectedPath = { XbeeRouting::Address(3), XbeeRouting::Address(4), XbeeRouting::Address(9), XbeeRouting::Address(8), XbeeRouting::Address(7), XbeeRouting::Address(6) };
@@ -513,3 +520,636 @@ TEST(NetworkTest, pathNoChainGraphVisited) {
   EXPECT_THAT(path, testing::ContainerEq(expectedPath));
 }
 
+
+/**
+ * Paths from self are served from the shortest path tree, which is rebuilt
+ * only after relevant change
+ */
+TEST(NetworkTest, pathCache) {
+  XbeeRouting::Network network(1);
+
+  SET_EDGE(network, 1, 2, 10, 0, 1);
+  SET_EDGE(network, 2, 3, 10, 0, 1);
+  SET_EDGE(network, 3, 4, 10, 0, 1);
+  SET_EDGE(network, 1, 5, 1, 1, 5);
+  SET_EDGE(network, 5, 4, 1, 1, 5);
+
+  for (XbeeRouting::Address a = 1; a <= 5; a++)
+    network.mac(a, 1);
+
+  XbeeRouting::Path path, expectedPath;
+
+  expectedPath = { XbeeRouting::Address(2), XbeeRouting::Address(3), XbeeRouting::Address(4) };
+  path = network.path(1, 4, XbeeRouting::Visited());
+  EXPECT_THAT(path, testing::ContainerEq(expectedPath));
+  EXPECT_EQ(1u, network.cache_hits());
+  EXPECT_EQ(0u, network.cache_misses());
+
+  path = network.path(1, 4, XbeeRouting::Visited());
+  EXPECT_THAT(path, testing::ContainerEq(expectedPath));
+  EXPECT_EQ(2u, network.cache_hits());
+
+  EXPECT_EQ(XbeeRouting::Address(2), network.next_hop(4));
+  EXPECT_EQ(XbeeRouting::Address(5), network.next_hop(5));
+  EXPECT_EQ(XbeeRouting::Address(0), network.next_hop(1));
+  EXPECT_EQ(XbeeRouting::Address(0), network.next_hop(6));
+
+  // worse edge out of the tree
+  uint64_t version = network.version();
+  network.update(5, 4, 10, 1, 10);
+  EXPECT_EQ(version, network.version());
+
+  // visited node on the tree path
+  XbeeRouting::Visited visited = { XbeeRouting::Address(3) };
+  expectedPath = { XbeeRouting::Address(5), XbeeRouting::Address(4) };
+  path = network.path(1, 4, visited);
+  EXPECT_THAT(path, testing::ContainerEq(expectedPath));
+  EXPECT_EQ(2u, network.cache_hits());
+  EXPECT_EQ(1u, network.cache_misses());
+
+  // the other way is not affected by visited node
+  expectedPath = { XbeeRouting::Address(2) };
+  path = network.path(1, 2, visited);
+  EXPECT_THAT(path, testing::ContainerEq(expectedPath));
+  EXPECT_EQ(3u, network.cache_hits());
+
+  // tree edge, still cheaper than 1 - 5 - 4
+  network.update(2, 3, 3, 0, 10);
+  EXPECT_NE(version, network.version());
+
+  version = network.version();
+  EXPECT_TRUE(network.drop(5, 4));
+  EXPECT_EQ(version, network.version());
+
+  EXPECT_TRUE(network.drop(2, 3));
+  EXPECT_NE(version, network.version());
+
+  // tree is repaired, not rebuilt
+  path = network.path(1, 4, XbeeRouting::Visited());
+  EXPECT_TRUE(path.empty());
+  EXPECT_EQ(4u, network.cache_hits());
+  EXPECT_EQ(1u, network.cache_misses());
+
+  // better edge out of the tree
+  network.add_edge(1, 4);
+  expectedPath = { XbeeRouting::Address(4) };
+  path = network.path(1, 4, XbeeRouting::Visited());
+  EXPECT_THAT(path, testing::ContainerEq(expectedPath));
+  EXPECT_EQ(5u, network.cache_hits());
+  EXPECT_EQ(1u, network.cache_misses());
+}
+
+//! Cost of path from a, as minimized by Network::path()
+static XbeeRouting::Metric pathCost(XbeeRouting::Network &network, XbeeRouting::Address a, const XbeeRouting::Path &path) {
+  XbeeRouting::Metric cost = 0;
+
+  for (XbeeRouting::Address b : path) {
+    cost += network.parameters(a, b).metric();
+    a = b;
+  }
+
+  return cost;
+}
+
+/**
+ * Cached paths are as good as Dijkstra run on every change
+ */
+TEST(NetworkTest, pathCacheMatchesDijkstra) {
+  const XbeeRouting::Address nodes = 30;
+  XbeeRouting::Network cached(1), uncached(1);
+  std::mt19937 random(868);
+
+  for (int step = 0; step < 400; step++) {
+    XbeeRouting::Address a = random() % nodes + 1, b = random() % nodes + 1;
+    int operation = random() % 10;
+
+    if (operation < 4) {
+      cached.add_edge(a, b);
+      uncached.add_edge(a, b);
+    } else if (operation < 9) {
+      uint8_t retries = random() % 8, error = random() % 2;
+
+      if (cached.adjacent(a, b)) {
+        cached.update(a, b, retries, error, 10);
+        uncached.update(a, b, retries, error, 10);
+      }
+    } else {
+      cached.drop(a, b);
+      uncached.drop(a, b);
+    }
+
+    if (cached.adjacent(1, a)) {
+      cached.mac(a, step % 3 ? a : 0);
+      uncached.mac(a, step % 3 ? a : 0);
+    }
+
+    XbeeRouting::Visited visited;
+
+    if (step % 2)
+      visited.push_back(random() % nodes + 1);
+
+    for (XbeeRouting::Address to = 2; to <= nodes; to++) {
+      uncached.invalidate();
+
+      XbeeRouting::Path expected = uncached.path(1, to, visited);
+      XbeeRouting::Path path = cached.path(1, to, visited);
+
+      ASSERT_EQ(expected.empty(), path.empty()) << "step " << step << ", to " << (int) to;
+
+      if (!path.empty()) {
+        ASSERT_EQ(pathCost(uncached, 1, expected), pathCost(cached, 1, path)) << "step " << step << ", to " << (int) to;
+
+        for (XbeeRouting::Address v : visited)
+          ASSERT_TRUE(std::find(path.begin(), path.end(), v) == path.end()) << "step " << step << ", to " << (int) to;
+
+        if (visited.empty()) {
+          ASSERT_EQ(path.front(), cached.next_hop(to)) << "step " << step << ", to " << (int) to;
+        }
+      }
+    }
+  }
+
+  EXPECT_GT(cached.cache_hits(), 0u);
+}
+
+/**
+ * Shortest path tree repaired after every metric update, added and dropped
+ * edge is as good as Dijkstra on dense mesh (every path is taken from the tree)
+ */
+TEST(NetworkTest, pathRepairMatchesDijkstra) {
+  const XbeeRouting::Address nodes = 120;
+  XbeeRouting::Network repaired(1), uncached(1);
+  std::mt19937 random(1868);
+
+  for (XbeeRouting::Address a = 1; a <= nodes; a++)
+    for (int i = 0; i < 3; i++) {
+      XbeeRouting::Address b = random() % nodes + 1;
+
+      repaired.add_edge(a, b);
+      uncached.add_edge(a, b);
+    }
+
+  for (XbeeRouting::Address a = 1; a <= nodes; a++) {
+    repaired.mac(a, a);
+    uncached.mac(a, a);
+  }
+
+  repaired.path(1, nodes, XbeeRouting::Visited());
+
+  for (int step = 0; step < 3000; step++) {
+    XbeeRouting::Address a = random() % nodes + 1, b = random() % nodes + 1;
+    int operation = random() % 20;
+
+    if (operation == 0) {
+      repaired.drop(a, b);
+      uncached.drop(a, b);
+    } else if (operation == 1) {
+      repaired.add_edge(a, b);
+      uncached.add_edge(a, b);
+    } else if (operation == 2 && uncached.adjacent(1, a)) {
+      repaired.mac(a, step % 2 ? a : 0);
+      uncached.mac(a, step % 2 ? a : 0);
+    } else if (uncached.adjacent(a, b)) {
+      uint8_t retries = random() % 16, error = random() % 4 == 0;
+
+      repaired.update(a, b, retries, error, 10);
+      uncached.update(a, b, retries, error, 10);
+    }
+
+    if (step % 30)
+      continue;
+
+    for (XbeeRouting::Address to = 2; to <= nodes; to++) {
+      uncached.invalidate();
+
+      XbeeRouting::Path expected = uncached.path(1, to, XbeeRouting::Visited());
+      XbeeRouting::Path path = repaired.path(1, to, XbeeRouting::Visited());
+
+      ASSERT_EQ(expected.empty(), path.empty()) << "step " << step << ", to " << (int) to;
+
+      if (!path.empty()) {
+        ASSERT_EQ(pathCost(uncached, 1, expected), pathCost(repaired, 1, path)) << "step " << step << ", to " << (int) to;
+      }
+    }
+  }
+
+  EXPECT_EQ(0u, repaired.cache_misses());
+}
+
+/**
+ * Path search stopping at destination finds the same cost as Bellman-Ford,
+ * visited nodes and first hops with unknown MAC are excluded
+ */
+TEST(NetworkTest, pathMatchesBellmanFord) {
+  const XbeeRouting::Address nodes = 60;
+  XbeeRouting::Network network(1);
+  std::mt19937 random(16);
+
+  for (int i = 0; i < 200; i++) {
+    XbeeRouting::Address a = random() % nodes + 1, b = random() % nodes + 1;
+
+    if (a != b)
+      SET_EDGE(network, a, b, random() % 100, random() % 5, random() % 20);
+  }
+
+  for (XbeeRouting::Address a = 1; a <= nodes; a++)
+    network.mac(a, a % 7 ? a : 0);
+
+  for (int query = 0; query < 300; query++) {
+    XbeeRouting::Address from = random() % nodes + 1, to = random() % nodes + 1;
+    XbeeRouting::Visited visited = { XbeeRouting::Address(random() % nodes + 1), XbeeRouting::Address(random() % nodes + 1) };
+    std::vector<XbeeRouting::Metric> distance(nodes + 1, XbeeRouting::UNREACHABLE);
+
+    distance[from] = 0;
+
+    for (int round = 0; round < nodes; round++)
+      for (XbeeRouting::Address a = 1; a <= nodes; a++)
+        for (XbeeRouting::Address b : network.neighbours(a)) {
+          bool excluded = std::find(visited.begin(), visited.end(), b) != visited.end() || (a == from && network.mac(b) == XbeeRouting::Frame::BROADCAST);
+
+          if (!excluded && distance[a] != XbeeRouting::UNREACHABLE)
+            distance[b] = std::min(distance[b], distance[a] + network.parameters(a, b).metric());
+        }
+
+    XbeeRouting::Path path = network.path(from, to, visited);
+
+    if (from == to || distance[to] == XbeeRouting::UNREACHABLE) {
+      EXPECT_TRUE(path.empty()) << (int) from << " -> " << (int) to;
+    } else {
+      ASSERT_FALSE(path.empty()) << (int) from << " -> " << (int) to;
+      EXPECT_EQ(distance[to], pathCost(network, from, path)) << (int) from << " -> " << (int) to;
+    }
+  }
+}
+
+/**
+ * Readers work on snapshots while graph is changed
+ */
+TEST(NetworkTest, concurrentReaders) {
+  const XbeeRouting::Address nodes = 40;
+  XbeeRouting::Network network(1);
+  std::atomic<bool> running(true);
+  std::vector<std::thread> readers;
+
+  for (XbeeRouting::Address a = 1; a < nodes; a++) {
+    network.add_edge(a, a + 1);
+    network.mac(a, a);
+  }
+
+  for (int r = 0; r < 3; r++)
+    readers.push_back(std::thread([&network, &running, nodes, r]() {
+      XbeeRouting::Visited visited = { XbeeRouting::Address(r + 2) };
+      XbeeRouting::Edge edges[XbeeRouting::Packet::MAX_EDGES];
+
+      while (running.load()) {
+        for (XbeeRouting::Address to = 2; to <= nodes; to++) {
+          XbeeRouting::Path path = network.path(1, to, r ? visited : XbeeRouting::Visited());
+
+          ASSERT_LE(path.size(), size_t(nodes));
+        }
+
+        ASSERT_LE(network.neighbours(1).size(), size_t(nodes));
+        ASSERT_LE(network.graph(edges, XbeeRouting::Packet::MAX_EDGES), XbeeRouting::Packet::MAX_EDGES);
+        network.adjacent(1, 2);
+        network.from_mac(nodes / 2);
+      }
+    }));
+
+  std::mt19937 random(15);
+
+  for (int step = 0; step < 2000; step++) {
+    XbeeRouting::Address a = random() % nodes + 1, b = random() % nodes + 1;
+
+    if (step % 3 == 0)
+      network.drop(a, b);
+    else if (step % 3 == 1)
+      network.add_edge(a, b);
+    else
+      network.update(a, a % nodes + 1, random() % 8, random() % 2, 10);
+  }
+
+  running = false;
+
+  for (std::thread &reader : readers)
+    reader.join();
+
+  EXPECT_GT(network.cache_hits(), 0u);
+}
+
+//! Wait till Routes are computed for the latest graph
+static bool allPairsReady(XbeeRouting::Network &network) {
+  for (int i = 0; i < 5000 && !network.all_pairs_ready(); i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  return network.all_pairs_ready();
+}
+
+/**
+ * Paths and next hops from background Routes are the same as found by
+ * Dijkstra, for every pair of nodes and after changes of the graph
+ */
+TEST(NetworkTest, allPairsMatchesDijkstra) {
+  const XbeeRouting::Address nodes = 50;
+  XbeeRouting::Network network(1), uncached(1);
+  std::mt19937 random(17);
+
+  for (int i = 0; i < 150; i++) {
+    XbeeRouting::Address a = random() % nodes + 1, b = random() % nodes + 1;
+    uint32_t good = random() % 100, errors = random() % 5, retries = random() % 20;
+
+    if (a != b) {
+      SET_EDGE(network, a, b, good, errors, retries);
+      SET_EDGE(uncached, a, b, good, errors, retries);
+    }
+  }
+
+  for (XbeeRouting::Address a = 1; a <= nodes; a++) {
+    network.mac(a, a % 9 ? a : 0);
+    uncached.mac(a, a % 9 ? a : 0);
+  }
+
+  EXPECT_FALSE(network.all_pairs_ready());
+
+  network.all_pairs(true);
+
+  for (int round = 0; round < 3; round++) {
+    ASSERT_TRUE(allPairsReady(network)) << "round " << round;
+
+    for (XbeeRouting::Address from = 1; from <= nodes; from++)
+      for (XbeeRouting::Address to = 1; to <= nodes; to++) {
+        XbeeRouting::Visited visited = { from, XbeeRouting::Address(random() % nodes + 1) };
+        XbeeRouting::Path expected = uncached.path(from, to, XbeeRouting::Visited({ from }));
+        XbeeRouting::Path avoiding = uncached.path(from, to, visited);
+        XbeeRouting::Path path = network.path(from, to, visited);
+
+        ASSERT_EQ(expected.empty() ? 0 : expected.front(), network.next_hop(from, to)) << (int) from << " -> " << (int) to;
+        ASSERT_EQ(avoiding.empty(), path.empty()) << (int) from << " -> " << (int) to;
+        ASSERT_EQ(pathCost(uncached, from, avoiding), pathCost(network, from, path)) << (int) from << " -> " << (int) to;
+      }
+
+    for (int i = 0; i < 20; i++) {
+      XbeeRouting::Address a = random() % nodes + 1, b = random() % nodes + 1;
+
+      if (i % 5 == 0) {
+        network.drop(a, b);
+        uncached.drop(a, b);
+      } else if (uncached.adjacent(a, b)) {
+        network.update(a, b, 30, 1, 10);
+        uncached.update(a, b, 30, 1, 10);
+      }
+    }
+  }
+
+  network.all_pairs(false);
+
+  EXPECT_FALSE(network.all_pairs_ready());
+}
+
+/**
+ * Alternative paths share no edge, the first one is Network::path() and
+ * they are ordered by cost
+ */
+TEST(NetworkTest, disjointPaths) {
+  const XbeeRouting::Address nodes = 40;
+  XbeeRouting::Network network(1);
+  std::mt19937 random(18);
+
+  for (int i = 0; i < 160; i++) {
+    XbeeRouting::Address a = random() % nodes + 1, b = random() % nodes + 1;
+
+    if (a != b)
+      SET_EDGE(network, a, b, random() % 100, random() % 5, random() % 20);
+  }
+
+  for (XbeeRouting::Address a = 1; a <= nodes; a++)
+    network.mac(a, a);
+
+  for (int query = 0; query < 200; query++) {
+    XbeeRouting::Address from = query % 2 ? 1 : random() % nodes + 1, to = random() % nodes + 1;
+    XbeeRouting::Visited visited = { from, XbeeRouting::Address(random() % nodes + 1) };
+    XbeeRouting::Path paths[4];
+    XbeeRouting::Metric costs[4];
+    std::set<std::pair<XbeeRouting::Address, XbeeRouting::Address>> used;
+
+    uint8_t count = network.paths(from, to, visited, paths, costs, 4);
+
+    ASSERT_EQ(network.path(from, to, visited).empty(), count == 0);
+
+    for (uint8_t i = 0; i < count; i++) {
+      XbeeRouting::Address a = from;
+
+      EXPECT_EQ(pathCost(network, from, paths[i]), costs[i]);
+
+      if (i > 0) {
+        EXPECT_LE(costs[i - 1], costs[i]);
+      }
+
+      for (XbeeRouting::Address b : paths[i]) {
+        EXPECT_TRUE(used.insert(std::make_pair(std::min(a, b), std::max(a, b))).second) << "edge " << (int) a << " - " << (int) b << " reused";
+        EXPECT_TRUE(std::find(visited.begin() + 1, visited.end(), b) == visited.end());
+        a = b;
+      }
+
+      EXPECT_EQ(to, a);
+    }
+  }
+}
+
+//! Advertisement of given links, every link has the same cost
+static XbeeRouting::Advertisement advertisement(std::initializer_list<XbeeRouting::Address> nodes, uint16_t cost) {
+  XbeeRouting::Advertisement links;
+
+  for (XbeeRouting::Address n : nodes) {
+    XbeeRouting::AdvertisedLink link;
+    link.node = n;
+    link.cost = cost;
+    links.push_back(link);
+  }
+
+  return links;
+}
+
+/**
+ * Newer advertisement replaces edges of its node, older and repeated ones
+ * are ignored, edges of self are kept
+ */
+TEST(NetworkTest, linkState) {
+  XbeeRouting::Network network(1);
+
+  network.add_edge(1, 2);
+
+  EXPECT_TRUE(network.link_state(2, 10, advertisement({ 3, 4 }, 2048)));
+  EXPECT_TRUE(network.adjacent(2, 3));
+  EXPECT_TRUE(network.adjacent(2, 4));
+  EXPECT_TRUE(network.adjacent(1, 2));
+  EXPECT_EQ(2048u, network.parameters(2, 3).metric());
+
+  // duplicate and older
+  EXPECT_FALSE(network.link_state(2, 10, advertisement({ 3 }, 0)));
+  EXPECT_FALSE(network.link_state(2, 9, advertisement({ 3 }, 0)));
+  EXPECT_TRUE(network.adjacent(2, 4));
+
+  EXPECT_TRUE(network.link_state(2, 11, advertisement({ 4 }, 100)));
+  EXPECT_FALSE(network.adjacent(2, 3));
+  EXPECT_TRUE(network.adjacent(1, 2));
+  EXPECT_EQ(100u, network.parameters(2, 4).metric());
+
+  // sequence numbers wrap around
+  EXPECT_TRUE(network.link_state(4, 65535, advertisement({ 2 }, 100)));
+  EXPECT_TRUE(network.link_state(4, 1, advertisement({ 2, 5 }, 100)));
+  EXPECT_FALSE(network.link_state(4, 65534, advertisement({ 2 }, 100)));
+  EXPECT_TRUE(network.adjacent(4, 5));
+
+  // 4 advertises edge to 2, which 2 does not know yet
+  EXPECT_TRUE(network.link_state(2, 12, advertisement({}, 0)));
+  EXPECT_TRUE(network.adjacent(2, 4));
+
+  uint16_t sequence;
+  XbeeRouting::Advertisement links;
+
+  ASSERT_TRUE(network.advertisement(4, sequence, links));
+  EXPECT_EQ(1, sequence);
+  EXPECT_EQ(2u, links.size());
+  EXPECT_FALSE(network.advertisement(5, sequence, links));
+
+  // edge to self is not added by the other end, self does not hear it
+  EXPECT_TRUE(network.link_state(5, 1, advertisement({ 1, 4 }, 100)));
+  EXPECT_TRUE(network.adjacent(4, 5));
+  EXPECT_FALSE(network.adjacent(1, 5));
+
+  // self
+  EXPECT_EQ(1, network.originate(links));
+  ASSERT_EQ(1u, links.size());
+  EXPECT_EQ(2, links[0].node);
+  EXPECT_FALSE(network.link_state(1, 1, advertisement({}, 0)));
+  EXPECT_TRUE(network.link_state(1, 40, advertisement({}, 0)));
+  EXPECT_TRUE(network.adjacent(1, 2));
+  EXPECT_EQ(41, network.originate(links));
+
+  // 2 reaches every neighbour of self, 4 does not reach 3
+  network.add_edge(1, 3);
+  network.add_edge(2, 3);
+
+  EXPECT_TRUE(network.covered(network.audience(2)));
+  EXPECT_FALSE(network.covered(network.audience(4)));
+  EXPECT_FALSE(network.covered(network.audience(0)));
+  EXPECT_TRUE(network.covered(network.audience(4) | network.audience(3)));
+}
+
+/**
+ * Digest changes with every advertisement and depends only on known ones
+ */
+TEST(NetworkTest, digest) {
+  XbeeRouting::Network a(1), b(2);
+  XbeeRouting::Advertisement links;
+
+  EXPECT_EQ(a.digest(), b.digest());
+
+  EXPECT_TRUE(a.link_state(3, 5, advertisement({ 4 }, 100)));
+  EXPECT_TRUE(a.link_state(19, 1, advertisement({ 3 }, 100)));
+  EXPECT_NE(a.digest(), b.digest());
+
+  // the same advertisements in different order
+  EXPECT_TRUE(b.link_state(19, 1, advertisement({ 3 }, 100)));
+  EXPECT_TRUE(b.link_state(3, 4, advertisement({ 4 }, 100)));
+
+  XbeeRouting::Digest x = a.digest(), y = b.digest();
+
+  // 3 and 19 share bucket, sequence of 3 differs
+  EXPECT_NE(x[XbeeRouting::Network::bucket(3)], y[XbeeRouting::Network::bucket(3)]);
+  EXPECT_EQ(XbeeRouting::Network::bucket(3), XbeeRouting::Network::bucket(19));
+
+  EXPECT_TRUE(b.link_state(3, 5, advertisement({ 4 }, 100)));
+  EXPECT_EQ(a.digest(), b.digest());
+
+  // own advertisement
+  a.originate(links);
+  EXPECT_NE(a.digest(), b.digest());
+  EXPECT_TRUE(b.link_state(1, 1, links));
+  EXPECT_EQ(a.digest(), b.digest());
+}
+
+/**
+ * Path avoids edge within a few failures after long good history, and the edge
+ * is tried again after it was not used for a while
+ */
+TEST(NetworkTest, metricsAdapt) {
+  XbeeRouting::Network network(1);
+  const uint32_t HALF_LIFE = XbeeRouting::Parameters::HALF_LIFE;
+  uint64_t now = 1000;
+
+  network.add_edge(1, 2);
+  network.add_edge(2, 4);
+  network.add_edge(1, 3);
+  network.add_edge(3, 4);
+
+  for (XbeeRouting::Address a = 1; a <= 4; a++)
+    network.mac(a, a);
+
+  // 1 - 2 - 4 was perfect for hours, 1 - 3 - 4 needs a retry
+  for (int i = 0; i < 100000; i++) {
+    network.update(1, 2, 0, 0, 20, now += 100);
+    network.update(2, 4, 0, 0, 20, now);
+    network.update(1, 3, 1, 0, 20, now);
+    network.update(3, 4, 0, 0, 20, now);
+  }
+
+  EXPECT_EQ(2, network.path(1, 4, XbeeRouting::Visited()).front());
+
+  for (int i = 0; i < 4; i++)
+    network.update(1, 2, 3, 1, 20, now += 100);
+
+  EXPECT_EQ(3, network.path(1, 4, XbeeRouting::Visited()).front());
+
+  // traffic goes through 3, 1 - 2 is not measured any more
+  for (uint64_t end = now + 2 * HALF_LIFE; now < end; now += 1000) {
+    network.update(1, 3, 1, 0, 20, now);
+    network.update(3, 4, 0, 0, 20, now);
+    network.decay(now);
+  }
+
+  EXPECT_EQ(3, network.path(1, 4, XbeeRouting::Visited()).front());
+
+  for (uint64_t end = now + 2 * HALF_LIFE; now < end; now += 1000) {
+    network.update(1, 3, 1, 0, 20, now);
+    network.update(3, 4, 0, 0, 20, now);
+    network.decay(now);
+  }
+
+  EXPECT_EQ(2, network.path(1, 4, XbeeRouting::Visited()).front());
+}
+
+/**
+ * Node is found by MAC address while it is in the network, its slot is reused
+ */
+TEST(NetworkTest, fromMac) {
+  XbeeRouting::Network network(1);
+
+  network.add_edge(1, 2);
+  network.add_edge(2, 3);
+  network.mac(2, 0x0013a20040a1b2c3);
+  network.mac(3, 0x0013a20040a1b2c4);
+
+  XbeeRouting::Node* node = network.node(3);
+
+  EXPECT_EQ(2, network.from_mac(0x0013a20040a1b2c3));
+  EXPECT_EQ(3, network.from_mac(0x0013a20040a1b2c4));
+  EXPECT_EQ(0, network.from_mac(0x0013a20040a1b2c5));
+  EXPECT_EQ(0x0013a20040a1b2c4u, node->mac);
+
+  // MAC changes when NodeBroadcast comes from replaced radio
+  network.mac(3, 0x0013a20040a1b2c5);
+  EXPECT_EQ(0, network.from_mac(0x0013a20040a1b2c4));
+  EXPECT_EQ(3, network.from_mac(0x0013a20040a1b2c5));
+
+  EXPECT_TRUE(network.drop(2, 3));
+  EXPECT_EQ(0, network.from_mac(0x0013a20040a1b2c5));
+  EXPECT_EQ(0u, network.mac(3));
+
+  network.add_edge(2, 3);
+  EXPECT_EQ(node, network.node(3));
+  EXPECT_EQ(0u, node->mac);
+  EXPECT_EQ(3, node->address);
+  EXPECT_EQ(network.self(), network.node(1));
+  EXPECT_TRUE(network.self()->self);
+}
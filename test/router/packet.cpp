@@ -0,0 +1,324 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "common.h"
+#include "../../src/router/packet.h"
+
+using namespace PUT::CS;
+
+/**
+ * Serialize packet as it would be received from the radio
+ */
+static unsigned char* receive_bytes(XbeeRouting::Packet &packet) {
+  XbeeRouting::Frame* transmit = packet.to_frame();
+  XbeeRouting::Frame receive(XbeeRouting::Frame::Type::Receive);
+  int length;
+
+  receive.data.receive.mac = 0x0013a20000000001;
+  receive.data.receive.network = 0xFFFE;
+  receive.data.receive.options = 0;
+  receive.length = transmit->length;
+  receive.data.receive.data = transmit->data.transmit.data;
+
+  unsigned char* bytes = receive.serialize(length);
+
+  // data is owned by transmit frame
+  receive.length = 0;
+  delete transmit;
+
+  return bytes;
+}
+
+/**
+ * Data packet view points into frame, copy owns its data
+ */
+TEST(PacketViewTest, data) {
+  XbeeRouting::Packet packet(std::string("hello"));
+  packet.destination = 7;
+  packet.source = 1;
+  packet.packet_id = 12;
+  packet.port = 3;
+  packet.visited = { 1, 4 };
+
+  unsigned char* bytes = receive_bytes(packet);
+
+  XbeeRouting::FrameView frame;
+  frame.unserialize(bytes);
+
+  ASSERT_EQ(XbeeRouting::Frame::Type::Receive, frame.type);
+
+  XbeeRouting::PacketView view;
+  ASSERT_EQ(XbeeRouting::Packet::Type::Data, view.from_frame(frame.data.receive, frame.length));
+
+  EXPECT_EQ(7, view.destination);
+  EXPECT_EQ(1, view.source);
+  EXPECT_EQ(12, view.packet_id);
+  EXPECT_EQ(3, view.port);
+  EXPECT_EQ(0x0013a20000000001u, view.mac);
+  ASSERT_EQ(2, view.visited_count);
+  EXPECT_EQ(4, view.visited[1]);
+  ASSERT_EQ(5, view.length);
+  EXPECT_EQ(0, memcmp("hello", view.data.content, 5));
+
+  // view is not a copy
+  EXPECT_GE(view.data.content, bytes);
+  EXPECT_LT(view.data.content, bytes + 300);
+
+  XbeeRouting::Packet copy(view);
+  free(bytes);
+
+  EXPECT_EQ(7, copy.destination);
+  EXPECT_THAT(copy.visited, testing::ElementsAre(1, 4));
+  ASSERT_EQ(5, copy.length);
+  EXPECT_EQ(0, memcmp("hello", copy.data.content, 5));
+}
+
+/**
+ * Ack parameters are decoded from the wire format
+ */
+TEST(PacketViewTest, ack) {
+  XbeeRouting::Packet packet(XbeeRouting::Packet::Type::Ack);
+  XbeeRouting::RemoteParameters parameters[2];
+
+  parameters[0].hop = 5;
+  parameters[0].delay = 300;
+  parameters[0].errors = 1;
+  parameters[1].hop = 6;
+  parameters[1].delay = 20;
+
+  packet.destination = 2;
+  packet.source = 6;
+  packet.origin = 1;
+  packet.status = 0;
+  packet.length = 2;
+  packet.data.parameters[0] = parameters[0];
+  packet.data.parameters[1] = parameters[1];
+
+  unsigned char* bytes = receive_bytes(packet);
+
+  XbeeRouting::FrameView frame;
+  frame.unserialize(bytes);
+
+  XbeeRouting::PacketView view;
+  ASSERT_EQ(XbeeRouting::Packet::Type::Ack, view.from_frame(frame.data.receive, frame.length));
+  ASSERT_EQ(2, view.length);
+  EXPECT_EQ(1, view.origin);
+
+  EXPECT_EQ(5, view.parameter(0).hop);
+  EXPECT_EQ(300, view.parameter(0).delay);
+  EXPECT_EQ(1, view.parameter(0).errors);
+  EXPECT_EQ(6, view.parameter(1).hop);
+  EXPECT_EQ(20, view.parameter(1).delay);
+
+  free(bytes);
+}
+
+/**
+ * Link-state advertisement keeps sequence number, age and links costs
+ */
+TEST(PacketViewTest, linkState) {
+  XbeeRouting::Packet packet(XbeeRouting::Packet::Type::LinkState);
+
+  packet.destination = 0;
+  packet.source = 9;
+  packet.sequence = 0xABCD;
+  packet.age = 3;
+  packet.length = 2;
+  packet.data.links[0].node = 4;
+  packet.data.links[0].cost = 1024;
+  packet.data.links[1].node = 200;
+  packet.data.links[1].cost = 0xFFFF;
+
+  unsigned char* bytes = receive_bytes(packet);
+
+  XbeeRouting::FrameView frame;
+  frame.unserialize(bytes);
+
+  XbeeRouting::PacketView view;
+  ASSERT_EQ(XbeeRouting::Packet::Type::LinkState, view.from_frame(frame.data.receive, frame.length));
+  EXPECT_EQ(9, view.source);
+  EXPECT_EQ(0xABCD, view.sequence);
+  EXPECT_EQ(3, view.age);
+  ASSERT_EQ(2, view.length);
+  EXPECT_EQ(4, view.link(0).node);
+  EXPECT_EQ(1024, view.link(0).cost);
+
+  XbeeRouting::Packet copy(view);
+  free(bytes);
+
+  EXPECT_EQ(0xABCD, copy.sequence);
+  ASSERT_EQ(2, copy.length);
+  EXPECT_EQ(200, copy.data.links[1].node);
+  EXPECT_EQ(0xFFFF, copy.data.links[1].cost);
+}
+
+/**
+ * NodeBroadcast carries topology digest, beacons without it are decoded too
+ */
+TEST(PacketViewTest, digest) {
+  XbeeRouting::Packet packet(XbeeRouting::Address(7));
+
+  packet.length = XbeeRouting::Packet::DIGEST_BUCKETS;
+
+  for (int i = 0; i < packet.length; i++)
+    packet.digest[i] = 0x0101 * i;
+
+  unsigned char* bytes = receive_bytes(packet);
+
+  XbeeRouting::FrameView frame;
+  frame.unserialize(bytes);
+
+  XbeeRouting::PacketView view;
+  ASSERT_EQ(XbeeRouting::Packet::Type::NodeBroadcast, view.from_frame(frame.data.receive, frame.length));
+  EXPECT_EQ(7, view.data.address);
+  ASSERT_EQ(XbeeRouting::Packet::DIGEST_BUCKETS, view.length);
+  EXPECT_EQ(0x0F0F, view.bucket(15));
+
+  XbeeRouting::Packet copy(view);
+  free(bytes);
+
+  ASSERT_EQ(XbeeRouting::Packet::DIGEST_BUCKETS, copy.length);
+  EXPECT_EQ(0x0303, copy.digest[3]);
+
+  XbeeRouting::Packet legacy(XbeeRouting::Address(8));
+  bytes = receive_bytes(legacy);
+  frame.unserialize(bytes);
+
+  ASSERT_EQ(XbeeRouting::Packet::Type::NodeBroadcast, view.from_frame(frame.data.receive, frame.length));
+  EXPECT_EQ(8, view.data.address);
+  EXPECT_EQ(0, view.length);
+  free(bytes);
+}
+
+#ifdef XBEE_WIDE_ADDRESS
+/**
+ * Addresses beyond single byte survive the wire format and keep packets apart
+ */
+TEST(PacketViewTest, wideAddress) {
+  XbeeRouting::Packet packet(std::string("hello"));
+  packet.destination = 700;
+  packet.source = 300;
+  packet.packet_id = 12;
+  packet.visited = { 300, 1000 };
+
+  unsigned char* bytes = receive_bytes(packet);
+
+  XbeeRouting::FrameView frame;
+  frame.unserialize(bytes);
+
+  XbeeRouting::PacketView view;
+  ASSERT_EQ(XbeeRouting::Packet::Type::Data, view.from_frame(frame.data.receive, frame.length));
+  EXPECT_EQ(700, view.destination);
+  EXPECT_EQ(300, view.source);
+  ASSERT_EQ(2, view.visited_count);
+  EXPECT_EQ(1000, view.visited[1]);
+  ASSERT_EQ(5, view.length);
+  free(bytes);
+
+  XbeeRouting::Packet ack(packet, 700, 0);
+  ack.data.parameters[ack.length++].hop = 1000;
+  ack.data.parameters[0].delay = 300;
+
+  bytes = receive_bytes(ack);
+  frame.unserialize(bytes);
+
+  ASSERT_EQ(XbeeRouting::Packet::Type::Ack, view.from_frame(frame.data.receive, frame.length));
+  EXPECT_EQ(1000, view.destination);
+  EXPECT_EQ(300, view.origin);
+  ASSERT_EQ(1, view.length);
+  EXPECT_EQ(1000, view.parameter(0).hop);
+  EXPECT_EQ(300, view.parameter(0).delay);
+  free(bytes);
+
+  // the same low bytes of addresses
+  XbeeRouting::Packet other(std::string("hello"));
+  other.destination = 700 & 0xFF;
+  other.source = 300 & 0xFF;
+  other.packet_id = 12;
+
+  EXPECT_EQ(packet.id(), ack.id());
+  EXPECT_NE(packet.id(), other.id());
+}
+
+#endif
+/**
+ * Moved packet takes payload and frame over, source is left empty
+ */
+TEST(PacketTest, move) {
+  EXPECT_FALSE(std::is_copy_constructible<XbeeRouting::Packet>::value);
+
+  XbeeRouting::Packet packet(std::string("hello"));
+  packet.visited = { 1, 4 };
+
+  XbeeRouting::Packet moved(std::move(packet));
+
+  EXPECT_EQ(0, packet.length);
+  EXPECT_TRUE(packet.visited.empty());
+  EXPECT_EQ(XbeeRouting::Packet::Type::Data, moved.type);
+  EXPECT_THAT(moved.visited, testing::ElementsAre(1, 4));
+  ASSERT_EQ(5, moved.length);
+  EXPECT_EQ(0, memcmp("hello", moved.data.content, 5));
+
+  XbeeRouting::Packet internal;
+  XbeeRouting::Frame* frame = new XbeeRouting::Frame(XbeeRouting::Frame::Type::Status);
+  internal.data.frame = frame;
+
+  // frame is released once, by the last owner
+  moved = std::move(internal);
+
+  EXPECT_EQ(XbeeRouting::Packet::Type::Internal, moved.type);
+  EXPECT_EQ(frame, moved.data.frame);
+  EXPECT_TRUE(internal.data.frame == nullptr);
+}
+
+/**
+ * Ack payload is inline, parameters are appended without allocation
+ */
+TEST(PacketTest, ack) {
+  XbeeRouting::Packet data(std::string("hello"));
+  data.source = 1;
+  data.destination = 7;
+  data.packet_id = 3;
+  data.visited = { 1, 4 };
+
+  XbeeRouting::Packet ack(data, 7, 0);
+
+  EXPECT_EQ(XbeeRouting::Packet::Type::Ack, ack.type);
+  EXPECT_EQ(4, ack.destination);
+  EXPECT_EQ(1, ack.origin);
+  EXPECT_EQ(data.id(), ack.id());
+  EXPECT_EQ(0, ack.length);
+
+  for (int i = 0; i < XbeeRouting::Packet::MAX_PARAMETERS; i++)
+    ack.data.parameters[ack.length++].hop = i;
+
+  XbeeRouting::Packet moved(std::move(ack));
+
+  ASSERT_EQ(XbeeRouting::Packet::MAX_PARAMETERS, moved.length);
+  EXPECT_EQ(XbeeRouting::Packet::MAX_PARAMETERS - 1, moved.data.parameters[moved.length - 1].hop);
+}
+
+/**
+ * Visited nodes are stored inline, up to what fits the wire format
+ */
+TEST(PacketTest, visitedCapacity) {
+  XbeeRouting::Packet packet(std::string("hello"));
+
+  for (size_t i = 0; i < XbeeRouting::Visited::capacity(); i++)
+    ASSERT_TRUE(packet.visited.push_back(i));
+
+  EXPECT_FALSE(packet.visited.push_back(1));
+  EXPECT_EQ(XbeeRouting::Visited::capacity(), packet.visited.size());
+  EXPECT_EQ(XbeeRouting::Visited::capacity() - 1, packet.visited.back());
+
+  unsigned char header[XbeeRouting::Frame::MAX_SIZE];
+  const uint8_t* content;
+  uint16_t content_length;
+
+  uint8_t length = packet.serialize(header, content, content_length);
+
+  // one more visited node would not fit 255 bytes
+  EXPECT_EQ(4 + (2 + XbeeRouting::Visited::capacity()) * sizeof(XbeeRouting::Address), length);
+  EXPECT_GT(length + sizeof(XbeeRouting::Address), 255u);
+  EXPECT_EQ(XbeeRouting::Visited::capacity(), header[3 + 2 * sizeof(XbeeRouting::Address)]);
+}
@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <atomic>
+#include <new>
+
+#include "common.h"
+#include "../../src/router/router.h"
+#include "../../src/router/history.h"
+#include "../../src/router/dispatcher.h"
+#include "../../src/router/reader.h"
+
+using namespace PUT::CS;
+
+//! Number of heap allocations made with operator new (in the whole test binary)
+static std::atomic<uint64_t> heap_allocations {0};
+
+void* operator new(size_t size) {
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size);
+
+  if (p == nullptr)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t &) noexcept {
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  return malloc(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+//! Heap allocations - operator new and malloc used by Buffers
+static uint64_t allocations() {
+  return heap_allocations.load() + XbeeRouting::Buffers::heap().load();
+}
+
+/**
+ * Slab gives its blocks only, exhausted slab reports fallback
+ */
+TEST(PoolTest, slab) {
+  XbeeRouting::Slab slab(20);
+
+  EXPECT_TRUE(slab.allocate() == nullptr);
+  ASSERT_TRUE(slab.configure(2));
+  EXPECT_FALSE(slab.configure(4));
+  EXPECT_EQ(0u, slab.block_size() % alignof(std::max_align_t));
+
+  void* a = slab.allocate();
+  void* b = slab.allocate();
+
+  ASSERT_TRUE(a != nullptr);
+  ASSERT_TRUE(b != nullptr);
+  EXPECT_TRUE(slab.allocate() == nullptr);
+  EXPECT_EQ(2u, slab.heap_allocations());
+  EXPECT_EQ(2u, slab.used());
+
+  int outside;
+  EXPECT_FALSE(slab.release(&outside));
+  EXPECT_TRUE(slab.release(a));
+  EXPECT_EQ(a, slab.allocate());
+  EXPECT_EQ(2u, slab.max_used());
+}
+
+//! Serialize packet received from mac as API frame
+static int receive_frame(const XbeeRouting::Packet &packet, uint64_t mac, unsigned char* bytes) {
+  unsigned char data[XbeeRouting::Frame::MAX_SIZE];
+  const uint8_t* payload;
+  uint16_t payload_length;
+  uint8_t length = packet.serialize(data, payload, payload_length);
+
+  if (payload_length > 0)
+    memcpy(data + length, payload, payload_length);
+
+  XbeeRouting::Frame receive(XbeeRouting::Frame::Type::Receive);
+  receive.data.receive.mac = mac;
+  receive.data.receive.network = 0xFFFE;
+  receive.data.receive.options = 0;
+  receive.data.receive.data = data;
+  receive.length = length + payload_length;
+
+  int written = receive.serialize(bytes);
+
+  // data is not owned by the frame
+  receive.length = 0;
+
+  return written;
+}
+
+//! Read next frame written by Xbee
+static void read_frame(int radio, XbeeRouting::FrameReader &reader, XbeeRouting::FrameView &frame) {
+  while (!reader.next(frame))
+    ASSERT_GT(reader.fill(radio), 0);
+}
+
+/**
+ * Steady state forwarding on node 3 - Data from 2 is received and delivered
+ * to 4, its StatusFrame and Ack update the network and Ack is passed to 2 -
+ * does not use the heap. Frames go through Xbee and Dispatcher, as in
+ * Router::process().
+ */
+TEST(PoolTest, forwardingWithoutHeap) {
+  XbeeRouting::Router::configure_pools();
+
+  int radio = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_NE(-1, radio);
+  ASSERT_EQ(0, grantpt(radio));
+  ASSERT_EQ(0, unlockpt(radio));
+
+  XbeeRouting::Xbee xbee(ptsname(radio), false);
+  XbeeRouting::Driver driver;
+  XbeeRouting::Network network(3);
+  XbeeRouting::Dispatcher dispatcher(xbee, network, driver);
+
+  for (XbeeRouting::Address a = 1; a <= 5; a++)
+    network.mac(a, 0x0013a20000000000 + a);
+
+  network.add_edge(1, 2);
+  network.add_edge(2, 3);
+  network.add_edge(3, 4);
+  network.add_edge(4, 5);
+
+  // data packet from 1 to 5, visited 2, and its ack passed by 4
+  unsigned char data_bytes[XbeeRouting::Frame::MAX_SIZE], ack_bytes[XbeeRouting::Frame::MAX_SIZE];
+  XbeeRouting::Packet data("hello");
+  data.source = 1;
+  data.destination = 5;
+  data.packet_id = 7;
+  data.visited.push_back(2);
+
+  int data_length = receive_frame(data, 0x0013a20000000002, data_bytes);
+
+  XbeeRouting::Packet ack(XbeeRouting::Packet::Type::Ack);
+  ack.source = 5;
+  ack.destination = 3;
+  ack.origin = 1;
+  ack.packet_id = 7;
+  ack.length = 1;
+  ack.data.parameters[0].hop = 5;
+  ack.data.parameters[0].delay = 10;
+
+  int ack_length = receive_frame(ack, 0x0013a20000000004, ack_bytes);
+
+  XbeeRouting::FrameReader written;
+  uint64_t before = 0;
+
+  for (int i = 0; i < 1000; i++) {
+    // first rounds fill containers, pools and logging buffers
+    if (i == 100)
+      before = allocations();
+
+    XbeeRouting::FrameView frame;
+    XbeeRouting::PacketView view;
+
+    ASSERT_EQ(data_length, write(radio, data_bytes, data_length));
+    ASSERT_TRUE(xbee.receive(frame));
+    ASSERT_EQ(XbeeRouting::Frame::Type::Receive, frame.type);
+
+    view.from_frame(frame.data.receive, frame.length);
+    dispatcher.scan(view);
+
+    XbeeRouting::Packet owned(view);
+    owned.visited.push_back(3);
+    ASSERT_TRUE(dispatcher.deliver(std::move(owned)));
+
+    // data goes to 4
+    XbeeRouting::FrameView sent;
+    read_frame(radio, written, sent);
+    ASSERT_EQ(XbeeRouting::Frame::Type::Transmit, sent.type);
+    ASSERT_EQ(0x0013a20000000004u, sent.data.transmit.mac);
+
+    unsigned char status_bytes[XbeeRouting::Frame::MAX_SIZE];
+    XbeeRouting::Frame status(XbeeRouting::Frame::Type::Status);
+    status.data.status.id = sent.data.transmit.id;
+    status.data.status.network = 0xFFFE;
+    status.data.status.retries = i % 2;
+    status.data.status.status = 0;
+    status.data.status.discovery = 0;
+
+    int status_length = status.serialize(status_bytes);
+    ASSERT_EQ(status_length, write(radio, status_bytes, status_length));
+    ASSERT_TRUE(xbee.receive(frame));
+    ASSERT_EQ(XbeeRouting::Frame::Type::Status, frame.type);
+
+    XbeeRouting::Packet internal;
+    internal.length = frame.length;
+    internal.data.frame = new XbeeRouting::Frame(frame);
+    dispatcher.scan(internal);
+
+    ASSERT_EQ(ack_length, write(radio, ack_bytes, ack_length));
+    ASSERT_TRUE(xbee.receive(frame));
+
+    view.from_frame(frame.data.receive, frame.length);
+    dispatcher.scan(view);
+
+    // ack goes to 2
+    read_frame(radio, written, sent);
+    ASSERT_EQ(XbeeRouting::Frame::Type::Transmit, sent.type);
+    ASSERT_EQ(0x0013a20000000002u, sent.data.transmit.mac);
+  }
+
+  EXPECT_EQ(before, allocations());
+  EXPECT_EQ(0, dispatcher.load(4));
+
+  close(radio);
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <unistd.h>
+#include <vector>
+
+#include "common.h"
+#include "../../src/router/reader.h"
+
+using namespace PUT::CS;
+
+//! Serialize status frame with given id
+static std::vector<unsigned char> status_frame(uint8_t id) {
+  XbeeRouting::Frame frame(XbeeRouting::Frame::Type::Status);
+  int length;
+
+  frame.data.status.id = id;
+  frame.data.status.network = 0xFFFE;
+  frame.data.status.retries = 2;
+  frame.data.status.status = 0;
+  frame.data.status.discovery = 0;
+
+  unsigned char* bytes = frame.serialize(length);
+  std::vector<unsigned char> result(bytes, bytes + length);
+  free(bytes);
+
+  return result;
+}
+
+/**
+ * Every frame from single read should be decoded
+ */
+TEST(FrameReaderTest, multipleFramesSingleRead) {
+  XbeeRouting::FrameReader reader;
+  std::vector<unsigned char> stream;
+  int fd[2];
+
+  for (uint8_t id = 1; id <= 3; id++) {
+    std::vector<unsigned char> f = status_frame(id);
+    stream.insert(stream.end(), f.begin(), f.end());
+  }
+
+  ASSERT_EQ(0, pipe(fd));
+  ASSERT_EQ((ssize_t)stream.size(), write(fd[1], stream.data(), stream.size()));
+
+  EXPECT_EQ((ssize_t)stream.size(), reader.fill(fd[0]));
+
+  for (uint8_t id = 1; id <= 3; id++) {
+    XbeeRouting::Frame* frame = reader.next();
+
+    ASSERT_NE(nullptr, frame);
+    EXPECT_EQ(XbeeRouting::Frame::Type::Status, frame->type);
+    EXPECT_EQ(id, frame->data.status.id);
+    EXPECT_EQ(2, frame->data.status.retries);
+
+    delete frame;
+  }
+
+  EXPECT_EQ(nullptr, reader.next());
+  EXPECT_EQ(stream.size(), reader.bytes());
+  EXPECT_EQ(3u, reader.frames());
+  EXPECT_EQ(0u, reader.checksum_errors());
+  EXPECT_EQ(0u, reader.resynchronizations());
+
+  close(fd[0]);
+  close(fd[1]);
+}
+
+/**
+ * Garbage and corrupted frames are skipped, valid frames survive
+ */
+TEST(FrameReaderTest, resyncAndChecksum) {
+  XbeeRouting::FrameReader reader;
+  std::vector<unsigned char> stream = { 0x01, 0x02, 0x03 };
+  std::vector<unsigned char> corrupted = status_frame(4);
+  std::vector<unsigned char> valid = status_frame(5);
+  int fd[2];
+
+  corrupted[5] ^= 0xFF;
+
+  stream.insert(stream.end(), corrupted.begin(), corrupted.end());
+  stream.insert(stream.end(), valid.begin(), valid.end());
+
+  ASSERT_EQ(0, pipe(fd));
+
+  // frame split between two reads
+  ASSERT_EQ((ssize_t)stream.size() - 3, write(fd[1], stream.data(), stream.size() - 3));
+  reader.fill(fd[0]);
+  EXPECT_EQ(nullptr, reader.next());
+
+  ASSERT_EQ(3, write(fd[1], stream.data() + stream.size() - 3, 3));
+  reader.fill(fd[0]);
+
+  XbeeRouting::Frame* frame = reader.next();
+
+  ASSERT_NE(nullptr, frame);
+  EXPECT_EQ(5, frame->data.status.id);
+  delete frame;
+
+  EXPECT_EQ(nullptr, reader.next());
+  EXPECT_EQ(1u, reader.frames());
+  EXPECT_EQ(1u, reader.checksum_errors());
+  EXPECT_EQ(2u, reader.resynchronizations());
+
+  close(fd[0]);
+  close(fd[1]);
+}
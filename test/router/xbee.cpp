@@ -0,0 +1,308 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "common.h"
+#include "../../src/router/xbee.h"
+
+using namespace PUT::CS;
+
+//! Write serialized frame to the radio side of the serial port
+static void write_frame(int fd, XbeeRouting::Frame &frame) {
+  int length;
+  unsigned char* bytes = frame.serialize(length);
+
+  ASSERT_EQ(length, write(fd, bytes, length));
+  free(bytes);
+}
+
+//! Write command response with given id
+static void write_response(int fd, uint8_t id, const char* command, const char* value) {
+  XbeeRouting::Frame frame(XbeeRouting::Frame::Type::CommandResponse);
+
+  frame.data.command_response.id = id;
+  memcpy(frame.data.command_response.command, command, 2);
+  frame.data.command_response.status = 0;
+  frame.length = strlen(value);
+  frame.data.command_response.data = (unsigned char*)malloc(frame.length);
+  memcpy(frame.data.command_response.data, value, frame.length);
+
+  write_frame(fd, frame);
+}
+
+/**
+ * Responses go to their requests by frame ID, other frames are kept for receive()
+ */
+TEST(XbeeTest, pipelinedCommands) {
+  int radio = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_NE(-1, radio);
+  ASSERT_EQ(0, grantpt(radio));
+  ASSERT_EQ(0, unlockpt(radio));
+
+  XbeeRouting::Xbee xbee(ptsname(radio), false);
+
+  std::future<XbeeRouting::Frame*> ni = xbee.request("NI");
+  std::future<XbeeRouting::Frame*> sl = xbee.request("SL");
+
+  // NI and SL commands
+  XbeeRouting::FrameReader commands;
+  XbeeRouting::FrameView command;
+  uint8_t ni_id = 0, sl_id = 0;
+
+  for (int i = 0; i < 2; i++) {
+    while (!commands.next(command))
+      ASSERT_GT(commands.fill(radio), 0);
+
+    ASSERT_EQ(XbeeRouting::Frame::Type::Command, command.type);
+
+    if (memcmp(command.data.command.command, "NI", 2) == 0)
+      ni_id = command.data.command.id;
+    if (memcmp(command.data.command.command, "SL", 2) == 0)
+      sl_id = command.data.command.id;
+  }
+
+  ASSERT_NE(0, ni_id);
+  ASSERT_NE(0, sl_id);
+  ASSERT_NE(ni_id, sl_id);
+
+  XbeeRouting::Frame status(XbeeRouting::Frame::Type::Status);
+  status.data.status.id = 7;
+  status.data.status.network = 0xFFFE;
+  status.data.status.retries = 0;
+  status.data.status.status = 0;
+  status.data.status.discovery = 0;
+
+  // responses out of order, with unrelated frames in between
+  write_frame(radio, status);
+  write_response(radio, sl_id, "SL", "ABCD");
+  write_response(radio, (uint8_t)(ni_id + 100), "DB", "x");
+  write_response(radio, ni_id, "NI", "node");
+
+  XbeeRouting::Frame* response = xbee.wait(ni);
+  ASSERT_NE(nullptr, response);
+  ASSERT_EQ(4, response->length);
+  EXPECT_EQ(0, memcmp("node", response->data.command_response.data, 4));
+  delete response;
+
+  ASSERT_EQ(std::future_status::ready, sl.wait_for(std::chrono::seconds(0)));
+  response = sl.get();
+  EXPECT_EQ(0, memcmp("ABCD", response->data.command_response.data, 4));
+  delete response;
+
+  // frames received while waiting are not lost
+  XbeeRouting::FrameView frame;
+  ASSERT_TRUE(xbee.receive(frame));
+  EXPECT_EQ(XbeeRouting::Frame::Type::Status, frame.type);
+  EXPECT_EQ(7, frame.data.status.id);
+
+  ASSERT_TRUE(xbee.receive(frame));
+  EXPECT_EQ(XbeeRouting::Frame::Type::CommandResponse, frame.type);
+  EXPECT_EQ(0, memcmp("DB", frame.data.command_response.command, 2));
+
+  close(radio);
+}
+
+/**
+ * Request fails when every frame ID is pending, expired requests free their IDs
+ */
+TEST(XbeeTest, expiredRequests) {
+  int radio = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_NE(-1, radio);
+  ASSERT_EQ(0, grantpt(radio));
+  ASSERT_EQ(0, unlockpt(radio));
+
+  std::atomic_bool draining(true);
+  std::thread drain([radio, &draining]() {
+    unsigned char bytes[256];
+    struct pollfd readable = { radio, POLLIN, 0 };
+
+    while (draining)
+      if (poll(&readable, 1, 10) == 1 && read(radio, bytes, sizeof(bytes)) <= 0)
+        return;
+  });
+
+  {
+    XbeeRouting::Xbee xbee(ptsname(radio), false);
+    std::vector<std::future<XbeeRouting::Frame*>> pending;
+
+    // commands are written before the transmit queue fills
+    for (int i = 0; i < 255; i++) {
+      while (xbee.queue_depth() > 16)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+      pending.push_back(xbee.request("NI"));
+    }
+
+    auto sent = std::chrono::steady_clock::now();
+
+    for (auto &request : pending)
+      EXPECT_EQ(std::future_status::timeout, request.wait_for(std::chrono::seconds(0)));
+
+    // no frame ID is free
+    std::future<XbeeRouting::Frame*> failed = xbee.request("SL");
+    ASSERT_EQ(std::future_status::ready, failed.wait_for(std::chrono::seconds(0)));
+    EXPECT_EQ(nullptr, failed.get());
+
+    EXPECT_EQ(255u, xbee.expire(sent));
+    EXPECT_EQ(0u, xbee.expire(sent));
+
+    for (auto &request : pending) {
+      ASSERT_EQ(std::future_status::ready, request.wait_for(std::chrono::seconds(0)));
+      EXPECT_EQ(nullptr, request.get());
+    }
+
+    // requests sent later are kept
+    std::future<XbeeRouting::Frame*> fresh = xbee.request("SL");
+    EXPECT_EQ(std::future_status::timeout, fresh.wait_for(std::chrono::seconds(0)));
+    EXPECT_EQ(0u, xbee.expire(sent));
+  }
+
+  draining = false;
+  drain.join();
+  close(radio);
+}
+
+/**
+ * Constructor returns as soon as radio reports reset, stale frames are dropped
+ */
+TEST(XbeeTest, resetWaitsForModemStatus) {
+  int radio = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_NE(-1, radio);
+  ASSERT_EQ(0, grantpt(radio));
+  ASSERT_EQ(0, unlockpt(radio));
+
+  std::thread firmware([radio]() {
+    XbeeRouting::FrameReader commands;
+    XbeeRouting::FrameView command;
+
+    while (!commands.next(command))
+      ASSERT_GT(commands.fill(radio), 0);
+
+    ASSERT_EQ(XbeeRouting::Frame::Type::Command, command.type);
+    ASSERT_EQ(0, memcmp("FR", command.data.command.command, 2));
+
+    XbeeRouting::Frame modem(XbeeRouting::Frame::Type::ModemStatus);
+    modem.data.modem_status.status = 0;
+
+    write_response(radio, command.data.command.id, "FR", "");
+    write_frame(radio, modem);
+    write_response(radio, 1, "DB", "x");
+  });
+
+  XbeeRouting::Xbee xbee(ptsname(radio));
+  firmware.join();
+
+  EXPECT_LT(xbee.reset_time().count(), 1000);
+
+  // frame received after reset is not dropped
+  XbeeRouting::FrameView frame;
+  ASSERT_TRUE(xbee.receive(frame));
+  EXPECT_EQ(XbeeRouting::Frame::Type::CommandResponse, frame.type);
+  EXPECT_EQ(0, memcmp("DB", frame.data.command_response.command, 2));
+
+  close(radio);
+}
+
+/**
+ * Frame which would overrun transmit queue slot is dropped
+ */
+TEST(XbeeTest, oversizedFrame) {
+  int radio = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_NE(-1, radio);
+  ASSERT_EQ(0, grantpt(radio));
+  ASSERT_EQ(0, unlockpt(radio));
+
+  XbeeRouting::Xbee xbee(ptsname(radio), false);
+  XbeeRouting::Packet packet(XbeeRouting::Packet::Type::Data);
+
+  packet.source = 1;
+  packet.destination = 2;
+  packet.length = XbeeRouting::Packet::MAX_PAYLOAD;
+  memset(packet.data.content, 'x', packet.length);
+
+  for (int i = 0; i < 5; i++)
+    packet.visited.push_back(i + 3);
+
+  EXPECT_EQ(XbeeRouting::Xbee::Sent::Queued, xbee.send(packet, 1, 0x0013a20000000002, 0xFFFE));
+
+  // full payload behind long visited list
+  for (int i = 5; i < 40; i++)
+    packet.visited.push_back(i + 3);
+
+  EXPECT_EQ(XbeeRouting::Xbee::Sent::Oversized, xbee.send(packet, 2, 0x0013a20000000002, 0xFFFE));
+  EXPECT_EQ(1u, xbee.dropped());
+
+  // only the first frame is written
+  XbeeRouting::FrameReader written;
+  XbeeRouting::FrameView frame;
+
+  while (!written.next(frame))
+    ASSERT_GT(written.fill(radio), 0);
+
+  EXPECT_EQ(XbeeRouting::Frame::Type::Transmit, frame.type);
+  EXPECT_EQ(1, frame.data.transmit.id);
+
+  close(radio);
+}
+
+/**
+ * Frames queued while serial port is busy are written with single system
+ * call, frames over queue capacity are dropped
+ */
+TEST(XbeeTest, transmitQueue) {
+  char path[32];
+  int radio = slow_serial_port(path);
+  ASSERT_NE(-1, radio);
+
+  {
+    XbeeRouting::Xbee xbee(path, false);
+    XbeeRouting::Packet packet(XbeeRouting::Packet::Type::Data);
+    size_t queued = 0;
+
+    packet.source = 1;
+    packet.destination = 2;
+    packet.length = 200;
+    memset(packet.data.content, 'x', packet.length);
+
+    // serial port takes few frames, then writer waits and the queue fills
+    for (int i = 0; i < 100; i++)
+      queued += xbee.send(packet, 0, 0x0013a20000000002, 0xFFFE) == XbeeRouting::Xbee::Sent::Queued;
+
+    EXPECT_LT(queued, 100u);
+    EXPECT_EQ(100u - queued, xbee.dropped());
+    EXPECT_GT(xbee.queue_depth(), 0u);
+
+    // every queued frame is written once serial port is read
+    XbeeRouting::FrameReader written;
+    XbeeRouting::FrameView frame;
+    struct pollfd readable = { radio, POLLIN, 0 };
+
+    for (size_t frames = 0; frames < queued; frames++) {
+      while (!written.next(frame)) {
+        ASSERT_EQ(1, poll(&readable, 1, 1000));
+        ASSERT_GT(written.fill(radio), 0);
+      }
+
+      EXPECT_EQ(XbeeRouting::Frame::Type::Transmit, frame.type);
+    }
+
+    for (int i = 0; i < 100 && xbee.queue_depth() > 0; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(0u, xbee.queue_depth());
+    EXPECT_EQ(queued, xbee.sent());
+    EXPECT_GT(xbee.coalescing(), 1.0);
+    EXPECT_GT(xbee.max_latency().count(), 0);
+    EXPECT_LE(xbee.latency(), xbee.max_latency());
+  }
+
+  close(radio);
+  unlink(path);
+}